@@ -455,6 +455,12 @@ win32:!win32-g++ {
 	}
 }
 
+# ChaCha20-Poly1305 is only available since crypto++ 8.1
+exists(src/chachapoly.cpp) {
+	HEADERS += src/chachapoly.h
+	SOURCES += src/chachapoly.cpp
+}
+
 DISTFILES += cryptopp.pri
 
 load(qt_build_paths)
@@ -5,13 +5,46 @@
 #include "synchelper_p.h"
 #include "changeemitter_p.h"
 
+#include <QtCore/QRunnable>
+
 using namespace QtDataSync;
+using std::tie;
 
 #define QTDATASYNC_LOG QTDATASYNC_LOG_CONTROLLER
 
+namespace {
+
+class UploadRunnable : public QRunnable
+{
+public:
+	UploadRunnable(std::function<void()> fn);
+	void run() override;
+
+private:
+	std::function<void()> _fn;
+};
+
+}
+
+const int ChangeController::MaxDeltaChain = 8;
+const int ChangeController::DeltaCacheSize = 100;
+const int ChangeController::MaxDebounceFactor = 4;
+const int ChangeController::PriorityReserveDivisor = 4;
+const int ChangeController::SnapshotChunkSize = 1000;
+const int ChangeController::MaxSnapshotSize = 512 * 1024; //512 KB
+const int ChangeController::ResumableSize = 256 * 1024; //256 KB
+
 ChangeController::ChangeController(const Defaults &defaults, QObject *parent) :
-	Controller{"change", defaults, parent}
-{}
+	Controller{"change", defaults, parent},
+	_uploadPool{new QThreadPool{this}},
+	_deltaBases{DeltaCacheSize},
+	_debounceTimer{new QTimer{this}}
+{
+	_debounceTimer->setSingleShot(true);
+	_debounceTimer->setTimerType(Qt::CoarseTimer);
+	connect(_debounceTimer, &QTimer::timeout,
+			this, &ChangeController::debounceTimeout);
+}
 
 void ChangeController::initialize(const QVariantHash &params)
 {
@@ -20,8 +53,42 @@ void ChangeController::initialize(const QVariantHash &params)
 	_emitter = params.value(QStringLiteral("emitter")).value<ChangeEmitter*>();
 	Q_ASSERT_X(_emitter, Q_FUNC_INFO, "Missing parameter: emitter (ChangeEmitter)");
 
+	//optional: if not set, changes are passed on unencrypted
+	_crypto = params.value(QStringLiteral("crypto")).value<CryptoController*>();
+
 	connect(_emitter, &ChangeEmitter::uploadNeeded,
 			this, &ChangeController::changeTriggered);
+
+	_typePriorities = TypePriorities{defaults().property(Defaults::TypePriorities).toHash()};
+
+	const auto debounce = defaults().property(Defaults::UploadDebounce).toHash();
+	for(auto it = debounce.constBegin(); it != debounce.constEnd(); it++) {
+		auto msecs = it.value().toInt();
+		if(msecs > 0)
+			_uploadDebounce.insert(it.key().toUtf8(), msecs);
+	}
+	if(!_uploadDebounce.isEmpty()) {
+		_changeClock.start();
+		connect(_emitter, &ChangeEmitter::uploadQueued,
+				this, &ChangeController::changeQueued);
+	}
+
+	_compressionLevel = defaults().property(Defaults::CompressionLevel).toInt();
+	_binaryPayloads = defaults().property(Defaults::BinaryPayloads).toBool();
+	_deltaEnabled = defaults().property(Defaults::DeltaUploads).toBool();
+	if(_deltaEnabled) {
+		connect(_store, &LocalStore::dataResetted,
+				this, [this](){
+			_deltaBases.clear();
+		});
+	}
+}
+
+void ChangeController::finalize()
+{
+	_debounceTimer->stop();
+	_uploadPool->clear();
+	_uploadPool->waitForDone();
 }
 
 void ChangeController::setUploadingEnabled(bool uploading)
@@ -42,13 +109,68 @@ void ChangeController::clearUploads()
 	if(!_activeUploads.isEmpty())
 		logDebug() << "Finished uploading changes";
 	_activeUploads.clear();
+	_activeSnapshot = {};
+	_snapshotIndex++; //discards the snapshot beeing prepared, if any
+	//drop everything still beeing prepared - results of running workers are discarded by index
+	_uploadPool->clear();
+	_preparedUploads.clear();
+	_sendIndex = _prepareIndex;
 	_changeEstimate = 0;
+	_uploadCursors.clear();
+	_debounceTimer->stop(); //restarted by the next scan, if still needed
 }
 
 void ChangeController::updateUploadLimit(quint32 limit)
 {
 	logDebug() << "Updated update limit to:" << limit;
-	_uploadLimit = static_cast<int>(limit);
+	//new limit means new connection -> start measuring again
+	_uploadWindow.reset(limit);
+}
+
+void ChangeController::updateDeltaSupport(bool supported)
+{
+	_deltaSupported = supported;
+	if(_deltaEnabled && !supported)
+		logDebug() << "Remote does not support delta uploads - uploading complete changes only";
+}
+
+void ChangeController::updateSnapshotSupport(const QUuid &deviceId, bool supported)
+{
+	if(supported)
+		_snapshotDevices.insert(deviceId);
+	else {
+		_snapshotDevices.remove(deviceId);
+		logDebug() << "Device" << deviceId << "does not support snapshots - uploading its changes one by one";
+	}
+}
+
+void ChangeController::updateDeltaBase(const ObjectKey &key, quint64 version, const QJsonObject &data)
+{
+	if(!_deltaEnabled)
+		return;
+	auto oldBase = _deltaBases.object(key);
+	_deltaBases.insert(key, new DeltaBase {
+						   version,
+						   data,
+						   SyncHelper::jsonHash(data),
+						   oldBase ? oldBase->chain : 0
+					   });
+}
+
+void ChangeController::dropDeltaBase(const ObjectKey &key)
+{
+	_deltaBases.remove(key);
+}
+
+void ChangeController::requestCompleteUploads(const QList<QByteArray> &keys)
+{
+	//other devices could not apply a delta - the next upload of those keys must contain the complete data
+	for(const auto &key : _deltaBases.keys()) {
+		if(keys.contains(key.hashed()))
+			_deltaBases.remove(key);
+	}
+	logDebug() << "Complete upload of" << keys.size() << "changes requested";
+	_store->markKeysChanged(keys);
 }
 
 void ChangeController::uploadDone(const QByteArray &key)
@@ -60,6 +182,9 @@ void ChangeController::uploadDone(const QByteArray &key)
 
 	try {
 		auto info = _activeUploads.take(key);
+		_resumableUploads.remove(key);
+		completeUpload(info);
+		storeDeltaBase(info);
 		_store->markUnchanged(info.key, info.version, info.isDelete);
 		_changeEstimate--;
 		emit progressIncrement();
@@ -67,7 +192,7 @@ void ChangeController::uploadDone(const QByteArray &key)
 				   << info.key << "as unchanged ( Active uploads:"
 				   << _activeUploads.size() << ")";
 
-		if(_uploadingEnabled && _activeUploads.size() < _uploadLimit) //queued, so we may have the luck to complete a few more before uploading again
+		if(_uploadingEnabled && _activeUploads.size() < uploadWindow()) //queued, so we may have the luck to complete a few more before uploading again
 			QMetaObject::invokeMethod(this, "uploadNext", Qt::QueuedConnection,
 									  Q_ARG(bool, false));
 	} catch(Exception &e) {
@@ -78,6 +203,13 @@ void ChangeController::uploadDone(const QByteArray &key)
 
 void ChangeController::deviceUploadDone(const QByteArray &key, QUuid deviceId)
 {
+	if(!_activeSnapshot.deviceId.isNull() &&
+	   _activeSnapshot.deviceId == deviceId &&
+	   _activeSnapshot.snapshotId == key) {
+		completeSnapshot();
+		return;
+	}
+
 	if(!_activeUploads.contains({key, deviceId})) {
 		logWarning() << "Unknown device key completed:" << key.toHex() << deviceId;
 		return;
@@ -85,6 +217,7 @@ void ChangeController::deviceUploadDone(const QByteArray &key, QUuid deviceId)
 
 	try {
 		auto info = _activeUploads.take({key, deviceId});
+		completeUpload(info);
 		_store->removeDeviceChange(info.key, deviceId);
 		_changeEstimate--;
 		emit progressIncrement();
@@ -92,7 +225,7 @@ void ChangeController::deviceUploadDone(const QByteArray &key, QUuid deviceId)
 				   << info.key << "for device" << deviceId << "as unchanged ( Active uploads:"
 				   << _activeUploads.size() << ")";
 
-		if(_uploadingEnabled && _activeUploads.size() < _uploadLimit) //queued, so we may have the luck to complete a few more before uploading again
+		if(_uploadingEnabled && _activeUploads.size() < uploadWindow()) //queued, so we may have the luck to complete a few more before uploading again
 			QMetaObject::invokeMethod(this, "uploadNext", Qt::QueuedConnection,
 									  Q_ARG(bool, false));
 	} catch(Exception &e) {
@@ -104,19 +237,39 @@ void ChangeController::deviceUploadDone(const QByteArray &key, QUuid deviceId)
 void ChangeController::changeTriggered()
 {
 	if(_uploadingEnabled)
-		uploadNext(_activeUploads.isEmpty());
+		uploadNext(!isUploading());
+}
+
+void ChangeController::changeQueued(const ObjectKey &key)
+{
+	if(debounceTime(key.typeName) <= 0)
+		return;
+
+	const auto now = _changeClock.elapsed();
+	auto it = _debouncedChanges.find(key);
+	if(it == _debouncedChanges.end())
+		_debouncedChanges.insert(key, std::make_tuple(now, now));
+	else
+		std::get<1>(*it) = now; //keep the first change, so constant changes still get uploaded eventually
+}
+
+void ChangeController::debounceTimeout()
+{
+	//debounced changes have been passed by the cursors, so scan again from the start
+	_uploadCursors.clear();
+	changeTriggered();
 }
 
 void ChangeController::uploadNext(bool emitStarted)
 {
 	//uploads already exists: emit started no matter whether any are actually started from this call
-	if(emitStarted && !_activeUploads.isEmpty()) {
+	if(emitStarted && isUploading()) {
 		emitStarted = false;
 		logDebug() << "Beginning uploading changes";
 		emit uploadingChanged(true);
 	}
 
-	if(_activeUploads.size() >= _uploadLimit)
+	if(_activeUploads.size() >= uploadWindow())
 		return;
 
 	try {
@@ -132,21 +285,20 @@ void ChangeController::uploadNext(bool emitStarted)
 			}
 		}
 
-		_store->loadChanges(_uploadLimit, [this, emitProgress, &emitStarted](const ObjectKey &objKey, quint64 version, const QString &file, QUuid deviceId) {
-			CachedObjectKey key(objKey, deviceId);
+		auto fillLimit = uploadWindow();
+		auto fillCount = 0; //the uploads that count against the fill limit
+		const std::function<bool(ObjectKey, quint64, QString, QUuid, QByteArray)> visitor = [this, emitProgress, &emitStarted, &fillLimit, &fillCount](const ObjectKey &objKey, quint64 version, const QString &file, QUuid deviceId, const QByteArray &keyHash) {
+			CachedObjectKey key(objKey, deviceId, keyHash); //hash is stored, so no need to calculate it for every change
 
-			//skip stuff already beeing uploaded (could still have changed, but to prevent errors)
-//			auto skip = false;
+			//device changes are bundled into snapshots instead, if possible
+			if(!deviceId.isNull() && _snapshotDevices.contains(deviceId))
+				return true;
+			//skip stuff already beeing uploaded (changed again while uploading - requeued by the store on completion)
 			if(_activeUploads.contains(key))
 				return true;
-//			for(const auto &mKey : _activeUploads.keys()) {
-//				if(key == mKey) {
-//					skip = true;
-//					break;
-//				}
-//			}
-//			if(skip)
-//				return true;
+			//skip stuff that was changed too recently - only the latest version is uploaded once it is stable
+			if(deviceId.isNull() && !checkDebounce(key))
+				return true;
 
 			//signale that uploading has started
 			if(emitStarted) {
@@ -157,51 +309,434 @@ void ChangeController::uploadNext(bool emitStarted)
 					emit progressAdded(_changeEstimate);
 			}
 
-			auto keyHash = key.hashed();
 			auto isDelete = file.isNull();
-			_activeUploads.insert(key, {key, version, isDelete});
+			_activeUploads.insert(key, {key, version, isDelete, -1, false, {}});
 			beginOp(); //start the default timeout
-			if(isDelete) {//deleted
-				if(deviceId.isNull()) {
-					emit uploadChange(keyHash, SyncHelper::combine(key, version));
-					logDebug() << "Started upload of deleted" << key
-							   << "( Active uploads:" << _activeUploads.size() << ")";
-				} else {
-					emit uploadDeviceChange(keyHash, deviceId, SyncHelper::combine(key, version));
-					logDebug() << "Started device upload of deleted"
-							   << key << "for device" << deviceId
-							   << "( Active uploads:" << _activeUploads.size() << ")";
-				}
-			} else { //changed
+			prepareUpload(key, version, file);
+
+			fillCount++;
+			return fillCount < fillLimit && _activeUploads.size() < uploadWindow(); //only continue as long as there is free space
+		};
+
+		//fill the window from the highest priority class first
+		//first pass: leave a reserve for each lower class, so they cannot starve - second pass: fill the rest in order
+		//uploads of lower classes do not count against the limit of a class in the first pass, as they only use their reserve
+		const auto classes = _typePriorities.classes();
+		const auto reserve = qMax(1, uploadWindow() / PriorityReserveDivisor);
+		for(auto pass = 0; pass < (classes.size() > 1 ? 2 : 1); pass++) {
+			for(auto i = 0; i < classes.size(); i++) {
+				const auto priority = classes[i];
+				fillLimit = uploadWindow();
+				if(pass == 0) {
+					fillLimit -= reserve * (classes.size() - 1 - i);
+					fillCount = activeUploads(priority);
+				} else
+					fillCount = _activeUploads.size();
+				if(fillCount >= fillLimit || _activeUploads.size() >= uploadWindow())
+					continue;
+
+				//continue after the last started change, so changes beeing uploaded are not scanned again
+				QByteArrayList types;
+				bool excludeTypes;
+				tie(types, excludeTypes) = _typePriorities.typeFilter(priority);
+				_uploadCursors[priority] = _store->loadUploads(uploadWindow(),
+															   visitor,
+															   _uploadCursors.value(priority),
+															   types,
+															   excludeTypes);
+			}
+		}
+
+		//upload the changes for new devices as snapshots, one at a time
+		if(!_snapshotDevices.isEmpty() && _activeSnapshot.deviceId.isNull() && prepareSnapshot()) {
+			if(emitStarted) {
+				emitStarted = false;
+				logDebug() << "Beginning uploading changes";
+				emit uploadingChanged(true);
+				if(emitProgress)
+					emit progressAdded(_changeEstimate);
+			}
+		}
+
+		if(!isUploading()) {
+			_uploadCursors.clear(); //nothing in flight, so the next scan can start at the beginning
+			endOp(); //stop any timeouts
+			if(_debounceTimer->isActive())
+				logDebug() << "Waiting for" << _debouncedChanges.size() << "debounced changes";
+			else {
+				logDebug() << "Finished uploading changes with" << _uploadWindow;
+				emit uploadingChanged(false);
+			}
+		}
+	} catch(Exception &e) {
+		logCritical() << "Error when trying to upload change:" << e.what();
+		emit controllerError(tr("Failed to upload changes to server."));
+	}
+}
+
+int ChangeController::uploadWindow() const
+{
+	return static_cast<int>(_uploadWindow.size());
+}
+
+int ChangeController::activeUploads(int minPriority) const
+{
+	if(_typePriorities.isEmpty())
+		return _activeUploads.size();
+
+	auto count = 0;
+	for(auto it = _activeUploads.constBegin(); it != _activeUploads.constEnd(); it++) {
+		if(_typePriorities.priority(it.key().typeName) >= minPriority)
+			count++;
+	}
+	return count;
+}
+
+bool ChangeController::isUploading() const
+{
+	return !_activeUploads.isEmpty() || !_activeSnapshot.deviceId.isNull();
+}
+
+int ChangeController::debounceTime(const QByteArray &typeName) const
+{
+	if(_uploadDebounce.isEmpty())
+		return 0;
+	return _uploadDebounce.value(typeName, _uploadDebounce.value(QByteArray{}, 0));
+}
+
+bool ChangeController::checkDebounce(const ObjectKey &key)
+{
+	if(_debouncedChanges.isEmpty())
+		return true;
+
+	auto it = _debouncedChanges.find(key);
+	if(it == _debouncedChanges.end())
+		return true;
+
+	const auto debounce = debounceTime(key.typeName);
+	qint64 firstChange, lastChange;
+	tie(firstChange, lastChange) = *it;
+	const auto remaining = qMin(lastChange + debounce,
+								firstChange + debounce * MaxDebounceFactor) - _changeClock.elapsed();
+	if(remaining <= 0) {
+		_debouncedChanges.erase(it);
+		return true;
+	}
+
+	if(!_debounceTimer->isActive() || remaining < _debounceTimer->remainingTime())
+		_debounceTimer->start(static_cast<int>(remaining));
+	return false;
+}
+
+void ChangeController::completeUpload(const UploadInfo &info)
+{
+	if(info.sentAt < 0) //not sent yet, i.e. failed to read
+		return;
+	auto oldSize = _uploadWindow.size();
+	_uploadWindow.acked(info.sentAt);
+	if(_uploadWindow.size() != oldSize)
+		logDebug() << "Upload window changed to" << _uploadWindow;
+}
+
+void ChangeController::storeDeltaBase(const UploadInfo &info)
+{
+	if(!_deltaEnabled)
+		return;
+
+	if(info.isDelete || info.sentAt < 0 || info.data.isEmpty())
+		_deltaBases.remove(info.key);
+	else {
+		// after a complete upload the chain starts over, deltas extend it
+		auto chain = 0;
+		if(info.isDelta) {
+			auto oldBase = _deltaBases.object(info.key);
+			chain = oldBase ? oldBase->chain + 1 : MaxDeltaChain;
+		}
+		_deltaBases.insert(info.key, new DeltaBase {
+							   info.version,
+							   info.data,
+							   SyncHelper::jsonHash(info.data),
+							   chain
+						   });
+	}
+}
+
+void ChangeController::prepareUpload(const CachedObjectKey &key, quint64 version, const QString &file)
+{
+	auto index = _prepareIndex++;
+
+	//reuse the encrypted data of an interrupted upload of the same version, so the server can resume it
+	auto rIt = key.optionalDevice.isNull() ? _resumableUploads.find(key.hashed()) : _resumableUploads.end();
+	if(rIt != _resumableUploads.end()) {
+		if(rIt->version == version &&
+		   rIt->upload.keyIndex == _crypto->keyIndex()) {
+			auto upload = rIt->upload;
+			QMetaObject::invokeMethod(this, [this, index, upload]() {
+				uploadPrepared(index, upload);
+			}, Qt::QueuedConnection);
+			logDebug() << "Resuming upload of" << key;
+			return;
+		} else
+			_resumableUploads.erase(rIt);
+	}
+
+	CryptoController::PreparedEncryption encryption;
+	if(_crypto)
+		encryption = _crypto->prepareEncryption();
+
+	//read, serialize and encrypt on the pool, the results are sent in order via uploadPrepared
+	//deltas are only possible against the version the server acknowledged last
+	auto trackBase = _deltaEnabled && _deltaSupported && _crypto && key.optionalDevice.isNull();
+	auto hasBase = false;
+	DeltaBase base {0, {}, {}, 0};
+	if(trackBase && !file.isNull()) {
+		auto cachedBase = _deltaBases.object(key);
+		if(cachedBase && cachedBase->chain < MaxDeltaChain) {
+			base = *cachedBase;
+			hasBase = true;
+		}
+	}
+
+	auto store = _store;
+	auto crypto = _crypto;
+	auto compressionLevel = _compressionLevel;
+	auto binaryPayloads = _binaryPayloads;
+	_uploadPool->start(new UploadRunnable{[this, store, crypto, compressionLevel, binaryPayloads, index, key, version, file, encryption, trackBase, hasBase, base]() {
+		PreparedUpload upload;
+		upload.keyHash = key.hashed();
+		upload.deviceId = key.optionalDevice;
+		try {
+			QByteArray changeData;
+			if(file.isNull())
+				changeData = SyncHelper::combine(key, version);
+			else {
 				try {
-					auto json = _store->readJson(key, file);
-					if(deviceId.isNull()) {
-						emit uploadChange(keyHash, SyncHelper::combine(key, version, json));
-						logDebug() << "Started upload of changed" << key
-								   << "( Active uploads:" << _activeUploads.size() << ")";
-					} else {
-						emit uploadDeviceChange(keyHash, deviceId, SyncHelper::combine(key, version, json));
-						logDebug() << "Started device upload of changed"
-								   << key << "for device" << deviceId
-								   << "( Active uploads:" << _activeUploads.size() << ")";
+					auto json = store->readJson(key, file);
+					changeData = SyncHelper::combine(key, version, json, compressionLevel, binaryPayloads);
+					if(trackBase)
+						upload.json = json;
+					if(hasBase) {
+						auto patchOk = false;
+						QJsonObject patch;
+						tie(patchOk, patch) = SyncHelper::createPatch(base.data, json);
+						if(patchOk) {
+							auto deltaData = SyncHelper::combineDelta(key, version,
+																	  base.version, base.checksum,
+																	  SyncHelper::jsonHash(json),
+																	  patch,
+																	  compressionLevel,
+																	  binaryPayloads);
+							//only worth it if actually smaller than the complete data
+							if(deltaData.size() < changeData.size()) {
+								changeData = deltaData;
+								upload.isDelta = true;
+							}
+						}
 					}
-				} catch (Exception &e) {
-					logWarning() << "Failed to read json for upload. Assuming unchanged. Error:" << e.what();
-					QMetaObject::invokeMethod(this, "uploadDone", Qt::QueuedConnection,
-											  Q_ARG(QByteArray, keyHash));
+				} catch(Exception &e) {
+					upload.readFailed = true;
+					upload.error = e.qWhat();
 				}
 			}
 
-			return _activeUploads.size() < _uploadLimit; //only continue as long as there is free space
-		});
+			if(!upload.readFailed) {
+				if(crypto)
+					tie(upload.keyIndex, upload.salt, upload.data) = crypto->encryptPrepared(encryption, changeData);
+				else
+					upload.data = changeData;
+			}
+		} catch(Exception &e) {
+			upload.error = e.qWhat();
+		}
 
-		if(_activeUploads.isEmpty()) {
-			endOp(); //stop any timeouts
-			logDebug() << "Finished uploading changes";
-			emit uploadingChanged(false);
+		QMetaObject::invokeMethod(this, [this, index, upload]() {
+			uploadPrepared(index, upload);
+		}, Qt::QueuedConnection);
+	}});
+}
+
+void ChangeController::uploadPrepared(quint64 index, const PreparedUpload &upload)
+{
+	if(index < _sendIndex) //cleared while beeing prepared
+		return;
+
+	//keep the order of the scan: only send once all previous uploads have been sent
+	_preparedUploads.insert(index, upload);
+	while(!_preparedUploads.isEmpty() && _preparedUploads.firstKey() == _sendIndex) {
+		sendPrepared(_preparedUploads.take(_sendIndex));
+		_sendIndex++;
+	}
+}
+
+void ChangeController::sendPrepared(const PreparedUpload &upload)
+{
+	CachedObjectKey key{upload.keyHash, upload.deviceId};
+	if(!_activeUploads.contains(key))
+		return;
+	auto &info = _activeUploads[key];
+
+	if(upload.readFailed) {
+		logWarning() << "Failed to read json for upload. Assuming unchanged. Error:" << upload.error;
+		if(upload.deviceId.isNull())
+			uploadDone(upload.keyHash);
+		else
+			deviceUploadDone(upload.keyHash, upload.deviceId);
+		return;
+	} else if(!upload.error.isNull()) {
+		logCritical() << "Error when trying to upload change:" << upload.error;
+		//never sent, so it must not keep its spot in the window
+		_activeUploads.remove(key);
+		emit controllerError(tr("Failed to upload changes to server."));
+		if(_uploadingEnabled && _activeUploads.size() < uploadWindow())
+			QMetaObject::invokeMethod(this, "uploadNext", Qt::QueuedConnection,
+									  Q_ARG(bool, false));
+		return;
+	}
+
+	info.sentAt = _uploadWindow.timestamp();
+	info.isDelta = upload.isDelta;
+	info.data = upload.json;
+	//large uploads are sent in chunks - keep them until acknowledged, so they can be resumed after a reconnect
+	if(_crypto &&
+	   upload.deviceId.isNull() &&
+	   !upload.isDelta &&
+	   upload.data.size() > ResumableSize)
+		_resumableUploads.insert(upload.keyHash, {info.version, upload});
+	if(upload.deviceId.isNull()) {
+		if(upload.isDelta)
+			emit uploadEncryptedDeltaChange(upload.keyHash, upload.keyIndex, upload.salt, upload.data);
+		else if(_crypto)
+			emit uploadEncryptedChange(upload.keyHash, upload.keyIndex, upload.salt, upload.data);
+		else
+			emit uploadChange(upload.keyHash, upload.data);
+		logDebug() << "Started upload of" << (info.isDelete ? "deleted" : (info.isDelta ? "delta of" : "changed")) << info.key
+				   << "( Active uploads:" << _activeUploads.size() << ")";
+	} else {
+		if(_crypto)
+			emit uploadEncryptedDeviceChange(upload.keyHash, upload.deviceId, upload.keyIndex, upload.salt, upload.data);
+		else
+			emit uploadDeviceChange(upload.keyHash, upload.deviceId, upload.data);
+		logDebug() << "Started device upload of" << (info.isDelete ? "deleted" : "changed")
+				   << info.key << "for device" << upload.deviceId
+				   << "( Active uploads:" << _activeUploads.size() << ")";
+	}
+}
+
+bool ChangeController::prepareSnapshot()
+{
+	QList<std::tuple<ObjectKey, quint64, QString>> entries;
+	QUuid deviceId;
+	for(const auto &snapshotDevice : qAsConst(_snapshotDevices)) {
+		deviceId = _store->loadDeviceUploads(SnapshotChunkSize, [&entries](const ObjectKey &key, quint64 version, const QString &file) {
+			entries.append(std::make_tuple(key, version, file));
+			return true;
+		}, snapshotDevice);
+		if(!deviceId.isNull())
+			break;
+	}
+	if(deviceId.isNull())
+		return false;
+
+	_activeSnapshot = {deviceId, QUuid::createUuid().toRfc4122(), {}};
+	beginOp(); //start the default timeout
+	auto index = ++_snapshotIndex;
+	CryptoController::PreparedEncryption encryption;
+	if(_crypto)
+		encryption = _crypto->prepareEncryption();
+
+	//read, serialize and encrypt all entries on the pool, but only up to the maximum size
+	auto store = _store;
+	auto crypto = _crypto;
+	auto compressionLevel = _compressionLevel;
+	auto binaryPayloads = _binaryPayloads;
+	auto snapshotId = _activeSnapshot.snapshotId;
+	_uploadPool->start(new UploadRunnable{[this, store, crypto, compressionLevel, binaryPayloads, index, deviceId, snapshotId, entries, encryption]() {
+		PreparedUpload upload;
+		upload.keyHash = snapshotId;
+		upload.deviceId = deviceId;
+		try {
+			QByteArrayList changes;
+			auto size = 0;
+			for(const auto &entry : entries) {
+				if(size >= MaxSnapshotSize) //the rest is part of the next snapshot
+					break;
+
+				const auto &key = std::get<0>(entry);
+				const auto version = std::get<1>(entry);
+				const auto &file = std::get<2>(entry);
+				upload.snapshotKeys.append(key);
+				if(file.isNull())
+					changes.append(SyncHelper::combine(key, version));
+				else {
+					try {
+						auto json = store->readJson(key, file);
+						changes.append(SyncHelper::combine(key, version, json, compressionLevel, binaryPayloads));
+					} catch(Exception &) {
+						//assume unchanged, just like for single uploads
+						continue;
+					}
+				}
+				size += changes.last().size();
+			}
+
+			auto changeData = SyncHelper::combineSnapshot(changes);
+			if(crypto)
+				tie(upload.keyIndex, upload.salt, upload.data) = crypto->encryptPrepared(encryption, changeData);
+			else
+				upload.data = changeData;
+		} catch(QException &e) {
+			upload.error = QString::fromUtf8(e.what());
+		}
+
+		QMetaObject::invokeMethod(this, [this, index, upload]() {
+			snapshotPrepared(index, upload);
+		}, Qt::QueuedConnection);
+	}});
+
+	logDebug() << "Preparing snapshot of up to" << entries.size()
+			   << "datasets for device" << deviceId;
+	return true;
+}
+
+void ChangeController::snapshotPrepared(quint64 index, const PreparedUpload &upload)
+{
+	if(index != _snapshotIndex || _activeSnapshot.deviceId != upload.deviceId) //cleared while beeing prepared
+		return;
+
+	if(!upload.error.isNull()) {
+		logCritical() << "Error when trying to upload snapshot:" << upload.error;
+		emit controllerError(tr("Failed to upload changes to server."));
+		return;
+	}
+
+	_activeSnapshot.keys = upload.snapshotKeys;
+	if(_crypto)
+		emit uploadEncryptedDeviceChange(upload.keyHash, upload.deviceId, upload.keyIndex, upload.salt, upload.data);
+	else
+		emit uploadDeviceChange(upload.keyHash, upload.deviceId, upload.data);
+	logDebug() << "Started snapshot upload of" << _activeSnapshot.keys.size()
+			   << "datasets for device" << upload.deviceId
+			   << "(" << upload.data.size() << "bytes )";
+}
+
+void ChangeController::completeSnapshot()
+{
+	try {
+		auto snapshot = _activeSnapshot;
+		_activeSnapshot = {};
+		_store->removeDeviceChanges(snapshot.keys, snapshot.deviceId);
+		for(auto i = 0; i < snapshot.keys.size(); i++) {
+			_changeEstimate--;
+			emit progressIncrement();
 		}
+		logDebug() << "Completed snapshot upload. Marked" << snapshot.keys.size()
+				   << "datasets for device" << snapshot.deviceId << "as unchanged";
+
+		if(_uploadingEnabled) //queued, for the same reasons as normal uploads
+			QMetaObject::invokeMethod(this, "uploadNext", Qt::QueuedConnection,
+									  Q_ARG(bool, false));
 	} catch(Exception &e) {
-		logCritical() << "Error when trying to upload change:" << e.what();
+		logCritical() << "Failed to complete snapshot upload with error:" << e.what();
 		emit controllerError(tr("Failed to upload changes to server."));
 	}
 }
@@ -231,6 +766,12 @@ ChangeController::CachedObjectKey::CachedObjectKey(QByteArray hash, QUuid device
 	_hash{std::move(hash)}
 {}
 
+ChangeController::CachedObjectKey::CachedObjectKey(ObjectKey other, QUuid deviceId, QByteArray hash) :
+	ObjectKey{std::move(other)},
+	optionalDevice{deviceId},
+	_hash{std::move(hash)}
+{}
+
 QByteArray ChangeController::CachedObjectKey::hashed() const
 {
 	if(_hash.isEmpty())
@@ -258,3 +799,14 @@ uint QtDataSync::qHash(const ChangeController::CachedObjectKey &key, uint seed)
 {
 	return qHash(key.hashed(), seed) ^ qHash(key.optionalDevice, seed);
 }
+
+
+
+UploadRunnable::UploadRunnable(std::function<void()> fn) :
+	_fn{std::move(fn)}
+{}
+
+void UploadRunnable::run()
+{
+	_fn();
+}
@@ -1,14 +1,26 @@
 #ifndef QTDATASYNC_CHANGECONTROLLER_P_H
 #define QTDATASYNC_CHANGECONTROLLER_P_H
 
+#include <tuple>
+
 #include <QtCore/QObject>
 #include <QtCore/QMutex>
 #include <QtCore/QUuid>
+#include <QtCore/QMap>
+#include <QtCore/QSet>
+#include <QtCore/QThreadPool>
+#include <QtCore/QCache>
+#include <QtCore/QJsonObject>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
 
 #include "qtdatasync_global.h"
 #include "objectkey.h"
 #include "controller_p.h"
 #include "localstore_p.h"
+#include "cryptocontroller_p.h"
+#include "adaptivewindow_p.h"
+#include "typepriorities_p.h"
 
 namespace QtDataSync {
 
@@ -34,6 +46,7 @@ public:
 		CachedObjectKey();
 		CachedObjectKey(ObjectKey other, QUuid deviceId = {});
 		CachedObjectKey(QByteArray hash, QUuid deviceId = {});
+		CachedObjectKey(ObjectKey other, QUuid deviceId, QByteArray hash);
 
 		QByteArray hashed() const;
 
@@ -49,11 +62,17 @@ public:
 	explicit ChangeController(const Defaults &defaults, QObject *parent = nullptr);
 
 	void initialize(const QVariantHash &params) final;
+	void finalize() final;
 
 public Q_SLOTS:
 	void setUploadingEnabled(bool uploading);
 	void clearUploads();
 	void updateUploadLimit(quint32 limit);
+	void updateDeltaSupport(bool supported);
+	void updateSnapshotSupport(const QUuid &deviceId, bool supported);
+	void updateDeltaBase(const QtDataSync::ObjectKey &key, quint64 version, const QJsonObject &data);
+	void dropDeltaBase(const QtDataSync::ObjectKey &key);
+	void requestCompleteUploads(const QList<QByteArray> &keys);
 
 	void uploadDone(const QByteArray &key);
 	void deviceUploadDone(const QByteArray &key, QUuid deviceId);
@@ -62,9 +81,14 @@ Q_SIGNALS:
 	void uploadingChanged(bool uploading);
 	void uploadChange(const QByteArray &key, const QByteArray &changeData);
 	void uploadDeviceChange(const QByteArray &key, const QUuid &deviceId, const QByteArray &changeData);
+	void uploadEncryptedChange(const QByteArray &key, quint32 keyIndex, const QByteArray &salt, const QByteArray &data);
+	void uploadEncryptedDeltaChange(const QByteArray &key, quint32 keyIndex, const QByteArray &salt, const QByteArray &data);
+	void uploadEncryptedDeviceChange(const QByteArray &key, const QUuid &deviceId, quint32 keyIndex, const QByteArray &salt, const QByteArray &data);
 
 private Q_SLOTS:
 	void changeTriggered();
+	void changeQueued(const QtDataSync::ObjectKey &key);
+	void debounceTimeout();
 	void uploadNext(bool emitStarted = false);
 
 private:
@@ -73,14 +97,94 @@ private:
 		ObjectKey key;
 		quint64 version;
 		bool isDelete;
+		qint64 sentAt;
+		bool isDelta;
+		QJsonObject data; //only set if delta uploads are enabled
+	};
+
+	//unexported private member
+	struct DeltaBase {
+		quint64 version;
+		QJsonObject data;
+		QByteArray checksum;
+		int chain; //number of deltas uploaded since the last complete upload
+	};
+
+	//unexported private member
+	struct PreparedUpload {
+		QByteArray keyHash;
+		QUuid deviceId;
+		bool readFailed = false;
+		QString error;
+		quint32 keyIndex = 0;
+		QByteArray salt;
+		QByteArray data;
+		bool isDelta = false;
+		QJsonObject json;
+		QList<ObjectKey> snapshotKeys; //only set for snapshots
 	};
 
+	//unexported private member
+	struct ResumableUpload {
+		quint64 version;
+		PreparedUpload upload;
+	};
+
+	//unexported private member
+	struct SnapshotUpload {
+		QUuid deviceId;
+		QByteArray snapshotId; //used as the data id of the device change
+		QList<ObjectKey> keys;
+	};
+
+	static const int MaxDeltaChain;
+	static const int DeltaCacheSize;
+	static const int MaxDebounceFactor; //debounced changes are uploaded after at most this many debounce times
+	static const int PriorityReserveDivisor; //each lower priority class may use at least window / divisor
+	static const int SnapshotChunkSize; //maximum number of datasets per snapshot
+	static const int MaxSnapshotSize; //maximum size of the bundled changes, before encryption
+	static const int ResumableSize; //minimum encrypted size of uploads that are kept for resuming, matches the chunk size of the connector
+
 	LocalStore *_store = nullptr;
 	ChangeEmitter *_emitter = nullptr;
+	CryptoController *_crypto = nullptr;
+	QThreadPool *_uploadPool;
 	bool _uploadingEnabled = false;
-	int _uploadLimit = 10;
+	AdaptiveWindow _uploadWindow; //bounded by the server upload limit
 	QHash<CachedObjectKey, UploadInfo> _activeUploads;
+	quint64 _prepareIndex = 0;
+	quint64 _sendIndex = 0;
+	QMap<quint64, PreparedUpload> _preparedUploads;
+	QHash<QByteArray, ResumableUpload> _resumableUploads; //by key hash, only while not acknowledged
 	quint32 _changeEstimate = 0;
+	TypePriorities _typePriorities;
+	QHash<int, quint64> _uploadCursors; //per priority class: position in the upload queue of the last change that was started
+	int _compressionLevel = 0;
+	bool _binaryPayloads = false;
+	bool _deltaEnabled = false;
+	bool _deltaSupported = false;
+	QSet<QUuid> _snapshotDevices; //new devices that can receive their changes as snapshots
+	SnapshotUpload _activeSnapshot; //only one at a time, null device if none is in progress
+	quint64 _snapshotIndex = 0;
+	QCache<ObjectKey, DeltaBase> _deltaBases;
+	QHash<QByteArray, int> _uploadDebounce;
+	QElapsedTimer _changeClock;
+	QHash<ObjectKey, std::tuple<qint64, qint64>> _debouncedChanges; // (first change, last change) - only for types with debounce
+	QTimer *_debounceTimer;
+
+	int uploadWindow() const;
+	int activeUploads(int minPriority) const; //only counts the uploads of the given or higher priority classes
+	bool isUploading() const;
+	int debounceTime(const QByteArray &typeName) const;
+	bool checkDebounce(const ObjectKey &key);
+	void completeUpload(const UploadInfo &info);
+	void storeDeltaBase(const UploadInfo &info);
+	void prepareUpload(const CachedObjectKey &key, quint64 version, const QString &file);
+	void uploadPrepared(quint64 index, const PreparedUpload &upload);
+	void sendPrepared(const PreparedUpload &upload);
+	bool prepareSnapshot();
+	void snapshotPrepared(quint64 index, const PreparedUpload &upload);
+	void completeSnapshot();
 };
 
 //not exported, just like the class
@@ -8,8 +8,10 @@ ChangeEmitter::ChangeEmitter(const Defaults &defaults, QObject *parent) :
 
 void ChangeEmitter::triggerChange(QObject *origin, const ObjectKey &key, bool deleted, bool changed)
 {
-	if(changed)
+	if(changed) {
+		emit uploadQueued(key);
 		emit uploadNeeded();
+	}
 	emit dataChanged(origin, key, deleted);
 	emit remoteDataChanged(key, deleted);
 }
@@ -50,8 +52,10 @@ void ChangeEmitter::triggerRemoteChange(const ObjectKey &key, bool deleted, bool
 			_cache->cache.remove(key);
 		}
 	}
-	if(changed)
+	if(changed) {
+		emit uploadQueued(key);
 		emit uploadNeeded();
+	}
 	emit dataChanged(nullptr, key, deleted);
 	emit remoteDataChanged(key, deleted);
 }
@@ -31,6 +31,7 @@ public Q_SLOTS:
 
 Q_SIGNALS:
 	void uploadNeeded();
+	void uploadQueued(const QtDataSync::ObjectKey &key); //only for single changes
 
 	void dataChanged(QObject *origin, const QtDataSync::ObjectKey &key, bool deleted);
 	void dataResetted(QObject *origin);
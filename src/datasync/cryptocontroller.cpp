@@ -6,6 +6,7 @@
 #include <QtCore/QCryptographicHash>
 #include <QtCore/QDataStream>
 #include <QtCore/QJsonDocument>
+#include <QtCore/QRunnable>
 #ifndef QTDATASYNC_USE_CRYPTOPP_OSRNG
 #include <QtCore/QRandomGenerator>
 #endif
@@ -17,6 +18,12 @@
 #include <cryptopp/twofish.h>
 #include <cryptopp/serpent.h>
 #include <cryptopp/pwdbased.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha3.h>
+#include <cryptopp/cpu.h>
+#if CRYPTOPP_VERSION >= 810
+#include <cryptopp/chachapoly.h>
+#endif
 
 #include <qiodevicesink.h>
 #include <qiodevicesource.h>
@@ -45,6 +52,16 @@ public:
 	KeyStore *createInstance(const QString &key, const Defaults &defaults, QObject *parent = nullptr);
 };
 
+class KeyGenerationRunnable : public QRunnable
+{
+public:
+	KeyGenerationRunnable(std::function<void()> fn);
+	void run() override;
+
+private:
+	std::function<void()> _fn;
+};
+
 }
 
 Q_GLOBAL_STATIC(ExtendedFactory, factory)
@@ -69,6 +86,21 @@ public:
 template <typename T>
 using GCM1 = GCM<T>;
 
+#if CRYPTOPP_VERSION >= 810
+template <class TScheme, class TInfo>
+class ChaChaCipherScheme : public CryptoController::CipherScheme
+{
+public:
+	QByteArray name() const override;
+	quint32 defaultKeyLength() const override;
+	quint32 ivLength() const override;
+	quint32 toKeyLength(quint32 length) const override;
+	QSharedPointer<AuthenticatedSymmetricCipher> encryptor() const override;
+	QSharedPointer<AuthenticatedSymmetricCipher> decryptor() const override;
+	QSharedPointer<MessageAuthenticationCode> cmac() const override;
+};
+#endif
+
 // ------------- KeyScheme class definitions -------------
 
 template <typename TScheme>
@@ -116,8 +148,11 @@ const QString CryptoController::keySignKeyTemplate(QStringLiteral("%1/signing"))
 const QString CryptoController::keyCryptKeyTemplate(QStringLiteral("%1/encryption"));
 const QString CryptoController::keyKeyFileTemplate(QStringLiteral("key_%1.enc"));
 
+QThreadStorage<QHash<CryptoController::ContextKey, QWeakPointer<CryptoController::CipherContext>>> CryptoController::_contextPool;
+
 CryptoController::CryptoController(const Defaults &defaults, QObject *parent) :
-	Controller{"crypto", defaults, parent}
+	Controller{"crypto", defaults, parent},
+	_keyPool{new QThreadPool{this}}
 {}
 
 QStringList CryptoController::allKeystoreKeys()
@@ -135,6 +170,24 @@ QStringList CryptoController::availableKeystoreKeys()
 	return keys;
 }
 
+Setup::CipherScheme CryptoController::autoCipherScheme()
+{
+	//AES-GCM is the fastest if the CPU can do both, AES and the carry-less multiplication, in hardware
+#if CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X32 || CRYPTOPP_BOOL_X64
+	if(HasAESNI() && HasCLMUL())
+		return Setup::AES_GCM;
+#elif CRYPTOPP_BOOL_ARM32 || CRYPTOPP_BOOL_ARMV8 || CRYPTOPP_BOOL_ARM64
+	if(HasAES() && HasPMULL())
+		return Setup::AES_GCM;
+#endif
+	//without that, ChaCha20 is several times faster. The extended nonce makes random salts safe
+#if CRYPTOPP_VERSION >= 810
+	return Setup::XCHACHA20_POLY1305;
+#else
+	return Setup::AES_EAX;
+#endif
+}
+
 bool CryptoController::keystoreAvailable(const QString &provider)
 {
 	return factory->isAvailable(provider);
@@ -149,10 +202,16 @@ void CryptoController::initialize(const QVariantHash &params)
 {
 	Q_UNUSED(params)
 	_asymCrypto = new ClientCrypto(this);
+	_keyPool->setMaxThreadCount(1);
 }
 
 void CryptoController::finalize()
 {
+	//the key generation calls back into the controller, so it must be done before it is destroyed
+	_keyPool->clear();
+	_keyPool->waitForDone();
+	_generatingKeys = false;
+	_pregeneratedKeys.reset();
 	clearKeyMaterial();
 }
 
@@ -251,6 +310,7 @@ void CryptoController::clearKeyMaterial()
 	_fingerprint.clear();
 	_asymCrypto->reset();
 	_loadedChiphers.clear();
+	clearContexts();
 	_localCipher = 0;
 	closeStore();
 	logDebug() << "Cleared all key material";
@@ -285,18 +345,65 @@ void CryptoController::deleteKeyMaterial(QUuid deviceId)
 	clearKeyMaterial();
 }
 
+void CryptoController::pregenerateKeys()
+{
+	if(_generatingKeys || _pregeneratedKeys)
+		return;
+
+	_pregeneratedParams = keyParams();
+	_generatingKeys = true;
+	emit keyGenerationChanged(true);
+	logDebug() << "Started generating private keys in the background";
+
+	auto params = _pregeneratedParams;
+	auto thread = this->thread();
+	_keyPool->start(new KeyGenerationRunnable{[this, params, thread]() {
+		QSharedPointer<ClientCrypto> crypto;
+		QString error;
+		try {
+			crypto.reset(new ClientCrypto{});
+			crypto->generate(static_cast<Setup::SignatureScheme>(params[0].toInt()),
+							 params[1],
+							 static_cast<Setup::EncryptionScheme>(params[2].toInt()),
+							 params[3]);
+			crypto->moveToThread(thread);
+		} catch(CppException &e) {
+			crypto.reset();
+			error = QString::fromUtf8(e.what());
+		}
+
+		QMetaObject::invokeMethod(this, [this, crypto, error]() {
+			keysPregenerated(crypto, error);
+		}, Qt::QueuedConnection);
+	}});
+}
+
+bool CryptoController::isGeneratingKeys() const
+{
+	return _generatingKeys;
+}
+
 void CryptoController::createPrivateKeys(const QByteArray &nonce)
 {
 	try {
-		if(_asymCrypto->rng().CanIncorporateEntropy())
-			_asymCrypto->rng().IncorporateEntropy(reinterpret_cast<const byte*>(nonce.constData()),
-												  static_cast<size_t>(nonce.size()));
-
-		//generate private signature and encryption keys
-		_asymCrypto->generate(static_cast<Setup::SignatureScheme>(defaults().property(Defaults::SignScheme).toInt()),
-							  defaults().property(Defaults::SignKeyParam),
-							  static_cast<Setup::EncryptionScheme>(defaults().property(Defaults::CryptScheme).toInt()),
-							  defaults().property(Defaults::CryptKeyParam));
+		if(_pregeneratedKeys && _pregeneratedParams == keyParams()) {
+			_asymCrypto->take(*_pregeneratedKeys);
+			logDebug() << "Using private keys generated in the background";
+		} else {
+			if(_generatingKeys)
+				logWarning() << "Background key generation has not finished yet - generating keys synchronously";
+
+			if(_asymCrypto->rng().CanIncorporateEntropy())
+				_asymCrypto->rng().IncorporateEntropy(reinterpret_cast<const byte*>(nonce.constData()),
+													  static_cast<size_t>(nonce.size()));
+
+			//generate private signature and encryption keys
+			_asymCrypto->generate(static_cast<Setup::SignatureScheme>(defaults().property(Defaults::SignScheme).toInt()),
+								  defaults().property(Defaults::SignKeyParam),
+								  static_cast<Setup::EncryptionScheme>(defaults().property(Defaults::CryptScheme).toInt()),
+								  defaults().property(Defaults::CryptKeyParam));
+		}
+		_pregeneratedKeys.reset(); //never use the same keys twice
 		_fingerprint = _asymCrypto->ownFingerprint();
 		emit fingerprintChanged(_fingerprint);
 
@@ -362,12 +469,12 @@ QByteArray CryptoController::serializeSignedMessage(const Message &message)
 tuple<quint32, QByteArray, QByteArray> CryptoController::encryptData(const QByteArray &plain)
 {
 	try {
-		auto info = getInfo(_localCipher);
+		const auto &info = getInfo(_localCipher);
 		QByteArray salt(static_cast<int>(info.scheme->ivLength()), Qt::Uninitialized);
 		_asymCrypto->rng().GenerateBlock(reinterpret_cast<byte*>(salt.data()),
 										 static_cast<size_t>(salt.size()));
 
-		auto cipher = encryptImpl(info, salt, plain);
+		auto cipher = encryptImpl(*context(_localCipher, info.scheme, info.key), salt, plain);
 
 		return make_tuple(_localCipher, salt, cipher);
 	} catch(CppException &e) {
@@ -380,8 +487,68 @@ tuple<quint32, QByteArray, QByteArray> CryptoController::encryptData(const QByte
 QByteArray CryptoController::decryptData(quint32 keyIndex, const QByteArray &salt, const QByteArray &cipher) const
 {
 	try {
-		auto info = getInfo(keyIndex);
-		return decryptImpl(info, salt, cipher);
+		const auto &info = getInfo(keyIndex);
+		return decryptImpl(*context(keyIndex, info.scheme, info.key), salt, cipher);
+	} catch(CppException &e) {
+		throw CryptoException(defaults(),
+							  QStringLiteral("Failed to decrypt downloaded data"),
+							  e);
+	}
+}
+
+CryptoController::PreparedEncryption CryptoController::prepareEncryption()
+{
+	try {
+		const auto &info = getInfo(_localCipher);
+		PreparedEncryption prepared;
+		prepared.keyIndex = _localCipher;
+		prepared.scheme = info.scheme;
+		prepared.key = info.key;
+		//the rng is not threadsafe, so the salt must be generated here
+		prepared.salt.resize(static_cast<int>(info.scheme->ivLength()));
+		_asymCrypto->rng().GenerateBlock(reinterpret_cast<byte*>(prepared.salt.data()),
+										 static_cast<size_t>(prepared.salt.size()));
+		return prepared;
+	} catch(CppException &e) {
+		throw CryptoException(defaults(),
+							  QStringLiteral("Failed to prepare data encryption for upload"),
+							  e);
+	}
+}
+
+tuple<quint32, QByteArray, QByteArray> CryptoController::encryptPrepared(const PreparedEncryption &prepared, const QByteArray &data) const
+{
+	try {
+		auto cipher = encryptImpl(*context(prepared.keyIndex, prepared.scheme, prepared.key), prepared.salt, data);
+		return make_tuple(prepared.keyIndex, prepared.salt, cipher);
+	} catch(CppException &e) {
+		throw CryptoException(defaults(),
+							  QStringLiteral("Failed to encrypt data for upload"),
+							  e);
+	}
+}
+
+CryptoController::PreparedEncryption CryptoController::prepareDecryption(quint32 keyIndex) const
+{
+	try {
+		//loads the key, if not done yet - must happen on the controllers thread
+		const auto &info = getInfo(keyIndex);
+		PreparedEncryption prepared;
+		prepared.keyIndex = keyIndex;
+		prepared.scheme = info.scheme;
+		prepared.key = info.key;
+		return prepared;
+	} catch(CppException &e) {
+		throw CryptoException(defaults(),
+							  QStringLiteral("Failed to prepare decryption of downloaded data"),
+							  e);
+	}
+}
+
+QByteArray CryptoController::decryptPrepared(const PreparedEncryption &prepared, const QByteArray &salt, const QByteArray &cipher) const
+{
+	try {
+		return decryptImpl(*context(prepared.keyIndex, prepared.scheme, prepared.key), salt, cipher);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to decrypt downloaded data"),
@@ -397,8 +564,8 @@ QByteArray CryptoController::createCmac(const QByteArray &data) const
 QByteArray CryptoController::createCmac(quint32 keyIndex, const QByteArray &data) const
 {
 	try {
-		auto info = getInfo(keyIndex);
-		return createCmacImpl(info, data);
+		const auto &info = getInfo(keyIndex);
+		return createCmacImpl(*context(keyIndex, info.scheme, info.key), data);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to create CMAC"),
@@ -409,8 +576,8 @@ QByteArray CryptoController::createCmac(quint32 keyIndex, const QByteArray &data
 void CryptoController::verifyCmac(quint32 keyIndex, const QByteArray &data, const QByteArray &mac) const
 {
 	try {
-		auto info = getInfo(keyIndex);
-		verifyCmacImpl(info, data, mac);
+		const auto &info = getInfo(keyIndex);
+		verifyCmacImpl(*context(keyIndex, info.scheme, info.key), data, mac);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to verify CMAC"),
@@ -492,8 +659,8 @@ QByteArray CryptoController::generateEncryptionKeyCmac(quint32 keyIndex) const
 	try {
 		QByteArray message = _asymCrypto->encryptionScheme() +
 							 _asymCrypto->writeCryptKey();
-		auto info = getInfo(keyIndex);
-		return createCmacImpl(info, message);
+		const auto &info = getInfo(keyIndex);
+		return createCmacImpl(*context(keyIndex, info.scheme, info.key), message);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to create CMAC for private encryption key"),
@@ -506,8 +673,8 @@ void CryptoController::verifyEncryptionKeyCmac(AsymmetricCrypto *crypto, const X
 	try {
 		QByteArray message = crypto->encryptionScheme() +
 							 crypto->writeKey(pubKey);
-		auto info = getInfo(_localCipher);
-		verifyCmacImpl(info, message, cmac);
+		const auto &info = getInfo(_localCipher);
+		verifyCmacImpl(*context(_localCipher, info.scheme, info.key), message, cmac);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to verify CMAC for private encryption key"),
@@ -635,10 +802,10 @@ SecByteBlock CryptoController::recoverExportKey(const QByteArray &scheme, const
 QByteArray CryptoController::createExportCmac(const QByteArray &scheme, const SecByteBlock &key, const QByteArray &data) const
 {
 	try {
-		CipherInfo info;
-		createScheme(scheme, info.scheme);
-		info.key = key;
-		return createCmacImpl(info, data);
+		CipherContext context;
+		createScheme(scheme, context.scheme);
+		context.key = key;
+		return createCmacImpl(context, data);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to generate cmac for export data"),
@@ -653,10 +820,10 @@ QByteArray CryptoController::createExportCmacForCrypto(const QByteArray &scheme,
 								  _asymCrypto->writeSignKey() +
 								  _asymCrypto->encryptionScheme() +
 								  _asymCrypto->writeCryptKey();
-		CipherInfo info;
-		createScheme(scheme, info.scheme);
-		info.key = key;
-		return createCmacImpl(info, trustMessage);
+		CipherContext context;
+		createScheme(scheme, context.scheme);
+		context.key = key;
+		return createCmacImpl(context, trustMessage);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to generate cmac for crypto keys"),
@@ -667,10 +834,10 @@ QByteArray CryptoController::createExportCmacForCrypto(const QByteArray &scheme,
 void CryptoController::verifyImportCmac(const QByteArray &scheme, const SecByteBlock &key, const QByteArray &data, const QByteArray &mac) const
 {
 	try {
-		CipherInfo info;
-		createScheme(scheme, info.scheme);
-		info.key = key;
-		verifyCmacImpl(info, data, mac);
+		CipherContext context;
+		createScheme(scheme, context.scheme);
+		context.key = key;
+		verifyCmacImpl(context, data, mac);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to verify cmac for import data"),
@@ -685,10 +852,10 @@ void CryptoController::verifyImportCmacForCrypto(const QByteArray &scheme, const
 								  cryptoInfo->writeKey(cryptoInfo->signatureKey()) +
 								  cryptoInfo->encryptionScheme() +
 								  cryptoInfo->writeKey(cryptoInfo->encryptionKey());
-		CipherInfo info;
-		createScheme(scheme, info.scheme);
-		info.key = key;
-		verifyCmacImpl(info, trustMessage, mac);
+		CipherContext context;
+		createScheme(scheme, context.scheme);
+		context.key = key;
+		verifyCmacImpl(context, trustMessage, mac);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to verify cmac for crypto keys"),
@@ -699,10 +866,10 @@ void CryptoController::verifyImportCmacForCrypto(const QByteArray &scheme, const
 QByteArray CryptoController::exportEncrypt(const QByteArray &scheme, const QByteArray &salt, const SecByteBlock &key, const QByteArray &data) const
 {
 	try {
-		CipherInfo info;
-		createScheme(scheme, info.scheme);
-		info.key = key;
-		return encryptImpl(info, salt, data);
+		CipherContext context;
+		createScheme(scheme, context.scheme);
+		context.key = key;
+		return encryptImpl(context, salt, data);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to encrypt export data"),
@@ -713,10 +880,10 @@ QByteArray CryptoController::exportEncrypt(const QByteArray &scheme, const QByte
 QByteArray CryptoController::importDecrypt(const QByteArray &scheme, const QByteArray &salt, const SecByteBlock &key, const QByteArray &data) const
 {
 	try {
-		CipherInfo info;
-		createScheme(scheme, info.scheme);
-		info.key = key;
-		return decryptImpl(info, salt, data);
+		CipherContext context;
+		createScheme(scheme, context.scheme);
+		context.key = key;
+		return decryptImpl(context, salt, data);
 	} catch(CppException &e) {
 		throw CryptoException(defaults(),
 							  QStringLiteral("Failed to decrypt import data"),
@@ -741,6 +908,12 @@ void CryptoController::createScheme(const QByteArray &name, QSharedPointer<Ciphe
 		ptr.reset(new StandardCipherScheme<GCM1, Serpent>());
 	else if(stdStr == EAX<IDEA>::Encryption::StaticAlgorithmName())
 		ptr.reset(new StandardCipherScheme<EAX, IDEA>());
+#if CRYPTOPP_VERSION >= 810
+	else if(stdStr == ChaCha20Poly1305::Encryption::StaticAlgorithmName())
+		ptr.reset(new ChaChaCipherScheme<ChaCha20Poly1305, ChaCha20Poly1305_Info>());
+	else if(stdStr == XChaCha20Poly1305::Encryption::StaticAlgorithmName())
+		ptr.reset(new ChaChaCipherScheme<XChaCha20Poly1305, XChaCha20Poly1305_Info>());
+#endif
 	else
 		throw CryptoPP::Exception(CryptoPP::Exception::NOT_IMPLEMENTED, "Symmetric Cipher Scheme \"" + stdStr + "\" not supported");
 }
@@ -769,6 +942,21 @@ void CryptoController::createScheme(Setup::CipherScheme scheme, QSharedPointer<C
 	case Setup::IDEA_EAX:
 		createScheme(QByteArray::fromStdString(EAX<IDEA>::Encryption::StaticAlgorithmName()), ptr);
 		break;
+#if CRYPTOPP_VERSION >= 810
+	case Setup::CHACHA20_POLY1305:
+		createScheme(QByteArray::fromStdString(ChaCha20Poly1305::Encryption::StaticAlgorithmName()), ptr);
+		break;
+	case Setup::XCHACHA20_POLY1305:
+		createScheme(QByteArray::fromStdString(XChaCha20Poly1305::Encryption::StaticAlgorithmName()), ptr);
+		break;
+#else
+	case Setup::CHACHA20_POLY1305:
+	case Setup::XCHACHA20_POLY1305:
+		throw CryptoPP::Exception(CryptoPP::Exception::NOT_IMPLEMENTED, "ChaCha20/Poly1305 cipher schemes require at least crypto++ 8.1");
+#endif
+	case Setup::AUTO_CIPHER:
+		createScheme(autoCipherScheme(), ptr);
+		break;
 	default:
 		Q_UNREACHABLE();
 		break;
@@ -807,11 +995,38 @@ QDir CryptoController::keysDir() const
 	return keyDir;
 }
 
+QVariantList CryptoController::keyParams() const
+{
+	return {
+		defaults().property(Defaults::SignScheme),
+		defaults().property(Defaults::SignKeyParam),
+		defaults().property(Defaults::CryptScheme),
+		defaults().property(Defaults::CryptKeyParam)
+	};
+}
+
+void CryptoController::keysPregenerated(const QSharedPointer<ClientCrypto> &crypto, const QString &error)
+{
+	if(!_generatingKeys) //discarded by finalize
+		return;
+	_generatingKeys = false;
+	if(crypto) {
+		_pregeneratedKeys = crypto;
+		logDebug() << "Finished generating private keys in the background";
+	} else {
+		logWarning() << "Failed to generate private keys in the background with error:" << error
+					 << "- keys are generated synchronously once needed";
+	}
+	emit keyGenerationChanged(false);
+}
+
 CryptoController::CipherInfo CryptoController::createInfo() const
 {
 	CipherInfo info;
-	createScheme(static_cast<Setup::CipherScheme>(defaults().property(Defaults::SymScheme).toInt()),
-				 info.scheme);
+	auto scheme = static_cast<Setup::CipherScheme>(defaults().property(Defaults::SymScheme).toInt());
+	createScheme(scheme, info.scheme);
+	if(scheme == Setup::AUTO_CIPHER)
+		logDebug() << "Automatically selected cipher scheme" << info.scheme->name();
 	auto keySize = defaults().property(Defaults::SymKeyParam).toUInt();
 	if(keySize == 0)
 		keySize = info.scheme->defaultKeyLength();
@@ -886,64 +1101,118 @@ void CryptoController::cleanCiphers() const
 			if(!keyDir.remove(keyKeyFileTemplate.arg(keyIndex)))
 				logWarning() << "Failed to delete file of cleared key with index" << keyIndex;
 			_loadedChiphers.remove(keyIndex);
+			clearContexts(keyIndex);
 		}
 	}
 }
 
-QByteArray CryptoController::createCmacImpl(const CryptoController::CipherInfo &info, const QByteArray &data) const
+QSharedPointer<CryptoController::CipherContext> CryptoController::context(quint32 keyIndex, const QSharedPointer<CipherScheme> &scheme, const SecByteBlock &key) const
+{
+	auto &ref = _contextPool.localData()[ContextKey{this, keyIndex}];
+	auto context = ref.toStrongRef();
+	if(!context || context->scheme != scheme || context->key != key) {
+		//first use on this thread, the contexts were cleared or the key of the index was replaced - create new keyed objects
+		auto oldContext = context;
+		context = QSharedPointer<CipherContext>::create();
+		context->scheme = scheme;
+		context->key = key;
+		ref = context;
+
+		QMutexLocker _(&_contextMutex);
+		if(oldContext)
+			_contexts.remove(keyIndex, oldContext); //release the replaced key right away
+		_contexts.insert(keyIndex, context);
+	}
+	return context;
+}
+
+void CryptoController::clearContexts() const
 {
-	auto cmac = info.scheme->cmac();
-	cmac->SetKey(info.key.data(), info.key.size());
+	//drops the owning references - contexts currently in use by other threads are released once they are done
+	QMutexLocker _(&_contextMutex);
+	_contexts.clear();
+}
 
-	QByteArray mac;
-	QByteArraySource (data, true,
-		new HashFilter(*cmac,
-			new QByteArraySink(mac)
-		) // HashFilter
-	); // QByteArraySource
+void CryptoController::clearContexts(quint32 keyIndex) const
+{
+	QMutexLocker _(&_contextMutex);
+	_contexts.remove(keyIndex);
+}
 
+QByteArray CryptoController::createCmacImpl(CryptoController::CipherContext &context, const QByteArray &data) const
+{
+	if(!context.cmac) {
+		auto cmac = context.scheme->cmac();
+		cmac->SetKey(context.key.data(), context.key.size());
+		context.cmac = cmac;
+	}
+
+	QByteArray mac(static_cast<int>(context.cmac->DigestSize()), Qt::Uninitialized);
+	context.cmac->CalculateDigest(reinterpret_cast<byte*>(mac.data()),
+								  reinterpret_cast<const byte*>(data.constData()),
+								  static_cast<size_t>(data.size()));
 	return mac;
 }
 
-void CryptoController::verifyCmacImpl(const CryptoController::CipherInfo &info, const QByteArray &data, const QByteArray &mac) const
+void CryptoController::verifyCmacImpl(CryptoController::CipherContext &context, const QByteArray &data, const QByteArray &mac) const
 {
-	auto cmac = info.scheme->cmac();
-	cmac->SetKey(info.key.data(), info.key.size());
+	if(!context.cmac) {
+		auto cmac = context.scheme->cmac();
+		cmac->SetKey(context.key.data(), context.key.size());
+		context.cmac = cmac;
+	}
 
-	QByteArraySource (data + mac, true,
-		new HashVerificationFilter(*cmac, nullptr, HashVerificationFilter::THROW_EXCEPTION | HashVerificationFilter::HASH_AT_END) // HashFilter
-	); // QByteArraySource
+	if(static_cast<size_t>(mac.size()) != context.cmac->DigestSize() ||
+	   !context.cmac->VerifyDigest(reinterpret_cast<const byte*>(mac.constData()),
+								   reinterpret_cast<const byte*>(data.constData()),
+								   static_cast<size_t>(data.size())))
+		throw HashVerificationFilter::HashVerificationFailed();
 }
 
-QByteArray CryptoController::encryptImpl(const CryptoController::CipherInfo &info, const QByteArray &salt, const QByteArray &plain) const
+QByteArray CryptoController::encryptImpl(CryptoController::CipherContext &context, const QByteArray &salt, const QByteArray &plain) const
 {
-	auto enc = info.scheme->encryptor();
-	enc->SetKeyWithIV(info.key.data(), info.key.size(),
-					  reinterpret_cast<const byte*>(salt.constData()),
-					  static_cast<size_t>(salt.size()));
+	auto iv = reinterpret_cast<const byte*>(salt.constData());
+	auto ivLength = static_cast<size_t>(salt.size());
+	if(!context.encryptor) {
+		auto enc = context.scheme->encryptor();
+		enc->SetKeyWithIV(context.key.data(), context.key.size(), iv, ivLength);
+		context.encryptor = enc;
+	}
 
-	QByteArray cipher;
-	QByteArraySource(plain, true,
-		new AuthenticatedEncryptionFilter(*enc,
-			new QByteArraySink(cipher)
-		) // AuthenticatedEncryptionFilter
-	); // QByteArraySource
+	//same layout as created by the AuthenticatedEncryptionFilter: (cipher, mac)
+	auto macSize = static_cast<int>(context.encryptor->DigestSize());
+	QByteArray cipher(plain.size() + macSize, Qt::Uninitialized);
+	auto out = reinterpret_cast<byte*>(cipher.data());
+	context.encryptor->EncryptAndAuthenticate(out,
+											  out + plain.size(), static_cast<size_t>(macSize),
+											  iv, static_cast<int>(ivLength),
+											  nullptr, 0,
+											  reinterpret_cast<const byte*>(plain.constData()),
+											  static_cast<size_t>(plain.size()));
 	return cipher;
 }
 
-QByteArray CryptoController::decryptImpl(const CryptoController::CipherInfo &info, const QByteArray &salt, const QByteArray &cipher) const
+QByteArray CryptoController::decryptImpl(CryptoController::CipherContext &context, const QByteArray &salt, const QByteArray &cipher) const
 {
-	auto dec = info.scheme->decryptor();
-	dec->SetKeyWithIV(info.key.data(), info.key.size(),
-					  reinterpret_cast<const byte*>(salt.constData()),
-					  static_cast<size_t>(salt.size()));
+	auto iv = reinterpret_cast<const byte*>(salt.constData());
+	auto ivLength = static_cast<size_t>(salt.size());
+	if(!context.decryptor) {
+		auto dec = context.scheme->decryptor();
+		dec->SetKeyWithIV(context.key.data(), context.key.size(), iv, ivLength);
+		context.decryptor = dec;
+	}
 
-	QByteArray plain;
-	QByteArraySource(cipher, true,
-		new AuthenticatedDecryptionFilter(*dec,
-			new QByteArraySink(plain)
-		) // AuthenticatedDecryptionFilter
-	); // QByteArraySource
+	auto macSize = static_cast<int>(context.decryptor->DigestSize());
+	if(cipher.size() < macSize)
+		throw HashVerificationFilter::HashVerificationFailed();
+	QByteArray plain(cipher.size() - macSize, Qt::Uninitialized);
+	auto in = reinterpret_cast<const byte*>(cipher.constData());
+	if(!context.decryptor->DecryptAndVerify(reinterpret_cast<byte*>(plain.data()),
+											in + plain.size(), static_cast<size_t>(macSize),
+											iv, static_cast<int>(ivLength),
+											nullptr, 0,
+											in, static_cast<size_t>(plain.size())))
+		throw HashVerificationFilter::HashVerificationFailed();
 	return plain;
 }
 
@@ -1025,6 +1294,16 @@ void ClientCrypto::reset()
 	_cryptKey.reset();
 }
 
+void ClientCrypto::take(ClientCrypto &other)
+{
+	reset();
+	_signKey.swap(other._signKey);
+	_cryptKey.swap(other._cryptKey);
+	setSignatureScheme(_signKey->name());
+	setEncryptionScheme(_cryptKey->name());
+	other.reset();
+}
+
 RandomNumberGenerator &ClientCrypto::rng()
 {
 	return _rng;
@@ -1256,6 +1535,53 @@ QSharedPointer<MessageAuthenticationCode> StandardCipherScheme<TScheme, TCipher>
 	return QSharedPointer<CMAC<TCipher>>::create();
 }
 
+#if CRYPTOPP_VERSION >= 810
+
+template <class TScheme, class TInfo>
+QByteArray ChaChaCipherScheme<TScheme, TInfo>::name() const
+{
+	return QByteArray::fromStdString(TScheme::Encryption::StaticAlgorithmName());
+}
+
+template <class TScheme, class TInfo>
+quint32 ChaChaCipherScheme<TScheme, TInfo>::defaultKeyLength() const
+{
+	return TInfo::DEFAULT_KEYLENGTH;
+}
+
+template <class TScheme, class TInfo>
+quint32 ChaChaCipherScheme<TScheme, TInfo>::ivLength() const
+{
+	return TInfo::IV_LENGTH;
+}
+
+template <class TScheme, class TInfo>
+quint32 ChaChaCipherScheme<TScheme, TInfo>::toKeyLength(quint32 length) const
+{
+	return static_cast<quint32>(TInfo::StaticGetValidKeyLength(length));
+}
+
+template <class TScheme, class TInfo>
+QSharedPointer<AuthenticatedSymmetricCipher> ChaChaCipherScheme<TScheme, TInfo>::encryptor() const
+{
+	return QSharedPointer<typename TScheme::Encryption>::create();
+}
+
+template <class TScheme, class TInfo>
+QSharedPointer<AuthenticatedSymmetricCipher> ChaChaCipherScheme<TScheme, TInfo>::decryptor() const
+{
+	return QSharedPointer<typename TScheme::Decryption>::create();
+}
+
+template <class TScheme, class TInfo>
+QSharedPointer<MessageAuthenticationCode> ChaChaCipherScheme<TScheme, TInfo>::cmac() const
+{
+	//there is no block cipher for a CMAC, and Poly1305 keys must not be reused
+	return QSharedPointer<HMAC<SHA3_256>>::create();
+}
+
+#endif
+
 // ------------- Generic KeyScheme Implementation -------------
 
 template <typename TScheme>
@@ -1410,4 +1736,13 @@ KeyStore *ExtendedFactory::createInstance(const QString &key, const Defaults &de
 		return nullptr;
 }
 
+KeyGenerationRunnable::KeyGenerationRunnable(std::function<void()> fn) :
+	_fn{std::move(fn)}
+{}
+
+void KeyGenerationRunnable::run()
+{
+	_fn();
+}
+
 }
@@ -6,6 +6,9 @@
 #include <QtCore/QObject>
 #include <QtCore/QUuid>
 #include <QtCore/QPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QThreadPool>
 
 #include <cryptopp/randpool.h>
 #include <cryptopp/osrng.h>
@@ -56,12 +59,21 @@ public:
 		virtual QSharedPointer<CryptoPP::MessageAuthenticationCode> cmac() const = 0;
 	};
 
+	//not exported, holds everything needed to encrypt or decrypt data outside of the controllers thread
+	struct PreparedEncryption {
+		quint32 keyIndex = 0;
+		QByteArray salt;
+		QSharedPointer<CipherScheme> scheme;
+		CryptoPP::SecByteBlock key;
+	};
+
 	explicit CryptoController(const Defaults &defaults, QObject *parent = nullptr);
 
 	static QStringList allKeystoreKeys();
 	static QStringList availableKeystoreKeys();
 	static bool keystoreAvailable(const QString &provider);
 	static KeyStore *loadKeystore(const QString &provider, QObject *parent, const QString &setupName);
+	static Setup::CipherScheme autoCipherScheme(); //the scheme used for Setup::AUTO_CIPHER on this machine
 
 	void initialize(const QVariantHash &params) final;
 	void finalize() final;
@@ -80,6 +92,8 @@ public:
 	void deleteKeyMaterial(QUuid deviceId);
 
 	//create and store new keys
+	void pregenerateKeys(); //generates private keys in the background, to be used by createPrivateKeys
+	bool isGeneratingKeys() const;
 	void createPrivateKeys(const QByteArray &nonce);
 	void storePrivateKeys(QUuid deviceId) const;
 
@@ -89,6 +103,10 @@ public:
 	//used for transport encryption of actual data
 	std::tuple<quint32, QByteArray, QByteArray> encryptData(const QByteArray &data); //(keyIndex, salt, data)
 	QByteArray decryptData(quint32 keyIndex, const QByteArray &salt, const QByteArray &cipher) const;
+	PreparedEncryption prepareEncryption();
+	std::tuple<quint32, QByteArray, QByteArray> encryptPrepared(const PreparedEncryption &prepared, const QByteArray &data) const; //(keyIndex, salt, data) - reentrant
+	PreparedEncryption prepareDecryption(quint32 keyIndex) const; //salt is not used
+	QByteArray decryptPrepared(const PreparedEncryption &prepared, const QByteArray &salt, const QByteArray &cipher) const; //reentrant
 
 	// cmac generation for verification of key updates etc.
 	QByteArray createCmac(const QByteArray &data) const;
@@ -134,6 +152,7 @@ public:
 
 Q_SIGNALS:
 	void fingerprintChanged(const QByteArray &fingerprint);
+	void keyGenerationChanged(bool generating);
 
 private:
 	//dont export private classes
@@ -142,6 +161,17 @@ private:
 		CryptoPP::SecByteBlock key;
 	};
 
+	//keyed cipher objects, reused for all operations of one thread with the same key
+	//owned by the controller, the threads only keep weak references, so clearing them releases the keys on all threads
+	struct CipherContext {
+		QSharedPointer<CipherScheme> scheme;
+		CryptoPP::SecByteBlock key; //to detect replaced keys
+		QSharedPointer<CryptoPP::AuthenticatedSymmetricCipher> encryptor;
+		QSharedPointer<CryptoPP::AuthenticatedSymmetricCipher> decryptor;
+		QSharedPointer<CryptoPP::MessageAuthenticationCode> cmac;
+	};
+	using ContextKey = QPair<const CryptoController*, quint32>; //(controller, keyIndex)
+
 	static const byte PwPurpose;
 	static const int PwRounds;
 
@@ -159,7 +189,14 @@ private:
 
 	QPointer<KeyStore> _keyStore;
 	ClientCrypto *_asymCrypto = nullptr;
+	QThreadPool *_keyPool;
+	bool _generatingKeys = false;
+	QSharedPointer<ClientCrypto> _pregeneratedKeys;
+	QVariantList _pregeneratedParams; //the key parameters the pregenerated keys were created with
 	mutable QHash<quint32, CipherInfo> _loadedChiphers;
+	mutable QMutex _contextMutex;
+	mutable QMultiHash<quint32, QSharedPointer<CipherContext>> _contexts; //(keyIndex, context) of all threads
+	static QThreadStorage<QHash<ContextKey, QWeakPointer<CipherContext>>> _contextPool;
 	quint32 _localCipher = 0;
 
 	QByteArray _fingerprint;
@@ -171,15 +208,20 @@ private:
 	void closeStore() const;
 
 	QDir keysDir() const;
+	QVariantList keyParams() const; //(signScheme, signParam, cryptScheme, cryptParam)
+	void keysPregenerated(const QSharedPointer<ClientCrypto> &crypto, const QString &error);
 	CipherInfo createInfo() const;
 	const CipherInfo &getInfo(quint32 keyIndex) const;
 	void storeCipherKey(quint32 keyIndex) const;
 	void cleanCiphers() const;
-
-	QByteArray createCmacImpl(const CipherInfo &info, const QByteArray &data) const;
-	void verifyCmacImpl(const CipherInfo &info, const QByteArray &data, const QByteArray &mac) const;
-	QByteArray encryptImpl(const CipherInfo &info, const QByteArray &salt, const QByteArray &plain) const;
-	QByteArray decryptImpl(const CipherInfo &info, const QByteArray &salt, const QByteArray &cipher) const;
+	QSharedPointer<CipherContext> context(quint32 keyIndex, const QSharedPointer<CipherScheme> &scheme, const CryptoPP::SecByteBlock &key) const;
+	void clearContexts() const;
+	void clearContexts(quint32 keyIndex) const;
+
+	QByteArray createCmacImpl(CipherContext &context, const QByteArray &data) const;
+	void verifyCmacImpl(CipherContext &context, const QByteArray &data, const QByteArray &mac) const;
+	QByteArray encryptImpl(CipherContext &context, const QByteArray &salt, const QByteArray &plain) const;
+	QByteArray decryptImpl(CipherContext &context, const QByteArray &salt, const QByteArray &cipher) const;
 };
 
 class Q_DATASYNC_EXPORT ClientCrypto : public AsymmetricCrypto
@@ -212,6 +254,7 @@ public:
 			  const QByteArray &cryptKey);
 
 	void reset();
+	void take(ClientCrypto &other); //takes over the keys of other, which is reset
 
 	CryptoPP::RandomNumberGenerator &rng();
 
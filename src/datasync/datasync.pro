@@ -29,6 +29,7 @@ HEADERS += \
 	controller_p.h \
 	syncmanager_p.h \
 	synchelper_p.h \
+	typepriorities_p.h \
 	synccontroller_p.h \
 	conflictresolver.h \
 	conflictresolver_p.h \
@@ -66,6 +67,7 @@ SOURCES += \
 	keystore.cpp \
 	controller.cpp \
 	synchelper.cpp \
+	typepriorities.cpp \
 	synccontroller.cpp \
 	conflictresolver.cpp \
 	syncmanager_p.cpp \
@@ -78,7 +78,12 @@ public:
 		CryptKeyParam, //!< @copybrief Setup::encryptionKeyParam
 		SymScheme, //!< @copybrief Setup::cipherScheme
 		SymKeyParam, //!< @copybrief Setup::cipherKeySize
-		EventLoggingMode //!< @copybrief Setup::eventLoggingMode
+		EventLoggingMode, //!< @copybrief Setup::eventLoggingMode
+		DeltaUploads, //!< @copybrief Setup::deltaUploads
+		CompressionLevel, //!< @copybrief Setup::compressionLevel
+		UploadDebounce, //!< @copybrief Setup::uploadDebounce
+		TypePriorities, //!< @copybrief Setup::typePriorities
+		BinaryPayloads //!< @copybrief Setup::binaryPayloads
 	};
 	Q_ENUM(PropertyKey)
 
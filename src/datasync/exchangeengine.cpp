@@ -100,28 +100,48 @@ void ExchangeEngine::initialize()
 		connectController(_changeController);
 		connect(_changeController, &ChangeController::uploadingChanged,
 				this, &ExchangeEngine::uploadingChanged);
-		connect(_changeController, &ChangeController::uploadChange,
-				_remoteConnector, &RemoteConnector::uploadData);
-		connect(_changeController, &ChangeController::uploadDeviceChange,
-				_remoteConnector, &RemoteConnector::uploadDeviceData);
+		connect(_changeController, &ChangeController::uploadEncryptedChange,
+				_remoteConnector, &RemoteConnector::uploadEncryptedData);
+		connect(_changeController, &ChangeController::uploadEncryptedDeltaChange,
+				_remoteConnector, &RemoteConnector::uploadEncryptedDeltaData);
+		connect(_changeController, &ChangeController::uploadEncryptedDeviceChange,
+				_remoteConnector, &RemoteConnector::uploadEncryptedDeviceData);
 
 		//sync controller
 		connectController(_syncController);
 		connect(_syncController, &SyncController::syncDone,
 				_remoteConnector, &RemoteConnector::downloadDone);
+		connect(_syncController, &SyncController::syncRejected,
+				_remoteConnector, &RemoteConnector::downloadRejected);
+		connect(_syncController, &SyncController::deltaBaseChanged,
+				_changeController, &ChangeController::updateDeltaBase);
+		connect(_syncController, &SyncController::deltaBaseInvalidated,
+				_changeController, &ChangeController::dropDeltaBase);
 
 		//remote controller
 		connectController(_remoteConnector);
 		connect(_remoteConnector, &RemoteConnector::remoteEvent,
 				this, &ExchangeEngine::remoteEvent);
+		connect(_remoteConnector, &RemoteConnector::generatingKeysChanged,
+				this, &ExchangeEngine::generatingKeysChanged);
 		connect(_remoteConnector, &RemoteConnector::updateUploadLimit,
 				_changeController, &ChangeController::updateUploadLimit);
+		connect(_remoteConnector, &RemoteConnector::updateDeltaSupport,
+				_changeController, &ChangeController::updateDeltaSupport);
+		connect(_remoteConnector, &RemoteConnector::updateSnapshotSupport,
+				_changeController, &ChangeController::updateSnapshotSupport);
 		connect(_remoteConnector, &RemoteConnector::uploadDone,
 				_changeController, &ChangeController::uploadDone);
 		connect(_remoteConnector, &RemoteConnector::deviceUploadDone,
 				_changeController, &ChangeController::deviceUploadDone);
+		connect(_remoteConnector, &RemoteConnector::completeUploadsRequested,
+				_changeController, &ChangeController::requestCompleteUploads);
 		connect(_remoteConnector, &RemoteConnector::downloadData,
 				_syncController, &SyncController::syncChange);
+		connect(_remoteConnector, &RemoteConnector::downloadParsed,
+				_syncController, &SyncController::syncParsedChange);
+		connect(_remoteConnector, &RemoteConnector::downloadSnapshot,
+				_syncController, &SyncController::syncSnapshot);
 		connect(_remoteConnector, &RemoteConnector::accountAccessGranted,
 				_localStore, &LocalStore::prepareAccountAdded);
 
@@ -130,6 +150,7 @@ void ExchangeEngine::initialize()
 		params.insert(QStringLiteral("delayStart"), _initialImport.isSet());
 		params.insert(QStringLiteral("store"), QVariant::fromValue(_localStore));
 		params.insert(QStringLiteral("emitter"), QVariant::fromValue(_emitter));
+		params.insert(QStringLiteral("crypto"), QVariant::fromValue(_remoteConnector->cryptoController()));
 		_changeController->initialize(params);
 		_syncController->initialize(params);
 		_remoteConnector->initialize(params);
@@ -190,7 +211,7 @@ void ExchangeEngine::resetAccount(bool keepData, bool clearConfig)
 	_syncController->setSyncEnabled(false);
 	_changeController->clearUploads();
 	_localStore->reset(keepData);
-	_remoteConnector->resetAccount(clearConfig);
+	_remoteConnector->resetAccount(clearConfig, keepData);
 }
 
 void ExchangeEngine::controllerError(const QString &errorMessage)
@@ -264,6 +285,17 @@ void ExchangeEngine::uploadingChanged(bool uploading)
 	}
 }
 
+void ExchangeEngine::generatingKeysChanged(bool generating)
+{
+	logDebug() << "Key generation state changed to:" << generating;
+	if(_state == SyncManager::Error)
+		return;
+	else if(generating)
+		upstate(SyncManager::GeneratingKeys);
+	else if(_state == SyncManager::GeneratingKeys)
+		upstate(SyncManager::Initializing);
+}
+
 void ExchangeEngine::addProgress(quint32 estimate)
 {
 	if(sender() == _progressAllowed) {
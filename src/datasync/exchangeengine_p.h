@@ -83,6 +83,7 @@ private Q_SLOTS:
 	void controllerTimeout();
 	void remoteEvent(RemoteConnector::RemoteEvent event);
 	void uploadingChanged(bool uploading);
+	void generatingKeysChanged(bool generating);
 
 	void addProgress(quint32 estimate);
 	void incrementProgress();
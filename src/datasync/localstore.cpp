@@ -3,6 +3,7 @@
 #include "synchelper_p.h"
 #include "emitteradapter_p.h"
 #include "eventcursor_p.h"
+#include "treemessage_p.h"
 
 #include <QtCore/QUrl>
 #include <QtCore/QJsonDocument>
@@ -10,9 +11,12 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QSaveFile>
 #include <QtCore/QRegularExpression>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QtEndian>
 
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
+#include <QtSql/QSqlRecord>
 
 using namespace QtDataSync;
 using std::function;
@@ -22,6 +26,26 @@ using std::make_tuple;
 #define QTDATASYNC_LOG _logger
 #define SCOPE_ASSERT() Q_ASSERT_X(scope.d->database.isValid(), Q_FUNC_INFO, "Cannot use SyncScope after committing it")
 
+namespace {
+
+//selects the key hashes of a sync tree bucket as a range, so the KeyHash index can be used
+QString bucketCondition(quint8 bucket)
+{
+	if(bucket == 0xFF)
+		return QStringLiteral("KeyHash >= ? ");
+	else
+		return QStringLiteral("KeyHash >= ? AND KeyHash < ? ");
+}
+
+void bindBucket(QSqlQuery &query, quint8 bucket)
+{
+	query.addBindValue(QByteArray(1, static_cast<char>(bucket)));
+	if(bucket != 0xFF)
+		query.addBindValue(QByteArray(1, static_cast<char>(bucket + 1)));
+}
+
+}
+
 LocalStore::LocalStore(Defaults defaults, QObject *parent) :
 	QObject{parent},
 	_defaults{std::move(defaults)},
@@ -43,6 +67,7 @@ LocalStore::LocalStore(Defaults defaults, QObject *parent) :
 										   "	File		TEXT,"
 										   "	Checksum	BLOB,"
 										   "	Changed		INTEGER NOT NULL DEFAULT 1,"
+										   "	KeyHash		BLOB,"
 										   "	PRIMARY KEY(Type, Id)"
 										   ") WITHOUT ROWID;"));
 		if(!createQuery.exec()) {
@@ -54,7 +79,8 @@ LocalStore::LocalStore(Defaults defaults, QObject *parent) :
 			};
 		}
 		logDebug() << "Created DataIndex table";
-	}
+	} else if(!_database->record(QStringLiteral("DataIndex")).contains(QStringLiteral("KeyHash")))
+		upgradeKeyHashes();
 
 	if(!_database->tables().contains(QStringLiteral("DeviceUploads"))) {
 		QSqlQuery createQuery{_database};
@@ -76,6 +102,115 @@ LocalStore::LocalStore(Defaults defaults, QObject *parent) :
 		logDebug() << "Created DeviceUploads table";
 	}
 
+	if(!_database->tables().contains(QStringLiteral("UploadQueue"))) {
+		// the queue is maintained by triggers, so every write transaction keeps it up to date
+		const QStringList createQueries {
+			QStringLiteral("CREATE TABLE IF NOT EXISTS UploadQueue ( "
+						   "	SeqId	INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
+						   "	Type	TEXT NOT NULL, "
+						   "	Id		TEXT NOT NULL, "
+						   "	Device	TEXT NOT NULL DEFAULT '', "
+						   "	UNIQUE(Type, Id, Device) "
+						   ");"),
+			//new changes are (re)queued at the end, but stay in place if changed again before uploading
+			//changes passed by the upload cursor are requeued once their outdated upload completes, see markUnchangedImpl
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS uploadqueue_insert "
+						   "AFTER INSERT ON DataIndex "
+						   "WHEN NEW.Changed = 1 "
+						   "BEGIN "
+						   "	INSERT OR REPLACE INTO UploadQueue (Type, Id) VALUES(NEW.Type, NEW.Id); "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS uploadqueue_update "
+						   "AFTER UPDATE ON DataIndex "
+						   "WHEN NEW.Changed = 1 AND (OLD.Changed = 0 OR NEW.Version != OLD.Version) "
+						   "BEGIN "
+						   "	INSERT OR IGNORE INTO UploadQueue (Type, Id) VALUES(NEW.Type, NEW.Id); "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS uploadqueue_unchanged "
+						   "AFTER UPDATE ON DataIndex "
+						   "WHEN NEW.Changed = 0 "
+						   "BEGIN "
+						   "	DELETE FROM UploadQueue WHERE Type = NEW.Type AND Id = NEW.Id AND Device = ''; "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS uploadqueue_delete "
+						   "AFTER DELETE ON DataIndex "
+						   "BEGIN "
+						   "	DELETE FROM UploadQueue WHERE Type = OLD.Type AND Id = OLD.Id; "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS uploadqueue_device_insert "
+						   "AFTER INSERT ON DeviceUploads "
+						   "BEGIN "
+						   "	INSERT OR REPLACE INTO UploadQueue (Type, Id, Device) VALUES(NEW.Type, NEW.Id, NEW.Device); "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS uploadqueue_device_delete "
+						   "AFTER DELETE ON DeviceUploads "
+						   "BEGIN "
+						   "	DELETE FROM UploadQueue WHERE Type = OLD.Type AND Id = OLD.Id AND Device = OLD.Device; "
+						   "END;"),
+			//queue changes of stores created before the queue existed
+			QStringLiteral("INSERT OR IGNORE INTO UploadQueue (Type, Id) "
+						   "SELECT Type, Id FROM DataIndex WHERE Changed = 1;"),
+			QStringLiteral("INSERT OR IGNORE INTO UploadQueue (Type, Id, Device) "
+						   "SELECT Type, Id, Device FROM DeviceUploads;")
+		};
+
+		for(const auto &query : createQueries) {
+			QSqlQuery createQuery{_database};
+			if(!createQuery.exec(query)) {
+				throw LocalStoreException {
+					_defaults,
+					QByteArray{QTDATASYNC_EXCEPTION_NAME(LocalStore)},
+					createQuery.executedQuery().simplified(),
+					createQuery.lastError().text()
+				};
+			}
+		}
+		logDebug() << "Created UploadQueue table";
+	}
+
+	if(!_database->tables().contains(QStringLiteral("SyncTree"))) {
+		// the buckets are invalidated by triggers and only recalculated when the tree is loaded
+		const QStringList createQueries {
+			QStringLiteral("CREATE TABLE IF NOT EXISTS SyncTree ( "
+						   "	Bucket	TEXT NOT NULL PRIMARY KEY, "
+						   "	Digest	BLOB "
+						   ") WITHOUT ROWID;"),
+			QStringLiteral("CREATE INDEX IF NOT EXISTS DataIndexKeyHash ON DataIndex (KeyHash);"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS synctree_insert "
+						   "AFTER INSERT ON DataIndex "
+						   "BEGIN "
+						   "	INSERT OR REPLACE INTO SyncTree (Bucket, Digest) VALUES(substr(hex(NEW.KeyHash), 1, 2), NULL); "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS synctree_update "
+						   "AFTER UPDATE ON DataIndex "
+						   "WHEN NEW.Version != OLD.Version OR NEW.Checksum IS NOT OLD.Checksum OR (NEW.File IS NULL) != (OLD.File IS NULL) "
+						   "BEGIN "
+						   "	INSERT OR REPLACE INTO SyncTree (Bucket, Digest) VALUES(substr(hex(NEW.KeyHash), 1, 2), NULL); "
+						   "END;"),
+			QStringLiteral("CREATE TRIGGER IF NOT EXISTS synctree_delete "
+						   "AFTER DELETE ON DataIndex "
+						   "BEGIN "
+						   "	INSERT OR REPLACE INTO SyncTree (Bucket, Digest) VALUES(substr(hex(OLD.KeyHash), 1, 2), NULL); "
+						   "END;"),
+			//invalidate all buckets of stores created before the tree existed
+			QStringLiteral("INSERT OR IGNORE INTO SyncTree (Bucket) "
+						   "SELECT DISTINCT substr(hex(KeyHash), 1, 2) FROM DataIndex;")
+		};
+
+		for(const auto &query : createQueries) {
+			QSqlQuery createQuery{_database};
+			if(!createQuery.exec(query)) {
+				throw LocalStoreException {
+					_defaults,
+					QByteArray{QTDATASYNC_EXCEPTION_NAME(LocalStore)},
+					createQuery.executedQuery().simplified(),
+					createQuery.lastError().text()
+				};
+			}
+		}
+		logDebug() << "Created SyncTree table";
+	}
+
 	try {
 		EventCursorPrivate::initDatabase(_defaults, _database, _logger, true);
 	} catch(EventCursorException &e) {
@@ -420,12 +555,8 @@ void LocalStore::reset(bool keepData)
 	beginWriteTransaction(ObjectKey{"any"}, true);
 
 	try {
-		if(keepData) { //mark everything changed, to upload if needed
-			QSqlQuery resetQuery(_database);
-			resetQuery.prepare(QStringLiteral("UPDATE DataIndex SET Changed = 1"));
-			exec(resetQuery);
-
-			//also: delete all not done device changes
+		if(keepData) { //changes are uploaded after reconciling the sync tree with the new account
+			//delete all not done device changes
 			QSqlQuery clearDevicesQuery(_database);
 			clearDevicesQuery.prepare(QStringLiteral("DELETE FROM DeviceUploads"));
 			exec(clearDevicesQuery);
@@ -480,16 +611,11 @@ void LocalStore::reset(bool keepData)
 quint32 LocalStore::changeCount() const
 {
 	QSqlQuery countQuery(_database);
-	countQuery.prepare(QStringLiteral("SELECT Sum(rows) FROM ( "
-									  "		SELECT Count(*) AS rows FROM DataIndex "
-									  "		WHERE Changed = 1"
-									  "		UNION ALL"
-									  "		SELECT Count(*) AS rows FROM DataIndex "
-									  "		INNER JOIN DeviceUploads "
-									  "		ON DataIndex.Type = DeviceUploads.Type "
-									  "		AND DataIndex.Id = DeviceUploads.Id "
-									  "		WHERE NOT (DataIndex.Changed = 1 AND File IS NULL)"
-									  ")"));
+	countQuery.prepare(QStringLiteral("SELECT Count(*) FROM UploadQueue "
+									  "INNER JOIN DataIndex "
+									  "ON (UploadQueue.Type = DataIndex.Type AND UploadQueue.Id = DataIndex.Id) "
+									  "WHERE UploadQueue.Device = '' "
+									  "OR NOT (DataIndex.Changed = 1 AND DataIndex.File IS NULL)")); //device changes only for those that haven't been operated on before
 	exec(countQuery);
 
 	if(countQuery.first())
@@ -498,53 +624,62 @@ quint32 LocalStore::changeCount() const
 		return 0;
 }
 
-void LocalStore::loadChanges(int limit, const function<bool(ObjectKey, quint64, QString, QUuid)> &visitor) const
+quint64 LocalStore::loadChanges(int limit, const function<bool(ObjectKey, quint64, QString, QUuid)> &visitor, quint64 afterSeqId, const QByteArrayList &typeFilter, bool excludeTypes) const
+{
+	return loadUploads(limit, [&visitor](const ObjectKey &key, quint64 version, const QString &file, QUuid device, const QByteArray &) {
+		return visitor(key, version, file, device);
+	}, afterSeqId, typeFilter, excludeTypes);
+}
+
+quint64 LocalStore::loadUploads(int limit, const function<bool(ObjectKey, quint64, QString, QUuid, QByteArray)> &visitor, quint64 afterSeqId, const QByteArrayList &typeFilter, bool excludeTypes) const
 {
 	beginReadTransaction();
 
 	try {
+		QString typeCondition;
+		if(!typeFilter.isEmpty()) {
+			QStringList placeholders;
+			for(auto i = 0; i < typeFilter.size(); i++)
+				placeholders.append(QStringLiteral("?"));
+			typeCondition = QStringLiteral("AND UploadQueue.Type %1 (%2) ")
+							.arg(excludeTypes ? QStringLiteral("NOT IN") : QStringLiteral("IN"),
+								 placeholders.join(QStringLiteral(", ")));
+		}
+
 		QSqlQuery readChangesQuery(_database);
-		readChangesQuery.prepare(QStringLiteral("SELECT Type, Id, Version, File FROM DataIndex WHERE Changed = 1 LIMIT ?"));
+		readChangesQuery.prepare(QStringLiteral("SELECT UploadQueue.SeqId, UploadQueue.Type, UploadQueue.Id, DataIndex.Version, DataIndex.File, UploadQueue.Device, DataIndex.KeyHash "
+												"FROM UploadQueue "
+												"INNER JOIN DataIndex "
+												"ON (UploadQueue.Type = DataIndex.Type AND UploadQueue.Id = DataIndex.Id) "
+												"WHERE UploadQueue.SeqId > ? "
+												"AND (UploadQueue.Device = '' OR NOT (DataIndex.Changed = 1 AND DataIndex.File IS NULL)) " //device changes only for those that haven't been operated on before
+												"%1"
+												"ORDER BY UploadQueue.SeqId "
+												"LIMIT ?").arg(typeCondition));
+		readChangesQuery.addBindValue(afterSeqId);
+		for(const auto &type : typeFilter)
+			readChangesQuery.addBindValue(type);
 		readChangesQuery.addBindValue(limit);
 		exec(readChangesQuery);
 
-		auto cnt = 0;
-		auto skip = false;
+		auto lastSeqId = afterSeqId;
 		while(readChangesQuery.next()) {
-			cnt++;
-			if(!visitor({readChangesQuery.value(0).toByteArray(), readChangesQuery.value(1).toString()},
-						readChangesQuery.value(2).toULongLong(),
-						readChangesQuery.value(3).toString(),
-						QUuid())) {
-				skip = true;
+			lastSeqId = readChangesQuery.value(0).toULongLong();
+			ObjectKey key{readChangesQuery.value(1).toByteArray(), readChangesQuery.value(2).toString()};
+			auto keyHash = readChangesQuery.value(6).toByteArray();
+			if(keyHash.isEmpty()) //should not happen, but just in case
+				keyHash = key.hashed();
+			if(!visitor(key,
+						readChangesQuery.value(3).toULongLong(),
+						readChangesQuery.value(4).toString(),
+						readChangesQuery.value(5).toUuid(), //empty for normal changes, which results in a null uuid
+						keyHash))
 				break;
-			}
-		}
-
-		if(!skip && cnt < limit) {
-			QSqlQuery readDeviceChangesQuery(_database);
-			readDeviceChangesQuery.prepare(QStringLiteral("SELECT DeviceUploads.Type, DeviceUploads.Id, DataIndex.Version, DataIndex.File, DeviceUploads.Device "
-														  "FROM DeviceUploads "
-														  "INNER JOIN DataIndex "
-														  "ON (DeviceUploads.Type = DataIndex.Type AND DeviceUploads.Id = DataIndex.Id) "
-														  "WHERE NOT (DataIndex.Changed = 1 AND File IS NULL) " //only those that haven't been operated on before
-														  "LIMIT ?"));
-			readDeviceChangesQuery.addBindValue(limit - cnt);
-			exec(readDeviceChangesQuery);
-
-			while(readDeviceChangesQuery.next()) {
-				if(!visitor({readDeviceChangesQuery.value(0).toByteArray(), readDeviceChangesQuery.value(1).toString()},
-							readDeviceChangesQuery.value(2).toULongLong(),
-							readDeviceChangesQuery.value(3).toString(),
-							readDeviceChangesQuery.value(4).toUuid())) {
-					skip = true;
-					break;
-				}
-			}
 		}
 
 		if(!_database->commit())
 			throw LocalStoreException(_defaults, QByteArray("<any>"), _database->databaseName(), _database->lastError().text());
+		return lastSeqId;
 	} catch(...) {
 		_database->rollback();
 		throw;
@@ -566,6 +701,80 @@ void LocalStore::removeDeviceChange(const ObjectKey &key, QUuid deviceId)
 	exec(rmDeviceQuery);
 }
 
+QUuid LocalStore::loadDeviceUploads(int limit, const function<bool(ObjectKey, quint64, QString)> &visitor, QUuid deviceId) const
+{
+	beginReadTransaction();
+
+	try {
+		//device changes only for those that haven't been operated on before, just like loadUploads
+		QSqlQuery readDeviceQuery(_database);
+		readDeviceQuery.prepare(QStringLiteral("SELECT DeviceUploads.Device "
+											   "FROM DeviceUploads "
+											   "INNER JOIN DataIndex "
+											   "ON (DeviceUploads.Type = DataIndex.Type AND DeviceUploads.Id = DataIndex.Id) "
+											   "WHERE NOT (DataIndex.Changed = 1 AND DataIndex.File IS NULL) "
+											   "%1"
+											   "LIMIT 1")
+								.arg(deviceId.isNull() ? QString{} : QStringLiteral("AND DeviceUploads.Device = ? ")));
+		if(!deviceId.isNull())
+			readDeviceQuery.addBindValue(deviceId);
+		exec(readDeviceQuery);
+
+		deviceId = QUuid{};
+		if(readDeviceQuery.first()) {
+			deviceId = readDeviceQuery.value(0).toUuid();
+
+			QSqlQuery readUploadsQuery(_database);
+			readUploadsQuery.prepare(QStringLiteral("SELECT DataIndex.Type, DataIndex.Id, DataIndex.Version, DataIndex.File "
+													"FROM DeviceUploads "
+													"INNER JOIN DataIndex "
+													"ON (DeviceUploads.Type = DataIndex.Type AND DeviceUploads.Id = DataIndex.Id) "
+													"WHERE DeviceUploads.Device = ? "
+													"AND NOT (DataIndex.Changed = 1 AND DataIndex.File IS NULL) "
+													"LIMIT ?"));
+			readUploadsQuery.addBindValue(deviceId);
+			readUploadsQuery.addBindValue(limit);
+			exec(readUploadsQuery);
+
+			while(readUploadsQuery.next()) {
+				if(!visitor({readUploadsQuery.value(0).toByteArray(), readUploadsQuery.value(1).toString()},
+							readUploadsQuery.value(2).toULongLong(),
+							readUploadsQuery.value(3).toString()))
+					break;
+			}
+		}
+
+		if(!_database->commit())
+			throw LocalStoreException(_defaults, QByteArray("<any>"), _database->databaseName(), _database->lastError().text());
+		return deviceId;
+	} catch(...) {
+		_database->rollback();
+		throw;
+	}
+}
+
+void LocalStore::removeDeviceChanges(const QList<ObjectKey> &keys, QUuid deviceId)
+{
+	beginWriteTransaction();
+
+	try {
+		QSqlQuery rmDeviceQuery(_database);
+		rmDeviceQuery.prepare(QStringLiteral("DELETE FROM DeviceUploads WHERE Type = ? AND Id = ? AND Device = ?"));
+		for(const auto &key : keys) {
+			rmDeviceQuery.addBindValue(key.typeName);
+			rmDeviceQuery.addBindValue(key.id);
+			rmDeviceQuery.addBindValue(deviceId);
+			exec(rmDeviceQuery, key);
+		}
+
+		if(!_database->commit())
+			throw LocalStoreException(_defaults, QByteArray("<any>"), _database->databaseName(), _database->lastError().text());
+	} catch(...) {
+		_database->rollback();
+		throw;
+	}
+}
+
 LocalStore::SyncScope LocalStore::startSync(const ObjectKey &key) const
 {
 	return SyncScope(_defaults, key, const_cast<LocalStore*>(this));
@@ -662,11 +871,12 @@ void LocalStore::storeDeleted(SyncScope &scope, quint64 version, bool changed, C
 		exec(updateQuery, scope.d->key);
 	} else {
 		QSqlQuery insertQuery(scope.d->database);
-		insertQuery.prepare(QStringLiteral("INSERT INTO DataIndex (Type, Id, Version, File, Checksum, Changed) VALUES(?, ?, ?, NULL, NULL, ?)"));
+		insertQuery.prepare(QStringLiteral("INSERT INTO DataIndex (Type, Id, Version, File, Checksum, Changed, KeyHash) VALUES(?, ?, ?, NULL, NULL, ?, ?)"));
 		insertQuery.addBindValue(scope.d->key.typeName);
 		insertQuery.addBindValue(scope.d->key.id);
 		insertQuery.addBindValue(version);
 		insertQuery.addBindValue(changed);
+		insertQuery.addBindValue(scope.d->key.hashed());
 		exec(insertQuery, scope.d->key);
 	}
 
@@ -704,15 +914,51 @@ void LocalStore::commitSync(SyncScope &scope) const
 {
 	SCOPE_ASSERT();
 
-	if(!scope.d->database->commit())
-		throw LocalStoreException(_defaults, scope.d->key, scope.d->database->databaseName(), scope.d->database->lastError().text());
+	if(scope.d->nested) {
+		QSqlQuery releaseQuery(scope.d->database);
+		if(!releaseQuery.exec(QStringLiteral("RELEASE SAVEPOINT SyncScope"))) {
+			throw LocalStoreException(_defaults,
+									  scope.d->key,
+									  releaseQuery.executedQuery().simplified(),
+									  releaseQuery.lastError().text());
+		}
 
-	if(scope.d->afterCommit)
-		scope.d->afterCommit();
+		//notify once the whole batch was commited
+		Q_ASSERT_X(_activeBatch, Q_FUNC_INFO, "SyncBatch was destroyed before its SyncScope");
+		if(scope.d->afterCommit)
+			_activeBatch->afterCommit.append(scope.d->afterCommit);
+	} else {
+		if(!scope.d->database->commit())
+			throw LocalStoreException(_defaults, scope.d->key, scope.d->database->databaseName(), scope.d->database->lastError().text());
+
+		if(scope.d->afterCommit)
+			scope.d->afterCommit();
+	}
 
 	scope.d->database = DatabaseRef(); //clear the ref, so it won't rollback
 }
 
+LocalStore::SyncBatch LocalStore::startSyncBatch() const
+{
+	Q_ASSERT_X(!_activeBatch, Q_FUNC_INFO, "Only 1 SyncBatch can be active at a time");
+	return SyncBatch(_defaults, const_cast<LocalStore*>(this));
+}
+
+void LocalStore::commitSyncBatch(SyncBatch &batch) const
+{
+	Q_ASSERT_X(batch.d->database.isValid(), Q_FUNC_INFO, "Cannot use SyncBatch after committing it");
+
+	if(!batch.d->database->commit())
+		throw LocalStoreException(_defaults, ObjectKey{"any"}, batch.d->database->databaseName(), batch.d->database->lastError().text());
+	batch.d->database = DatabaseRef(); //clear the ref, so it won't rollback
+	batch.d->owner->_activeBatch = nullptr;
+
+	const auto actions = std::move(batch.d->afterCommit);
+	batch.d->afterCommit.clear();
+	for(const auto &action : actions)
+		action();
+}
+
 void LocalStore::prepareAccountAdded(QUuid deviceId)
 {
 	try {
@@ -729,6 +975,147 @@ void LocalStore::prepareAccountAdded(QUuid deviceId)
 	}
 }
 
+QList<QByteArray> LocalStore::loadSyncTree()
+{
+	beginWriteTransaction();
+
+	try {
+		QSqlQuery dirtyQuery(_database);
+		dirtyQuery.prepare(QStringLiteral("SELECT Bucket FROM SyncTree WHERE Digest IS NULL"));
+		exec(dirtyQuery);
+		QHash<QByteArray, QByteArray> digests;
+		while(dirtyQuery.next())
+			digests.insert(dirtyQuery.value(0).toByteArray(), QByteArray{});
+
+		if(!digests.isEmpty()) {
+			QCryptographicHash hash{QCryptographicHash::Sha3_256};
+			QByteArray version{static_cast<int>(sizeof(quint64)), Qt::Uninitialized};
+			for(auto it = digests.begin(); it != digests.end(); it++) {
+				const auto bucket = QByteArray::fromHex(it.key());
+				if(bucket.size() != 1)
+					continue;
+
+				// deleted entries are excluded, as only the device that deleted them drops them from the index
+				QSqlQuery leafQuery(_database);
+				leafQuery.prepare(QStringLiteral("SELECT KeyHash, Version, Checksum FROM DataIndex "
+												 "WHERE File IS NOT NULL AND %1"
+												 "ORDER BY KeyHash")
+								  .arg(bucketCondition(static_cast<quint8>(bucket[0]))));
+				bindBucket(leafQuery, static_cast<quint8>(bucket[0]));
+				exec(leafQuery);
+
+				auto hasLeafs = false;
+				hash.reset();
+				while(leafQuery.next()) {
+					hasLeafs = true;
+					qToBigEndian<quint64>(leafQuery.value(1).toULongLong(), version.data());
+					hash.addData(leafQuery.value(0).toByteArray());
+					hash.addData(version);
+					hash.addData(leafQuery.value(2).toByteArray());
+				}
+				if(hasLeafs)
+					*it = hash.result();
+			}
+
+			QSqlQuery updateQuery(_database);
+			updateQuery.prepare(QStringLiteral("UPDATE SyncTree SET Digest = ? WHERE Bucket = ?"));
+			QSqlQuery removeQuery(_database);
+			removeQuery.prepare(QStringLiteral("DELETE FROM SyncTree WHERE Bucket = ?"));
+			for(auto it = digests.constBegin(); it != digests.constEnd(); it++) {
+				if(it->isEmpty()) { //no entries left - same as a bucket that never existed
+					removeQuery.addBindValue(it.key());
+					exec(removeQuery);
+				} else {
+					updateQuery.addBindValue(*it);
+					updateQuery.addBindValue(it.key());
+					exec(updateQuery);
+				}
+			}
+			logDebug() << "Recalculated" << digests.size() << "sync tree buckets";
+		}
+
+		const auto emptyDigest = QCryptographicHash::hash({}, QCryptographicHash::Sha3_256);
+		QList<QByteArray> tree;
+		tree.reserve(TreeMessage::BucketCount);
+		for(auto i = 0; i < TreeMessage::BucketCount; i++)
+			tree.append(emptyDigest);
+
+		QSqlQuery treeQuery(_database);
+		treeQuery.prepare(QStringLiteral("SELECT Bucket, Digest FROM SyncTree"));
+		exec(treeQuery);
+		while(treeQuery.next()) {
+			const auto bucket = QByteArray::fromHex(treeQuery.value(0).toByteArray());
+			if(bucket.size() == 1)
+				tree[static_cast<quint8>(bucket[0])] = treeQuery.value(1).toByteArray();
+		}
+
+		if(!_database->commit())
+			throw LocalStoreException(_defaults, ObjectKey{"any"}, _database->databaseName(), _database->lastError().text());
+		return tree;
+	} catch(...) {
+		_database->rollback();
+		throw;
+	}
+}
+
+void LocalStore::markTreeChanged(const QByteArray &buckets)
+{
+	try {
+		beginWriteTransaction();
+		try {
+			auto changed = false;
+			for(const auto bucket : buckets) {
+				QSqlQuery markQuery(_database);
+				markQuery.prepare(QStringLiteral("UPDATE DataIndex SET Changed = 1 "
+												 "WHERE File IS NOT NULL AND %1")
+								  .arg(bucketCondition(static_cast<quint8>(bucket))));
+				bindBucket(markQuery, static_cast<quint8>(bucket));
+				exec(markQuery);
+				if(markQuery.numRowsAffected() != 0) //in case of -1 (unknown), simply assue changed
+					changed = true;
+			}
+
+			if(!_database->commit())
+				throw LocalStoreException(_defaults, ObjectKey{"any"}, _database->databaseName(), _database->lastError().text());
+			if(changed)
+				_emitter->triggerUpload();
+		} catch(...) {
+			_database->rollback();
+			throw;
+		}
+	} catch(Exception &e) {
+		logCritical() << "Failed to mark diverged sync tree buckets as changed with error:" << e.what();
+	}
+}
+
+void LocalStore::markKeysChanged(const QList<QByteArray> &keyHashes)
+{
+	try {
+		beginWriteTransaction();
+		try {
+			QSqlQuery markQuery(_database);
+			markQuery.prepare(QStringLiteral("UPDATE DataIndex SET Changed = 1 WHERE KeyHash = ?"));
+			auto changed = false;
+			for(const auto &keyHash : keyHashes) {
+				markQuery.addBindValue(keyHash);
+				exec(markQuery);
+				if(markQuery.numRowsAffected() != 0) //in case of -1 (unknown), simply assue changed
+					changed = true;
+			}
+
+			if(!_database->commit())
+				throw LocalStoreException(_defaults, ObjectKey{"any"}, _database->databaseName(), _database->lastError().text());
+			if(changed)
+				_emitter->triggerUpload();
+		} catch(...) {
+			_database->rollback();
+			throw;
+		}
+	} catch(Exception &e) {
+		logCritical() << "Failed to mark entries for a complete upload with error:" << e.what();
+	}
+}
+
 QDir LocalStore::typeDirectory(const ObjectKey &key) const
 {
 	auto encName = QUrl::toPercentEncoding(QString::fromUtf8(key.typeName))
@@ -779,6 +1166,44 @@ void LocalStore::exec(QSqlQuery &query, const ObjectKey &key) const
 	}
 }
 
+void LocalStore::upgradeKeyHashes()
+{
+	beginWriteTransaction(ObjectKey{"any"}, true);
+
+	try {
+		//another store may have upgraded it in the meantime
+		if(_database->record(QStringLiteral("DataIndex")).contains(QStringLiteral("KeyHash"))) {
+			_database->commit();
+			return;
+		}
+
+		QSqlQuery alterQuery(_database);
+		alterQuery.prepare(QStringLiteral("ALTER TABLE DataIndex ADD COLUMN KeyHash BLOB"));
+		exec(alterQuery);
+
+		QSqlQuery keysQuery(_database);
+		keysQuery.prepare(QStringLiteral("SELECT Type, Id FROM DataIndex"));
+		exec(keysQuery);
+
+		QSqlQuery updateQuery(_database);
+		updateQuery.prepare(QStringLiteral("UPDATE DataIndex SET KeyHash = ? WHERE Type = ? AND Id = ?"));
+		while(keysQuery.next()) {
+			ObjectKey key{keysQuery.value(0).toByteArray(), keysQuery.value(1).toString()};
+			updateQuery.addBindValue(key.hashed());
+			updateQuery.addBindValue(key.typeName);
+			updateQuery.addBindValue(key.id);
+			exec(updateQuery, key);
+		}
+
+		if(!_database->commit())
+			throw LocalStoreException(_defaults, QByteArray("any"), _database->databaseName(), _database->lastError().text());
+		logDebug() << "Added KeyHash column to DataIndex table";
+	} catch(...) {
+		_database->rollback();
+		throw;
+	}
+}
+
 function<void()> LocalStore::storeChangedImpl(const DatabaseRef &db, const ObjectKey &key, quint64 version, const QString &fileName, const QJsonObject &data, bool changed, bool existing)
 {
 	auto tableDir = typeDirectory(key);
@@ -830,13 +1255,14 @@ function<void()> LocalStore::storeChangedImpl(const DatabaseRef &db, const Objec
 		exec(updateQuery, key);
 	} else {
 		QSqlQuery insertQuery(db);
-		insertQuery.prepare(QStringLiteral("INSERT INTO DataIndex (Type, Id, Version, File, Checksum, Changed) VALUES(?, ?, ?, ?, ?, ?)"));
+		insertQuery.prepare(QStringLiteral("INSERT INTO DataIndex (Type, Id, Version, File, Checksum, Changed, KeyHash) VALUES(?, ?, ?, ?, ?, ?, ?)"));
 		insertQuery.addBindValue(key.typeName);
 		insertQuery.addBindValue(key.id);
 		insertQuery.addBindValue(version);
 		insertQuery.addBindValue(tableDir.relativeFilePath(info.completeBaseName()));
 		insertQuery.addBindValue(SyncHelper::jsonHash(data));
 		insertQuery.addBindValue(changed);
+		insertQuery.addBindValue(key.hashed());
 		exec(insertQuery, key);
 	}
 
@@ -864,6 +1290,17 @@ void LocalStore::markUnchangedImpl(const DatabaseRef &db, const ObjectKey &key,
 	completeQuery.addBindValue(key.id);
 	completeQuery.addBindValue(version);
 	exec(completeQuery);
+
+	//changed again while uploading: requeue at the end, as the upload cursor has already passed it
+	if(completeQuery.numRowsAffected() == 0) {
+		QSqlQuery requeueQuery(db);
+		requeueQuery.prepare(QStringLiteral("INSERT OR REPLACE INTO UploadQueue (Type, Id) "
+											"SELECT Type, Id FROM DataIndex "
+											"WHERE Type = ? AND Id = ? AND Changed = 1"));
+		requeueQuery.addBindValue(key.typeName);
+		requeueQuery.addBindValue(key.id);
+		exec(requeueQuery);
+	}
 }
 
 // ------------- SyncScope -------------
@@ -872,7 +1309,9 @@ LocalStore::SyncScope::SyncScope(const Defaults &defaults, const ObjectKey &key,
 	d{new Private(defaults, key, owner)}
 {
 	QSqlQuery transactQuery(d->database);
-	if(!transactQuery.exec(QStringLiteral("BEGIN IMMEDIATE TRANSACTION"))) {
+	if(!transactQuery.exec(d->nested ?
+							   QStringLiteral("SAVEPOINT SyncScope") :
+							   QStringLiteral("BEGIN IMMEDIATE TRANSACTION"))) {
 		throw LocalStoreException(defaults,
 								  key,
 								  transactQuery.executedQuery().simplified(),
@@ -888,7 +1327,15 @@ LocalStore::SyncScope::SyncScope(LocalStore::SyncScope &&other) noexcept :
 
 LocalStore::SyncScope::~SyncScope()
 {
-	if(d->database.isValid())
+	if(!d || !d->database.isValid())
+		return;
+
+	if(d->nested) {
+		//only undo the changes of this scope, the rest of the batch stays intact
+		QSqlQuery rollbackQuery(d->database);
+		rollbackQuery.exec(QStringLiteral("ROLLBACK TO SAVEPOINT SyncScope"));
+		rollbackQuery.exec(QStringLiteral("RELEASE SAVEPOINT SyncScope"));
+	} else
 		d->database->rollback();
 }
 
@@ -896,5 +1343,44 @@ LocalStore::SyncScope::~SyncScope()
 
 LocalStore::SyncScope::Private::Private(const Defaults &defaults, ObjectKey key, LocalStore *owner) :
 	key{std::move(key)},
-	database{defaults.aquireDatabase(owner)}
+	database{defaults.aquireDatabase(owner)},
+	nested{owner->_activeBatch != nullptr}
+{}
+
+// ------------- SyncBatch -------------
+
+LocalStore::SyncBatch::SyncBatch(const Defaults &defaults, LocalStore *owner) :
+	d{new Private(defaults, owner)}
+{
+	QSqlQuery transactQuery(d->database);
+	if(!transactQuery.exec(QStringLiteral("BEGIN IMMEDIATE TRANSACTION"))) {
+		throw LocalStoreException(defaults,
+								  ObjectKey{"any"},
+								  transactQuery.executedQuery().simplified(),
+								  transactQuery.lastError().text());
+	}
+	owner->_activeBatch = d.data();
+}
+
+LocalStore::SyncBatch::SyncBatch(LocalStore::SyncBatch &&other) noexcept :
+	d()
+{
+	d.swap(other.d);
+}
+
+LocalStore::SyncBatch::~SyncBatch()
+{
+	if(d && d->database.isValid())
+		d->database->rollback();
+}
+
+LocalStore::SyncBatch::Private::Private(const Defaults &defaults, LocalStore *owner) :
+	database{defaults.aquireDatabase(owner)},
+	owner{owner}
 {}
+
+LocalStore::SyncBatch::Private::~Private()
+{
+	if(owner->_activeBatch == this)
+		owner->_activeBatch = nullptr;
+}
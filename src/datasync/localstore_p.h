@@ -46,6 +46,7 @@ public:
 			ObjectKey key;
 			DatabaseRef database;
 			std::function<void()> afterCommit;
+			bool nested; //part of a SyncBatch, uses a savepoint instead of a transaction
 
 			Private(const Defaults &defaults, ObjectKey key, LocalStore *owner);
 		};
@@ -54,6 +55,29 @@ public:
 		SyncScope(const Defaults &defaults, const ObjectKey &key, LocalStore *owner);
 	};
 
+	class Q_DATASYNC_EXPORT SyncBatch {
+		friend class LocalStore;
+		Q_DISABLE_COPY(SyncBatch)
+
+	public:
+		SyncBatch(SyncBatch &&other) noexcept;
+		~SyncBatch();
+
+	private:
+		//no export needed
+		struct Private {
+			DatabaseRef database;
+			LocalStore *owner;
+			QList<std::function<void()>> afterCommit;
+
+			Private(const Defaults &defaults, LocalStore *owner);
+			~Private();
+		};
+		QScopedPointer<Private> d;
+
+		SyncBatch(const Defaults &defaults, LocalStore *owner);
+	};
+
 	explicit LocalStore(Defaults defaults, QObject *parent = nullptr);
 	~LocalStore() override;
 
@@ -75,9 +99,22 @@ public:
 
 	// change access
 	quint32 changeCount() const;
-	void loadChanges(int limit, const std::function<bool(ObjectKey, quint64, QString, QUuid)> &visitor) const; //(key, version, file, device)
+	quint64 loadChanges(int limit,
+						const std::function<bool(ObjectKey, quint64, QString, QUuid)> &visitor,
+						quint64 afterSeqId = 0,
+						const QByteArrayList &typeFilter = {},
+						bool excludeTypes = false) const; //(key, version, file, device) - returns the queue position of the last visited change
+	quint64 loadUploads(int limit,
+						const std::function<bool(ObjectKey, quint64, QString, QUuid, QByteArray)> &visitor,
+						quint64 afterSeqId = 0,
+						const QByteArrayList &typeFilter = {},
+						bool excludeTypes = false) const; //same as loadChanges, but passes the stored key hash as well
 	void markUnchanged(const ObjectKey &key, quint64 version, bool isDelete);
 	void removeDeviceChange(const ObjectKey &key, QUuid deviceId);
+	QUuid loadDeviceUploads(int limit,
+							const std::function<bool(ObjectKey, quint64, QString)> &visitor,
+							QUuid deviceId = {}) const; //(key, version, file) - visits the uploads of one (or the given) device only and returns that device
+	void removeDeviceChanges(const QList<ObjectKey> &keys, QUuid deviceId);
 
 	// sync access
 	SyncScope startSync(const ObjectKey &key) const;
@@ -100,6 +137,13 @@ public:
 					   quint64 oldVersion,
 					   bool isDelete);
 	void commitSync(SyncScope &scope) const;
+	SyncBatch startSyncBatch() const; //all scopes started while the batch exists become part of it
+	void commitSyncBatch(SyncBatch &batch) const;
+
+	// sync tree access
+	QList<QByteArray> loadSyncTree(); //bucket digests, ordered by the first byte of the key hash
+	void markTreeChanged(const QByteArray &buckets); //one byte per bucket
+	void markKeysChanged(const QList<QByteArray> &keyHashes);
 
 	void prepareAccountAdded(QUuid deviceId);
 
@@ -112,6 +156,7 @@ private:
 	Logger *_logger;
 	EmitterAdapter *_emitter;
 	DatabaseRef _database;
+	SyncBatch::Private *_activeBatch = nullptr;
 
 	QDir typeDirectory(const ObjectKey &key) const;
 	QString filePath(const QDir &typeDir, const QString &baseName) const;
@@ -120,6 +165,7 @@ private:
 	void beginReadTransaction(const ObjectKey &key = ObjectKey{"any"}) const;
 	void beginWriteTransaction(const ObjectKey &key = ObjectKey{"any"}, bool exclusive = false);
 	void exec(QSqlQuery &query, const ObjectKey &key = ObjectKey{"any"}) const;
+	void upgradeKeyHashes();
 
 	Q_REQUIRED_RESULT std::function<void ()> storeChangedImpl(const DatabaseRef &db,
 																 const ObjectKey &key,
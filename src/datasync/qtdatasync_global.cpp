@@ -4,6 +4,7 @@
 
 #include "exchangerotransport_p.h"
 #include "exchangebufferserver_p.h"
+#include "sharedmemorybuffer_p.h"
 
 #include <QtCore/QCoreApplication>
 #include "message_p.h"
@@ -21,6 +22,9 @@ void setupQtDataSync()
 	QtDataSync::QtRoTransportRegistry::registerTransport(QtDataSync::ExchangeBufferServer::UrlScheme(),
 														 new QtDataSync::ThreadedQtRoServer{},
 														 new QtDataSync::ThreadedQtRoClient{});
+	QtDataSync::QtRoTransportRegistry::registerTransport(QtDataSync::SharedMemoryBuffer::UrlScheme(),
+														 new QtDataSync::SharedMemoryQtRoServer{},
+														 new QtDataSync::SharedMemoryQtRoClient{});
 
 	QtDataSync::Message::registerTypes();
 }
@@ -1,8 +1,11 @@
 #include "remoteconnector_p.h"
 #include "logger.h"
 #include "setup_p.h"
+#include "synchelper_p.h"
 
 #include <QtCore/QSysInfo>
+#include <QtCore/QRunnable>
+#include <QtCore/QCryptographicHash>
 
 #include "registermessage_p.h"
 #include "loginmessage_p.h"
@@ -32,6 +35,20 @@ using byte = CryptoPP::byte;
 
 #define logRetry(...) (_retryIndex == 0 ? logWarning(__VA_ARGS__) : (logDebug(__VA_ARGS__) << "Repeated"))
 
+namespace {
+
+class DownloadRunnable : public QRunnable
+{
+public:
+	DownloadRunnable(std::function<void()> fn);
+	void run() override;
+
+private:
+	std::function<void()> _fn;
+};
+
+}
+
 const QString RemoteConnector::keyRemoteEnabled(QStringLiteral("enabled"));
 const QString RemoteConnector::keyRemoteConfig(QStringLiteral("remote"));
 const QString RemoteConnector::keyRemoteUrl(QStringLiteral("remote/url"));
@@ -47,6 +64,7 @@ const QString RemoteConnector::keyImportPartner(QStringLiteral("import/partner")
 const QString RemoteConnector::keyImportScheme(QStringLiteral("import/scheme"));
 const QString RemoteConnector::keyImportCmac(QStringLiteral("import/cmac"));
 const QString RemoteConnector::keySendCmac(QStringLiteral("sendCmac"));
+const QString RemoteConnector::keyReconcile(QStringLiteral("reconcile"));
 
 const QVector<seconds> RemoteConnector::Timeouts = {
 	seconds{5},
@@ -56,9 +74,13 @@ const QVector<seconds> RemoteConnector::Timeouts = {
 	minutes{5}
 };
 
+const int RemoteConnector::MaxBatchSize = 512 * 1024; //512 KB
+const int RemoteConnector::MaxPendingDownloads = 256;
+
 RemoteConnector::RemoteConnector(const Defaults &defaults, QObject *parent) :
 	Controller{"connector", defaults, parent},
-	_cryptoController{new CryptoController(defaults, this)}
+	_cryptoController{new CryptoController(defaults, this)},
+	_downloadPool{new QThreadPool{this}}
 {}
 
 CryptoController *RemoteConnector::cryptoController() const
@@ -69,6 +91,14 @@ CryptoController *RemoteConnector::cryptoController() const
 void RemoteConnector::initialize(const QVariantHash &params)
 {
 	_cryptoController->initialize(params);
+	connect(_cryptoController, &CryptoController::keyGenerationChanged,
+			this, &RemoteConnector::keyGenerationChanged);
+	//new devices need private keys - generate them now, so registering does not have to wait
+	if(sValue(keyDeviceId).toUuid().isNull())
+		_cryptoController->pregenerateKeys();
+	//optional: if not set, the sync tree is never reconciled with the server
+	_store = params.value(QStringLiteral("store")).value<LocalStore*>();
+	_typePriorities = TypePriorities{defaults().property(Defaults::TypePriorities).toHash()};
 
 	//setup keepalive timer
 	_pingTimer = new QTimer(this);
@@ -77,6 +107,13 @@ void RemoteConnector::initialize(const QVariantHash &params)
 	connect(_pingTimer, &QTimer::timeout,
 			this, &RemoteConnector::ping);
 
+	//setup batch timer - collects all changes prepared within one event loop cycle
+	_batchTimer = new QTimer(this);
+	_batchTimer->setInterval(0);
+	_batchTimer->setSingleShot(true);
+	connect(_batchTimer, &QTimer::timeout,
+			this, &RemoteConnector::flushChanges);
+
 	//setup SM
 	_stateMachine = new ConnectorStateMachine(this);
 	_stateMachine->connectToState(QStringLiteral("Connecting"),
@@ -119,6 +156,8 @@ void RemoteConnector::start()
 void RemoteConnector::finalize()
 {
 	_pingTimer->stop();
+	clearDownloads();
+	_downloadPool->waitForDone();
 	_cryptoController->finalize();
 
 	if(_stateMachine->isRunning()) {
@@ -195,6 +234,8 @@ void RemoteConnector::resync()
 		return;
 	}
 	emit remoteEvent(RemoteReadyWithChanges);
+	if(_treeEnabled)
+		sendTree(true);
 	sendMessage(SyncMessage());
 }
 
@@ -220,8 +261,14 @@ void RemoteConnector::removeDevice(QUuid deviceId)
 	sendMessage(RemoveMessage{deviceId});
 }
 
-void RemoteConnector::resetAccount(bool clearConfig)
+void RemoteConnector::resetAccount(bool clearConfig, bool keepData)
 {
+	//kept data is reconciled with the account once connected again
+	if(keepData)
+		settings()->setValue(keyReconcile, true);
+	else
+		settings()->remove(keyReconcile);
+
 	if(clearConfig) { //always clear, in order to reset imports
 		settings()->remove(keyRemoteConfig);
 		settings()->remove(keyImport);
@@ -308,9 +355,10 @@ void RemoteConnector::loginReply(QUuid deviceId, bool accept)
 		if(accept) {
 			AcceptMessage message(deviceId);
 			tie(message.index, message.scheme, message.secret) = _cryptoController->encryptSecretKey(crypto.data(), crypto->encryptionKey());
-			sendSignedMessage(message);
+			sendAuthenticatedMessage(message);
 			logDebug() << "Granting access to account for device" << deviceId;
 		} else {
+			_snapshotDevices.remove(deviceId);
 			sendMessage(DenyMessage{deviceId});
 			logInfo() << "Rejected access to account for device" << deviceId;
 		}
@@ -368,6 +416,80 @@ void RemoteConnector::uploadDeviceData(const QByteArray &key, QUuid deviceId, co
 	}
 }
 
+void RemoteConnector::uploadEncryptedData(const QByteArray &key, quint32 keyIndex, const QByteArray &salt, const QByteArray &data)
+{
+	if(!isIdle()) {
+		logWarning() << "Can't upload when not in idle state. Ignoring request";
+		return;
+	}
+
+	//large changes are uploaded in chunks, one at a time
+	if(_chunkEnabled && data.size() > ChangeChunkMessage::ChunkSize) {
+		try {
+			const auto chunkCount = (data.size() + ChangeChunkMessage::ChunkSize - 1) / ChangeChunkMessage::ChunkSize;
+			_chunkedUploads.insert(key, {keyIndex, salt, data, static_cast<quint32>(chunkCount)});
+			sendChunk(key, 0); //always starts with the first, the server replies with the next missing chunk to resume
+		} catch(Exception &e) {
+			onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<ChangeChunkMessage>());
+		}
+		return;
+	}
+
+	if(_batchEnabled) {
+		_pendingChanges.append(make_tuple(key, keyIndex, salt, data));
+		_batchTimer->start();
+		return;
+	}
+
+	try {
+		ChangeMessage message(key);
+		message.keyIndex = keyIndex;
+		message.salt = salt;
+		message.data = data;
+		sendMessage(message);
+	} catch(Exception &e) {
+		onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<ChangeMessage>());
+	}
+}
+
+void RemoteConnector::uploadEncryptedDeltaData(const QByteArray &key, quint32 keyIndex, const QByteArray &salt, const QByteArray &data)
+{
+	if(!isIdle()) {
+		logWarning() << "Can't upload when not in idle state. Ignoring request";
+		return;
+	}
+
+	try {
+		DeltaChangeMessage message(key);
+		message.keyIndex = keyIndex;
+		message.salt = salt;
+		message.data = data;
+		sendMessage(message);
+	} catch(Exception &e) {
+		onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<DeltaChangeMessage>());
+	}
+}
+
+void RemoteConnector::uploadEncryptedDeviceData(const QByteArray &key, QUuid deviceId, quint32 keyIndex, const QByteArray &salt, const QByteArray &data)
+{
+	if(!isIdle()) {
+		logWarning() << "Can't upload when not in idle state. Ignoring request";
+		return;
+	}
+
+	try {
+		//device changes are never chunked. They only exist while adding a device, and a change
+		//larger than the servers quota/limit is rejected with a QuotaHitError anyways
+		DeviceChangeMessage message(key, deviceId);
+		message.keyIndex = keyIndex;
+		message.salt = salt;
+		message.data = data;
+		sendMessage(message);
+	} catch(Exception &e) {
+		onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<DeviceChangeMessage>());
+	}
+}
+
 void RemoteConnector::downloadDone(const quint64 key)
 {
 	if(!isIdle()) {
@@ -385,6 +507,24 @@ void RemoteConnector::downloadDone(const quint64 key)
 	}
 }
 
+void RemoteConnector::downloadRejected(const quint64 key)
+{
+	if(!isIdle()) {
+		logWarning() << "Can't download when not in idle state. Ignoring request";
+		return;
+	}
+
+	try {
+		//completes the download as well, but makes the server request the complete change from the uploader
+		ChangedNackMessage message(key);
+		sendMessage(message);
+		emit progressIncrement();
+		beginOp(minutes(5), false);
+	} catch(Exception &e) {
+		onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<ChangedNackMessage>());
+	}
+}
+
 void RemoteConnector::setSyncEnabled(bool syncEnabled)
 {
 	if (sValue(keyRemoteEnabled).toBool() == syncEnabled)
@@ -403,6 +543,7 @@ void RemoteConnector::setDeviceName(const QString &deviceName)
 	if(sValue(keyDeviceName).toString() != deviceName) {
 		settings()->setValue(keyDeviceName, deviceName);
 		emit deviceNameChanged(deviceName);
+		clearTicket(); //the name is only updated by a full login
 		reconnect();
 	}
 }
@@ -412,6 +553,7 @@ void RemoteConnector::resetDeviceName()
 	if(settings()->contains(keyDeviceName)) {
 		settings()->remove(keyDeviceName);
 		emit deviceNameChanged(deviceName());
+		clearTicket(); //the name is only updated by a full login
 		reconnect();
 	}
 }
@@ -453,24 +595,46 @@ void RemoteConnector::binaryMessageReceived(const QByteArray &message)
 		return;
 	}
 
-	if(_messageProcessingBlocked) { // enqueue messages for later if currently wating for a statemachine update
+	if(_messageProcessingBlocked || _downloadsBlocked) { // enqueue messages for later if currently wating for a statemachine update or for downloads
 		_messageBuffer.enqueue(message);
 		return;
 	}
 
 	QByteArray name;
 	try {
-		QDataStream stream(message);
+		MessageFrame frame{message};
+		QDataStream stream(&frame);
 		Message::setupStream(stream);
 		stream.startTransaction();
 		stream >> name;
 		if(!stream.commitTransaction())
 			throw DataStreamException(stream);
 
+		//other messages must wait for all downloads before them to be passed on
+		if(_deliverIndex != _decodeIndex &&
+		   !Message::isType<ChangedMessage>(name) &&
+		   !Message::isType<ChangedInfoMessage>(name) &&
+		   !Message::isType<ChangedBatchMessage>(name) &&
+		   !Message::isType<ChangedChunkMessage>(name)) {
+			_downloadsBlocked = true;
+			_messageBuffer.prepend(message);
+			return;
+		}
+
+		//downloads keep the frame alive until decrypted, so their data can be sliced from it
+		//chunks are not sliced, as they are cached across frames until complete
+		frame.setSlicing(Message::isType<ChangedMessage>(name) ||
+						 Message::isType<ChangedInfoMessage>(name) ||
+						 Message::isType<ChangedBatchMessage>(name));
+
 		if(Message::isType<ErrorMessage>(name))
 			onError(Message::deserializeMessage<ErrorMessage>(stream));
 		else if(Message::isType<IdentifyMessage>(name))
 			onIdentify(Message::deserializeMessage<IdentifyMessage>(stream));
+		else if(Message::isType<SessionMessage>(name))
+			onSession(Message::deserializeMessage<SessionMessage>(stream));
+		else if(Message::isType<TicketMessage>(name))
+			onTicket(Message::deserializeMessage<TicketMessage>(stream));
 		else if(Message::isType<AccountMessage>(name))
 			onAccount(Message::deserializeMessage<AccountMessage>(stream));
 		else if(Message::isType<WelcomeMessage>(name))
@@ -479,12 +643,20 @@ void RemoteConnector::binaryMessageReceived(const QByteArray &message)
 			onGrant(Message::deserializeMessage<GrantMessage>(stream));
 		else if(Message::isType<ChangeAckMessage>(name))
 			onChangeAck(Message::deserializeMessage<ChangeAckMessage>(stream));
+		else if(Message::isType<ChangeBatchAckMessage>(name))
+			onChangeBatchAck(Message::deserializeMessage<ChangeBatchAckMessage>(stream));
 		else if(Message::isType<DeviceChangeAckMessage>(name))
 			onDeviceChangeAck(Message::deserializeMessage<DeviceChangeAckMessage>(stream));
+		else if(Message::isType<ChangeChunkAckMessage>(name))
+			onChangeChunkAck(Message::deserializeMessage<ChangeChunkAckMessage>(stream));
 		else if(Message::isType<ChangedMessage>(name))
-			onChanged(Message::deserializeMessage<ChangedMessage>(stream));
+			onChanged(Message::deserializeMessage<ChangedMessage>(stream), message);
 		else if(Message::isType<ChangedInfoMessage>(name))
-			onChangedInfo(Message::deserializeMessage<ChangedInfoMessage>(stream));
+			onChangedInfo(Message::deserializeMessage<ChangedInfoMessage>(stream), message);
+		else if(Message::isType<ChangedBatchMessage>(name))
+			onChangedBatch(Message::deserializeMessage<ChangedBatchMessage>(stream), message);
+		else if(Message::isType<ChangedChunkMessage>(name))
+			onChangedChunk(Message::deserializeMessage<ChangedChunkMessage>(stream));
 		else if(Message::isType<LastChangedMessage>(name))
 			onLastChanged(Message::deserializeMessage<LastChangedMessage>(stream));
 		else if(Message::isType<DevicesMessage>(name))
@@ -493,6 +665,10 @@ void RemoteConnector::binaryMessageReceived(const QByteArray &message)
 			onRemoveAck(Message::deserializeMessage<RemoveAckMessage>(stream));
 		else if(Message::isType<ProofMessage>(name))
 			onProof(Message::deserializeMessage<ProofMessage>(stream));
+		else if(Message::isType<VersionedProofMessage>(name)) {
+			auto message = Message::deserializeMessage<VersionedProofMessage>(stream);
+			onProof(message, message.protocolVersion >= InitMessage::SnapshotVersion);
+		}
 		else if(Message::isType<AcceptAckMessage>(name))
 			onAcceptAck(Message::deserializeMessage<AcceptAckMessage>(stream));
 		else if(Message::isType<MacUpdateAckMessage>(name))
@@ -501,6 +677,10 @@ void RemoteConnector::binaryMessageReceived(const QByteArray &message)
 			onDeviceKeys(Message::deserializeMessage<DeviceKeysMessage>(stream));
 		else if(Message::isType<NewKeyAckMessage>(name))
 			onNewKeyAck(Message::deserializeMessage<NewKeyAckMessage>(stream));
+		else if(Message::isType<TreeDiffMessage>(name))
+			onTreeDiff(Message::deserializeMessage<TreeDiffMessage>(stream));
+		else if(Message::isType<ResendMessage>(name))
+			onResend(Message::deserializeMessage<ResendMessage>(stream));
 		else {
 			logWarning().noquote() << "Unknown message received:" << Message::typeName(name);
 			triggerError(true);
@@ -577,6 +757,8 @@ void RemoteConnector::doConnect()
 		submitEventSync(QStringLiteral("noConnect"));
 		return;
 	}
+	if(remoteUrl != _resumeUrl)
+		clearTicket();
 
 	if(_socket && _socket->state() != QAbstractSocket::UnconnectedState) {
 		logWarning() << "Deleting already open socket connection";
@@ -665,6 +847,41 @@ void RemoteConnector::doDisconnect()
 		submitEventSync(QStringLiteral("disconnected"));
 }
 
+void RemoteConnector::flushChanges()
+{
+	if(_pendingChanges.isEmpty())
+		return;
+	if(!isIdle()) {
+		logWarning() << "Can't upload when not in idle state. Dropping" << _pendingChanges.size() << "changes";
+		_pendingChanges.clear();
+		return;
+	}
+
+	try {
+		while(!_pendingChanges.isEmpty()) {
+			ChangeBatchMessage message;
+			auto size = 0;
+			do {
+				auto change = _pendingChanges.takeFirst();
+				size += get<3>(change).size();
+				message.changes.append(change);
+			} while(!_pendingChanges.isEmpty() && size < MaxBatchSize);
+
+			if(message.changes.size() == 1) {
+				ChangeMessage single;
+				tie(single.dataId, single.keyIndex, single.salt, single.data) = message.changes.first();
+				sendMessage(single);
+			} else {
+				logDebug() << "Uploading batch of" << message.changes.size() << "changes";
+				sendMessage(message);
+			}
+		}
+	} catch(Exception &e) {
+		_pendingChanges.clear();
+		onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<ChangeBatchMessage>());
+	}
+}
+
 void RemoteConnector::scheduleRetry()
 {
 	auto delta = retry();
@@ -679,6 +896,18 @@ void RemoteConnector::onEntryIdleState()
 	if(_cryptoController->hasKeyUpdate())
 		initKeyUpdate();
 
+	if(sValue(keyReconcile).toBool()) {
+		settings()->remove(keyReconcile);
+		if(_treeEnabled)
+			sendTree(true);
+		else if(_store) { //server cannot compare trees - upload everything
+			QByteArray buckets;
+			for(auto i = 0; i < TreeMessage::BucketCount; i++)
+				buckets.append(static_cast<char>(i));
+			_store->markTreeChanged(buckets);
+		}
+	}
+
 	if(_expectChanges) {
 		_expectChanges = false;
 		logDebug() << "Server has changes. Reloading states";
@@ -698,7 +927,12 @@ void RemoteConnector::machineReady()
 {
 	logDebug() << "Reached stable states:" << _stateMachine->activeStateNames(false);
 	_messageProcessingBlocked = false;
-	while(!_messageProcessingBlocked && !_messageBuffer.isEmpty())
+	processBufferedMessages();
+}
+
+void RemoteConnector::processBufferedMessages()
+{
+	while(!_messageProcessingBlocked && !_downloadsBlocked && !_messageBuffer.isEmpty())
 		binaryMessageReceived(_messageBuffer.dequeue());
 }
 
@@ -712,6 +946,14 @@ void RemoteConnector::sendSignedMessage(const Message &message)
 	_socket->sendBinaryMessage(_cryptoController->serializeSignedMessage(message));
 }
 
+void RemoteConnector::sendAuthenticatedMessage(const Message &message)
+{
+	if(_sessionKey.empty())
+		sendSignedMessage(message);
+	else
+		_socket->sendBinaryMessage(message.serializeAuthenticated(_sessionKey, _sessionSequence++));
+}
+
 bool RemoteConnector::isIdle() const
 {
 	return _stateMachine->isActive(QStringLiteral("Idle"));
@@ -779,8 +1021,10 @@ bool RemoteConnector::loadIdentity()
 			_cryptoController->clearKeyMaterial();
 			_cryptoController->acquireStore(!_deviceId.isNull());
 
-			if(_deviceId.isNull()) //no user -> nothing to be loaded
+			if(_deviceId.isNull()) { //no user -> nothing to be loaded, but keys will be needed
+				_cryptoController->pregenerateKeys();
 				return true;
+			}
 
 			_cryptoController->loadKeyMaterial(_deviceId);
 		}
@@ -811,10 +1055,47 @@ seconds RemoteConnector::retry()
 
 void RemoteConnector::clearCaches(bool includeExport)
 {
+	_batchTimer->stop();
+	_pendingChanges.clear();
+	_chunkedUploads.clear();
+	clearDownloads();
+	if(includeExport)
+		_chunkedDownloads.clear(); //kept across reconnects otherwise, so they can be resumed
 	_deviceCache.clear();
+	_reportedTree.clear();
 	if(includeExport)
 		_exportsCache.clear();
 	_activeProofs.clear();
+	_snapshotDevices.clear();
+	_sessionKey.New(0);
+	_sessionSequence = 0;
+	_resuming = false;
+	if(includeExport)
+		clearTicket();
+	_pendingIdentify.reset();
+}
+
+void RemoteConnector::clearTicket()
+{
+	_resumeTicket.clear();
+	_resumeKey.New(0);
+	_resumeUrl.clear();
+}
+
+bool RemoteConnector::canResume(const IdentifyMessage &message) const
+{
+	return message.protocolVersion >= InitMessage::ResumeVersion &&
+			!_resumeTicket.isEmpty() &&
+			!_resumeDeadline.hasExpired();
+}
+
+void RemoteConnector::clearDownloads()
+{
+	//drop everything still beeing decoded - results of running workers are discarded by index
+	_downloadPool->clear();
+	_decodedDownloads.clear();
+	_deliverIndex = _decodeIndex;
+	_downloadsBlocked = false;
 }
 
 QVariant RemoteConnector::sValue(const QString &key) const
@@ -886,6 +1167,134 @@ void RemoteConnector::sendKeyUpdate()
 	logDebug() << "Sent exchange mac for key with index" << _cryptoController->keyIndex();
 }
 
+void RemoteConnector::sendTree(bool reconcile)
+{
+	if(!_store)
+		return;
+
+	try {
+		const auto tree = _store->loadSyncTree();
+		QCryptographicHash rootHash{QCryptographicHash::Sha3_256};
+		for(const auto &digest : tree)
+			rootHash.addData(digest);
+		const auto root = rootHash.result();
+		if(!reconcile && root == _reportedTree)
+			return; //server already knows this state
+
+		_reportedTree = root;
+		sendMessage(TreeMessage{reconcile, tree});
+		logDebug() << "Sent sync tree with root" << root.toHex() << "- reconcile:" << reconcile;
+	} catch(Exception &e) {
+		logWarning() << "Failed to load the sync tree with error:" << e.what();
+	}
+}
+
+void RemoteConnector::sendChunk(const QByteArray &key, quint32 chunkIndex)
+{
+	const auto &upload = _chunkedUploads[key];
+	ChangeChunkMessage message(key);
+	message.keyIndex = upload.keyIndex;
+	message.salt = upload.salt;
+	message.chunkIndex = chunkIndex;
+	message.chunkCount = upload.chunkCount;
+	//serialized right away, so a raw slice of the upload is enough
+	const auto offset = static_cast<int>(chunkIndex) * ChangeChunkMessage::ChunkSize;
+	message.data = QByteArray::fromRawData(upload.data.constData() + offset,
+										   qMin(upload.data.size() - offset, static_cast<int>(ChangeChunkMessage::ChunkSize)));
+	sendMessage(message);
+}
+
+void RemoteConnector::decodeDownload(quint64 dataIndex, quint32 keyIndex, const QByteArray &salt, const QByteArray &cipher, const QByteArray &frame, quint64 groupEnd)
+{
+	auto decryption = _cryptoController->prepareDecryption(keyIndex);
+	auto index = _decodeIndex++;
+	auto crypto = _cryptoController;
+	auto typePriorities = _typePriorities;
+	groupEnd = qMax(index, groupEnd);
+
+	//decrypt and parse on the pool, the results are passed on in order via downloadDecoded
+	//the frame is captured as well, as salt and cipher may be slices of it
+	_downloadPool->start(new DownloadRunnable{[this, crypto, typePriorities, index, groupEnd, dataIndex, decryption, salt, cipher, frame]() {
+		Q_UNUSED(frame)
+		DecodedDownload download;
+		download.dataIndex = dataIndex;
+		download.groupEnd = groupEnd;
+		try {
+			download.data = crypto->decryptPrepared(decryption, salt, cipher);
+			try {
+				download.isSnapshot = SyncHelper::isSnapshot(download.data);
+				if(download.isSnapshot)
+					download.snapshot = SyncHelper::parseSnapshot(download.data);
+				else {
+					download.change = SyncHelper::parse(download.data);
+					if(!typePriorities.isEmpty())
+						download.priority = typePriorities.priority(download.change.key.typeName);
+				}
+				download.parsed = true;
+			} catch(QException &) {
+				//passed on unparsed, so the sync controller can report it
+			}
+		} catch(Exception &e) {
+			download.error = e.qWhat();
+		}
+
+		QMetaObject::invokeMethod(this, [this, index, download]() {
+			downloadDecoded(index, download);
+		}, Qt::QueuedConnection);
+	}});
+
+	if(_decodeIndex - _deliverIndex >= static_cast<quint64>(MaxPendingDownloads))
+		_downloadsBlocked = true;
+}
+
+void RemoteConnector::downloadDecoded(quint64 index, const DecodedDownload &download)
+{
+	if(index < _deliverIndex) //cleared while beeing decoded
+		return;
+
+	//keep the order of the server: only pass on complete groups, once all previous downloads have been passed on
+	_decodedDownloads.insert(index, download);
+	while(!_decodedDownloads.isEmpty() && _decodedDownloads.firstKey() == _deliverIndex) {
+		const auto groupEnd = _decodedDownloads.first().groupEnd;
+		auto complete = true;
+		for(auto i = _deliverIndex + 1; complete && i <= groupEnd; i++)
+			complete = _decodedDownloads.contains(i);
+		if(!complete)
+			break;
+
+		QList<DecodedDownload> group;
+		for(auto i = _deliverIndex; i <= groupEnd; i++)
+			group.append(_decodedDownloads.take(i));
+		_deliverIndex = groupEnd + 1;
+
+		//apply higher priority classes first, but keep the order of the server within a class
+		if(group.size() > 1) {
+			std::stable_sort(group.begin(), group.end(), [](const DecodedDownload &lhs, const DecodedDownload &rhs) {
+				return lhs.priority > rhs.priority;
+			});
+		}
+
+		for(const auto &decoded : group) {
+			if(!decoded.error.isNull()) {
+				clearDownloads();
+				onError({ErrorMessage::ClientError, decoded.error}, Message::messageName<ChangedMessage>());
+				return;
+			} else if(decoded.parsed && decoded.isSnapshot)
+				emit downloadSnapshot(decoded.dataIndex, decoded.snapshot);
+			else if(decoded.parsed)
+				emit downloadParsed(decoded.dataIndex, decoded.change);
+			else
+				emit downloadData(decoded.dataIndex, decoded.data);
+		}
+	}
+
+	//continue with buffered messages, once there is space for more downloads
+	if(_downloadsBlocked && _decodeIndex - _deliverIndex < static_cast<quint64>(MaxPendingDownloads)) {
+		_downloadsBlocked = false;
+		processBufferedMessages();
+	}
+}
+
 void RemoteConnector::onError(const ErrorMessage &message, const QByteArray &messageName)
 {
 	if(!messageName.isEmpty())
@@ -932,19 +1341,49 @@ void RemoteConnector::onIdentify(const IdentifyMessage &message)
 	// allow connecting too, because possible event order: [Connecting] -> connected -> onIdentify -> [Connected] -> ...
 	// instead of the "clean" order: [Connecting] -> connected -> [Connected] -> onIdentify -> ...
 	// can happen when the message is received before the connected event has been sent
-	if(!_stateMachine->isActive(QStringLiteral("Connected")) &&
+	// the server answers a rejected resumption with a new IdentifyMessage, to continue with a full login
+	const auto resumeRejected = _resuming && _stateMachine->isActive(QStringLiteral("LoggingIn"));
+	if(!resumeRejected &&
+	   !_stateMachine->isActive(QStringLiteral("Connected")) &&
 	   !_stateMachine->isActive(QStringLiteral("Connecting"))) {
 		logWarning() << "Unexpected IdentifyMessage";
 		triggerError(true);
 	} else {
-		emit updateUploadLimit(message.uploadLimit);
-		if(!_deviceId.isNull()) {
+		emit updateUploadLimit(message.uploadMaximum);
+		_batchEnabled = message.protocolVersion >= InitMessage::BatchVersion;
+		emit updateDeltaSupport(message.protocolVersion >= InitMessage::DeltaVersion);
+		_treeEnabled = message.protocolVersion >= InitMessage::TreeVersion;
+		_chunkEnabled = message.protocolVersion >= InitMessage::ChunkVersion;
+		if(resumeRejected) {
+			logDebug() << "Server rejected the resumption ticket. Falling back to a full login";
+			_resuming = false;
+			_sessionKey.New(0);
+			clearTicket();
+		}
+
+		if(!_deviceId.isNull() && canResume(message)) {
+			ResumeMessage msg(_deviceId,
+							  _resumeTicket,
+							  message.nonce);
+			_socket->sendBinaryMessage(msg.serializeAuthenticated(_resumeKey, 0));
+			_sessionKey = ResumeMessage::deriveSessionKey(_resumeKey, message.nonce);
+			_sessionSequence = 0;
+			_resuming = true;
+			submitEventSync(QStringLiteral("awaitLogin"));
+			logDebug() << "Sent resume message for device id" << _deviceId;
+		} else if(!_deviceId.isNull()) {
 			LoginMessage msg(_deviceId,
 							 sValue(keyDeviceName).toString(),
 							 message.nonce);
 			sendSignedMessage(msg);
-			submitEventSync(QStringLiteral("awaitLogin"));
+			if(!resumeRejected) //already logging in
+				submitEventSync(QStringLiteral("awaitLogin"));
 			logDebug() << "Sent login message for device id" << _deviceId;
+		} else if(_cryptoController->isGeneratingKeys()) {
+			//continue once the keys are ready, instead of blocking the engine by generating them again
+			_pendingIdentify = QSharedPointer<IdentifyMessage>::create(message);
+			emit generatingKeysChanged(true);
+			logDebug() << "Waiting for the background key generation to finish before registering";
 		} else {
 			_cryptoController->createPrivateKeys(message.nonce);
 			auto crypto = _cryptoController->crypto();
@@ -991,6 +1430,17 @@ void RemoteConnector::onIdentify(const IdentifyMessage &message)
 	}
 }
 
+void RemoteConnector::keyGenerationChanged(bool generating)
+{
+	if(generating || !_pendingIdentify)
+		return;
+
+	auto message = *_pendingIdentify;
+	_pendingIdentify.reset();
+	emit generatingKeysChanged(false);
+	onIdentify(message);
+}
+
 void RemoteConnector::onAccount(const AccountMessage &message, bool checkState)
 {
 	if(checkState && !_stateMachine->isActive(QStringLiteral("Registering"))) {
@@ -1009,13 +1459,58 @@ void RemoteConnector::onAccount(const AccountMessage &message, bool checkState)
 	}
 }
 
+void RemoteConnector::onSession(const SessionMessage &message)
+{
+	//is always sent right before the account, welcome or grant message
+	if(!_stateMachine->isActive(QStringLiteral("Registering")) &&
+	   !_stateMachine->isActive(QStringLiteral("LoggingIn")) &&
+	   !_stateMachine->isActive(QStringLiteral("Granting"))) {
+		logWarning() << "Unexpected SessionMessage";
+		triggerError(true);
+	} else {
+		auto key = _cryptoController->crypto()->decrypt(message.key);
+		if(key.size() != SessionMessage::KeySize) {
+			logWarning() << "Received session key with invalid size";
+			triggerError(true);
+			return;
+		}
+		_sessionKey.Assign(reinterpret_cast<const byte*>(key.constData()), static_cast<size_t>(key.size()));
+		_sessionSequence = 0;
+		key.fill('\0');
+		logDebug() << "Established authenticated session";
+	}
+}
+
+void RemoteConnector::onTicket(const TicketMessage &message)
+{
+	//is always sent right after the session message
+	if(_sessionKey.empty() ||
+	   (!_stateMachine->isActive(QStringLiteral("Registering")) &&
+		!_stateMachine->isActive(QStringLiteral("LoggingIn")) &&
+		!_stateMachine->isActive(QStringLiteral("Granting")))) {
+		logWarning() << "Unexpected TicketMessage";
+		triggerError(true);
+	} else {
+		//only kept in memory, the session key is the secret to resume with it
+		_resumeTicket = message.ticket;
+		_resumeKey = _sessionKey;
+		_resumeDeadline.setRemainingTime(static_cast<qint64>(message.lifetime) * 1000, Qt::VeryCoarseTimer);
+		_resumeUrl = sValue(keyRemoteUrl).toUrl();
+		logDebug() << "Received resumption ticket, valid for" << message.lifetime << "seconds";
+	}
+}
+
 void RemoteConnector::onWelcome(const WelcomeMessage &message)
 {
 	if(!_stateMachine->isActive(QStringLiteral("LoggingIn"))) {
 		logWarning() << "Unexpected WelcomeMessage";
 		triggerError(true);
 	} else {
-		logDebug() << "Login successful";
+		if(_resuming) {
+			_resuming = false;
+			logDebug() << "Session resumed";
+		} else
+			logDebug() << "Login successful";
 		// reset retry index only after successfuly account creation or login
 		_expectChanges = message.hasChanges;
 		submitEventSync(QStringLiteral("account"));
@@ -1061,24 +1556,93 @@ void RemoteConnector::onChangeAck(const ChangeAckMessage &message)
 		emit uploadDone(message.dataId);
 }
 
+void RemoteConnector::onChangeBatchAck(const ChangeBatchAckMessage &message)
+{
+	if(checkIdle(message)) {
+		for(const auto &dataId : message.dataIds)
+			emit uploadDone(dataId);
+	}
+}
+
 void RemoteConnector::onDeviceChangeAck(const DeviceChangeAckMessage &message)
 {
 	if(checkIdle(message))
 		emit deviceUploadDone(message.dataId, message.deviceId);
 }
 
-void RemoteConnector::onChanged(const ChangedMessage &message)
+void RemoteConnector::onChanged(const ChangedMessage &message, const QByteArray &frame)
 {
 	if(checkIdle(message)) {
-		auto data = _cryptoController->decryptData(message.keyIndex,
-												   message.salt,
-												   message.data);
 		beginOp();//start download timeout
-		emit downloadData(message.dataIndex, data);
+		decodeDownload(message.dataIndex,
+					   message.keyIndex,
+					   message.salt,
+					   message.data,
+					   frame);
+	}
+}
+
+void RemoteConnector::onChangeChunkAck(const ChangeChunkAckMessage &message)
+{
+	if(!checkIdle(message))
+		return;
+
+	auto it = _chunkedUploads.find(message.dataId);
+	if(it == _chunkedUploads.end() || it->salt != message.salt) {
+		logWarning() << "Ignoring chunk ack for unknown upload" << message.dataId.toHex();
+		return;
+	}
+
+	if(message.nextChunk >= it->chunkCount) {
+		_chunkedUploads.erase(it);
+		emit uploadDone(message.dataId);
+	} else {
+		try {
+			sendChunk(message.dataId, message.nextChunk);
+		} catch(Exception &e) {
+			onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<ChangeChunkMessage>());
+		}
+	}
+}
+
+void RemoteConnector::onChangedChunk(const ChangedChunkMessage &message)
+{
+	if(!checkIdle(message))
+		return;
+
+	beginOp();//start download timeout
+	if(message.changeEstimate > 0) { //first change of a download, just like onChangedInfo
+		logDebug() << "Started downloading, estimated changes:" << message.changeEstimate;
+		emit remoteEvent(RemoteReadyWithChanges);
+		emit progressAdded(message.changeEstimate);
+	}
+
+	//a different salt means a new version of the change, so a partial one cannot be resumed
+	auto &download = _chunkedDownloads[message.dataIndex];
+	if(download.salt != message.salt || download.chunkCount != message.chunkCount)
+		download = {message.keyIndex, message.salt, {}, message.chunkCount, 0};
+	//only append the expected chunk - the server starts with the first one when resuming
+	if(message.chunkIndex == download.received) {
+		download.data.append(message.data);
+		download.received++;
+	}
+
+	try {
+		sendMessage(ChangedChunkAckMessage{message.dataIndex, download.received});
+		if(download.received == download.chunkCount) {
+			auto complete = _chunkedDownloads.take(message.dataIndex);
+			decodeDownload(message.dataIndex,
+						   complete.keyIndex,
+						   complete.salt,
+						   complete.data,
+						   {});
+		}
+	} catch(Exception &e) {
+		onError({ErrorMessage::ClientError, e.qWhat()}, Message::messageName<ChangedChunkAckMessage>());
 	}
 }
 
-void RemoteConnector::onChangedInfo(const ChangedInfoMessage &message)
+void RemoteConnector::onChangedInfo(const ChangedInfoMessage &message, const QByteArray &frame)
 {
 	if(checkIdle(message)) {
 		logDebug() << "Started downloading, estimated changes:" << message.changeEstimate;
@@ -1086,7 +1650,18 @@ void RemoteConnector::onChangedInfo(const ChangedInfoMessage &message)
 		emit remoteEvent(RemoteReadyWithChanges);
 		emit progressAdded(message.changeEstimate);
 		//parse as usual
-		onChanged(message);
+		onChanged(message, frame);
+	}
+}
+
+void RemoteConnector::onChangedBatch(const ChangedBatchMessage &message, const QByteArray &frame)
+{
+	if(checkIdle(message)) {
+		beginOp();//start download timeout
+		//with priorities, the whole batch must be decoded before it can be sorted
+		auto groupEnd = _typePriorities.isEmpty() ? 0 : _decodeIndex + static_cast<quint64>(message.changes.size()) - 1;
+		for(const auto &change : message.changes)
+			decodeDownload(get<0>(change), get<1>(change), get<2>(change), get<3>(change), frame, groupEnd);
 	}
 }
 
@@ -1098,6 +1673,8 @@ void RemoteConnector::onLastChanged(const LastChangedMessage &message)
 		logDebug() << "Completed downloading changes";
 		endOp(); //downloads done
 		emit remoteEvent(RemoteReady); //back to normal
+		if(_treeEnabled) //keep the servers copy of the tree up to date
+			sendTree(false);
 	}
 }
 
@@ -1133,7 +1710,7 @@ void RemoteConnector::onRemoveAck(const RemoveAckMessage &message)
 	}
 }
 
-void RemoteConnector::onProof(const ProofMessage &message)
+void RemoteConnector::onProof(const ProofMessage &message, bool snapshotSupport)
 {
 	if(checkIdle(message)) {
 		try {
@@ -1160,6 +1737,11 @@ void RemoteConnector::onProof(const ProofMessage &message)
 
 			//all verifications accepted
 			_activeProofs.insert(message.deviceId, cryptInfo);
+			//the server only reports the version of the new device if it supports snapshots itself
+			if(snapshotSupport)
+				_snapshotDevices.insert(message.deviceId);
+			else
+				_snapshotDevices.remove(message.deviceId);
 			if(trusted) {//trusted -> ready to go, send back the accept
 				logInfo() << "Accepted trusted import proof request for device" << message.deviceId;
 				loginReply(message.deviceId, true);
@@ -1173,6 +1755,7 @@ void RemoteConnector::onProof(const ProofMessage &message)
 			auto deviceId = message.deviceId;
 			QTimer::singleShot(scdtime(minutes(10)), Qt::VeryCoarseTimer, this, [this, deviceId]() {
 				if(_activeProofs.remove(deviceId) > 0) {
+					_snapshotDevices.remove(deviceId);
 					logInfo() << "Rejecting ProofMessage after timeout";
 					sendMessage(DenyMessage{deviceId});
 				}
@@ -1187,6 +1770,8 @@ void RemoteConnector::onProof(const ProofMessage &message)
 void RemoteConnector::onAcceptAck(const AcceptAckMessage &message)
 {
 	if(checkIdle(message)) {
+		//must be known before the changes for the new device are queued
+		emit updateSnapshotSupport(message.deviceId, _snapshotDevices.remove(message.deviceId));
 		emit accountAccessGranted(message.deviceId);
 		logInfo() << "Granted access to account for device" << message.deviceId;
 	}
@@ -1239,7 +1824,7 @@ void RemoteConnector::onDeviceKeys(const DeviceKeysMessage &message)
 				}
 			}
 
-			sendSignedMessage(reply);
+			sendAuthenticatedMessage(reply);
 			logDebug() << "Sent exchange key update to server";
 		}
 	}
@@ -1253,6 +1838,26 @@ void RemoteConnector::onNewKeyAck(const NewKeyAckMessage &message)
 	}
 }
 
+void RemoteConnector::onTreeDiff(const TreeDiffMessage &message)
+{
+	if(checkIdle(message)) {
+		if(message.buckets.isEmpty())
+			logDebug() << "Sync tree matches all other devices";
+		else if(_store) {
+			logDebug() << "Sync tree diverged in" << message.buckets.size() << "buckets. Uploading their entries";
+			_store->markTreeChanged(message.buckets);
+		}
+	}
+}
+
+void RemoteConnector::onResend(const ResendMessage &message)
+{
+	if(checkIdle(message)) {
+		logDebug() << "Other devices could not apply" << message.dataIds.size() << "delta changes. Uploading them completely";
+		emit completeUploadsRequested(message.dataIds);
+	}
+}
+
 
 
 QByteArray ExportData::signData() const
@@ -1261,3 +1866,14 @@ QByteArray ExportData::signData() const
 			partnerId.toRfc4122() +
 			scheme;
 }
+
+
+
+DownloadRunnable::DownloadRunnable(std::function<void()> fn) :
+	_fn{std::move(fn)}
+{}
+
+void DownloadRunnable::run()
+{
+	_fn();
+}
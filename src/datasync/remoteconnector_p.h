@@ -6,7 +6,10 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QUuid>
+#include <QtCore/QSet>
 #include <QtCore/QTimer>
+#include <QtCore/QThreadPool>
+#include <QtCore/QDeadlineTimer>
 
 #include <QtWebSockets/QWebSocket>
 
@@ -15,6 +18,9 @@
 #include "defaults.h"
 #include "cryptocontroller_p.h"
 #include "accountmanager.h"
+#include "typepriorities_p.h"
+#include "synchelper_p.h"
+#include "localstore_p.h"
 
 #include "errormessage_p.h"
 #include "identifymessage_p.h"
@@ -30,6 +36,9 @@
 #include "macupdatemessage_p.h"
 #include "devicekeysmessage_p.h"
 #include "newkeymessage_p.h"
+#include "treemessage_p.h"
+#include "chunkmessage_p.h"
+#include "sessionmessage_p.h"
 
 class ConnectorStateMachine;
 
@@ -73,6 +82,7 @@ public:
 	static const QString keyImportScheme;
 	static const QString keyImportCmac;
 	static const QString keySendCmac;
+	static const QString keyReconcile;
 
 	enum RemoteEvent {
 		RemoteDisconnected,
@@ -102,7 +112,7 @@ public Q_SLOTS:
 
 	void listDevices();
 	void removeDevice(QUuid deviceId);
-	void resetAccount(bool removeConfig);
+	void resetAccount(bool removeConfig, bool keepData = false);
 	void changeRemote(const RemoteConfig &config);
 	void prepareImport(const ExportData &data, const CryptoPP::SecByteBlock &key);
 	void loginReply(QUuid deviceId, bool accept);
@@ -111,7 +121,11 @@ public Q_SLOTS:
 
 	void uploadData(const QByteArray &key, const QByteArray &changeData);
 	void uploadDeviceData(const QByteArray &key, QUuid deviceId, const QByteArray &changeData);
+	void uploadEncryptedData(const QByteArray &key, quint32 keyIndex, const QByteArray &salt, const QByteArray &data);
+	void uploadEncryptedDeltaData(const QByteArray &key, quint32 keyIndex, const QByteArray &salt, const QByteArray &data);
+	void uploadEncryptedDeviceData(const QByteArray &key, QUuid deviceId, quint32 keyIndex, const QByteArray &salt, const QByteArray &data);
 	void downloadDone(const quint64 key);
+	void downloadRejected(const quint64 key);
 
 	void setSyncEnabled(bool syncEnabled);
 	void setDeviceName(const QString &deviceName);
@@ -121,11 +135,17 @@ Q_SIGNALS:
 	void finalized();
 
 	void updateUploadLimit(quint32 limit);
+	void updateDeltaSupport(bool supported);
+	void updateSnapshotSupport(const QUuid &deviceId, bool supported);
 	void remoteEvent(RemoteEvent event);
+	void generatingKeysChanged(bool generating);
 
 	void uploadDone(const QByteArray &key);
 	void deviceUploadDone(const QByteArray &key, const QUuid &deviceId);
+	void completeUploadsRequested(const QList<QByteArray> &keys);
 	void downloadData(const quint64 key, const QByteArray &changeData);
+	void downloadParsed(const quint64 key, const QtDataSync::SyncHelper::ChangeData &change);
+	void downloadSnapshot(const quint64 key, const QList<QtDataSync::SyncHelper::ChangeData> &changes);
 
 	void syncEnabledChanged(bool syncEnabled);
 	void deviceNameChanged(const QString &deviceName);
@@ -142,6 +162,7 @@ private Q_SLOTS:
 	void sslErrors(const QList<QSslError> &errors);
 	void ping();
 	void tryClose();
+	void flushChanges();
 
 	//statemachine
 	void doConnect();
@@ -152,9 +173,40 @@ private Q_SLOTS:
 	void machineReady();
 
 private:
+	//decrypted and parsed on the download pool
+	struct DecodedDownload {
+		quint64 dataIndex = 0;
+		quint64 groupEnd = 0; //last index that must be decoded before this one can be passed on
+		int priority = 0;
+		QByteArray data;
+		bool parsed = false;
+		SyncHelper::ChangeData change;
+		bool isSnapshot = false;
+		QList<SyncHelper::ChangeData> snapshot;
+		QString error;
+	};
+
+	struct ChunkedUpload {
+		quint32 keyIndex;
+		QByteArray salt;
+		QByteArray data;
+		quint32 chunkCount;
+	};
+
+	struct ChunkedDownload {
+		quint32 keyIndex;
+		QByteArray salt;
+		QByteArray data; //all chunks received so far
+		quint32 chunkCount;
+		quint32 received;
+	};
+
 	static const QVector<std::chrono::seconds> Timeouts;
+	static const int MaxBatchSize;
+	static const int MaxPendingDownloads;
 
 	CryptoController *_cryptoController;
+	LocalStore *_store = nullptr;
 
 	QWebSocket *_socket = nullptr;
 	QQueue<QByteArray> _messageBuffer;
@@ -163,6 +215,30 @@ private:
 	QTimer *_pingTimer = nullptr;
 	bool _awaitingPing = false;
 
+	bool _batchEnabled = false;
+	bool _treeEnabled = false;
+	bool _chunkEnabled = false;
+	QHash<QByteArray, ChunkedUpload> _chunkedUploads;
+	QHash<quint64, ChunkedDownload> _chunkedDownloads;
+	CryptoPP::SecByteBlock _sessionKey; //replaces signatures of privileged messages, if the server supports it
+	quint64 _sessionSequence = 0;
+	QByteArray _resumeTicket; //lets reconnects skip the signed login, kept across reconnects
+	CryptoPP::SecByteBlock _resumeKey;
+	QDeadlineTimer _resumeDeadline;
+	QUrl _resumeUrl;
+	bool _resuming = false;
+	QSharedPointer<IdentifyMessage> _pendingIdentify; //registration waiting for the background key generation
+	QByteArray _reportedTree; //root of the last tree sent to the server
+	QTimer *_batchTimer = nullptr;
+	QList<ChangeBatchMessage::Change> _pendingChanges;
+	TypePriorities _typePriorities;
+
+	QThreadPool *_downloadPool;
+	quint64 _decodeIndex = 0;
+	quint64 _deliverIndex = 0;
+	QMap<quint64, DecodedDownload> _decodedDownloads;
+	bool _downloadsBlocked = false;
+
 	ConnectorStateMachine *_stateMachine = nullptr;
 	int _retryIndex = 0;
 	bool _expectChanges = false;
@@ -171,10 +247,13 @@ private:
 	QList<DeviceInfo> _deviceCache;
 	QHash<QByteArray, CryptoPP::SecByteBlock> _exportsCache;
 	QHash<QUuid, QSharedPointer<AsymmetricCryptoInfo>> _activeProofs;
+	QSet<QUuid> _snapshotDevices; //proofs of devices that can receive snapshots, until accepted
 
 	void sendMessage(const Message &message);
 	void sendSignedMessage(const Message &message);
+	void sendAuthenticatedMessage(const Message &message);
 
+	void processBufferedMessages();
 	bool isIdle() const;
 	bool checkIdle(const Message &message);
 	void triggerError(bool canRecover);
@@ -184,30 +263,46 @@ private:
 	bool loadIdentity();
 	std::chrono::seconds retry();
 	void clearCaches(bool includeExport);
+	void clearTicket();
+	bool canResume(const IdentifyMessage &message) const;
+	void clearDownloads();
 
 	QVariant sValue(const QString &key) const;
 	RemoteConfig loadConfig() const;
 	void storeConfig(const RemoteConfig &config);
 
 	void sendKeyUpdate();
+	void sendTree(bool reconcile);
+	void sendChunk(const QByteArray &key, quint32 chunkIndex);
+	void decodeDownload(quint64 dataIndex, quint32 keyIndex, const QByteArray &salt, const QByteArray &cipher, const QByteArray &frame, quint64 groupEnd = 0);
+	void downloadDecoded(quint64 index, const DecodedDownload &download);
 
 	void onError(const ErrorMessage &message, const QByteArray &messageName = {});
 	void onIdentify(const IdentifyMessage &message);
+	void keyGenerationChanged(bool generating);
 	void onAccount(const AccountMessage &message, bool checkState = true);
+	void onSession(const SessionMessage &message);
+	void onTicket(const TicketMessage &message);
 	void onWelcome(const WelcomeMessage &message);
 	void onGrant(const GrantMessage &message);
 	void onChangeAck(const ChangeAckMessage &message);
+	void onChangeBatchAck(const ChangeBatchAckMessage &message);
 	void onDeviceChangeAck(const DeviceChangeAckMessage &message);
-	void onChanged(const ChangedMessage &message);
-	void onChangedInfo(const ChangedInfoMessage &message);
+	void onChanged(const ChangedMessage &message, const QByteArray &frame);
+	void onChangeChunkAck(const ChangeChunkAckMessage &message);
+	void onChangedChunk(const ChangedChunkMessage &message);
+	void onChangedInfo(const ChangedInfoMessage &message, const QByteArray &frame);
+	void onChangedBatch(const ChangedBatchMessage &message, const QByteArray &frame);
 	void onLastChanged(const LastChangedMessage &message);
 	void onDevices(const DevicesMessage &message);
 	void onRemoveAck(const RemoveAckMessage &message);
-	void onProof(const ProofMessage &message);
+	void onProof(const ProofMessage &message, bool snapshotSupport = false);
 	void onAcceptAck(const AcceptAckMessage &message);
 	void onMacUpdateAck(const MacUpdateAckMessage &message);
 	void onDeviceKeys(const DeviceKeysMessage &message);
 	void onNewKeyAck(const NewKeyAckMessage &message);
+	void onTreeDiff(const TreeDiffMessage &message);
+	void onResend(const ResendMessage &message);
 };
 
 }
@@ -1,6 +1,8 @@
 #include "exchangerotransport_p.h"
 #include "exchangebuffer_p.h"
 #include "exchangebufferserver_p.h"
+#include "sharedmemorybuffer_p.h"
+#include "sharedmemorybufferserver_p.h"
 using namespace QtDataSync;
 
 bool ThreadedQtRoServer::prepareHostNode(const QUrl &url, QRemoteObjectHostBase *host)
@@ -29,3 +31,35 @@ bool ThreadedQtRoClient::prepareClientNode(const QUrl &url, QRemoteObjectNode *n
 		return false;
 	}
 }
+
+bool SharedMemoryQtRoServer::prepareHostNode(const QUrl &url, QRemoteObjectHostBase *host)
+{
+	auto server = new SharedMemoryBufferServer{host};
+	if(server->listen(url))
+		return true;
+	else {
+		delete server;
+		return false;
+	}
+}
+
+bool SharedMemoryQtRoClient::prepareClientNode(const QUrl &url, QRemoteObjectNode *node)
+{
+	if(url.scheme() != SharedMemoryBuffer::UrlScheme() || !url.isValid()) {
+		qCCritical(rothreadedbackend).noquote() << "Unsupported URL-Scheme:" << url.scheme();
+		return false;
+	}
+
+	auto buffer = new SharedMemoryBuffer{node};
+	QObject::connect(buffer, &SharedMemoryBuffer::partnerConnected,
+					 node, [buffer, node]() {
+		node->addClientSideConnection(buffer);
+	});
+
+	if(buffer->connectTo(SharedMemoryBuffer::serverName(url)))
+		return true;
+	else {
+		delete buffer;
+		return false;
+	}
+}
@@ -18,6 +18,18 @@ public:
 	bool prepareClientNode(const QUrl &url, QRemoteObjectNode *node) override;
 };
 
+class SharedMemoryQtRoServer : public QtRoTransportRegistry::Server
+{
+public:
+	bool prepareHostNode(const QUrl &url, QRemoteObjectHostBase *host) override;
+};
+
+class SharedMemoryQtRoClient : public QtRoTransportRegistry::Client
+{
+public:
+	bool prepareClientNode(const QUrl &url, QRemoteObjectNode *node) override;
+};
+
 }
 
 #endif // THREADEDCLIENT_P_H
@@ -1,11 +1,15 @@
 HEADERS += \
 	$$PWD/exchangebuffer_p.h \
     $$PWD/exchangebufferserver_p.h \
-    $$PWD/exchangerotransport_p.h
+    $$PWD/exchangerotransport_p.h \
+    $$PWD/sharedmemorybuffer_p.h \
+    $$PWD/sharedmemorybufferserver_p.h
 
 SOURCES += \
 	$$PWD/exchangebuffer.cpp \
     $$PWD/exchangebufferserver.cpp \
-    $$PWD/exchangerotransport.cpp
+    $$PWD/exchangerotransport.cpp \
+    $$PWD/sharedmemorybuffer.cpp \
+    $$PWD/sharedmemorybufferserver.cpp
 
 INCLUDEPATH += $$PWD
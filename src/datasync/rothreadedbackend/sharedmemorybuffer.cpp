@@ -0,0 +1,313 @@
+#include "sharedmemorybuffer_p.h"
+
+#include <new>
+
+#include <QtCore/QUrlQuery>
+#include <QtCore/QUuid>
+#include <QtCore/QCryptographicHash>
+using namespace QtDataSync;
+
+// the rings are shared between processes, so the atomics must not depend on process local locks
+Q_STATIC_ASSERT_X(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_BOOL_LOCK_FREE == 2,
+				  "The shared memory transport requires lock free 64bit atomics");
+
+const char SharedMemoryBuffer::DataSignal = 'd';
+const char SharedMemoryBuffer::SpaceSignal = 's';
+
+const QString SharedMemoryBuffer::UrlScheme()
+{
+	static const QString urlScheme{QStringLiteral("shm")};
+	return urlScheme;
+}
+
+QString SharedMemoryBuffer::serverName(const QUrl &url)
+{
+	const auto name = url.authority() + url.path();
+	return QStringLiteral("qtdatasync-shm-") +
+			QString::fromLatin1(QCryptographicHash::hash(name.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+int SharedMemoryBuffer::ringCapacity(const QUrl &url)
+{
+	auto ok = false;
+	auto size = QUrlQuery{url}.queryItemValue(QStringLiteral("size")).toInt(&ok);
+	if(!ok || size <= 0)
+		size = 256 * 1024;
+	//round up to the next power of two, so positions can be masked
+	auto capacity = 4096;
+	while(capacity < size && capacity < (1 << 30))
+		capacity <<= 1;
+	return capacity;
+}
+
+SharedMemoryBuffer::SharedMemoryBuffer(QObject *parent) :
+	QIODevice{parent}
+{
+	connect(this, &SharedMemoryBuffer::partnerDisconnected,
+			this, &SharedMemoryBuffer::disconnected,
+			Qt::DirectConnection);
+}
+
+SharedMemoryBuffer::~SharedMemoryBuffer()
+{
+	if(isOpen())
+		close();
+}
+
+bool SharedMemoryBuffer::openHost(QLocalSocket *socket, int capacity)
+{
+	Q_ASSERT_X(socket, Q_FUNC_INFO, "socket must not be nullptr");
+	Q_ASSERT_X(capacity > 0 && (capacity & (capacity - 1)) == 0, Q_FUNC_INFO, "capacity must be a power of two");
+	if(_socket || isOpen()) {
+		setErrorString(tr("SharedMemoryBuffer already open"));
+		return false;
+	}
+
+	_socket = socket;
+	_socket->setParent(this);
+	connect(_socket, &QLocalSocket::readyRead,
+			this, &SharedMemoryBuffer::socketReady);
+	connect(_socket, &QLocalSocket::disconnected,
+			this, &SharedMemoryBuffer::socketClosed);
+
+	const auto key = QStringLiteral("qtdatasync-shm-") + QUuid::createUuid().toString(QUuid::WithoutBraces);
+	_memory = new QSharedMemory{key, this};
+	if(!_memory->create(static_cast<int>(sizeof(Segment)) + 2 * capacity)) {
+		setErrorString(_memory->errorString());
+		_socket->disconnectFromServer();
+		return false;
+	}
+
+	auto segment = new (_memory->data()) Segment{};
+	segment->capacity = static_cast<quint32>(capacity);
+	for(auto &ring : segment->rings) {
+		ring.readPos.store(0);
+		ring.writePos.store(0);
+		ring.dataSignaled.store(false);
+		ring.writerBlocked.store(false);
+	}
+	if(!setupRings(true)) {
+		_socket->disconnectFromServer();
+		return false;
+	}
+
+	_socket->write(key.toUtf8() + '\n');
+	_socket->flush();
+	return openInternal();
+}
+
+bool SharedMemoryBuffer::connectTo(const QString &serverName)
+{
+	if(_socket || isOpen()) {
+		setErrorString(tr("SharedMemoryBuffer already open"));
+		return false;
+	}
+
+	_socket = new QLocalSocket{this};
+	connect(_socket, &QLocalSocket::readyRead,
+			this, &SharedMemoryBuffer::socketReady);
+	connect(_socket, &QLocalSocket::disconnected,
+			this, &SharedMemoryBuffer::socketClosed);
+	connect(_socket, QOverload<QLocalSocket::LocalSocketError>::of(&QLocalSocket::error),
+			this, [this](QLocalSocket::LocalSocketError error) {
+		if(error != QLocalSocket::PeerClosedError) {
+			qCWarning(rothreadedbackend).noquote() << "Shared memory wakeup socket failed with error:"
+												   << _socket->errorString();
+		}
+	});
+	_socket->connectToServer(serverName);
+	return true;
+}
+
+bool SharedMemoryBuffer::isSequential() const
+{
+	return true;
+}
+
+void SharedMemoryBuffer::close()
+{
+	_pending.clear();
+	QIODevice::close();
+	if(_socket)
+		_socket->disconnectFromServer();
+	_readRing = nullptr;
+	_readData = nullptr;
+	_writeRing = nullptr;
+	_writeData = nullptr;
+	if(_memory)
+		_memory->detach();
+	emit partnerDisconnected({});
+}
+
+qint64 SharedMemoryBuffer::bytesAvailable() const
+{
+	auto size = QIODevice::bytesAvailable();
+	if(_readRing)
+		size += static_cast<qint64>(_readRing->writePos.load() - _readRing->readPos.load());
+	return size;
+}
+
+qint64 SharedMemoryBuffer::readData(char *data, qint64 maxlen)
+{
+	if(!_readRing || maxlen <= 0)
+		return 0;
+
+	const auto rPos = _readRing->readPos.load(std::memory_order_relaxed);
+	const auto wPos = _readRing->writePos.load(std::memory_order_acquire);
+	const auto size = qMin<quint64>(wPos - rPos, static_cast<quint64>(maxlen));
+	if(size == 0)
+		return 0;
+
+	const auto offset = rPos & _mask;
+	const auto first = qMin<quint64>(size, (_mask + 1) - offset);
+	memcpy(data, _readData + offset, static_cast<size_t>(first));
+	memcpy(data + first, _readData, static_cast<size_t>(size - first));
+	_readRing->readPos.store(rPos + size, std::memory_order_release);
+
+	if(_readRing->writerBlocked.exchange(false))
+		signalPartner(SpaceSignal);
+	return static_cast<qint64>(size);
+}
+
+qint64 SharedMemoryBuffer::writeData(const char *data, qint64 len)
+{
+	if(len <= 0 || !_writeRing)
+		return 0;
+
+	if(_pending.isEmpty()) {
+		auto written = writeRing(data, len);
+		if(written < len)
+			_pending.append(data + written, static_cast<int>(len - written));
+	} else
+		_pending.append(data, static_cast<int>(len));
+	flushPending();
+	return len;
+}
+
+void SharedMemoryBuffer::socketReady()
+{
+	if(!isOpen()) {
+		// client handshake: the first line contains the key of the segment created by the host
+		if(!_socket->canReadLine())
+			return;
+		const auto key = QString::fromUtf8(_socket->readLine().trimmed());
+		_memory = new QSharedMemory{key, this};
+		if(!_memory->attach() || !setupRings(false)) {
+			qCWarning(rothreadedbackend).noquote() << "Failed to attach to shared memory segment with error:"
+												   << _memory->errorString();
+			_socket->disconnectFromServer();
+			return;
+		}
+		if(!openInternal())
+			return;
+	}
+
+	auto hasData = false;
+	auto hasSpace = false;
+	for(const auto code : _socket->readAll()) {
+		if(code == DataSignal)
+			hasData = true;
+		else if(code == SpaceSignal)
+			hasSpace = true;
+	}
+
+	if(hasSpace)
+		flushPending();
+	if(hasData && _readRing) {
+		//clear before reading, so writes after this point will signal again
+		_readRing->dataSignaled.store(false);
+		emit readyRead();
+	}
+}
+
+void SharedMemoryBuffer::socketClosed()
+{
+	if(isOpen())
+		close();
+}
+
+bool SharedMemoryBuffer::open(QIODevice::OpenMode mode)
+{
+	Q_UNUSED(mode);
+	return false;
+}
+
+bool SharedMemoryBuffer::setupRings(bool isHost)
+{
+	const auto minSize = static_cast<int>(sizeof(Segment));
+	if(_memory->size() < minSize) {
+		setErrorString(tr("Shared memory segment is too small"));
+		return false;
+	}
+
+	auto segment = static_cast<Segment*>(_memory->data());
+	const quint64 capacity = segment->capacity;
+	if(capacity == 0 ||
+	   (capacity & (capacity - 1)) != 0 ||
+	   static_cast<quint64>(_memory->size()) < minSize + 2 * capacity) {
+		setErrorString(tr("Shared memory segment has an invalid ring capacity"));
+		return false;
+	}
+
+	auto base = static_cast<char*>(_memory->data()) + minSize;
+	_mask = capacity - 1;
+	// host writes to ring 0 and reads from ring 1 - the client does it the other way around
+	_writeRing = &segment->rings[isHost ? 0 : 1];
+	_writeData = base + (isHost ? 0 : capacity);
+	_readRing = &segment->rings[isHost ? 1 : 0];
+	_readData = base + (isHost ? capacity : 0);
+	return true;
+}
+
+bool SharedMemoryBuffer::openInternal()
+{
+	if(QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+		emit partnerConnected({});
+		return true;
+	} else {
+		_socket->disconnectFromServer();
+		return false;
+	}
+}
+
+qint64 SharedMemoryBuffer::writeRing(const char *data, qint64 len)
+{
+	const auto wPos = _writeRing->writePos.load(std::memory_order_relaxed);
+	const auto rPos = _writeRing->readPos.load(std::memory_order_acquire);
+	const auto size = qMin<quint64>((_mask + 1) - (wPos - rPos), static_cast<quint64>(len));
+	if(size == 0)
+		return 0;
+
+	const auto offset = wPos & _mask;
+	const auto first = qMin<quint64>(size, (_mask + 1) - offset);
+	memcpy(_writeData + offset, data, static_cast<size_t>(first));
+	memcpy(_writeData, data + first, static_cast<size_t>(size - first));
+	_writeRing->writePos.store(wPos + size, std::memory_order_release);
+
+	if(!_writeRing->dataSignaled.exchange(true))
+		signalPartner(DataSignal);
+	return static_cast<qint64>(size);
+}
+
+void SharedMemoryBuffer::flushPending()
+{
+	if(_pending.isEmpty() || !_writeRing)
+		return;
+
+	auto written = writeRing(_pending.constData(), _pending.size());
+	_pending.remove(0, static_cast<int>(written));
+	if(!_pending.isEmpty()) {
+		_writeRing->writerBlocked.store(true);
+		// retry once, in case the reader drained the ring before it could see the flag
+		written = writeRing(_pending.constData(), _pending.size());
+		_pending.remove(0, static_cast<int>(written));
+	}
+}
+
+void SharedMemoryBuffer::signalPartner(char code)
+{
+	if(!_socket || _socket->state() != QLocalSocket::ConnectedState)
+		return;
+	_socket->write(&code, 1);
+	_socket->flush();
+}
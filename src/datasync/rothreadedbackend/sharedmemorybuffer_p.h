@@ -0,0 +1,86 @@
+#ifndef SHAREDMEMORYBUFFER_P_H
+#define SHAREDMEMORYBUFFER_P_H
+
+#include <atomic>
+
+#include <QtCore/QIODevice>
+#include <QtCore/QSharedMemory>
+#include <QtCore/QUrl>
+
+#include <QtNetwork/QLocalSocket>
+
+#include "qtdatasync_global.h"
+#include "exchangebuffer_p.h"
+
+namespace QtDataSync {
+
+class Q_DATASYNC_EXPORT SharedMemoryBuffer : public QIODevice
+{
+	Q_OBJECT
+
+public:
+	static const QString UrlScheme();
+	static QString serverName(const QUrl &url);
+	static int ringCapacity(const QUrl &url);
+
+	explicit SharedMemoryBuffer(QObject *parent = nullptr);
+	~SharedMemoryBuffer() override;
+
+	//host side: creates the segment and passes its key to the already connected socket
+	bool openHost(QLocalSocket *socket, int capacity);
+	//client side: connects to the server and waits for the segment key
+	bool connectTo(const QString &serverName);
+
+	bool isSequential() const override;
+	void close() override;
+	qint64 bytesAvailable() const override;
+
+Q_SIGNALS:
+	void partnerConnected(QPrivateSignal);
+	void partnerDisconnected(QPrivateSignal);
+	void disconnected(QPrivateSignal); //alias signal of partnerDisconnected for remote objects (naming convention)
+
+protected:
+	qint64 readData(char *data, qint64 maxlen) override;
+	qint64 writeData(const char *data, qint64 len) override;
+
+private Q_SLOTS:
+	void socketReady();
+	void socketClosed();
+
+private:
+	struct Ring {
+		std::atomic<quint64> readPos;
+		std::atomic<quint64> writePos;
+		std::atomic<bool> dataSignaled;
+		std::atomic<bool> writerBlocked;
+	};
+
+	struct Segment {
+		quint32 capacity;
+		Ring rings[2];
+	};
+
+	static const char DataSignal;
+	static const char SpaceSignal;
+
+	QLocalSocket *_socket = nullptr;
+	QSharedMemory *_memory = nullptr;
+	quint64 _mask = 0;
+	Ring *_readRing = nullptr;
+	char *_readData = nullptr;
+	Ring *_writeRing = nullptr;
+	char *_writeData = nullptr;
+	QByteArray _pending;
+
+	bool open(OpenMode mode) override;
+	bool setupRings(bool isHost);
+	bool openInternal();
+	qint64 writeRing(const char *data, qint64 len);
+	void flushPending();
+	void signalPartner(char code);
+};
+
+}
+
+#endif // SHAREDMEMORYBUFFER_P_H
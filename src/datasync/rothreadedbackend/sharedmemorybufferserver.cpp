@@ -0,0 +1,58 @@
+#include "sharedmemorybufferserver_p.h"
+using namespace QtDataSync;
+
+SharedMemoryBufferServer::SharedMemoryBufferServer(QRemoteObjectHostBase *host) :
+	QObject{host},
+	_host{host},
+	_server{new QLocalServer{this}}
+{
+	connect(_server, &QLocalServer::newConnection,
+			this, &SharedMemoryBufferServer::addConnection);
+}
+
+bool SharedMemoryBufferServer::listen(const QUrl &url)
+{
+	if(url.scheme() != SharedMemoryBuffer::UrlScheme() || !url.isValid()) {
+		qCCritical(rothreadedbackend).noquote() << "Unsupported URL-Scheme:" << url.scheme();
+		return false;
+	}
+
+	_server->close();
+	_capacity = SharedMemoryBuffer::ringCapacity(url);
+	const auto name = SharedMemoryBuffer::serverName(url);
+	_server->setSocketOptions(QLocalServer::UserAccessOption);
+	if(!_server->listen(name)) {
+		if(_server->serverError() != QAbstractSocket::AddressInUseError) {
+			qCWarning(rothreadedbackend).noquote() << "Failed to listen for shared memory connections on"
+												   << url.toString() << "with error:" << _server->errorString();
+			return false;
+		}
+
+		// remains of a crashed instance - remove them and try again
+		qCDebug(rothreadedbackend).noquote() << "Removing stale shared memory server for:" << url.toString();
+		QLocalServer::removeServer(name);
+		if(!_server->listen(name)) {
+			qCWarning(rothreadedbackend).noquote() << "Failed to listen for shared memory connections on"
+												   << url.toString() << "with error:" << _server->errorString();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void SharedMemoryBufferServer::addConnection()
+{
+	while(_server->hasPendingConnections()) {
+		auto socket = _server->nextPendingConnection();
+		auto hostBuffer = new SharedMemoryBuffer{_host};
+		if(!hostBuffer->openHost(socket, _capacity)) {
+			qCWarning(rothreadedbackend).noquote() << "Failed to create shared memory buffer with error:"
+												   << hostBuffer->errorString();
+			hostBuffer->deleteLater();
+			continue;
+		}
+
+		_host->addHostSideConnection(hostBuffer);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef SHAREDMEMORYBUFFERSERVER_P_H
+#define SHAREDMEMORYBUFFERSERVER_P_H
+
+#include <QtCore/QUrl>
+
+#include <QtNetwork/QLocalServer>
+
+#include "qtdatasync_global.h"
+#include "sharedmemorybuffer_p.h"
+#include "qtrotransportregistry.h"
+
+namespace QtDataSync {
+
+class Q_DATASYNC_EXPORT SharedMemoryBufferServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit SharedMemoryBufferServer(QRemoteObjectHostBase *host);
+
+	bool listen(const QUrl &url);
+
+private Q_SLOTS:
+	void addConnection();
+
+private:
+	QRemoteObjectHostBase *_host;
+	QLocalServer *_server;
+	int _capacity = 0;
+};
+
+}
+
+#endif // SHAREDMEMORYBUFFERSERVER_P_H
@@ -210,6 +210,31 @@ Setup::EventMode Setup::eventLoggingMode() const
 	return d->properties.value(Defaults::EventLoggingMode).value<EventMode>();
 }
 
+bool Setup::deltaUploads() const
+{
+	return d->properties.value(Defaults::DeltaUploads).toBool();
+}
+
+int Setup::compressionLevel() const
+{
+	return d->properties.value(Defaults::CompressionLevel).toInt();
+}
+
+bool Setup::binaryPayloads() const
+{
+	return d->properties.value(Defaults::BinaryPayloads).toBool();
+}
+
+QVariantHash Setup::uploadDebounce() const
+{
+	return d->properties.value(Defaults::UploadDebounce).toHash();
+}
+
+QVariantHash Setup::typePriorities() const
+{
+	return d->properties.value(Defaults::TypePriorities).toHash();
+}
+
 Setup &Setup::setLocalDir(QString localDir)
 {
 	d->localDir = std::move(localDir);
@@ -319,6 +344,36 @@ Setup &Setup::setEventLoggingMode(Setup::EventMode eventLoggingMode)
 	return *this;
 }
 
+Setup &Setup::setDeltaUploads(bool deltaUploads)
+{
+	d->properties.insert(Defaults::DeltaUploads, deltaUploads);
+	return *this;
+}
+
+Setup &Setup::setCompressionLevel(int compressionLevel)
+{
+	d->properties.insert(Defaults::CompressionLevel, qBound(-1, compressionLevel, 9));
+	return *this;
+}
+
+Setup &Setup::setBinaryPayloads(bool binaryPayloads)
+{
+	d->properties.insert(Defaults::BinaryPayloads, binaryPayloads);
+	return *this;
+}
+
+Setup &Setup::setUploadDebounce(QVariantHash uploadDebounce)
+{
+	d->properties.insert(Defaults::UploadDebounce, std::move(uploadDebounce));
+	return *this;
+}
+
+Setup &Setup::setTypePriorities(QVariantHash typePriorities)
+{
+	d->properties.insert(Defaults::TypePriorities, std::move(typePriorities));
+	return *this;
+}
+
 Setup &Setup::resetLocalDir()
 {
 	d->localDir = SetupPrivate::DefaultLocalDir;
@@ -424,6 +479,36 @@ Setup &Setup::resetEventLoggingMode()
 	return setEventLoggingMode(EventMode::Unchanged);
 }
 
+Setup &Setup::resetDeltaUploads()
+{
+	d->properties.insert(Defaults::DeltaUploads, false);
+	return *this;
+}
+
+Setup &Setup::resetCompressionLevel()
+{
+	d->properties.insert(Defaults::CompressionLevel, 0);
+	return *this;
+}
+
+Setup &Setup::resetBinaryPayloads()
+{
+	d->properties.insert(Defaults::BinaryPayloads, false);
+	return *this;
+}
+
+Setup &Setup::resetUploadDebounce()
+{
+	d->properties.insert(Defaults::UploadDebounce, QVariantHash{});
+	return *this;
+}
+
+Setup &Setup::resetTypePriorities()
+{
+	d->properties.insert(Defaults::TypePriorities, QVariantHash{});
+	return *this;
+}
+
 Setup &Setup::setAccount(const QJsonObject &importData, bool keepData, bool allowFailure)
 {
 	d->initialImport = ExchangeEngine::ImportData {
@@ -637,7 +722,12 @@ SetupPrivate::SetupPrivate() :
 		{Defaults::SignScheme, Setup::ECDSA_ECP_SHA3_512},
 		{Defaults::CryptScheme, Setup::ECIES_ECP_SHA3_512},
 		{Defaults::SymScheme, Setup::AES_EAX},
-		{Defaults::EventLoggingMode, QVariant::fromValue(Setup::EventMode::Unchanged)}
+		{Defaults::EventLoggingMode, QVariant::fromValue(Setup::EventMode::Unchanged)},
+		{Defaults::DeltaUploads, false},
+		{Defaults::CompressionLevel, 0},
+		{Defaults::UploadDebounce, QVariantHash{}},
+		{Defaults::TypePriorities, QVariantHash{}},
+		{Defaults::BinaryPayloads, false}
 	}
 {}
 
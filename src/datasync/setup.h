@@ -7,6 +7,7 @@
 #include <QtCore/qobject.h>
 #include <QtCore/qlogging.h>
 #include <QtCore/qurl.h>
+#include <QtCore/qvariant.h>
 class QLockFile;
 
 #include <QtNetwork/qsslconfiguration.h>
@@ -97,6 +98,16 @@ class Q_DATASYNC_EXPORT Setup
 	Q_PROPERTY(qint32 cipherKeySize READ cipherKeySize WRITE setCipherKeySize RESET resetCipherKeySize) //MAJOR make uint
 	//! The logging mode for database change events
 	Q_PROPERTY(EventMode eventLoggingMode READ eventLoggingMode WRITE setEventLoggingMode RESET resetEventLoggingMode REVISION 2)
+	//! Specifies whether changes may be uploaded as patches against the last synchronized version
+	Q_PROPERTY(bool deltaUploads READ deltaUploads WRITE setDeltaUploads RESET resetDeltaUploads REVISION 2)
+	//! The zlib compression level used for data before it gets encrypted
+	Q_PROPERTY(int compressionLevel READ compressionLevel WRITE setCompressionLevel RESET resetCompressionLevel REVISION 2)
+	//! Specifies whether data is serialized as binary CBOR instead of JSON text before it gets encrypted
+	Q_PROPERTY(bool binaryPayloads READ binaryPayloads WRITE setBinaryPayloads RESET resetBinaryPayloads REVISION 2)
+	//! The time in milliseconds, per type, that changes must be stable before they are uploaded
+	Q_PROPERTY(QVariantHash uploadDebounce READ uploadDebounce WRITE setUploadDebounce RESET resetUploadDebounce REVISION 2)
+	//! The priorities of the types, which determine in what order changes are synchronized
+	Q_PROPERTY(QVariantHash typePriorities READ typePriorities WRITE setTypePriorities RESET resetTypePriorities REVISION 2)
 
 public:
 	//! Typedef of an error handler function. See Setup::fatalErrorHandler
@@ -133,6 +144,9 @@ public:
 		SERPENT_EAX, //!< Serpent operating in EAX authenticated encryption mode
 		SERPENT_GCM, //!< Serpent operating in GCM authenticated encryption mode
 		IDEA_EAX, //!< IDEA operating in EAX authenticated encryption mode
+		CHACHA20_POLY1305, //!< ChaCha20 stream cipher with Poly1305 authentication (Requires at least crypto++ 8.1)
+		XCHACHA20_POLY1305, //!< XChaCha20 stream cipher (extended nonce) with Poly1305 authentication (Requires at least crypto++ 8.1)
+		AUTO_CIPHER //!< Picks the fastest available scheme for the current CPU when generating keys
 	};
 	Q_ENUM(CipherScheme)
 
@@ -237,6 +251,16 @@ public:
 	qint32 cipherKeySize() const;
 	//! @readAcFn{Setup::eventLoggingMode}
 	EventMode eventLoggingMode() const;
+	//! @readAcFn{Setup::deltaUploads}
+	bool deltaUploads() const;
+	//! @readAcFn{Setup::compressionLevel}
+	int compressionLevel() const;
+	//! @readAcFn{Setup::binaryPayloads}
+	bool binaryPayloads() const;
+	//! @readAcFn{Setup::uploadDebounce}
+	QVariantHash uploadDebounce() const;
+	//! @readAcFn{Setup::typePriorities}
+	QVariantHash typePriorities() const;
 
 	//! @writeAcFn{Setup::localDir}
 	Setup &setLocalDir(QString localDir);
@@ -274,6 +298,16 @@ public:
 	Setup &setCipherKeySize(qint32 cipherKeySize);
 	//! @writeAcFn{Setup::eventLoggingMode}
 	Setup &setEventLoggingMode(EventMode eventLoggingMode);
+	//! @writeAcFn{Setup::deltaUploads}
+	Setup &setDeltaUploads(bool deltaUploads);
+	//! @writeAcFn{Setup::compressionLevel}
+	Setup &setCompressionLevel(int compressionLevel);
+	//! @writeAcFn{Setup::binaryPayloads}
+	Setup &setBinaryPayloads(bool binaryPayloads);
+	//! @writeAcFn{Setup::uploadDebounce}
+	Setup &setUploadDebounce(QVariantHash uploadDebounce);
+	//! @writeAcFn{Setup::typePriorities}
+	Setup &setTypePriorities(QVariantHash typePriorities);
 
 	//! @resetAcFn{Setup::localDir}
 	Setup &resetLocalDir();
@@ -311,6 +345,16 @@ public:
 	Setup &resetCipherKeySize();
 	//! @resetAcFn{Setup::resetEventLoggingMode}
 	Setup &resetEventLoggingMode();
+	//! @resetAcFn{Setup::deltaUploads}
+	Setup &resetDeltaUploads();
+	//! @resetAcFn{Setup::compressionLevel}
+	Setup &resetCompressionLevel();
+	//! @resetAcFn{Setup::binaryPayloads}
+	Setup &resetBinaryPayloads();
+	//! @resetAcFn{Setup::uploadDebounce}
+	Setup &resetUploadDebounce();
+	//! @resetAcFn{Setup::typePriorities}
+	Setup &resetTypePriorities();
 
 	//! Sets an account to be imported on creation of the instance
 	Setup &setAccount(const QJsonObject &importData, bool keepData = false, bool allowFailure = false);
@@ -3,13 +3,25 @@
 #include "conflictresolver.h"
 
 using namespace QtDataSync;
+using std::tuple;
+using std::make_tuple;
+using std::get;
 using std::tie;
 
 #define QTDATASYNC_LOG QTDATASYNC_LOG_CONTROLLER
 
+const int SyncController::BatchDelay = 20;
+const int SyncController::MaxBatchSize = 500;
+
 SyncController::SyncController(const Defaults &defaults, QObject *parent) :
-	Controller{"sync", defaults, parent}
-{}
+	Controller{"sync", defaults, parent},
+	_batchTimer{new QTimer(this)}
+{
+	_batchTimer->setInterval(BatchDelay);
+	_batchTimer->setSingleShot(true);
+	connect(_batchTimer, &QTimer::timeout,
+			this, &SyncController::flushChanges);
+}
 
 void SyncController::initialize(const QVariantHash &params)
 {
@@ -20,6 +32,11 @@ void SyncController::initialize(const QVariantHash &params)
 void SyncController::setSyncEnabled(bool enabled)
 {
 	_enabled = enabled;
+	if(!_enabled) {
+		_batchTimer->stop();
+		_pendingChanges.clear();
+		_pendingCount = 0;
+	}
 }
 
 void SyncController::syncChange(quint64 key, const QByteArray &changeData)
@@ -28,139 +45,268 @@ void SyncController::syncChange(quint64 key, const QByteArray &changeData)
 		return;
 
 	try {
-		bool remoteDeleted;
-		ObjectKey objKey;
-		quint64 remoteVersion;
-		QJsonObject remoteData;
-		tie(remoteDeleted, objKey, remoteVersion, remoteData) = SyncHelper::extract(changeData);
-
-		auto scope = _store->startSync(objKey);
-		LocalStore::ChangeType localState;
-		quint64 localVersion;
-		QString localFileName;
-		QByteArray localChecksum;
-		tie(localState, localVersion, localFileName, localChecksum) = _store->loadChangeInfo(scope);
-
-		const char *syncActionStr = "invalid";
-		const char *syncActionRes = "invalid";
-
-		switch (localState) {
-		case LocalStore::Exists:
-			if(remoteDeleted) { // exists<->deleted
-				syncActionStr = "exists<->deleted";
-				if(localVersion < remoteVersion) {
-					auto persist = defaults().property(Defaults::PersistDeleted).toBool();
-					_store->storeDeleted(scope, remoteVersion, !persist, localState); //store the delete either unchanged or changed, see exchange.txt
-					syncActionRes = "remote";
-				} else if(localVersion == remoteVersion) {
-					switch (static_cast<Setup::SyncPolicy>(defaults().property(Defaults::ConflictPolicy).toInt())) {
-					case Setup::PreferChanged:
-						_store->updateVersion(scope, localVersion, localVersion + 1ull, true); //keep as "v1 + 1"
-						syncActionRes = "local";
-						break;
-					case Setup::PreferDeleted:
-						_store->storeDeleted(scope, remoteVersion + 1ull, true, localState); //store as "v2 + 1"
-						syncActionRes = "remote";
-						break;
-					default:
-						Q_UNREACHABLE();
-						break;
-					}
-				} else //(localVersion > remoteVersion): do nothing
+		syncParsedChange(key, SyncHelper::parse(changeData));
+	} catch (QException &e) {
+		logCritical() << "Failed to synchronize data:" << e.what();
+		emit controllerError(tr("Data downloaded from server is invalid."));
+	}
+}
+
+void SyncController::syncParsedChange(quint64 key, const SyncHelper::ChangeData &change)
+{
+	if(!_enabled)
+		return;
+
+	_pendingChanges.append({key, {change}});
+	if(++_pendingCount >= MaxBatchSize)
+		flushChanges();
+	else if(!_batchTimer->isActive())
+		_batchTimer->start();
+}
+
+void SyncController::syncSnapshot(quint64 key, const QList<SyncHelper::ChangeData> &changes)
+{
+	if(!_enabled)
+		return;
+
+	//snapshots are large enough on their own, so they are applied right away, together with what is already queued
+	_pendingChanges.append({key, changes});
+	_pendingCount += changes.size();
+	flushChanges();
+}
+
+void SyncController::flushChanges()
+{
+	_batchTimer->stop();
+	if(_pendingChanges.isEmpty())
+		return;
+
+	const auto downloads = std::move(_pendingChanges);
+	_pendingChanges.clear();
+	const auto changeCount = _pendingCount;
+	_pendingCount = 0;
+	QList<tuple<ObjectKey, bool, quint64, QJsonObject>> doneChanges; //(objKey, isRemoteState, version, data)
+	doneChanges.reserve(changeCount);
+	QList<quint64> doneKeys;
+	doneKeys.reserve(downloads.size());
+	QList<quint64> rejectedKeys;
+
+	try {
+		auto batch = _store->startSyncBatch();
+		for(const auto &download : downloads) {
+			auto complete = true;
+			auto rejected = false;
+			for(const auto &change : download.second) {
+				//a failing change only rolls back itself - the rest of the batch is still applied
+				try {
+					ObjectKey objKey;
+					auto isRemoteState = false;
+					quint64 remoteVersion;
+					QJsonObject remoteData;
+					tie(objKey, isRemoteState, remoteVersion, remoteData) = applyChange(change, rejected);
+					doneChanges.append(make_tuple(objKey, isRemoteState, remoteVersion, remoteData));
+				} catch (QException &e) {
+					logCritical() << "Failed to synchronize data:" << e.what();
+					emit controllerError(tr("Data downloaded from server is invalid."));
+					complete = false;
+				}
+			}
+			if(!complete)
+				continue;
+			else if(rejected)
+				rejectedKeys.append(download.first);
+			else
+				doneKeys.append(download.first);
+		}
+		_store->commitSyncBatch(batch);
+		logDebug() << "Applied" << doneChanges.size() << "of" << changeCount
+				   << "downloaded changes in one transaction";
+	} catch (QException &e) {
+		logCritical() << "Failed to store synchronized data:" << e.what();
+		emit controllerError(tr("Failed to store data downloaded from server."));
+		return;
+	}
+
+	//only acknowledge the changes once they have been commited
+	for(const auto &done : doneChanges) {
+		if(get<1>(done))
+			emit deltaBaseChanged(get<0>(done), get<2>(done), get<3>(done));
+		else
+			emit deltaBaseInvalidated(get<0>(done));
+	}
+	for(const auto key : doneKeys)
+		emit syncDone(key);
+	for(const auto key : rejectedKeys)
+		emit syncRejected(key);
+}
+
+tuple<ObjectKey, bool, quint64, QJsonObject> SyncController::applyChange(const SyncHelper::ChangeData &change, bool &rejected)
+{
+	const auto &objKey = change.key;
+	auto remoteDeleted = change.deleted;
+	auto remoteVersion = change.version;
+	auto remoteData = change.data;
+
+	auto scope = _store->startSync(objKey);
+	LocalStore::ChangeType localState;
+	quint64 localVersion;
+	QString localFileName;
+	QByteArray localChecksum;
+	tie(localState, localVersion, localFileName, localChecksum) = _store->loadChangeInfo(scope);
+
+	//deltas that do not match the local data are not applied. The local data stays untouched and the complete data is requested instead
+	//deltas older than the local data are handled like any other outdated change
+	if(change.isDelta &&
+	   (localState == LocalStore::NoExists || localVersion <= remoteVersion) &&
+	   !applyDelta(change, localState, localVersion, localFileName, localChecksum, remoteData)) {
+		_store->commitSync(scope);
+		rejected = true;
+		return make_tuple(objKey, false, remoteVersion, QJsonObject{});
+	}
+
+	const char *syncActionStr = "invalid";
+	const char *syncActionRes = "invalid";
+	auto isRemoteState = false; //local data is now exactly what the server has
+
+	switch (localState) {
+	case LocalStore::Exists:
+		if(remoteDeleted) { // exists<->deleted
+			syncActionStr = "exists<->deleted";
+			if(localVersion < remoteVersion) {
+				auto persist = defaults().property(Defaults::PersistDeleted).toBool();
+				_store->storeDeleted(scope, remoteVersion, !persist, localState); //store the delete either unchanged or changed, see exchange.txt
+				syncActionRes = "remote";
+			} else if(localVersion == remoteVersion) {
+				switch (static_cast<Setup::SyncPolicy>(defaults().property(Defaults::ConflictPolicy).toInt())) {
+				case Setup::PreferChanged:
+					_store->updateVersion(scope, localVersion, localVersion + 1ull, true); //keep as "v1 + 1"
 					syncActionRes = "local";
-			} else { // exists<->changed
-				syncActionStr = "exists<->changed";
-				if(localVersion < remoteVersion) {
-					_store->storeChanged(scope, remoteVersion, localFileName, remoteData, false, localState); //simply update the local data
+					break;
+				case Setup::PreferDeleted:
+					_store->storeDeleted(scope, remoteVersion + 1ull, true, localState); //store as "v2 + 1"
 					syncActionRes = "remote";
-				} else if(localVersion == remoteVersion) {
-					auto remoteChecksum = SyncHelper::jsonHash(remoteData);
-					if(localChecksum != remoteChecksum) { //conflict!
-						QJsonObject resolvedData;
-						auto resolver = defaults().conflictResolver();
-						if(resolver) {
-							auto localData = _store->readJson(objKey, localFileName);
-							resolvedData = resolver->resolveConflict(QMetaType::type(objKey.typeName.constData()), localData, remoteData);
-						}
-						//deterministic alg the chooses 1 dataset no matter which one is local
-						if(!resolvedData.isEmpty()) {
-							_store->storeChanged(scope, localVersion + 1ull, localFileName, resolvedData, true, localState); //store as "v2 + 1"
-							syncActionRes = "merged";
-						} else if(localChecksum > remoteChecksum) {
-							_store->updateVersion(scope, localVersion, localVersion + 1ull, true); //keep as "v1 + 1"
-							syncActionRes = "local";
-						} else {
-							_store->storeChanged(scope, remoteVersion + 1ull, localFileName, remoteData, true, localState); //store as "v2 + 1"
-							syncActionRes = "remote";
-						}
-					} else {//(localChecksum == remoteChecksum): mark unchanged, if it was changed, because same data does not need another upload
-						_store->markUnchanged(scope, localVersion, false);
-						syncActionRes = "identical";
+					break;
+				default:
+					Q_UNREACHABLE();
+					break;
+				}
+			} else //(localVersion > remoteVersion): do nothing
+				syncActionRes = "local";
+		} else { // exists<->changed
+			syncActionStr = "exists<->changed";
+			if(localVersion < remoteVersion) {
+				_store->storeChanged(scope, remoteVersion, localFileName, remoteData, false, localState); //simply update the local data
+				syncActionRes = "remote";
+				isRemoteState = true;
+			} else if(localVersion == remoteVersion) {
+				auto remoteChecksum = SyncHelper::jsonHash(remoteData);
+				if(localChecksum != remoteChecksum) { //conflict!
+					QJsonObject resolvedData;
+					auto resolver = defaults().conflictResolver();
+					if(resolver) {
+						auto localData = _store->readJson(objKey, localFileName);
+						resolvedData = resolver->resolveConflict(QMetaType::type(objKey.typeName.constData()), localData, remoteData);
 					}
-				} else //(localVersion > remoteVersion): do nothing
-					syncActionRes = "local";
-			}
-			break;
-		case LocalStore::ExistsDeleted:
-			if(remoteDeleted) { // cachedDelete<->deleted
-				syncActionStr = "cachedDelete<->deleted";
-				syncActionRes = "identical";
-				if(localVersion <= remoteVersion) {
-					if(defaults().property(Defaults::PersistDeleted).toBool()) //when persisting, store the delete
-						_store->updateVersion(scope, localVersion, remoteVersion, false);
-					else //if not, simply delete the cached delete as it is not needed anymore
-						_store->markUnchanged(scope, localVersion, true); //pass local version to make shure it's accepted
-				} //else: do nothing
-			} else { // cachedDelete<->changed
-				syncActionStr = "cachedDelete<->changed";
-				if(localVersion < remoteVersion) {
-					_store->storeChanged(scope, remoteVersion, localFileName, remoteData, false, localState); //simply update the local data
-					syncActionRes = "remote";
-				} else if(localVersion == remoteVersion) {
-					switch (static_cast<Setup::SyncPolicy>(defaults().property(Defaults::ConflictPolicy).toInt())) {
-					case Setup::PreferChanged:
-						_store->storeChanged(scope, remoteVersion + 1ull, localFileName, remoteData, true, localState); //store as "v2 + 1"
-						syncActionRes = "remote";
-						break;
-					case Setup::PreferDeleted:
+					//deterministic alg the chooses 1 dataset no matter which one is local
+					if(!resolvedData.isEmpty()) {
+						_store->storeChanged(scope, localVersion + 1ull, localFileName, resolvedData, true, localState); //store as "v2 + 1"
+						syncActionRes = "merged";
+					} else if(localChecksum > remoteChecksum) {
 						_store->updateVersion(scope, localVersion, localVersion + 1ull, true); //keep as "v1 + 1"
 						syncActionRes = "local";
-						break;
-					default:
-						Q_UNREACHABLE();
-						break;
+					} else {
+						_store->storeChanged(scope, remoteVersion + 1ull, localFileName, remoteData, true, localState); //store as "v2 + 1"
+						syncActionRes = "remote";
 					}
-				} else //(localVersion > remoteVersion): do nothing
-					syncActionRes = "local";
-			}
-			break;
-		case LocalStore::NoExists:
-			if(remoteDeleted) { // noexists<->deleted
-				syncActionStr = "noexists<->deleted";
-				syncActionRes = "identical";
+				} else {//(localChecksum == remoteChecksum): mark unchanged, if it was changed, because same data does not need another upload
+					_store->markUnchanged(scope, localVersion, false);
+					syncActionRes = "identical";
+					isRemoteState = true;
+				}
+			} else //(localVersion > remoteVersion): do nothing
+				syncActionRes = "local";
+		}
+		break;
+	case LocalStore::ExistsDeleted:
+		if(remoteDeleted) { // cachedDelete<->deleted
+			syncActionStr = "cachedDelete<->deleted";
+			syncActionRes = "identical";
+			if(localVersion <= remoteVersion) {
 				if(defaults().property(Defaults::PersistDeleted).toBool()) //when persisting, store the delete
-					_store->storeDeleted(scope, remoteVersion, false, localState);
-				//else: do nothing
-			} else { // noexists<->changed
-				syncActionStr = "noexists<->changed";
+					_store->updateVersion(scope, localVersion, remoteVersion, false);
+				else //if not, simply delete the cached delete as it is not needed anymore
+					_store->markUnchanged(scope, localVersion, true); //pass local version to make shure it's accepted
+			} //else: do nothing
+		} else { // cachedDelete<->changed
+			syncActionStr = "cachedDelete<->changed";
+			if(localVersion < remoteVersion) {
+				_store->storeChanged(scope, remoteVersion, localFileName, remoteData, false, localState); //simply update the local data
 				syncActionRes = "remote";
-				//no additional info, simply take it (See exchange.txt)
-				_store->storeChanged(scope, remoteVersion, localFileName, remoteData, false, localState);
-			}
-			break;
-		default:
-			Q_UNREACHABLE();
-			break;
+				isRemoteState = true;
+			} else if(localVersion == remoteVersion) {
+				switch (static_cast<Setup::SyncPolicy>(defaults().property(Defaults::ConflictPolicy).toInt())) {
+				case Setup::PreferChanged:
+					_store->storeChanged(scope, remoteVersion + 1ull, localFileName, remoteData, true, localState); //store as "v2 + 1"
+					syncActionRes = "remote";
+					break;
+				case Setup::PreferDeleted:
+					_store->updateVersion(scope, localVersion, localVersion + 1ull, true); //keep as "v1 + 1"
+					syncActionRes = "local";
+					break;
+				default:
+					Q_UNREACHABLE();
+					break;
+				}
+			} else //(localVersion > remoteVersion): do nothing
+				syncActionRes = "local";
+		}
+		break;
+	case LocalStore::NoExists:
+		if(remoteDeleted) { // noexists<->deleted
+			syncActionStr = "noexists<->deleted";
+			syncActionRes = "identical";
+			if(defaults().property(Defaults::PersistDeleted).toBool()) //when persisting, store the delete
+				_store->storeDeleted(scope, remoteVersion, false, localState);
+			//else: do nothing
+		} else { // noexists<->changed
+			syncActionStr = "noexists<->changed";
+			syncActionRes = "remote";
+			//no additional info, simply take it (See exchange.txt)
+			_store->storeChanged(scope, remoteVersion, localFileName, remoteData, false, localState);
+			isRemoteState = true;
 		}
+		break;
+	default:
+		Q_UNREACHABLE();
+		break;
+	}
 
-		logDebug().nospace() << "Synced " << objKey
-							 << " with action(" << syncActionStr << "), result is data of: "
-							 << syncActionRes;
+	logDebug().nospace() << "Synced " << objKey
+						 << (change.isDelta ? " from delta" : "")
+						 << " with action(" << syncActionStr << "), result is data of: "
+						 << syncActionRes;
 
-		_store->commitSync(scope);
-		emit syncDone(key);
-	} catch (QException &e) {
-		logCritical() << "Failed to synchronize data:" << e.what();
-		emit controllerError(tr("Data downloaded from server is invalid."));
-	}
+	_store->commitSync(scope);
+	return make_tuple(objKey, isRemoteState, remoteVersion, remoteData);
+}
+
+bool SyncController::applyDelta(const SyncHelper::ChangeData &change, LocalStore::ChangeType localState, quint64 localVersion, const QString &localFileName, const QByteArray &localChecksum, QJsonObject &remoteData)
+{
+	const auto &objKey = change.key;
+
+	if(localState == LocalStore::Exists &&
+	   localVersion == change.baseVersion &&
+	   localChecksum == change.baseChecksum) {
+		remoteData = SyncHelper::applyPatch(_store->readJson(objKey, localFileName), change.data);
+		if(SyncHelper::jsonHash(remoteData) == change.checksum)
+			return true;
+		logWarning() << "Reconstructed data of delta for" << objKey << "does not match the checksum";
+	} else if(localState == LocalStore::NoExists)
+		logWarning() << "Unable to apply delta for" << objKey << "- no local base data exists";
+	else
+		logDebug() << "Unable to apply delta for" << objKey << "- local data is not the base of the delta";
+
+	logDebug().nospace() << "Synced " << objKey
+						 << " from delta with action(mismatch), result is data of: none - requesting complete data";
+	return false;
 }
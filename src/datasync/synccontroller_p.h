@@ -1,9 +1,14 @@
 #ifndef QTDATASYNC_SYNCCONTROLLER_P_H
 #define QTDATASYNC_SYNCCONTROLLER_P_H
 
+#include <tuple>
+
+#include <QtCore/QTimer>
+
 #include "qtdatasync_global.h"
 #include "controller_p.h"
 #include "localstore_p.h"
+#include "synchelper_p.h"
 
 namespace QtDataSync {
 
@@ -19,13 +24,35 @@ public:
 public Q_SLOTS:
 	void setSyncEnabled(bool enabled);
 	void syncChange(quint64 key, const QByteArray &changeData);
+	void syncParsedChange(quint64 key, const QtDataSync::SyncHelper::ChangeData &change);
+	void syncSnapshot(quint64 key, const QList<QtDataSync::SyncHelper::ChangeData> &changes);
 
 Q_SIGNALS:
 	void syncDone(quint64 key);
+	void syncRejected(quint64 key); //a delta could not be applied, the complete change is needed
+	void deltaBaseChanged(const QtDataSync::ObjectKey &key, quint64 version, const QJsonObject &data);
+	void deltaBaseInvalidated(const QtDataSync::ObjectKey &key);
+
+private Q_SLOTS:
+	void flushChanges();
 
 private:
+	static const int BatchDelay;
+	static const int MaxBatchSize;
+
 	LocalStore *_store = nullptr;
 	bool _enabled = false;
+
+	QTimer *_batchTimer;
+	QList<QPair<quint64, QList<SyncHelper::ChangeData>>> _pendingChanges; //a download is only done once all of its changes are
+	int _pendingCount = 0;
+
+	std::tuple<ObjectKey, bool, quint64, QJsonObject> applyChange(const SyncHelper::ChangeData &change, bool &rejected); //(key, isRemoteState, version, data)
+
+	bool applyDelta(const SyncHelper::ChangeData &change,
+					LocalStore::ChangeType localState, quint64 localVersion,
+					const QString &localFileName, const QByteArray &localChecksum,
+					QJsonObject &remoteData);
 };
 
 }
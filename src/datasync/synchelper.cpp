@@ -5,6 +5,10 @@
 #include <QtCore/QLocale>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonArray>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QtCore/QCborValue>
+#include <QtCore/QCborMap>
+#endif
 
 #include "message_p.h"
 
@@ -14,7 +18,21 @@ using std::tuple;
 using std::make_tuple;
 
 namespace {
+//not valid json, so older versions fail to parse deltas instead of storing garbage
+const QByteArray DeltaMarker{"\0delta", 6};
+//prefixes the json data if compressed - again invalid json for older versions
+const QByteArray CompressedMarker{"\0zlib", 5};
+//prefixes the data if serialized as cbor, followed by the version of the envelope
+const QByteArray CborMarker{"\0cbor", 5};
+const char CborVersion = 1;
+//used instead of the json data for snapshots, followed by the bundled changes
+const QByteArray SnapshotMarker{"\0snapshot", 9};
+
+QByteArray packJson(const QJsonObject &data, int compressionLevel, bool binary);
+bool unpackJson(const QByteArray &data, QJsonObject &object);
+
 void hashNext(QCryptographicHash &hash, const QJsonValue &value);
+bool diffNext(const QJsonObject &base, const QJsonObject &target, QJsonObject &patch);
 }
 
 QByteArray SyncHelper::jsonHash(const QJsonObject &object)
@@ -24,7 +42,7 @@ QByteArray SyncHelper::jsonHash(const QJsonObject &object)
 	return hash.result();
 }
 
-QByteArray SyncHelper::combine(const ObjectKey &key, quint64 version, const QJsonObject &data)
+QByteArray SyncHelper::combine(const ObjectKey &key, quint64 version, const QJsonObject &data, int compressionLevel, bool binary)
 {
 	QByteArray out;
 	QDataStream stream(&out, QIODevice::WriteOnly | QIODevice::Unbuffered);
@@ -32,7 +50,7 @@ QByteArray SyncHelper::combine(const ObjectKey &key, quint64 version, const QJso
 
 	stream << key
 		   << version
-		   << QJsonDocument(data).toJson(QJsonDocument::Compact);
+		   << packJson(data, compressionLevel, binary);
 
 	if(stream.status() != QDataStream::Ok)
 		throw DataStreamException(stream);
@@ -69,18 +87,10 @@ tuple<bool, ObjectKey, quint64, QJsonObject> SyncHelper::extract(const QByteArra
 		   >> jData;
 
 	QJsonObject obj;
-	if(jData.isNull())
+	if(jData.isNull() || unpackJson(jData, obj))
 		stream.commitTransaction();
-	else {
-		QJsonParseError error;
-		auto doc = QJsonDocument::fromJson(jData, &error);
-		if(error.error != QJsonParseError::NoError || !doc.isObject())
-			stream.abortTransaction();
-		else {
-			obj = doc.object();
-			stream.commitTransaction();
-		}
-	}
+	else
+		stream.abortTransaction();
 
 	if(stream.status() != QDataStream::Ok)
 		throw DataStreamException(stream);
@@ -88,8 +98,275 @@ tuple<bool, ObjectKey, quint64, QJsonObject> SyncHelper::extract(const QByteArra
 	return make_tuple(jData.isNull(), key, version, obj);
 }
 
+ObjectKey SyncHelper::extractKey(const QByteArray &data)
+{
+	ObjectKey key;
+
+	QDataStream stream(data);
+	Message::setupStream(stream);
+	stream >> key;
+
+	if(stream.status() != QDataStream::Ok)
+		throw DataStreamException(stream);
+	return key;
+}
+
+QByteArray SyncHelper::combineDelta(const ObjectKey &key, quint64 version, quint64 baseVersion, const QByteArray &baseChecksum, const QByteArray &checksum, const QJsonObject &patch, int compressionLevel, bool binary)
+{
+	QByteArray out;
+	QDataStream stream(&out, QIODevice::WriteOnly | QIODevice::Unbuffered);
+	Message::setupStream(stream);
+
+	stream << key
+		   << version
+		   << DeltaMarker
+		   << baseVersion
+		   << baseChecksum
+		   << checksum
+		   << packJson(patch, compressionLevel, binary);
+
+	if(stream.status() != QDataStream::Ok)
+		throw DataStreamException(stream);
+	return out;
+}
+
+bool SyncHelper::isDelta(const QByteArray &data)
+{
+	ObjectKey key;
+	quint64 version;
+	QByteArray jData;
+
+	QDataStream stream(data);
+	Message::setupStream(stream);
+	stream >> key
+		   >> version
+		   >> jData;
+	return stream.status() == QDataStream::Ok && jData == DeltaMarker;
+}
+
+tuple<ObjectKey, quint64, quint64, QByteArray, QByteArray, QJsonObject> SyncHelper::extractDelta(const QByteArray &data)
+{
+	ObjectKey key;
+	quint64 version;
+	QByteArray marker;
+	quint64 baseVersion;
+	QByteArray baseChecksum;
+	QByteArray checksum;
+	QByteArray jData;
+
+	QDataStream stream(data);
+	Message::setupStream(stream);
+
+	stream.startTransaction();
+	stream >> key
+		   >> version
+		   >> marker
+		   >> baseVersion
+		   >> baseChecksum
+		   >> checksum
+		   >> jData;
+
+	QJsonObject patch;
+	if(marker != DeltaMarker || !unpackJson(jData, patch))
+		stream.abortTransaction();
+	else
+		stream.commitTransaction();
+
+	if(stream.status() != QDataStream::Ok)
+		throw DataStreamException(stream);
+
+	return make_tuple(key, version, baseVersion, baseChecksum, checksum, patch);
+}
+
+ChangeData SyncHelper::parse(const QByteArray &data)
+{
+	ChangeData change;
+	change.isDelta = isDelta(data);
+	if(change.isDelta) {
+		std::tie(change.key,
+				 change.version,
+				 change.baseVersion,
+				 change.baseChecksum,
+				 change.checksum,
+				 change.data) = extractDelta(data);
+	} else {
+		std::tie(change.deleted,
+				 change.key,
+				 change.version,
+				 change.data) = extract(data);
+	}
+	return change;
+}
+
+QByteArray SyncHelper::combineSnapshot(const QByteArrayList &changes)
+{
+	QByteArray out;
+	QDataStream stream(&out, QIODevice::WriteOnly | QIODevice::Unbuffered);
+	Message::setupStream(stream);
+
+	stream << ObjectKey{}
+		   << quint64(0)
+		   << SnapshotMarker
+		   << changes;
+
+	if(stream.status() != QDataStream::Ok)
+		throw DataStreamException(stream);
+	return out;
+}
+
+bool SyncHelper::isSnapshot(const QByteArray &data)
+{
+	ObjectKey key;
+	quint64 version;
+	QByteArray jData;
+
+	QDataStream stream(data);
+	Message::setupStream(stream);
+	stream >> key
+		   >> version
+		   >> jData;
+	return stream.status() == QDataStream::Ok && jData == SnapshotMarker;
+}
+
+QList<ChangeData> SyncHelper::parseSnapshot(const QByteArray &data)
+{
+	ObjectKey key;
+	quint64 version;
+	QByteArray marker;
+	QByteArrayList changes;
+
+	QDataStream stream(data);
+	Message::setupStream(stream);
+
+	stream.startTransaction();
+	stream >> key
+		   >> version
+		   >> marker
+		   >> changes;
+
+	if(marker != SnapshotMarker)
+		stream.abortTransaction();
+	else
+		stream.commitTransaction();
+
+	if(stream.status() != QDataStream::Ok)
+		throw DataStreamException(stream);
+
+	QList<ChangeData> result;
+	result.reserve(changes.size());
+	for(const auto &change : changes) //nested snapshots are not valid changes, so parse fails for them
+		result.append(parse(change));
+	return result;
+}
+
+tuple<bool, QJsonObject> SyncHelper::createPatch(const QJsonObject &base, const QJsonObject &target)
+{
+	QJsonObject patch;
+	auto ok = diffNext(base, target, patch);
+	return make_tuple(ok, patch);
+}
+
+QJsonObject SyncHelper::applyPatch(const QJsonObject &base, const QJsonObject &patch)
+{
+	auto result = base;
+	for(auto it = patch.begin(); it != patch.end(); it++) {
+		if(it.value().isNull())
+			result.remove(it.key());
+		else if(it.value().isObject())
+			result.insert(it.key(), applyPatch(result.value(it.key()).toObject(), it.value().toObject()));
+		else
+			result.insert(it.key(), it.value());
+	}
+	return result;
+}
+
 namespace {
 
+QByteArray packJson(const QJsonObject &data, int compressionLevel, bool binary)
+{
+	QByteArray jData;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	if(binary)
+		jData = CborMarker + CborVersion + QCborValue::fromJsonValue(data).toCbor();
+	else
+#else
+	Q_UNUSED(binary)
+#endif
+		jData = QJsonDocument(data).toJson(QJsonDocument::Compact);
+	if(compressionLevel == 0)
+		return jData;
+
+	//only use the compressed data if it is actually smaller
+	auto compressed = CompressedMarker + qCompress(jData, compressionLevel);
+	if(compressed.size() < jData.size())
+		return compressed;
+	else
+		return jData;
+}
+
+bool unpackJson(const QByteArray &data, QJsonObject &object)
+{
+	if(data.startsWith(CompressedMarker)) {
+		auto jData = qUncompress(data.mid(CompressedMarker.size())); //returns empty data on errors, which makes parsing fail
+		//compressed data is never compressed again
+		return !jData.startsWith(CompressedMarker) && unpackJson(jData, object);
+	}
+
+	if(data.startsWith(CborMarker)) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+		if(data.size() <= CborMarker.size() || data[CborMarker.size()] != CborVersion)
+			return false;
+		QCborParserError error;
+		auto value = QCborValue::fromCbor(data.mid(CborMarker.size() + 1), &error);
+		if(error.error != QCborError::NoError || !value.isMap())
+			return false;
+		object = value.toMap().toJsonObject();
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	QJsonParseError error;
+	auto doc = QJsonDocument::fromJson(data, &error);
+	if(error.error != QJsonParseError::NoError || !doc.isObject())
+		return false;
+	object = doc.object();
+	return true;
+}
+
+bool diffNext(const QJsonObject &base, const QJsonObject &target, QJsonObject &patch)
+{
+	for(auto it = base.begin(); it != base.end(); it++) {
+		if(!target.contains(it.key()))
+			patch.insert(it.key(), QJsonValue::Null);
+	}
+
+	for(auto it = target.begin(); it != target.end(); it++) {
+		const auto value = it.value();
+		const auto baseValue = base.value(it.key());
+		if(value == baseValue)
+			continue;
+		// null means "remove" in a merge patch, so explicit nulls cannot be expressed
+		if(value.isNull())
+			return false;
+		if(value.isObject() && baseValue.isObject()) {
+			QJsonObject subPatch;
+			if(!diffNext(baseValue.toObject(), value.toObject(), subPatch))
+				return false;
+			patch.insert(it.key(), subPatch);
+		} else if(value.isObject()) {
+			// objects are merged into nothing - the whole object is the patch, but must not contain nulls
+			QJsonObject subPatch;
+			if(!diffNext({}, value.toObject(), subPatch))
+				return false;
+			patch.insert(it.key(), subPatch);
+		} else
+			patch.insert(it.key(), value);
+	}
+	return true;
+}
+
 void hashNext(QCryptographicHash &hash, const QJsonValue &value)
 {
 	switch (value.type()) {
@@ -4,6 +4,7 @@
 #include <tuple>
 
 #include <QtCore/QJsonObject>
+#include <QtCore/QMetaType>
 
 #include "qtdatasync_global.h"
 #include "objectkey.h"
@@ -12,15 +13,43 @@ namespace QtDataSync {
 
 namespace SyncHelper {
 
+//not exported, holds the result of extract or extractDelta, whichever matches the data
+struct ChangeData {
+	bool isDelta = false;
+	bool deleted = false;
+	ObjectKey key;
+	quint64 version = 0;
+	QJsonObject data; //the patch, in case of a delta
+	quint64 baseVersion = 0;
+	QByteArray baseChecksum;
+	QByteArray checksum;
+};
+
 //exports are needed for tests
 Q_DATASYNC_EXPORT QByteArray jsonHash(const QJsonObject &object);
 
-Q_DATASYNC_EXPORT QByteArray combine(const ObjectKey &key, quint64 version, const QJsonObject &data);
+Q_DATASYNC_EXPORT QByteArray combine(const ObjectKey &key, quint64 version, const QJsonObject &data, int compressionLevel = 0, bool binary = false);
 Q_DATASYNC_EXPORT QByteArray combine(const ObjectKey &key, quint64 version);
 Q_DATASYNC_EXPORT std::tuple<bool, ObjectKey, quint64, QJsonObject> extract(const QByteArray &data); // (deleted, key, version, data)
+Q_DATASYNC_EXPORT ObjectKey extractKey(const QByteArray &data); //works for complete and delta data
+
+Q_DATASYNC_EXPORT QByteArray combineDelta(const ObjectKey &key, quint64 version, quint64 baseVersion, const QByteArray &baseChecksum, const QByteArray &checksum, const QJsonObject &patch, int compressionLevel = 0, bool binary = false);
+Q_DATASYNC_EXPORT bool isDelta(const QByteArray &data);
+Q_DATASYNC_EXPORT std::tuple<ObjectKey, quint64, quint64, QByteArray, QByteArray, QJsonObject> extractDelta(const QByteArray &data); // (key, version, baseVersion, baseChecksum, checksum, patch)
+Q_DATASYNC_EXPORT ChangeData parse(const QByteArray &data); //works for complete and delta data - reentrant
+
+Q_DATASYNC_EXPORT QByteArray combineSnapshot(const QByteArrayList &changes); //bundles complete changes of multiple datasets
+Q_DATASYNC_EXPORT bool isSnapshot(const QByteArray &data);
+Q_DATASYNC_EXPORT QList<ChangeData> parseSnapshot(const QByteArray &data); //reentrant
+
+// json merge patches (RFC 7396)
+Q_DATASYNC_EXPORT std::tuple<bool, QJsonObject> createPatch(const QJsonObject &base, const QJsonObject &target); // (valid, patch)
+Q_DATASYNC_EXPORT QJsonObject applyPatch(const QJsonObject &base, const QJsonObject &patch);
 
 }
 
 }
 
+Q_DECLARE_METATYPE(QtDataSync::SyncHelper::ChangeData)
+
 #endif // QTDATASYNC_SYNCHELPER_P_H
@@ -40,7 +40,8 @@ public:
 		Uploading, //!< Uploading changes to the remote
 		Synchronized, //!< All changes have been synchronized. The engine is idle
 		Error, //!< An internal error occured. Synchronization is paused until reconnect() is called
-		Disconnected //!< The remote is not available or sync has been disabled and the engine thus is disconnected
+		Disconnected, //!< The remote is not available or sync has been disabled and the engine thus is disconnected
+		GeneratingKeys //!< Connected, but the private keys of a new device are still beeing generated before registering
 	};
 	Q_ENUM(SyncState)
 
@@ -81,12 +81,14 @@ void SyncManagerPrivate::runOnState(QUuid id, bool downloadOnly, bool triggerSyn
 		}
 		Q_FALLTHROUGH();
 	case SyncManager::Initializing: //conntect to react to result
+	case SyncManager::GeneratingKeys:
 	case SyncManager::Downloading:
 	{
 		auto resObj = new QObject(this);
 		connect(this, &SyncManagerPrivate::syncStateChanged, resObj, [this, resObj, id, downloadOnly](SyncManager::SyncState newState) {
 			switch (newState) {
 			case SyncManager::Initializing: //do nothing
+			case SyncManager::GeneratingKeys:
 			case SyncManager::Downloading:
 				break;
 			case SyncManager::Uploading: //download only -> done, else do nothing
@@ -0,0 +1,46 @@
+#include "typepriorities_p.h"
+
+#include <algorithm>
+#include <functional>
+using namespace QtDataSync;
+
+TypePriorities::TypePriorities(const QVariantHash &config)
+{
+	for(auto it = config.constBegin(); it != config.constEnd(); it++) {
+		if(it.key().isEmpty())
+			_defaultPriority = it.value().toInt();
+		else
+			_priorities.insert(it.key().toUtf8(), it.value().toInt());
+	}
+}
+
+bool TypePriorities::isEmpty() const
+{
+	return _priorities.isEmpty();
+}
+
+int TypePriorities::priority(const QByteArray &typeName) const
+{
+	return _priorities.value(typeName, _defaultPriority);
+}
+
+QList<int> TypePriorities::classes() const
+{
+	auto classes = _priorities.values();
+	classes.append(_defaultPriority);
+	std::sort(classes.begin(), classes.end(), std::greater<int>{});
+	classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+	return classes;
+}
+
+std::pair<QByteArrayList, bool> TypePriorities::typeFilter(int priority) const
+{
+	QByteArrayList types;
+	const auto isDefault = priority == _defaultPriority;
+	for(auto it = _priorities.constBegin(); it != _priorities.constEnd(); it++) {
+		//the default class contains everything except the types of other classes
+		if((it.value() == priority) != isDefault)
+			types.append(it.key());
+	}
+	return {types, isDefault};
+}
@@ -0,0 +1,33 @@
+#ifndef QTDATASYNC_TYPEPRIORITIES_P_H
+#define QTDATASYNC_TYPEPRIORITIES_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QVariant>
+#include <QtCore/QByteArrayList>
+
+#include "qtdatasync_global.h"
+
+namespace QtDataSync {
+
+//maps the types to priority classes, as configured via Setup::typePriorities
+class Q_DATASYNC_EXPORT TypePriorities
+{
+public:
+	TypePriorities(const QVariantHash &config = {});
+
+	bool isEmpty() const;
+	int priority(const QByteArray &typeName) const;
+
+	//all classes, highest first
+	QList<int> classes() const;
+	//the types of a class - for the default class, this are the types to be excluded instead
+	std::pair<QByteArrayList, bool> typeFilter(int priority) const; //(types, exclude)
+
+private:
+	int _defaultPriority = 0;
+	QHash<QByteArray, int> _priorities;
+};
+
+}
+
+#endif // QTDATASYNC_TYPEPRIORITIES_P_H
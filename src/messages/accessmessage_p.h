@@ -17,6 +17,7 @@ class Q_DATASYNC_EXPORT AccessMessage : public RegisterBaseMessage
 	Q_PROPERTY(QByteArray macscheme MEMBER macscheme)
 	Q_PROPERTY(QByteArray cmac MEMBER cmac)
 	Q_PROPERTY(QByteArray trustmac MEMBER trustmac)
+	QTDATASYNC_MESSAGE_FIELDS(RegisterBaseMessage, pNonce, partnerId, macscheme, cmac, trustmac)
 
 public:
 	AccessMessage();
@@ -14,6 +14,7 @@ class Q_DATASYNC_EXPORT AccountMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(Message, deviceId)
 
 public:
 	AccountMessage(QUuid deviceId = {});
@@ -0,0 +1,108 @@
+#include "adaptivewindow_p.h"
+
+#include <QtCore/QtMath>
+
+using namespace QtDataSync;
+
+const qint64 AdaptiveWindow::RttTolerance = 20;
+
+AdaptiveWindow::AdaptiveWindow(quint32 initial, quint32 maximum) :
+	_initial{qMax(initial, 1u)},
+	_maximum{qMax(maximum, 1u)},
+	_window{static_cast<double>(qMin(_initial, _maximum))}
+{
+	_clock.start();
+}
+
+quint32 AdaptiveWindow::size() const
+{
+	return qBound(1u, static_cast<quint32>(qFloor(_window)), _maximum);
+}
+
+quint32 AdaptiveWindow::initial() const
+{
+	return _initial;
+}
+
+quint32 AdaptiveWindow::maximum() const
+{
+	return _maximum;
+}
+
+qint64 AdaptiveWindow::smoothedRtt() const
+{
+	return _srtt;
+}
+
+qint64 AdaptiveWindow::minimumRtt() const
+{
+	return _minRtt;
+}
+
+quint32 AdaptiveWindow::decreases() const
+{
+	return _decreases;
+}
+
+void AdaptiveWindow::reset(quint32 maximum)
+{
+	_maximum = qMax(maximum, 1u);
+	reset();
+}
+
+void AdaptiveWindow::reset()
+{
+	_window = qMin(_initial, _maximum);
+	_srtt = -1;
+	_minRtt = -1;
+	_lastDecrease = -1;
+	_decreases = 0;
+}
+
+qint64 AdaptiveWindow::timestamp() const
+{
+	return _clock.elapsed();
+}
+
+void AdaptiveWindow::acked(qint64 sentTimestamp, bool congested)
+{
+	acked(sentTimestamp, _clock.elapsed(), congested);
+}
+
+void AdaptiveWindow::acked(qint64 sentTimestamp, qint64 ackTimestamp, bool congested)
+{
+	const auto now = ackTimestamp;
+	const auto rtt = qMax<qint64>(now - sentTimestamp, 0);
+	if(_minRtt < 0 || rtt < _minRtt)
+		_minRtt = rtt;
+	if(_srtt < 0)
+		_srtt = rtt;
+	else
+		_srtt = (7 * _srtt + rtt) / 8;
+
+	// a rising rtt means the data is queued somewhere -> back off
+	if(!congested && _srtt > 2 * _minRtt + RttTolerance)
+		congested = true;
+
+	if(congested) {
+		// only decrease once per round trip, as all acks of the current window see the same congestion
+		if(_lastDecrease < 0 || now - _lastDecrease > _srtt) {
+			_window = qMax(_window / 2.0, 1.0);
+			_lastDecrease = now;
+			_decreases++;
+		}
+	} else
+		_window = qMin(_window + 1.0 / _window, static_cast<double>(_maximum));
+}
+
+QDebug QtDataSync::operator<<(QDebug debug, const AdaptiveWindow &window)
+{
+	QDebugStateSaver saver(debug);
+	debug.nospace().noquote() << "AdaptiveWindow(size: " << window.size()
+							  << "/" << window.maximum()
+							  << ", srtt: " << window.smoothedRtt()
+							  << "ms, min rtt: " << window.minimumRtt()
+							  << "ms, decreases: " << window.decreases()
+							  << ")";
+	return debug;
+}
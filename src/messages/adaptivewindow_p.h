@@ -0,0 +1,52 @@
+#ifndef QTDATASYNC_ADAPTIVEWINDOW_P_H
+#define QTDATASYNC_ADAPTIVEWINDOW_P_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QDebug>
+
+#include "qtdatasync_global.h"
+
+namespace QtDataSync {
+
+//AIMD flow control window: grows by one per round trip while acks are fast, halves on congestion
+class Q_DATASYNC_EXPORT AdaptiveWindow
+{
+public:
+	static const qint64 RttTolerance; //ms
+
+	AdaptiveWindow(quint32 initial = 10, quint32 maximum = 10);
+
+	quint32 size() const;
+	quint32 initial() const;
+	quint32 maximum() const;
+	qint64 smoothedRtt() const;
+	qint64 minimumRtt() const;
+	quint32 decreases() const;
+
+	//resets the window to the initial size and forgets all measurements
+	void reset(quint32 maximum);
+	void reset();
+
+	//timestamp to be passed to acked() once the ack for the data sent now arrives
+	qint64 timestamp() const;
+	//congested can be used to force a decrease, e.g. on overloaded queues
+	void acked(qint64 sentTimestamp, bool congested = false);
+	//same as above, with an explicit time of the ack, as returned by timestamp()
+	void acked(qint64 sentTimestamp, qint64 ackTimestamp, bool congested = false);
+
+private:
+	QElapsedTimer _clock;
+	quint32 _initial;
+	quint32 _maximum;
+	double _window;
+	qint64 _srtt = -1;
+	qint64 _minRtt = -1;
+	qint64 _lastDecrease = -1;
+	quint32 _decreases = 0;
+};
+
+Q_DATASYNC_EXPORT QDebug operator<<(QDebug debug, const AdaptiveWindow &window);
+
+}
+
+#endif // QTDATASYNC_ADAPTIVEWINDOW_P_H
@@ -35,3 +35,26 @@ const QMetaObject *ChangedAckMessage::getMetaObject() const
 {
 	return &staticMetaObject;
 }
+
+
+
+ChangedNackMessage::ChangedNackMessage(quint64 dataIndex) :
+	ChangedAckMessage{dataIndex}
+{}
+
+const QMetaObject *ChangedNackMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+
+
+const QMetaObject *ChangedBatchMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool ChangedBatchMessage::validate()
+{
+	return !changes.isEmpty();
+}
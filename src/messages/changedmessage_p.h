@@ -1,6 +1,10 @@
 #ifndef QTDATASYNC_CHANGEDMESSAGE_P_H
 #define QTDATASYNC_CHANGEDMESSAGE_P_H
 
+#include <tuple>
+
+#include <QtCore/QList>
+
 #include "message_p.h"
 
 namespace QtDataSync {
@@ -13,6 +17,7 @@ class Q_DATASYNC_EXPORT ChangedMessage : public Message
 	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
 	Q_PROPERTY(QByteArray salt MEMBER salt)
 	Q_PROPERTY(QByteArray data MEMBER data)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataIndex, keyIndex, salt, data)
 
 public:
 	quint64 dataIndex = 0;
@@ -29,6 +34,7 @@ class Q_DATASYNC_EXPORT ChangedInfoMessage : public ChangedMessage
 	Q_GADGET
 
 	Q_PROPERTY(quint32 changeEstimate MEMBER changeEstimate)
+	QTDATASYNC_MESSAGE_FIELDS(ChangedMessage, changeEstimate)
 
 public:
 	ChangedInfoMessage(quint32 changeEstimate = 0);
@@ -52,6 +58,7 @@ class Q_DATASYNC_EXPORT ChangedAckMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(quint64 dataIndex MEMBER dataIndex)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataIndex)
 
 public:
 	ChangedAckMessage(quint64 dataIndex = 0);
@@ -62,11 +69,42 @@ protected:
 	const QMetaObject *getMetaObject() const override;
 };
 
+class Q_DATASYNC_EXPORT ChangedNackMessage : public ChangedAckMessage
+{
+	Q_GADGET
+
+public:
+	ChangedNackMessage(quint64 dataIndex = 0); //the change was a delta that could not be applied
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
+class Q_DATASYNC_EXPORT ChangedBatchMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QList<QtDataSync::ChangedBatchMessage::Changed> changes MEMBER changes)
+	QTDATASYNC_MESSAGE_FIELDS(Message, changes)
+
+public:
+	using Changed = std::tuple<quint64, quint32, QByteArray, QByteArray>; //(dataIndex, keyIndex, salt, data)
+
+	QList<Changed> changes;
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
 }
 
 Q_DECLARE_METATYPE(QtDataSync::ChangedMessage)
 Q_DECLARE_METATYPE(QtDataSync::ChangedInfoMessage)
 Q_DECLARE_METATYPE(QtDataSync::LastChangedMessage)
 Q_DECLARE_METATYPE(QtDataSync::ChangedAckMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangedNackMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangedBatchMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangedBatchMessage::Changed)
 
 #endif // QTDATASYNC_CHANGEDMESSAGE_P_H
@@ -12,6 +12,17 @@ const QMetaObject *ChangeMessage::getMetaObject() const
 
 
 
+DeltaChangeMessage::DeltaChangeMessage(QByteArray dataId) :
+	ChangeMessage{std::move(dataId)}
+{}
+
+const QMetaObject *DeltaChangeMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+
+
 ChangeAckMessage::ChangeAckMessage(const ChangeMessage &message) :
 	dataId{message.dataId}
 {}
@@ -20,3 +31,45 @@ const QMetaObject *ChangeAckMessage::getMetaObject() const
 {
 	return &staticMetaObject;
 }
+
+
+
+const QMetaObject *ChangeBatchMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool ChangeBatchMessage::validate()
+{
+	return !changes.isEmpty();
+}
+
+
+
+ChangeBatchAckMessage::ChangeBatchAckMessage(const ChangeBatchMessage &message)
+{
+	dataIds.reserve(message.changes.size());
+	for(const auto &change : message.changes)
+		dataIds.append(std::get<0>(change));
+}
+
+const QMetaObject *ChangeBatchAckMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+
+
+ResendMessage::ResendMessage(QList<QByteArray> dataIds) :
+	dataIds{std::move(dataIds)}
+{}
+
+const QMetaObject *ResendMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool ResendMessage::validate()
+{
+	return !dataIds.isEmpty();
+}
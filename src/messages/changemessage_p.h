@@ -1,6 +1,10 @@
 #ifndef QTDATASYNC_CHANGEMESSAGE_P_H
 #define QTDATASYNC_CHANGEMESSAGE_P_H
 
+#include <tuple>
+
+#include <QtCore/QList>
+
 #include "message_p.h"
 
 namespace QtDataSync {
@@ -13,6 +17,7 @@ class Q_DATASYNC_EXPORT ChangeMessage : public Message
 	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
 	Q_PROPERTY(QByteArray salt MEMBER salt)
 	Q_PROPERTY(QByteArray data MEMBER data)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataId, keyIndex, salt, data)
 
 public:
 	ChangeMessage(QByteArray dataId = {});
@@ -26,11 +31,23 @@ protected:
 	const QMetaObject *getMetaObject() const override;
 };
 
+class Q_DATASYNC_EXPORT DeltaChangeMessage : public ChangeMessage
+{
+	Q_GADGET
+
+public:
+	DeltaChangeMessage(QByteArray dataId = {});
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
 class Q_DATASYNC_EXPORT ChangeAckMessage : public Message
 {
 	Q_GADGET
 
 	Q_PROPERTY(QByteArray dataId MEMBER dataId)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataId)
 
 public:
 	ChangeAckMessage(const ChangeMessage &message = {});
@@ -41,9 +58,64 @@ protected:
 	const QMetaObject *getMetaObject() const override;
 };
 
+class Q_DATASYNC_EXPORT ChangeBatchMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QList<QtDataSync::ChangeBatchMessage::Change> changes MEMBER changes)
+	QTDATASYNC_MESSAGE_FIELDS(Message, changes)
+
+public:
+	using Change = std::tuple<QByteArray, quint32, QByteArray, QByteArray>; //(dataId, keyIndex, salt, data)
+
+	QList<Change> changes;
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+class Q_DATASYNC_EXPORT ChangeBatchAckMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QList<QByteArray> dataIds MEMBER dataIds)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataIds)
+
+public:
+	ChangeBatchAckMessage(const ChangeBatchMessage &message = {});
+
+	QList<QByteArray> dataIds;
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
+class Q_DATASYNC_EXPORT ResendMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QList<QByteArray> dataIds MEMBER dataIds)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataIds)
+
+public:
+	ResendMessage(QList<QByteArray> dataIds = {});
+
+	QList<QByteArray> dataIds; //changes other devices need completely, as they could not apply a delta
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
 }
 
 Q_DECLARE_METATYPE(QtDataSync::ChangeMessage)
+Q_DECLARE_METATYPE(QtDataSync::DeltaChangeMessage)
 Q_DECLARE_METATYPE(QtDataSync::ChangeAckMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangeBatchMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangeBatchMessage::Change)
+Q_DECLARE_METATYPE(QtDataSync::ChangeBatchAckMessage)
+Q_DECLARE_METATYPE(QtDataSync::ResendMessage)
 
 #endif // QTDATASYNC_CHANGEMESSAGE_P_H
@@ -0,0 +1,57 @@
+#include "chunkmessage_p.h"
+using namespace QtDataSync;
+
+ChangeChunkMessage::ChangeChunkMessage(QByteArray dataId) :
+	dataId{std::move(dataId)}
+{}
+
+const QMetaObject *ChangeChunkMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool ChangeChunkMessage::validate()
+{
+	return chunkIndex < chunkCount &&
+			!data.isEmpty() &&
+			data.size() <= ChunkSize;
+}
+
+
+
+ChangeChunkAckMessage::ChangeChunkAckMessage(const ChangeChunkMessage &message, quint32 nextChunk) :
+	dataId{message.dataId},
+	salt{message.salt},
+	nextChunk{nextChunk}
+{}
+
+const QMetaObject *ChangeChunkAckMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+
+
+const QMetaObject *ChangedChunkMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool ChangedChunkMessage::validate()
+{
+	return chunkIndex < chunkCount &&
+			!data.isEmpty() &&
+			data.size() <= ChangeChunkMessage::ChunkSize;
+}
+
+
+
+ChangedChunkAckMessage::ChangedChunkAckMessage(quint64 dataIndex, quint32 nextChunk) :
+	dataIndex{dataIndex},
+	nextChunk{nextChunk}
+{}
+
+const QMetaObject *ChangedChunkAckMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
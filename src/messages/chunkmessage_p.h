@@ -0,0 +1,109 @@
+#ifndef QTDATASYNC_CHUNKMESSAGE_P_H
+#define QTDATASYNC_CHUNKMESSAGE_P_H
+
+#include "message_p.h"
+
+namespace QtDataSync {
+
+class Q_DATASYNC_EXPORT ChangeChunkMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QByteArray dataId MEMBER dataId)
+	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
+	Q_PROPERTY(QByteArray salt MEMBER salt)
+	Q_PROPERTY(quint32 chunkIndex MEMBER chunkIndex)
+	Q_PROPERTY(quint32 chunkCount MEMBER chunkCount)
+	Q_PROPERTY(QByteArray data MEMBER data)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataId, keyIndex, salt, chunkIndex, chunkCount, data)
+
+public:
+	static const int ChunkSize = 256 * 1024; //changes with more encrypted data are split into chunks of this size
+
+	ChangeChunkMessage(QByteArray dataId = {});
+
+	QByteArray dataId;
+	quint32 keyIndex = 0;
+	QByteArray salt; //identifies the upload, so an interrupted one can be resumed
+	quint32 chunkIndex = 0;
+	quint32 chunkCount = 0;
+	QByteArray data;
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+class Q_DATASYNC_EXPORT ChangeChunkAckMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QByteArray dataId MEMBER dataId)
+	Q_PROPERTY(QByteArray salt MEMBER salt)
+	Q_PROPERTY(quint32 nextChunk MEMBER nextChunk)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataId, salt, nextChunk)
+
+public:
+	ChangeChunkAckMessage(const ChangeChunkMessage &message = {}, quint32 nextChunk = 0);
+
+	QByteArray dataId;
+	QByteArray salt;
+	quint32 nextChunk; //the chunk count once all chunks have been stored
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
+class Q_DATASYNC_EXPORT ChangedChunkMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(quint64 dataIndex MEMBER dataIndex)
+	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
+	Q_PROPERTY(QByteArray salt MEMBER salt)
+	Q_PROPERTY(quint32 chunkIndex MEMBER chunkIndex)
+	Q_PROPERTY(quint32 chunkCount MEMBER chunkCount)
+	Q_PROPERTY(quint32 changeEstimate MEMBER changeEstimate)
+	Q_PROPERTY(QByteArray data MEMBER data)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataIndex, keyIndex, salt, chunkIndex, chunkCount, changeEstimate, data)
+
+public:
+	quint64 dataIndex = 0;
+	quint32 keyIndex = 0;
+	QByteArray salt;
+	quint32 chunkIndex = 0;
+	quint32 chunkCount = 0;
+	quint32 changeEstimate = 0; //only set if the change is the first of a download, just like ChangedInfoMessage
+	QByteArray data;
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+class Q_DATASYNC_EXPORT ChangedChunkAckMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(quint64 dataIndex MEMBER dataIndex)
+	Q_PROPERTY(quint32 nextChunk MEMBER nextChunk)
+	QTDATASYNC_MESSAGE_FIELDS(Message, dataIndex, nextChunk)
+
+public:
+	ChangedChunkAckMessage(quint64 dataIndex = 0, quint32 nextChunk = 0);
+
+	quint64 dataIndex;
+	quint32 nextChunk; //the chunk count once all chunks have been received
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
+}
+
+Q_DECLARE_METATYPE(QtDataSync::ChangeChunkMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangeChunkAckMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangedChunkMessage)
+Q_DECLARE_METATYPE(QtDataSync::ChangedChunkAckMessage)
+
+#endif // QTDATASYNC_CHUNKMESSAGE_P_H
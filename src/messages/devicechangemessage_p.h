@@ -13,6 +13,7 @@ class Q_DATASYNC_EXPORT DeviceChangeMessage : public ChangeMessage
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(ChangeMessage, deviceId)
 
 public:
 	DeviceChangeMessage(QByteArray dataId = {}, QUuid deviceId = {});
@@ -28,6 +29,7 @@ class Q_DATASYNC_EXPORT DeviceChangeAckMessage : public ChangeAckMessage
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(ChangeAckMessage, deviceId)
 
 public:
 	DeviceChangeAckMessage(const DeviceChangeMessage &message = {});
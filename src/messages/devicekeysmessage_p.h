@@ -14,6 +14,7 @@ class Q_DATASYNC_EXPORT DeviceKeysMessage : public Message
 	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
 	Q_PROPERTY(bool duplicated MEMBER duplicated)
 	Q_PROPERTY(QList<QtDataSync::DeviceKeysMessage::DeviceKey> devices MEMBER devices)
+	QTDATASYNC_MESSAGE_FIELDS(Message, keyIndex, duplicated, devices)
 
 public:
 	using DeviceKey = std::tuple<QUuid, QByteArray, QByteArray, QByteArray>; // (deviceid, scheme, key, mac)
@@ -23,6 +23,7 @@ class Q_DATASYNC_EXPORT DevicesMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(QList<QtDataSync::DevicesMessage::DeviceInfo> devices MEMBER devices)
+	QTDATASYNC_MESSAGE_FIELDS(Message, devices)
 
 public:
 	using DeviceInfo = std::tuple<QUuid, Utf8String, QByteArray>; // (deviceid, name, fingerprint)
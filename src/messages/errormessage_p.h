@@ -14,6 +14,7 @@ class Q_DATASYNC_EXPORT ErrorMessage : public Message
 	Q_PROPERTY(ErrorType type MEMBER type)
 	Q_PROPERTY(QtDataSync::Utf8String message MEMBER message)
 	Q_PROPERTY(bool canRecover MEMBER canRecover)
+	QTDATASYNC_MESSAGE_FIELDS(Message, type, message, canRecover)
 
 public:
 	enum ErrorType {
@@ -14,6 +14,7 @@ class Q_DATASYNC_EXPORT GrantMessage : public AccountMessage
 	Q_PROPERTY(quint32 index MEMBER index)
 	Q_PROPERTY(QByteArray scheme MEMBER scheme)
 	Q_PROPERTY(QByteArray secret MEMBER secret)
+	QTDATASYNC_MESSAGE_FIELDS(AccountMessage, index, scheme, secret)
 
 public:
 	GrantMessage();
@@ -5,8 +5,16 @@ using namespace QtDataSync;
 using byte = CryptoPP::byte;
 #endif
 
-const QVersionNumber InitMessage::CurrentVersion(1); //NOTE update accordingly
+const QVersionNumber InitMessage::CurrentVersion(9); //NOTE update accordingly
 const QVersionNumber InitMessage::CompatVersion(1);
+const QVersionNumber InitMessage::BatchVersion(2);
+const QVersionNumber InitMessage::DeltaVersion(3);
+const QVersionNumber InitMessage::TreeVersion(4);
+const QVersionNumber InitMessage::SnapshotVersion(5);
+const QVersionNumber InitMessage::ChunkVersion(6);
+const QVersionNumber InitMessage::SessionVersion(7);
+const QVersionNumber InitMessage::ResumeVersion(8);
+const QVersionNumber InitMessage::AdaptiveVersion(9);
 
 InitMessage::InitMessage() = default;
 
@@ -30,7 +38,8 @@ bool InitMessage::validate()
 
 IdentifyMessage::IdentifyMessage(quint32 uploadLimit) :
 	InitMessage{},
-	uploadLimit{uploadLimit}
+	uploadLimit{uploadLimit},
+	uploadMaximum{uploadLimit}
 {}
 
 IdentifyMessage IdentifyMessage::createRandom(quint32 uploadLimit, CryptoPP::RandomNumberGenerator &rng)
@@ -42,6 +51,23 @@ IdentifyMessage IdentifyMessage::createRandom(quint32 uploadLimit, CryptoPP::Ran
 	return msg;
 }
 
+void IdentifyMessage::writeFields(QDataStream &stream) const
+{
+	//the server does not know the clients version yet, but older clients ignore the trailing maximum
+	InitMessage::writeFields(stream);
+	writeAll(stream, uploadLimit, uploadMaximum);
+}
+
+void IdentifyMessage::readFields(QDataStream &stream)
+{
+	InitMessage::readFields(stream);
+	readAll(stream, uploadLimit);
+	if(protocolVersion >= AdaptiveVersion)
+		readAll(stream, uploadMaximum);
+	else
+		uploadMaximum = uploadLimit;
+}
+
 const QMetaObject *IdentifyMessage::getMetaObject() const
 {
 	return &staticMetaObject;
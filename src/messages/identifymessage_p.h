@@ -32,10 +32,19 @@ class Q_DATASYNC_EXPORT InitMessage : public Message
 
 	Q_PROPERTY(QVersionNumber protocolVersion MEMBER protocolVersion)
 	Q_PROPERTY(QByteArray nonce MEMBER nonce)
+	QTDATASYNC_MESSAGE_FIELDS(Message, protocolVersion, nonce)
 
 public:
 	static const QVersionNumber CurrentVersion;
 	static const QVersionNumber CompatVersion;
+	static const QVersionNumber BatchVersion;
+	static const QVersionNumber DeltaVersion;
+	static const QVersionNumber TreeVersion;
+	static const QVersionNumber SnapshotVersion;
+	static const QVersionNumber ChunkVersion;
+	static const QVersionNumber SessionVersion;
+	static const QVersionNumber ResumeVersion;
+	static const QVersionNumber AdaptiveVersion;
 	static const int NonceSize = 16;
 	InitMessage();
 
@@ -54,13 +63,18 @@ class Q_DATASYNC_EXPORT IdentifyMessage : public InitMessage
 	Q_GADGET
 
 	Q_PROPERTY(quint32 uploadLimit MEMBER uploadLimit)
+	Q_PROPERTY(quint32 uploadMaximum MEMBER uploadMaximum)
 
 public:
 	IdentifyMessage(quint32 uploadLimit = 0);
 
 	static IdentifyMessage createRandom(quint32 uploadLimit, CryptoPP::RandomNumberGenerator &rng);
 
-	quint32 uploadLimit;
+	quint32 uploadLimit; //fixed window of clients before AdaptiveVersion
+	quint32 uploadMaximum; //upper bound of the adaptive upload window, same as the limit for older servers
+
+	void writeFields(QDataStream &stream) const override;
+	void readFields(QDataStream &stream) override;
 
 protected:
 	const QMetaObject *getMetaObject() const override;
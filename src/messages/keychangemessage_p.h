@@ -10,6 +10,7 @@ class Q_DATASYNC_EXPORT KeyChangeMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(quint32 nextIndex MEMBER nextIndex)
+	QTDATASYNC_MESSAGE_FIELDS(Message, nextIndex)
 
 public:
 	KeyChangeMessage(quint32 nextIndex = 0);
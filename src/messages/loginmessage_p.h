@@ -14,6 +14,7 @@ class Q_DATASYNC_EXPORT LoginMessage : public InitMessage
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
 	Q_PROPERTY(QtDataSync::Utf8String deviceName MEMBER deviceName)
+	QTDATASYNC_MESSAGE_FIELDS(InitMessage, deviceId, deviceName)
 
 public:
 	LoginMessage(QUuid deviceId = {}, QString deviceName = {}, QByteArray nonce = {});
@@ -11,6 +11,7 @@ class Q_DATASYNC_EXPORT MacUpdateMessage : public Message
 
 	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
 	Q_PROPERTY(QByteArray cmac MEMBER cmac)
+	QTDATASYNC_MESSAGE_FIELDS(Message, keyIndex, cmac)
 
 public:
 	MacUpdateMessage(quint32 keyIndex = 0, QByteArray cmac = {});
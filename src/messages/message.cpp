@@ -3,12 +3,24 @@
 
 #include <QtCore/QMetaProperty>
 #include <QtCore/QVersionNumber>
+#include <QtCore/QtEndian>
+
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha3.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/misc.h>
 
 #include "devicesmessage_p.h"
 #include "devicekeysmessage_p.h"
 #include "newkeymessage_p.h"
+#include "changemessage_p.h"
+#include "changedmessage_p.h"
 
 using namespace QtDataSync;
+using std::tie;
+#if CRYPTOPP_VERSION >= 600
+using byte = CryptoPP::byte;
+#endif
 
 #define REGISTER(x) do { \
 	qRegisterMetaType<x>(#x); \
@@ -31,6 +43,8 @@ void Message::registerTypes()
 	REGISTER_LIST(QtDataSync::DevicesMessage::DeviceInfo);
 	REGISTER_LIST(QtDataSync::DeviceKeysMessage::DeviceKey);
 	REGISTER_LIST(QtDataSync::NewKeyMessage::KeyUpdate);
+	REGISTER_LIST(QtDataSync::ChangeBatchMessage::Change);
+	REGISTER_LIST(QtDataSync::ChangedBatchMessage::Changed);
 }
 
 Message::~Message() = default;
@@ -102,25 +116,37 @@ void Message::deserializeMessageTo(QDataStream &stream, Message &message)
 	throw DataStreamException(stream);
 }
 
-void Message::verifySignature(QDataStream &stream, const CryptoPP::X509PublicKey &key, AsymmetricCrypto *crypto)
+QByteArray Message::serializeAuthenticated(const CryptoPP::SecByteBlock &sessionKey, quint64 sequence) const
 {
-	auto device = stream.device();
-	auto cPos = device->pos();
+	QByteArray out;
+	QDataStream stream(&out, QIODevice::WriteOnly | QIODevice::Unbuffered); //unbuffered needed for the mac
+	setupStream(stream);
+	serializeTo(stream);
+	stream << sessionMac(sessionKey, sequence, out);
+	return out;
+}
 
-	stream.startTransaction();
+void Message::verifySignature(QDataStream &stream, const CryptoPP::X509PublicKey &key, AsymmetricCrypto *crypto)
+{
+	QByteArray msgData;
 	QByteArray signature;
-	stream >> signature;
-	if(!stream.commitTransaction())
-		throw DataStreamException(stream);
-
-	auto nPos = device->pos();
-	device->reset();
-	auto msgData = device->read(cPos);
-	device->seek(nPos);
-
+	tie(msgData, signature) = readSigned(stream);
 	crypto->verify(key, msgData, signature);
 }
 
+void Message::verifyAuthentication(QDataStream &stream, const CryptoPP::SecByteBlock &sessionKey, quint64 sequence)
+{
+	QByteArray msgData;
+	QByteArray mac;
+	tie(msgData, mac) = readSigned(stream);
+	const auto expected = sessionMac(sessionKey, sequence, msgData);
+	if(mac.size() != expected.size() ||
+	   !CryptoPP::VerifyBufsEqual(reinterpret_cast<const byte*>(mac.constData()),
+								  reinterpret_cast<const byte*>(expected.constData()),
+								  static_cast<size_t>(mac.size())))
+		throw CryptoPP::HashVerificationFilter::HashVerificationFailed();
+}
+
 bool Message::validate()
 {
 	return true;
@@ -136,7 +162,81 @@ QByteArray Message::msgNameImpl(const QMetaObject *metaObject)
 	return name;
 }
 
-QDataStream &QtDataSync::operator<<(QDataStream &stream, const Message &message)
+std::tuple<QByteArray, QByteArray> Message::readSigned(QDataStream &stream)
+{
+	auto device = stream.device();
+	auto cPos = device->pos();
+
+	stream.startTransaction();
+	QByteArray signature;
+	stream >> signature;
+	if(!stream.commitTransaction())
+		throw DataStreamException(stream);
+
+	//verify directly over the signed range of the frame, if the message is read from memory
+	auto buffer = qobject_cast<QBuffer*>(device);
+	if(buffer)
+		return std::make_tuple(QByteArray::fromRawData(buffer->data().constData(), static_cast<int>(cPos)), signature);
+	else {
+		auto nPos = device->pos();
+		device->reset();
+		auto msgData = device->read(cPos);
+		device->seek(nPos);
+		return std::make_tuple(msgData, signature);
+	}
+}
+
+QByteArray Message::sessionMac(const CryptoPP::SecByteBlock &sessionKey, quint64 sequence, const QByteArray &data)
+{
+	//the sequence number binds the mac to the position in the session, so messages cannot be replayed
+	byte seqData[sizeof(quint64)];
+	qToBigEndian(sequence, seqData);
+
+	CryptoPP::HMAC<CryptoPP::SHA3_256> hmac{sessionKey.data(), sessionKey.size()};
+	hmac.Update(seqData, sizeof(seqData));
+	hmac.Update(reinterpret_cast<const byte*>(data.constData()), static_cast<size_t>(data.size()));
+	QByteArray mac(static_cast<int>(hmac.DigestSize()), Qt::Uninitialized);
+	hmac.Final(reinterpret_cast<byte*>(mac.data()));
+	return mac;
+}
+
+void Message::writeFields(QDataStream &stream) const
+{
+	Q_UNUSED(stream)
+}
+
+void Message::readFields(QDataStream &stream)
+{
+	Q_UNUSED(stream)
+}
+
+void Message::readField(QDataStream &stream, QByteArray &field)
+{
+	auto frame = qobject_cast<MessageFrame*>(stream.device());
+	if(!frame || !frame->slicing()) {
+		stream >> field;
+		return;
+	}
+
+	//same format as the QByteArray stream operator
+	field.clear();
+	quint32 size = 0;
+	stream >> size;
+	if(stream.status() != QDataStream::Ok ||
+	   size == 0xFFFFFFFFu ||
+	   size == 0)
+		return;
+
+	auto pos = frame->pos();
+	if(size > frame->size() - pos) {
+		stream.setStatus(QDataStream::ReadPastEnd);
+		return;
+	}
+	field = frame->slice(pos, size);
+	frame->seek(pos + size);
+}
+
+void Message::writeProperties(QDataStream &stream, const Message &message)
 {
 	//seralize all properties in order, without type information
 	auto mo = message.metaObject();
@@ -146,10 +246,9 @@ QDataStream &QtDataSync::operator<<(QDataStream &stream, const Message &message)
 		auto data = prop.readOnGadget(&message);
 		QMetaType::save(stream, tId, data.constData());
 	}
-	return stream;
 }
 
-QDataStream &QtDataSync::operator>>(QDataStream &stream, Message &message)
+void Message::readProperties(QDataStream &stream, Message &message)
 {
 	//deseralize all properties in order, without type information
 	auto mo = message.metaObject();
@@ -161,9 +260,46 @@ QDataStream &QtDataSync::operator>>(QDataStream &stream, Message &message)
 		QMetaType::load(stream, tId, tData.data());
 		prop.writeOnGadget(&message, tData);
 	}
+}
+
+QDataStream &QtDataSync::operator<<(QDataStream &stream, const Message &message)
+{
+	//the fields are serialized in the order of the properties, without type information
+	message.writeFields(stream);
 	return stream;
 }
 
+QDataStream &QtDataSync::operator>>(QDataStream &stream, Message &message)
+{
+	message.readFields(stream);
+	return stream;
+}
+
+
+
+MessageFrame::MessageFrame(const QByteArray &frame, QObject *parent) :
+	QBuffer{parent}
+{
+	setData(frame);
+	open(QIODevice::ReadOnly);
+}
+
+bool MessageFrame::slicing() const
+{
+	return _slicing;
+}
+
+void MessageFrame::setSlicing(bool slicing)
+{
+	_slicing = slicing;
+}
+
+QByteArray MessageFrame::slice(qint64 offset, qint64 size) const
+{
+	Q_ASSERT_X(offset >= 0 && size >= 0 && offset + size <= this->size(), Q_FUNC_INFO, "slice out of frame bounds");
+	return QByteArray::fromRawData(data().constData() + offset, static_cast<int>(size));
+}
+
 
 
 DataStreamException::DataStreamException(QDataStream &stream) :
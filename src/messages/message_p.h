@@ -2,15 +2,20 @@
 #define QTDATASYNC_MESSAGE_P_H
 
 #include <tuple>
+#include <initializer_list>
+#include <type_traits>
 
 #include <QtCore/QObject>
 #include <QtCore/QByteArray>
+#include <QtCore/QBuffer>
+#include <QtCore/QList>
 #include <QtCore/QDataStream>
 #include <QtCore/QException>
 #include <QtCore/QSharedPointer>
 
 #include <cryptopp/rng.h>
 #include <cryptopp/asn.h>
+#include <cryptopp/secblock.h>
 
 #if defined(QT_BUILD_DATASYNC_LIB)
 #	define Q_DATASYNC_EXPORT Q_DECL_EXPORT
@@ -56,6 +61,36 @@ public:
 Q_DATASYNC_EXPORT QDataStream &operator<<(QDataStream &stream, const Utf8String &message);
 Q_DATASYNC_EXPORT QDataStream &operator>>(QDataStream &stream, Utf8String &message);
 
+//read only device over a received message. With slicing enabled, byte array fields are read as raw slices of the frame
+//instead of copies, so the parsed message must not outlive the frame data passed to the constructor
+class Q_DATASYNC_EXPORT MessageFrame : public QBuffer
+{
+	Q_OBJECT
+
+public:
+	explicit MessageFrame(const QByteArray &frame, QObject *parent = nullptr);
+
+	bool slicing() const;
+	void setSlicing(bool slicing);
+
+	QByteArray slice(qint64 offset, qint64 size) const;
+
+private:
+	bool _slicing = false;
+};
+
+//generates the (de)serialization of a message. The members must be passed in the same order as the properties
+#define QTDATASYNC_MESSAGE_FIELDS(TBase, ...) \
+	public: \
+		void writeFields(QDataStream &stream) const override { \
+			TBase::writeFields(stream); \
+			QtDataSync::Message::writeAll(stream, __VA_ARGS__); \
+		} \
+		void readFields(QDataStream &stream) override { \
+			TBase::readFields(stream); \
+			QtDataSync::Message::readAll(stream, __VA_ARGS__); \
+		}
+
 class Q_DATASYNC_EXPORT Message
 {
 	Q_GADGET
@@ -84,6 +119,7 @@ public:
 	QByteArray serializeSigned(const CryptoPP::PKCS8PrivateKey &key,
 							   CryptoPP::RandomNumberGenerator &rng,
 							   AsymmetricCrypto *crypto) const;
+	QByteArray serializeAuthenticated(const CryptoPP::SecByteBlock &sessionKey, quint64 sequence) const;
 
 	static void setupStream(QDataStream &stream);
 	static void deserializeMessageTo(QDataStream &stream, Message &message);
@@ -93,13 +129,47 @@ public:
 	static inline void verifySignature(QDataStream &stream, const QSharedPointer<CryptoPP::X509PublicKey> &key, AsymmetricCrypto *crypto) {
 		return verifySignature(stream, *key, crypto);
 	}
+	static void verifyAuthentication(QDataStream &stream, const CryptoPP::SecByteBlock &sessionKey, quint64 sequence);
+
+	//reflection based (de)serialization via the properties - wire identical, but slow. Only used to verify the generated code
+	static void writeProperties(QDataStream &stream, const Message &message);
+	static void readProperties(QDataStream &stream, Message &message);
+
+	//generated via QTDATASYNC_MESSAGE_FIELDS
+	virtual void writeFields(QDataStream &stream) const;
+	virtual void readFields(QDataStream &stream);
 
 protected:
 	virtual const QMetaObject *getMetaObject() const = 0;
 	virtual bool validate();
 
+	template <typename... TArgs>
+	static inline void writeAll(QDataStream &stream, const TArgs&... fields);
+	template <typename... TArgs>
+	static inline void readAll(QDataStream &stream, TArgs&... fields);
+
 private:
 	static QByteArray msgNameImpl(const QMetaObject *getMetaObject);
+	static std::tuple<QByteArray, QByteArray> readSigned(QDataStream &stream); //(signed data, signature)
+	static QByteArray sessionMac(const CryptoPP::SecByteBlock &sessionKey, quint64 sequence, const QByteArray &data);
+
+	//enums are streamed as their integer value, just like QMetaType does
+	template <typename T>
+	static inline typename std::enable_if<!std::is_enum<T>::value>::type writeField(QDataStream &stream, const T &field);
+	template <typename T>
+	static inline typename std::enable_if<std::is_enum<T>::value>::type writeField(QDataStream &stream, const T &field);
+	template <typename T>
+	static inline typename std::enable_if<!std::is_enum<T>::value>::type readField(QDataStream &stream, T &field);
+	template <typename T>
+	static inline typename std::enable_if<std::is_enum<T>::value>::type readField(QDataStream &stream, T &field);
+	//byte arrays, and lists or tuples of them, can be sliced from a MessageFrame
+	static void readField(QDataStream &stream, QByteArray &field);
+	template <typename T>
+	static inline void readField(QDataStream &stream, QList<T> &field);
+	template <typename... TArgs>
+	static inline void readField(QDataStream &stream, std::tuple<TArgs...> &field);
+	template <typename TTuple, std::size_t... Indexes>
+	static inline void readTuple(QDataStream &stream, TTuple &field, std::index_sequence<Indexes...>);
 };
 
 Q_DATASYNC_EXPORT QDataStream &operator<<(QDataStream &stream, const Message &message);
@@ -121,6 +191,73 @@ inline bool Message::isType(const QByteArray &name)
 	return (messageName<TMessage>() == name);
 }
 
+template <typename... TArgs>
+inline void Message::writeAll(QDataStream &stream, const TArgs&... fields)
+{
+	//braced lists are evaluated in order
+	(void)std::initializer_list<int>{(writeField(stream, fields), 0)...};
+}
+
+template <typename... TArgs>
+inline void Message::readAll(QDataStream &stream, TArgs&... fields)
+{
+	(void)std::initializer_list<int>{(readField(stream, fields), 0)...};
+}
+
+template <typename T>
+inline typename std::enable_if<!std::is_enum<T>::value>::type Message::writeField(QDataStream &stream, const T &field)
+{
+	stream << field;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type Message::writeField(QDataStream &stream, const T &field)
+{
+	stream << static_cast<qint32>(field);
+}
+
+template <typename T>
+inline typename std::enable_if<!std::is_enum<T>::value>::type Message::readField(QDataStream &stream, T &field)
+{
+	stream >> field;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type Message::readField(QDataStream &stream, T &field)
+{
+	qint32 value = 0;
+	stream >> value;
+	field = static_cast<T>(value);
+}
+
+template <typename T>
+inline void Message::readField(QDataStream &stream, QList<T> &field)
+{
+	//same format as the QList stream operator, but without reserving the untrusted size
+	field.clear();
+	quint32 size = 0;
+	stream >> size;
+	for(quint32 i = 0; i < size && stream.status() == QDataStream::Ok; i++) {
+		T value;
+		readField(stream, value);
+		field.append(value);
+	}
+	if(stream.status() != QDataStream::Ok)
+		field.clear();
+}
+
+template <typename... TArgs>
+inline void Message::readField(QDataStream &stream, std::tuple<TArgs...> &field)
+{
+	readTuple(stream, field, std::index_sequence_for<TArgs...>{});
+}
+
+template <typename TTuple, std::size_t... Indexes>
+inline void Message::readTuple(QDataStream &stream, TTuple &field, std::index_sequence<Indexes...>)
+{
+	(void)std::initializer_list<int>{(readField(stream, std::get<Indexes>(field)), 0)...};
+}
+
 template <typename TMessage>
 inline TMessage Message::deserializeMessage(QDataStream &stream)
 {
@@ -27,7 +27,12 @@ HEADERS += \
 	macupdatemessage_p.h \
 	keychangemessage_p.h \
 	devicekeysmessage_p.h \
-	newkeymessage_p.h
+	newkeymessage_p.h \
+	treemessage_p.h \
+	chunkmessage_p.h \
+	sessionmessage_p.h \
+	adaptivewindow_p.h \
+	sharedcache_p.h
 
 SOURCES += \
 	message.cpp \
@@ -50,7 +55,11 @@ SOURCES += \
 	macupdatemessage.cpp \
 	keychangemessage.cpp \
 	devicekeysmessage.cpp \
-	newkeymessage.cpp
+	newkeymessage.cpp \
+	treemessage.cpp \
+	chunkmessage.cpp \
+	sessionmessage.cpp \
+	adaptivewindow.cpp
 
 DISTFILES += \
 	messages.pri
@@ -14,6 +14,7 @@ class Q_DATASYNC_EXPORT NewKeyMessage : public MacUpdateMessage
 
 	Q_PROPERTY(QByteArray scheme MEMBER scheme)
 	Q_PROPERTY(QList<QtDataSync::NewKeyMessage::KeyUpdate> deviceKeys MEMBER deviceKeys)
+	QTDATASYNC_MESSAGE_FIELDS(MacUpdateMessage, scheme, deviceKeys)
 
 public:
 	using KeyUpdate = std::tuple<QUuid, QByteArray, QByteArray>; //(deviceId, key, cmac)
@@ -32,6 +33,7 @@ class Q_DATASYNC_EXPORT NewKeyAckMessage : public MacUpdateAckMessage
 	Q_GADGET
 
 	Q_PROPERTY(quint32 keyIndex MEMBER keyIndex)
+	QTDATASYNC_MESSAGE_FIELDS(MacUpdateAckMessage, keyIndex)
 
 public:
 	NewKeyAckMessage(const NewKeyMessage &message = {});
@@ -23,6 +23,20 @@ const QMetaObject *ProofMessage::getMetaObject() const
 
 
 
+VersionedProofMessage::VersionedProofMessage() = default;
+
+VersionedProofMessage::VersionedProofMessage(const AccessMessage &access, QUuid deviceId) :
+	ProofMessage{access, deviceId},
+	protocolVersion{access.protocolVersion}
+{}
+
+const QMetaObject *VersionedProofMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+
+
 DenyMessage::DenyMessage(QUuid deviceId) :
 	deviceId{deviceId}
 {}
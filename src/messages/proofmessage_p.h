@@ -1,6 +1,8 @@
 #ifndef QTDATASYNC_PROOFMESSAGE_P_H
 #define QTDATASYNC_PROOFMESSAGE_P_H
 
+#include <QtCore/QVersionNumber>
+
 #include "message_p.h"
 #include "accessmessage_p.h"
 
@@ -20,6 +22,7 @@ class Q_DATASYNC_EXPORT ProofMessage : public Message
 	Q_PROPERTY(QByteArray macscheme MEMBER macscheme)
 	Q_PROPERTY(QByteArray cmac MEMBER cmac)
 	Q_PROPERTY(QByteArray trustmac MEMBER trustmac)
+	QTDATASYNC_MESSAGE_FIELDS(Message, pNonce, deviceId, deviceName, signAlgorithm, signKey, cryptAlgorithm, cryptKey, macscheme, cmac, trustmac)
 
 public:
 	ProofMessage();
@@ -40,11 +43,29 @@ protected:
 	const QMetaObject *getMetaObject() const override;
 };
 
+class Q_DATASYNC_EXPORT VersionedProofMessage : public ProofMessage
+{
+	Q_GADGET
+
+	Q_PROPERTY(QVersionNumber protocolVersion MEMBER protocolVersion)
+	QTDATASYNC_MESSAGE_FIELDS(ProofMessage, protocolVersion)
+
+public:
+	VersionedProofMessage();
+	VersionedProofMessage(const AccessMessage &access, QUuid deviceId);
+
+	QVersionNumber protocolVersion; //of the device requesting access, only sent to partners that support snapshots
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
 class Q_DATASYNC_EXPORT DenyMessage : public Message
 {
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(Message, deviceId)
 
 public:
 	DenyMessage(QUuid deviceId = {});
@@ -63,6 +84,7 @@ class Q_DATASYNC_EXPORT AcceptMessage : public Message
 	Q_PROPERTY(quint32 index MEMBER index)
 	Q_PROPERTY(QByteArray scheme MEMBER scheme)
 	Q_PROPERTY(QByteArray secret MEMBER secret)
+	QTDATASYNC_MESSAGE_FIELDS(Message, deviceId, index, scheme, secret)
 
 public:
 	AcceptMessage(QUuid deviceId = {});
@@ -81,6 +103,7 @@ class Q_DATASYNC_EXPORT AcceptAckMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(Message, deviceId)
 
 public:
 	AcceptAckMessage(QUuid deviceId = {});
@@ -94,6 +117,7 @@ protected:
 }
 
 Q_DECLARE_METATYPE(QtDataSync::ProofMessage)
+Q_DECLARE_METATYPE(QtDataSync::VersionedProofMessage)
 Q_DECLARE_METATYPE(QtDataSync::DenyMessage)
 Q_DECLARE_METATYPE(QtDataSync::AcceptMessage)
 Q_DECLARE_METATYPE(QtDataSync::AcceptAckMessage)
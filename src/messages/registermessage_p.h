@@ -20,6 +20,7 @@ class Q_DATASYNC_EXPORT RegisterBaseMessage : public InitMessage
 	Q_PROPERTY(QByteArray cryptAlgorithm MEMBER cryptAlgorithm)
 	Q_PROPERTY(QByteArray cryptKey MEMBER cryptKey)
 	Q_PROPERTY(QtDataSync::Utf8String deviceName MEMBER deviceName)
+	QTDATASYNC_MESSAGE_FIELDS(InitMessage, signAlgorithm, signKey, cryptAlgorithm, cryptKey, deviceName)
 
 public:
 	RegisterBaseMessage();
@@ -46,6 +47,7 @@ class Q_DATASYNC_EXPORT RegisterMessage : public RegisterBaseMessage
 	Q_GADGET
 
 	Q_PROPERTY(QByteArray cmac MEMBER cmac)
+	QTDATASYNC_MESSAGE_FIELDS(RegisterBaseMessage, cmac)
 
 public:
 	RegisterMessage();
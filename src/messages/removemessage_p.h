@@ -12,6 +12,7 @@ class Q_DATASYNC_EXPORT RemoveMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(Message, deviceId)
 
 public:
 	RemoveMessage(QUuid deviceId = {});
@@ -27,6 +28,7 @@ class Q_DATASYNC_EXPORT RemoveAckMessage : public Message
 	Q_GADGET
 
 	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	QTDATASYNC_MESSAGE_FIELDS(Message, deviceId)
 
 public:
 	RemoveAckMessage(QUuid deviceId = {});
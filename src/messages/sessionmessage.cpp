@@ -0,0 +1,68 @@
+#include "sessionmessage_p.h"
+
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha3.h>
+
+using namespace QtDataSync;
+#if CRYPTOPP_VERSION >= 600
+using byte = CryptoPP::byte;
+#endif
+
+SessionMessage::SessionMessage(QByteArray key) :
+	key{std::move(key)}
+{}
+
+const QMetaObject *SessionMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool SessionMessage::validate()
+{
+	return !key.isEmpty();
+}
+
+
+
+TicketMessage::TicketMessage(QByteArray ticket, quint32 lifetime) :
+	ticket{std::move(ticket)},
+	lifetime{lifetime}
+{}
+
+const QMetaObject *TicketMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool TicketMessage::validate()
+{
+	return !ticket.isEmpty() && lifetime > 0;
+}
+
+
+
+ResumeMessage::ResumeMessage(QUuid deviceId, QByteArray ticket, QByteArray nonce) :
+	InitMessage{std::move(nonce)},
+	deviceId{deviceId},
+	ticket{std::move(ticket)}
+{}
+
+CryptoPP::SecByteBlock ResumeMessage::deriveSessionKey(const CryptoPP::SecByteBlock &secret, const QByteArray &nonce)
+{
+	//every resumed connection gets a fresh key, bound to the servers nonce
+	CryptoPP::HMAC<CryptoPP::SHA3_256> hmac{secret.data(), secret.size()};
+	hmac.Update(reinterpret_cast<const byte*>(nonce.constData()), static_cast<size_t>(nonce.size()));
+	CryptoPP::SecByteBlock key(hmac.DigestSize());
+	hmac.Final(key.data());
+	return key;
+}
+
+const QMetaObject *ResumeMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool ResumeMessage::validate()
+{
+	return InitMessage::validate() && !ticket.isEmpty();
+}
@@ -0,0 +1,76 @@
+#ifndef QTDATASYNC_SESSIONMESSAGE_P_H
+#define QTDATASYNC_SESSIONMESSAGE_P_H
+
+#include <QtCore/QUuid>
+
+#include "message_p.h"
+#include "identifymessage_p.h"
+
+namespace QtDataSync {
+
+class Q_DATASYNC_EXPORT SessionMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QByteArray key MEMBER key)
+	QTDATASYNC_MESSAGE_FIELDS(Message, key)
+
+public:
+	static const int KeySize = 32;
+
+	SessionMessage(QByteArray key = {});
+
+	QByteArray key; //session key, encrypted with the devices public encryption key
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+class Q_DATASYNC_EXPORT TicketMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QByteArray ticket MEMBER ticket)
+	Q_PROPERTY(quint32 lifetime MEMBER lifetime)
+	QTDATASYNC_MESSAGE_FIELDS(Message, ticket, lifetime)
+
+public:
+	TicketMessage(QByteArray ticket = {}, quint32 lifetime = 0);
+
+	QByteArray ticket; //opaque for the client, the key of the session it was sent in is the secret to resume with it
+	quint32 lifetime; //in seconds
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+class Q_DATASYNC_EXPORT ResumeMessage : public InitMessage
+{
+	Q_GADGET
+
+	Q_PROPERTY(QUuid deviceId MEMBER deviceId)
+	Q_PROPERTY(QByteArray ticket MEMBER ticket)
+	QTDATASYNC_MESSAGE_FIELDS(InitMessage, deviceId, ticket)
+
+public:
+	ResumeMessage(QUuid deviceId = {}, QByteArray ticket = {}, QByteArray nonce = {});
+
+	QUuid deviceId;
+	QByteArray ticket;
+
+	static CryptoPP::SecByteBlock deriveSessionKey(const CryptoPP::SecByteBlock &secret, const QByteArray &nonce);
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+}
+
+Q_DECLARE_METATYPE(QtDataSync::SessionMessage)
+Q_DECLARE_METATYPE(QtDataSync::TicketMessage)
+Q_DECLARE_METATYPE(QtDataSync::ResumeMessage)
+
+#endif // QTDATASYNC_SESSIONMESSAGE_P_H
@@ -0,0 +1,147 @@
+#ifndef QTDATASYNC_SHAREDCACHE_P_H
+#define QTDATASYNC_SHAREDCACHE_P_H
+
+#include <tuple>
+
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QDebug>
+
+#include "qtdatasync_global.h"
+
+namespace QtDataSync {
+
+//thread safe cache of shared, immutable objects that counts its hits and misses
+template <typename TKey, typename T>
+class SharedCache
+{
+public:
+	using Entry = QSharedPointer<T>;
+
+	SharedCache(int maxSize = 100);
+
+	int size() const;
+	int maxSize() const;
+	quint64 hits() const;
+	quint64 misses() const;
+
+	void setMaxSize(int maxSize);
+
+	//returns the cached entry, or a null entry and the generation to be passed to insert() once loaded
+	std::tuple<Entry, quint64> find(const TKey &key);
+	//only inserts if the cache was not invalidated since the generation was obtained
+	bool insert(const TKey &key, const Entry &entry, quint64 generation);
+	void invalidate(const TKey &key);
+	void clear();
+
+private:
+	mutable QMutex _mutex;
+	QCache<TKey, Entry> _cache;
+	quint64 _hits = 0;
+	quint64 _misses = 0;
+	quint64 _generation = 0; //incremented on invalidation, so concurrent loads do not cache removed entries
+};
+
+template <typename TKey, typename T>
+QDebug operator<<(QDebug debug, const SharedCache<TKey, T> &cache);
+
+// ------------- Generic Implementation -------------
+
+template <typename TKey, typename T>
+SharedCache<TKey, T>::SharedCache(int maxSize) :
+	_cache{maxSize}
+{}
+
+template <typename TKey, typename T>
+int SharedCache<TKey, T>::size() const
+{
+	QMutexLocker _(&_mutex);
+	return _cache.size();
+}
+
+template <typename TKey, typename T>
+int SharedCache<TKey, T>::maxSize() const
+{
+	QMutexLocker _(&_mutex);
+	return _cache.maxCost();
+}
+
+template <typename TKey, typename T>
+quint64 SharedCache<TKey, T>::hits() const
+{
+	QMutexLocker _(&_mutex);
+	return _hits;
+}
+
+template <typename TKey, typename T>
+quint64 SharedCache<TKey, T>::misses() const
+{
+	QMutexLocker _(&_mutex);
+	return _misses;
+}
+
+template <typename TKey, typename T>
+void SharedCache<TKey, T>::setMaxSize(int maxSize)
+{
+	QMutexLocker _(&_mutex);
+	_cache.setMaxCost(maxSize);
+}
+
+template <typename TKey, typename T>
+std::tuple<typename SharedCache<TKey, T>::Entry, quint64> SharedCache<TKey, T>::find(const TKey &key)
+{
+	QMutexLocker _(&_mutex);
+	auto cached = _cache.object(key);
+	if(cached) {
+		_hits++;
+		return std::make_tuple(*cached, _generation);
+	} else {
+		_misses++;
+		return std::make_tuple(Entry{}, _generation);
+	}
+}
+
+template <typename TKey, typename T>
+bool SharedCache<TKey, T>::insert(const TKey &key, const Entry &entry, quint64 generation)
+{
+	QMutexLocker _(&_mutex);
+	if(generation != _generation)
+		return false;
+	return _cache.insert(key, new Entry{entry});
+}
+
+template <typename TKey, typename T>
+void SharedCache<TKey, T>::invalidate(const TKey &key)
+{
+	QMutexLocker _(&_mutex);
+	_generation++;
+	_cache.remove(key);
+}
+
+template <typename TKey, typename T>
+void SharedCache<TKey, T>::clear()
+{
+	QMutexLocker _(&_mutex);
+	_generation++;
+	_cache.clear();
+}
+
+template <typename TKey, typename T>
+QDebug operator<<(QDebug debug, const SharedCache<TKey, T> &cache)
+{
+	QDebugStateSaver saver(debug);
+	const auto hits = cache.hits();
+	const auto total = hits + cache.misses();
+	debug.nospace().noquote() << "SharedCache(size: " << cache.size()
+							  << "/" << cache.maxSize()
+							  << ", hits: " << hits
+							  << ", misses: " << cache.misses()
+							  << ", hit rate: " << QString::number(total > 0 ? (100.0 * hits) / total : 0.0, 'f', 1)
+							  << "%)";
+	return debug;
+}
+
+}
+
+#endif // QTDATASYNC_SHAREDCACHE_P_H
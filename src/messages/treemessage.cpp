@@ -0,0 +1,28 @@
+#include "treemessage_p.h"
+using namespace QtDataSync;
+
+TreeMessage::TreeMessage(bool reconcile, QList<QByteArray> buckets) :
+	reconcile{reconcile},
+	buckets{std::move(buckets)}
+{}
+
+const QMetaObject *TreeMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
+
+bool TreeMessage::validate()
+{
+	return buckets.size() == BucketCount;
+}
+
+
+
+TreeDiffMessage::TreeDiffMessage(QByteArray buckets) :
+	buckets{std::move(buckets)}
+{}
+
+const QMetaObject *TreeDiffMessage::getMetaObject() const
+{
+	return &staticMetaObject;
+}
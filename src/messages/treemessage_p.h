@@ -0,0 +1,52 @@
+#ifndef QTDATASYNC_TREEMESSAGE_P_H
+#define QTDATASYNC_TREEMESSAGE_P_H
+
+#include <QtCore/QList>
+
+#include "message_p.h"
+
+namespace QtDataSync {
+
+class Q_DATASYNC_EXPORT TreeMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(bool reconcile MEMBER reconcile)
+	Q_PROPERTY(QList<QByteArray> buckets MEMBER buckets)
+	QTDATASYNC_MESSAGE_FIELDS(Message, reconcile, buckets)
+
+public:
+	static const int BucketCount = 256; //one bucket per first byte of the key hash
+
+	TreeMessage(bool reconcile = false, QList<QByteArray> buckets = {});
+
+	bool reconcile;
+	QList<QByteArray> buckets; //digests, ordered by bucket
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+	bool validate() override;
+};
+
+class Q_DATASYNC_EXPORT TreeDiffMessage : public Message
+{
+	Q_GADGET
+
+	Q_PROPERTY(QByteArray buckets MEMBER buckets)
+	QTDATASYNC_MESSAGE_FIELDS(Message, buckets)
+
+public:
+	TreeDiffMessage(QByteArray buckets = {});
+
+	QByteArray buckets; //one byte per diverged bucket
+
+protected:
+	const QMetaObject *getMetaObject() const override;
+};
+
+}
+
+Q_DECLARE_METATYPE(QtDataSync::TreeMessage)
+Q_DECLARE_METATYPE(QtDataSync::TreeDiffMessage)
+
+#endif // QTDATASYNC_TREEMESSAGE_P_H
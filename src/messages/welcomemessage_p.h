@@ -16,6 +16,7 @@ class Q_DATASYNC_EXPORT WelcomeMessage : public Message
 	Q_PROPERTY(QByteArray scheme MEMBER scheme)
 	Q_PROPERTY(QByteArray key MEMBER key)
 	Q_PROPERTY(QByteArray cmac MEMBER cmac)
+	QTDATASYNC_MESSAGE_FIELDS(Message, hasChanges, keyIndex, scheme, key, cmac)
 
 public:
 	WelcomeMessage(bool hasChanges = false);
@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+TARGET = tst_benchmarkcrypto
+
+SOURCES += \
+		tst_benchmarkcrypto.cpp
+
+DEFINES += PLUGIN_DIR=\\\"$$OUT_PWD/../../../../plugins/keystores/\\\"
@@ -0,0 +1,444 @@
+#include <QString>
+#include <QtTest>
+#include <QCoreApplication>
+#include <testlib.h>
+#include <QtDataSync/private/cryptocontroller_p.h>
+
+//fake private
+#define private public
+#include <QtDataSync/private/defaults_p.h>
+#undef private
+using namespace QtDataSync;
+
+class BenchmarkCrypto : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void benchmarkSignKeygen_data();
+	void benchmarkSignKeygen();
+	void benchmarkSign_data();
+	void benchmarkSign();
+	void benchmarkVerify_data();
+	void benchmarkVerify();
+
+	void benchmarkCryptKeygen_data();
+	void benchmarkCryptKeygen();
+	void benchmarkEncrypt_data();
+	void benchmarkEncrypt();
+	void benchmarkDecrypt_data();
+	void benchmarkDecrypt();
+
+	void benchmarkCmac_data();
+	void benchmarkCmac();
+	void benchmarkSymEncrypt_data();
+	void benchmarkSymEncrypt();
+	void benchmarkSymDecrypt_data();
+	void benchmarkSymDecrypt();
+
+private:
+	CryptoController *controller;
+
+	void signData();
+	void cryptData();
+	void symData();
+
+	//the other key of the pair always uses the cheapest scheme, to keep its influence low
+	void generate(ClientCrypto &crypto, Setup::SignatureScheme scheme, const QVariant &param);
+	void generate(ClientCrypto &crypto, Setup::EncryptionScheme scheme, const QVariant &param);
+	void loadCipher(Setup::CipherScheme scheme);
+};
+
+void BenchmarkCrypto::initTestCase()
+{
+	QVERIFY(qputenv("PLUGIN_KEYSTORES_PATH", PLUGIN_DIR));
+	qInfo() << "crypto++ version:" << CRYPTOPP_VERSION
+			<< "automatic cipher scheme:" << CryptoController::autoCipherScheme();
+
+	try {
+		TestLib::init();
+		Setup setup;
+		TestLib::setup(setup);
+		setup.create();
+
+		controller = new CryptoController(DefaultsPrivate::obtainDefaults(DefaultSetup), this);
+		controller->initialize({});
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::cleanupTestCase()
+{
+	controller->finalize();
+	delete controller;
+	controller = nullptr;
+	Setup::removeSetup(DefaultSetup, true);
+}
+
+void BenchmarkCrypto::benchmarkSignKeygen_data()
+{
+	signData();
+}
+
+void BenchmarkCrypto::benchmarkSignKeygen()
+{
+	QFETCH(Setup::SignatureScheme, scheme);
+	QFETCH(QVariant, param);
+
+	try {
+		ClientCrypto crypto;
+		QBENCHMARK {
+			generate(crypto, scheme, param);
+		}
+		QVERIFY(crypto.signKey());
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkSign_data()
+{
+	signData();
+}
+
+void BenchmarkCrypto::benchmarkSign()
+{
+	QFETCH(Setup::SignatureScheme, scheme);
+	QFETCH(QVariant, param);
+
+	QByteArray message(256, 'x');
+	try {
+		ClientCrypto crypto;
+		generate(crypto, scheme, param);
+
+		QByteArray signature;
+		QBENCHMARK {
+			signature = crypto.sign(message);
+		}
+		crypto.verify(crypto.signKey(), message, signature);
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkVerify_data()
+{
+	signData();
+}
+
+void BenchmarkCrypto::benchmarkVerify()
+{
+	QFETCH(Setup::SignatureScheme, scheme);
+	QFETCH(QVariant, param);
+
+	QByteArray message(256, 'x');
+	try {
+		ClientCrypto crypto;
+		generate(crypto, scheme, param);
+		auto key = crypto.signKey();
+		auto signature = crypto.sign(message);
+
+		QBENCHMARK {
+			crypto.verify(key, message, signature);
+		}
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkCryptKeygen_data()
+{
+	cryptData();
+}
+
+void BenchmarkCrypto::benchmarkCryptKeygen()
+{
+	QFETCH(Setup::EncryptionScheme, scheme);
+	QFETCH(QVariant, param);
+
+	try {
+		ClientCrypto crypto;
+		QBENCHMARK {
+			generate(crypto, scheme, param);
+		}
+		QVERIFY(crypto.cryptKey());
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkEncrypt_data()
+{
+	cryptData();
+}
+
+void BenchmarkCrypto::benchmarkEncrypt()
+{
+	QFETCH(Setup::EncryptionScheme, scheme);
+	QFETCH(QVariant, param);
+
+	//asymmetric encryption is only used for secret keys
+	QByteArray message(32, 'k');
+	try {
+		ClientCrypto crypto;
+		generate(crypto, scheme, param);
+		auto key = crypto.cryptKey();
+
+		QByteArray cipher;
+		QBENCHMARK {
+			cipher = crypto.encrypt(key, message);
+		}
+		QCOMPARE(crypto.decrypt(cipher), message);
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkDecrypt_data()
+{
+	cryptData();
+}
+
+void BenchmarkCrypto::benchmarkDecrypt()
+{
+	QFETCH(Setup::EncryptionScheme, scheme);
+	QFETCH(QVariant, param);
+
+	QByteArray message(32, 'k');
+	try {
+		ClientCrypto crypto;
+		generate(crypto, scheme, param);
+		auto cipher = crypto.encrypt(crypto.cryptKey(), message);
+
+		QByteArray plain;
+		QBENCHMARK {
+			plain = crypto.decrypt(cipher);
+		}
+		QCOMPARE(plain, message);
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkCmac_data()
+{
+	symData();
+}
+
+void BenchmarkCrypto::benchmarkCmac()
+{
+	QFETCH(Setup::CipherScheme, scheme);
+	QFETCH(int, size);
+
+	QByteArray data(size, 'x');
+	try {
+		loadCipher(scheme);
+
+		QByteArray mac;
+		QBENCHMARK {
+			mac = controller->createCmac(data);
+		}
+		controller->verifyCmac(controller->keyIndex(), data, mac);
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkSymEncrypt_data()
+{
+	symData();
+}
+
+void BenchmarkCrypto::benchmarkSymEncrypt()
+{
+	QFETCH(Setup::CipherScheme, scheme);
+	QFETCH(int, size);
+
+	QByteArray data(size, 'x');
+	try {
+		loadCipher(scheme);
+		auto prepared = controller->prepareEncryption();
+
+		QByteArray salt;
+		QByteArray cipher;
+		QBENCHMARK {
+			std::tie(std::ignore, salt, cipher) = controller->encryptPrepared(prepared, data);
+		}
+		QCOMPARE(controller->decryptData(prepared.keyIndex, salt, cipher), data);
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::benchmarkSymDecrypt_data()
+{
+	symData();
+}
+
+void BenchmarkCrypto::benchmarkSymDecrypt()
+{
+	QFETCH(Setup::CipherScheme, scheme);
+	QFETCH(int, size);
+
+	QByteArray data(size, 'x');
+	try {
+		loadCipher(scheme);
+		quint32 keyIndex;
+		QByteArray salt;
+		QByteArray cipher;
+		std::tie(keyIndex, salt, cipher) = controller->encryptData(data);
+		auto prepared = controller->prepareDecryption(keyIndex);
+
+		QByteArray plain;
+		QBENCHMARK {
+			plain = controller->decryptPrepared(prepared, salt, cipher);
+		}
+		QCOMPARE(plain, data);
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void BenchmarkCrypto::signData()
+{
+	QTest::addColumn<Setup::SignatureScheme>("scheme");
+	QTest::addColumn<QVariant>("param");
+
+	for(auto size : {2048, 3072, 4096}) {
+		QTest::newRow("RSA_PSS_SHA3_512:" + QByteArray::number(size))
+				<< Setup::RSA_PSS_SHA3_512
+				<< QVariant(size);
+	}
+
+	const QList<std::pair<const char*, Setup::EllipticCurve>> curves {
+		{"secp256r1", Setup::secp256r1},
+		{"secp384r1", Setup::secp384r1},
+		{"secp521r1", Setup::secp521r1},
+		{"secp256k1", Setup::secp256k1},
+		{"brainpoolP256r1", Setup::brainpoolP256r1},
+		{"brainpoolP384r1", Setup::brainpoolP384r1},
+		{"brainpoolP512r1", Setup::brainpoolP512r1}
+	};
+	for(const auto &curve : curves) {
+		QTest::newRow(QByteArray("ECDSA_ECP_SHA3_512:") + curve.first)
+				<< Setup::ECDSA_ECP_SHA3_512
+				<< QVariant(curve.second);
+		QTest::newRow(QByteArray("ECNR_ECP_SHA3_512:") + curve.first)
+				<< Setup::ECNR_ECP_SHA3_512
+				<< QVariant(curve.second);
+	}
+}
+
+void BenchmarkCrypto::cryptData()
+{
+	QTest::addColumn<Setup::EncryptionScheme>("scheme");
+	QTest::addColumn<QVariant>("param");
+
+	for(auto size : {2048, 3072, 4096}) {
+		QTest::newRow("RSA_OAEP_SHA3_512:" + QByteArray::number(size))
+				<< Setup::RSA_OAEP_SHA3_512
+				<< QVariant(size);
+	}
+
+#if CRYPTOPP_VERSION >= 600
+	const QList<std::pair<const char*, Setup::EllipticCurve>> curves {
+		{"secp256r1", Setup::secp256r1},
+		{"secp384r1", Setup::secp384r1},
+		{"secp521r1", Setup::secp521r1},
+		{"brainpoolP256r1", Setup::brainpoolP256r1},
+		{"brainpoolP384r1", Setup::brainpoolP384r1},
+		{"brainpoolP512r1", Setup::brainpoolP512r1}
+	};
+	for(const auto &curve : curves) {
+		QTest::newRow(QByteArray("ECIES_ECP_SHA3_512:") + curve.first)
+				<< Setup::ECIES_ECP_SHA3_512
+				<< QVariant(curve.second);
+	}
+#endif
+}
+
+void BenchmarkCrypto::symData()
+{
+	QTest::addColumn<Setup::CipherScheme>("scheme");
+	QTest::addColumn<int>("size");
+
+	const QList<std::pair<const char*, Setup::CipherScheme>> schemes {
+		{"AES_EAX", Setup::AES_EAX},
+		{"AES_GCM", Setup::AES_GCM},
+		{"TWOFISH_EAX", Setup::TWOFISH_EAX},
+		{"TWOFISH_GCM", Setup::TWOFISH_GCM},
+		{"SERPENT_EAX", Setup::SERPENT_EAX},
+		{"SERPENT_GCM", Setup::SERPENT_GCM},
+		{"IDEA_EAX", Setup::IDEA_EAX},
+#if CRYPTOPP_VERSION >= 810
+		{"CHACHA20_POLY1305", Setup::CHACHA20_POLY1305},
+		{"XCHACHA20_POLY1305", Setup::XCHACHA20_POLY1305},
+#endif
+	};
+	for(const auto &scheme : schemes) {
+		for(auto size : {64, 1024, 16384, 262144, 1048576}) {
+			QTest::newRow(QByteArray(scheme.first) + ":" + QByteArray::number(size))
+					<< scheme.second
+					<< size;
+		}
+	}
+}
+
+void BenchmarkCrypto::generate(ClientCrypto &crypto, Setup::SignatureScheme scheme, const QVariant &param)
+{
+#if CRYPTOPP_VERSION >= 600
+	crypto.generate(scheme, param,
+					Setup::ECIES_ECP_SHA3_512, QVariant(Setup::secp256r1));
+#else
+	crypto.generate(scheme, param,
+					Setup::RSA_OAEP_SHA3_512, QVariant(2048));
+#endif
+}
+
+void BenchmarkCrypto::generate(ClientCrypto &crypto, Setup::EncryptionScheme scheme, const QVariant &param)
+{
+	crypto.generate(Setup::ECDSA_ECP_SHA3_512, QVariant(Setup::secp256r1),
+					scheme, param);
+}
+
+void BenchmarkCrypto::loadCipher(Setup::CipherScheme scheme)
+{
+	controller->clearKeyMaterial();
+	auto dPriv = DefaultsPrivate::obtainDefaults(DefaultSetup);
+	dPriv->properties.insert(Defaults::SymScheme, scheme);
+	controller->createPrivateKeys("nonce");
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	BenchmarkCrypto bench;
+	QTEST_SET_MAIN_SOURCE_PATH
+
+	//unless an output is specified, additionally write the results as xml, so they can be tracked across releases
+	auto args = app.arguments();
+	const QStringList outputArgs {
+		QStringLiteral("-o"),
+		QStringLiteral("-txt"),
+		QStringLiteral("-csv"),
+		QStringLiteral("-xml"),
+		QStringLiteral("-lightxml"),
+		QStringLiteral("-xunitxml"),
+		QStringLiteral("-teamcity"),
+		QStringLiteral("-tap")
+	};
+	auto hasOutput = false;
+	for(const auto &arg : outputArgs)
+		hasOutput = hasOutput || args.contains(arg);
+	if(!hasOutput) {
+		args << QStringLiteral("-o") << QStringLiteral("benchmarkcrypto.xml,xml")
+			 << QStringLiteral("-o") << QStringLiteral("-,txt");
+	}
+	return QTest::qExec(&bench, args);
+}
+
+#include "tst_benchmarkcrypto.moc"
@@ -1,6 +1,6 @@
 include(../tests.pri)
 
-QT += service
+QT += service sql
 
 TARGET = tst_appserver
 
@@ -2,6 +2,10 @@
 #include <QtTest>
 #include <QCoreApplication>
 #include <QProcess>
+#include <QSettings>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
 #include <QtService/ServiceControl>
 #include <testlib.h>
 #include <mockclient.h>
@@ -18,13 +22,16 @@
 #include <QtDataSync/private/accountmessage_p.h>
 #include <QtDataSync/private/loginmessage_p.h>
 #include <QtDataSync/private/welcomemessage_p.h>
+#include <QtDataSync/private/sessionmessage_p.h>
 #include <QtDataSync/private/accessmessage_p.h>
 #include <QtDataSync/private/proofmessage_p.h>
 #include <QtDataSync/private/grantmessage_p.h>
 #include <QtDataSync/private/macupdatemessage_p.h>
 #include <QtDataSync/private/changemessage_p.h>
 #include <QtDataSync/private/changedmessage_p.h>
+#include <QtDataSync/private/chunkmessage_p.h>
 #include <QtDataSync/private/syncmessage_p.h>
+#include <QtDataSync/private/treemessage_p.h>
 #include <QtDataSync/private/devicechangemessage_p.h>
 #include <QtDataSync/private/keychangemessage_p.h>
 #include <QtDataSync/private/devicekeysmessage_p.h>
@@ -54,6 +61,8 @@ private Q_SLOTS:
 	void testInvalidLoginSignature();
 	void testInvalidLoginDevId();
 	void testLogin();
+	void testResume();
+	void testUpdateDeviceKeys();
 
 	void testAddDevice();
 	void testInvalidAccessNonce();
@@ -61,12 +70,17 @@ private Q_SLOTS:
 	void testDenyAddDevice();
 	void testOfflineAddDevice();
 	void testInvalidAcceptSignature();
+	void testInvalidAcceptMac();
 	void testAddDeviceInvalidKeyIndex();
 	void testSendDoubleAccept();
 
 	void testChangeUpload();
+	void testChangeBatchUpload();
 	void testChangeDownloadOnLogin();
 	void testLiveChanges();
+	void testChunkUpload();
+	void testChunkDownload();
+	void testDeltaResend();
 	void testSyncCommand();
 	void testDeviceUploading();
 
@@ -76,6 +90,7 @@ private Q_SLOTS:
 	void testChangeKeyPendingChanges();
 	void testAddNewKeyInvalidIndex();
 	void testAddNewKeyInvalidSignature();
+	void testAddNewKeyInvalidMac();
 	void testAddNewKeyPendingChanges();
 	void testKeyChangeNoAck();
 
@@ -106,10 +121,12 @@ private:
 	QUuid partnerDevId;
 	ClientCrypto *partnerCrypto;
 
+	void testLogin(const QVersionNumber &protocolVersion);
 	void testAddDevice(MockClient *&partner, QUuid &partnerDevId, bool keepPartner = false);
 
 	void clean(bool disconnect = true);
 	void clean(MockClient *&client, bool disconnect = true);
+	void updateDeviceKeys(QUuid deviceId, ClientCrypto *keyCrypto);
 
 	template <typename TMessage, typename... Args>
 	inline QSharedPointer<Message> create(Args... args);
@@ -413,6 +430,11 @@ void TestAppServer::testInvalidLoginDevId()
 }
 
 void TestAppServer::testLogin()
+{
+	testLogin(InitMessage::CurrentVersion);
+}
+
+void TestAppServer::testLogin(const QVersionNumber &protocolVersion)
 {
 	try {
 		//establish connection
@@ -429,11 +451,13 @@ void TestAppServer::testLogin()
 		}));
 
 		//send back a valid login message
-		client->sendSigned(LoginMessage {
-							   devId,
-							   devName,
-							   mNonce
-						   }, crypto);
+		LoginMessage loginMsg {
+			devId,
+			devName,
+			mNonce
+		};
+		loginMsg.protocolVersion = protocolVersion;
+		client->sendSigned(loginMsg, crypto);
 
 		//wait for the account message
 		QVERIFY(client->waitForReply<WelcomeMessage>([&](WelcomeMessage message, bool &ok) {
@@ -444,6 +468,8 @@ void TestAppServer::testLogin()
 			QVERIFY(message.cmac.isNull());
 			ok = true;
 		}));
+		//older clients keep signing their messages
+		QCOMPARE(client->hasSession(), protocolVersion >= InitMessage::SessionVersion);
 
 		//keep session active
 	} catch(std::exception &e) {
@@ -451,6 +477,126 @@ void TestAppServer::testLogin()
 	}
 }
 
+void TestAppServer::testResume()
+{
+	try {
+		//ticket of the login session
+		QVERIFY(client);
+		auto ticket = client->ticket();
+		QVERIFY(!ticket.isEmpty());
+		auto secret = client->ticketSecret(crypto);
+		clean();
+
+		//establish connection
+		client = new MockClient(this);
+		QVERIFY(client->waitForConnected());
+
+		//wait for identify message
+		QByteArray mNonce;
+		QVERIFY(client->waitForReply<IdentifyMessage>([&](IdentifyMessage message, bool &ok) {
+			QVERIFY(message.nonce.size() >= InitMessage::NonceSize);
+			QCOMPARE(message.protocolVersion, InitMessage::CurrentVersion);
+			mNonce = message.nonce;
+			ok = true;
+		}));
+
+		//send a resume message with a wrong secret
+		CryptoPP::SecByteBlock wrongSecret(secret.size());
+		crypto->rng().GenerateBlock(wrongSecret.data(), wrongSecret.size());
+		client->sendResume(ResumeMessage {
+							   devId,
+							   ticket,
+							   mNonce
+						   }, wrongSecret);
+
+		//rejected: wait for a new identify message, to fall back to a normal login
+		QVERIFY(client->waitForReply<IdentifyMessage>([&](IdentifyMessage message, bool &ok) {
+			QVERIFY(message.nonce.size() >= InitMessage::NonceSize);
+			QVERIFY(message.nonce != mNonce);
+			mNonce = message.nonce;
+			ok = true;
+		}));
+
+		//send a valid resume message
+		client->sendResume(ResumeMessage {
+							   devId,
+							   ticket,
+							   mNonce
+						   }, secret);
+
+		//wait for the welcome message, without a new session or ticket
+		QVERIFY(client->waitForReply<WelcomeMessage>([&](WelcomeMessage message, bool &ok) {
+			QVERIFY(!message.hasChanges);
+			QCOMPARE(message.keyIndex, 0u);
+			QVERIFY(message.key.isEmpty());
+			ok = true;
+		}));
+		QVERIFY(client->hasSession());
+		QVERIFY(client->ticket().isEmpty());
+
+		//keep session active
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestAppServer::testUpdateDeviceKeys()
+{
+	try {
+		//logged in, so the keys of the device are cached by the server
+		QVERIFY(client);
+		QVERIFY(client->hasSession());
+		clean();
+
+		auto newCrypto = new ClientCrypto(this);
+		newCrypto->generate(Setup::RSA_PSS_SHA3_512, 2048,
+							Setup::RSA_OAEP_SHA3_512, 2048);
+		updateDeviceKeys(devId, newCrypto);
+		if(QTest::currentTestFailed())
+			return;
+
+		for(auto useNewKeys : {false, true}) {
+			//establish connection
+			client = new MockClient(this);
+			QVERIFY(client->waitForConnected());
+
+			//wait for identify message
+			QByteArray mNonce;
+			QVERIFY(client->waitForReply<IdentifyMessage>([&](IdentifyMessage message, bool &ok) {
+				mNonce = message.nonce;
+				ok = true;
+			}));
+
+			//send a login signed with the old or the new keys
+			client->sendSigned(LoginMessage {
+								   devId,
+								   devName,
+								   mNonce
+							   }, useNewKeys ? newCrypto : crypto);
+
+			if(useNewKeys) {
+				//the new keys must be loaded instead of the cached ones
+				QVERIFY(client->waitForReply<WelcomeMessage>([&](WelcomeMessage message, bool &ok) {
+					Q_UNUSED(message)
+					ok = true;
+				}));
+				QVERIFY(client->hasSession());
+			} else //the cached keys must have been invalidated
+				QVERIFY(client->waitForError(ErrorMessage::AuthenticationError));
+			clean();
+		}
+
+		//restore the original keys and login again
+		updateDeviceKeys(devId, crypto);
+		newCrypto->deleteLater();
+		if(QTest::currentTestFailed())
+			return;
+		testLogin();
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestAppServer::testAddDevice()
 {
 	testAddDevice(partner, partnerDevId);
@@ -519,7 +665,7 @@ void TestAppServer::testAddDevice(MockClient *&partner, QUuid &partnerDevId, boo
 		accMsg.index = keyIndex;
 		accMsg.scheme = keyScheme;
 		accMsg.secret = keySecret;
-		client->sendSigned(accMsg, crypto);
+		client->sendAuthenticated(accMsg, crypto);
 		QVERIFY(client->waitForReply<AcceptAckMessage>([&](AcceptAckMessage message, bool &ok) {
 			QCOMPARE(message.deviceId, partnerDevId);
 			ok = true;
@@ -756,7 +902,11 @@ void TestAppServer::testOfflineAddDevice()
 void TestAppServer::testInvalidAcceptSignature()
 {
 	try {
+		//login without session support
+		clean(client);
+		testLogin(InitMessage::ChunkVersion);
 		QVERIFY(client);
+		QVERIFY(!client->hasSession());
 
 		//invalid accept
 		AcceptMessage accMsg { QUuid::createUuid() };
@@ -776,6 +926,30 @@ void TestAppServer::testInvalidAcceptSignature()
 	}
 }
 
+void TestAppServer::testInvalidAcceptMac()
+{
+	try {
+		QVERIFY(client);
+		QVERIFY(client->hasSession());
+
+		//invalid accept
+		AcceptMessage accMsg { QUuid::createUuid() };
+		accMsg.index = 42;
+		accMsg.scheme = "keyScheme";
+		accMsg.secret = "keySecret";
+		auto sData = client->serializeAuthenticated(accMsg, crypto);
+		sData[sData.size() - 1] = sData[sData.size() - 1] + 'x';
+		client->sendBytes(sData); //message + fake mac
+
+		QVERIFY(client->waitForError(ErrorMessage::AuthenticationError));
+		clean(client);
+
+		testLogin();
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestAppServer::testAddDeviceInvalidKeyIndex()
 {
 	QByteArray pNonce = "partner_nonce";
@@ -842,7 +1016,7 @@ void TestAppServer::testAddDeviceInvalidKeyIndex()
 		accMsg.index = keyIndex;
 		accMsg.scheme = keyScheme;
 		accMsg.secret = keySecret;
-		client->sendSigned(accMsg, crypto);
+		client->sendAuthenticated(accMsg, crypto);
 		QVERIFY(client->waitForReply<AcceptAckMessage>([&](AcceptAckMessage message, bool &ok) {
 			QCOMPARE(message.deviceId, partnerDevId);
 			ok = true;
@@ -936,7 +1110,7 @@ void TestAppServer::testSendDoubleAccept()
 		accMsg.index = keyIndex;
 		accMsg.scheme = keyScheme;
 		accMsg.secret = keySecret;
-		client->sendSigned(accMsg, crypto);
+		client->sendAuthenticated(accMsg, crypto);
 		QVERIFY(client->waitForReply<AcceptAckMessage>([&](AcceptAckMessage message, bool &ok) {
 			QCOMPARE(message.deviceId, partnerDevId);
 			ok = true;
@@ -964,7 +1138,7 @@ void TestAppServer::testSendDoubleAccept()
 		}));
 
 		//send another proof accept
-		client->sendSigned(accMsg, crypto);
+		client->sendAuthenticated(accMsg, crypto);
 		QVERIFY(client->waitForNothing()); //no accept ack
 		QVERIFY(partner->waitForNothing()); //no grant
 
@@ -1020,6 +1194,34 @@ void TestAppServer::testChangeUpload()
 	}
 }
 
+void TestAppServer::testChangeBatchUpload()
+{
+	QByteArray dataId1 = "dataId1";
+	QByteArray dataId2 = "dataId2";
+	quint32 keyIndex = 0;
+	QByteArray salt = "salt";
+	QByteArray data = "data";
+
+	try {
+		QVERIFY(client);
+		QVERIFY(!partner);
+
+		//send upload 1 and 2 again, as one batch
+		ChangeBatchMessage batchMsg;
+		batchMsg.changes.append(std::make_tuple(dataId1, keyIndex, salt, data));
+		batchMsg.changes.append(std::make_tuple(dataId2, keyIndex, salt, data));
+		client->send(batchMsg);
+
+		//wait for ack
+		QVERIFY(client->waitForReply<ChangeBatchAckMessage>([&](ChangeBatchAckMessage message, bool &ok) {
+			QCOMPARE(message.dataIds, QList<QByteArray>({dataId1, dataId2}));
+			ok = true;
+		}));
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestAppServer::testChangeDownloadOnLogin()
 {
 	quint32 keyIndex = 0;
@@ -1142,6 +1344,178 @@ void TestAppServer::testLiveChanges()
 	}
 }
 
+void TestAppServer::testChunkUpload()
+{
+	QByteArray dataId1 = "dataId5";
+	quint32 keyIndex = 0;
+	QByteArray salt = "chunkSalt";
+	QByteArrayList chunks = {"chunk0", "chunk1", "chunk2"};
+
+	try {
+		QVERIFY(client);
+		QVERIFY(partner);
+
+		ChangeChunkMessage chunkMsg { dataId1 };
+		chunkMsg.keyIndex = keyIndex;
+		chunkMsg.salt = salt;
+		chunkMsg.chunkCount = static_cast<quint32>(chunks.size());
+
+		//send the first two chunks, one after the other
+		for(quint32 i = 0; i < 2; i++) {
+			chunkMsg.chunkIndex = i;
+			chunkMsg.data = chunks[static_cast<int>(i)];
+			client->send(chunkMsg);
+			QVERIFY(client->waitForReply<ChangeChunkAckMessage>([&](ChangeChunkAckMessage message, bool &ok) {
+				QCOMPARE(message.dataId, dataId1);
+				QCOMPARE(message.salt, salt);
+				QCOMPARE(message.nextChunk, i + 1);
+				ok = true;
+			}));
+		}
+		//nothing must be sent to the partner yet
+		QVERIFY(partner->waitForNothing());
+
+		//resume: start over, the server must skip ahead to the missing chunk
+		chunkMsg.chunkIndex = 0;
+		chunkMsg.data = chunks[0];
+		client->send(chunkMsg);
+		QVERIFY(client->waitForReply<ChangeChunkAckMessage>([&](ChangeChunkAckMessage message, bool &ok) {
+			QCOMPARE(message.dataId, dataId1);
+			QCOMPARE(message.nextChunk, 2u);
+			ok = true;
+		}));
+
+		//send the last chunk
+		chunkMsg.chunkIndex = 2;
+		chunkMsg.data = chunks[2];
+		client->send(chunkMsg);
+		QVERIFY(client->waitForReply<ChangeChunkAckMessage>([&](ChangeChunkAckMessage message, bool &ok) {
+			QCOMPARE(message.dataId, dataId1);
+			QCOMPARE(message.nextChunk, chunkMsg.chunkCount);
+			ok = true;
+		}));
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestAppServer::testChunkDownload()
+{
+	quint32 keyIndex = 0;
+	QByteArray salt = "chunkSalt";
+	QByteArrayList chunks = {"chunk0", "chunk1", "chunk2"};
+
+	try {
+		QVERIFY(client);
+		QVERIFY(partner);
+
+		//the partner gets the first chunk of the change uploaded in testChunkUpload
+		quint64 dataId1 = 0;
+		QVERIFY(partner->waitForReply<ChangedChunkMessage>([&](ChangedChunkMessage message, bool &ok) {
+			QCOMPARE(message.changeEstimate, 1u);
+			QCOMPARE(message.keyIndex, keyIndex);
+			QCOMPARE(message.salt, salt);
+			QCOMPARE(message.chunkIndex, 0u);
+			QCOMPARE(message.chunkCount, static_cast<quint32>(chunks.size()));
+			QCOMPARE(message.data, chunks[0]);
+			dataId1 = message.dataIndex;
+			ok = true;
+		}));
+
+		//request the remaining chunks, one at a time
+		for(quint32 i = 1; i < static_cast<quint32>(chunks.size()); i++) {
+			partner->send(ChangedChunkAckMessage { dataId1, i });
+			QVERIFY(partner->waitForReply<ChangedChunkMessage>([&](ChangedChunkMessage message, bool &ok) {
+				QCOMPARE(message.dataIndex, dataId1);
+				QCOMPARE(message.changeEstimate, 0u);
+				QCOMPARE(message.chunkIndex, i);
+				QCOMPARE(message.data, chunks[static_cast<int>(i)]);
+				ok = true;
+			}));
+		}
+
+		//acknowledge the last chunk and the completed change
+		partner->send(ChangedChunkAckMessage { dataId1, static_cast<quint32>(chunks.size()) });
+		QVERIFY(partner->waitForNothing());
+		partner->send(ChangedAckMessage { dataId1 });
+		QVERIFY(partner->waitForReply<LastChangedMessage>([&](LastChangedMessage message, bool &ok) {
+			Q_UNUSED(message)
+			ok = true;
+		}));
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestAppServer::testDeltaResend()
+{
+	QByteArray dataId1 = "dataId6";
+	quint32 keyIndex = 0;
+	QByteArray salt = "salt";
+	QByteArray data = "delta";
+
+	try {
+		QVERIFY(client);
+		QVERIFY(partner);
+
+		//send a delta upload
+		DeltaChangeMessage changeMsg { dataId1 };
+		changeMsg.keyIndex = keyIndex;
+		changeMsg.salt = salt;
+		changeMsg.data = data;
+		client->send(changeMsg);
+		QVERIFY(client->waitForReply<ChangeAckMessage>([&](ChangeAckMessage message, bool &ok) {
+			QCOMPARE(message.dataId, dataId1);
+			ok = true;
+		}));
+
+		//partner gets the delta, but cannot apply it
+		quint64 dataId2 = 0;
+		QVERIFY(partner->waitForReply<ChangedInfoMessage>([&](ChangedInfoMessage message, bool &ok) {
+			QCOMPARE(message.changeEstimate, 1u);
+			QCOMPARE(message.data, data);
+			dataId2 = message.dataIndex;
+			ok = true;
+		}));
+		partner->send(ChangedNackMessage { dataId2 });
+		QVERIFY(partner->waitForReply<LastChangedMessage>([&](LastChangedMessage message, bool &ok) {
+			Q_UNUSED(message)
+			ok = true;
+		}));
+
+		//the uploader is asked for the complete change
+		QVERIFY(client->waitForReply<ResendMessage>([&](ResendMessage message, bool &ok) {
+			QCOMPARE(message.dataIds, QList<QByteArray>{dataId1});
+			ok = true;
+		}));
+
+		//the complete upload replaces the delta
+		ChangeMessage fullMsg { dataId1 };
+		fullMsg.keyIndex = keyIndex;
+		fullMsg.salt = salt;
+		fullMsg.data = "data";
+		client->send(fullMsg);
+		QVERIFY(client->waitForReply<ChangeAckMessage>([&](ChangeAckMessage message, bool &ok) {
+			QCOMPARE(message.dataId, dataId1);
+			ok = true;
+		}));
+		QVERIFY(partner->waitForReply<ChangedInfoMessage>([&](ChangedInfoMessage message, bool &ok) {
+			QCOMPARE(message.changeEstimate, 1u);
+			QCOMPARE(message.data, fullMsg.data);
+			dataId2 = message.dataIndex;
+			ok = true;
+		}));
+		partner->send(ChangedAckMessage { dataId2 });
+		QVERIFY(partner->waitForReply<LastChangedMessage>([&](LastChangedMessage message, bool &ok) {
+			Q_UNUSED(message)
+			ok = true;
+		}));
+		QVERIFY(client->waitForNothing());
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestAppServer::testSyncCommand()
 {
 	try {
@@ -1255,7 +1629,7 @@ void TestAppServer::testChangeKey()
 		keyMsg.cmac = devName.toUtf8();
 		keyMsg.scheme = scheme;
 		keyMsg.deviceKeys.append(std::make_tuple(partnerDevId, key, cmac));
-		client->sendSigned(keyMsg, crypto);
+		client->sendAuthenticated(keyMsg, crypto);
 
 		//wait for ack
 		QVERIFY(client->waitForReply<NewKeyAckMessage>([&](NewKeyAckMessage message, bool &ok) {
@@ -1400,7 +1774,7 @@ void TestAppServer::testChangeKeyPendingChanges()
 		keyMsg.cmac = devName.toUtf8();
 		keyMsg.scheme = scheme;
 		keyMsg.deviceKeys.append(std::make_tuple(partnerDevId, key, cmac));
-		client->sendSigned(keyMsg, crypto);
+		client->sendAuthenticated(keyMsg, crypto);
 
 		//wait for ack
 		QVERIFY(client->waitForReply<NewKeyAckMessage>([&](NewKeyAckMessage message, bool &ok) {
@@ -1431,7 +1805,7 @@ void TestAppServer::testAddNewKeyInvalidIndex()
 		keyMsg.cmac = "cmac";
 		keyMsg.scheme = "scheme";
 		keyMsg.deviceKeys.append(std::make_tuple(partnerDevId, "key", "cmac"));
-		client->sendSigned(keyMsg, crypto);
+		client->sendAuthenticated(keyMsg, crypto);
 
 		//make shure no disconnect
 		QVERIFY(client->waitForError(ErrorMessage::KeyIndexError));
@@ -1448,7 +1822,11 @@ void TestAppServer::testAddNewKeyInvalidSignature()
 	quint32 nextIndex = 3;//valid index
 
 	try {
+		//login without session support
+		clean(client);
+		testLogin(InitMessage::ChunkVersion);
 		QVERIFY(client);
+		QVERIFY(!client->hasSession());
 
 		NewKeyMessage keyMsg;
 		keyMsg.keyIndex = nextIndex;
@@ -1469,6 +1847,33 @@ void TestAppServer::testAddNewKeyInvalidSignature()
 	}
 }
 
+void TestAppServer::testAddNewKeyInvalidMac()
+{
+	quint32 nextIndex = 3;//valid index
+
+	try {
+		QVERIFY(client);
+		QVERIFY(client->hasSession());
+
+		NewKeyMessage keyMsg;
+		keyMsg.keyIndex = nextIndex;
+		keyMsg.cmac = "cmac";
+		keyMsg.scheme = "scheme";
+		keyMsg.deviceKeys.append(std::make_tuple(partnerDevId, "key", "cmac"));
+		auto sData = client->serializeAuthenticated(keyMsg, crypto);
+		sData[sData.size() - 1] = sData[sData.size() - 1] + 'x';
+		client->sendBytes(sData); //message + fake mac
+
+		//make shure no disconnect
+		QVERIFY(client->waitForError(ErrorMessage::AuthenticationError));
+		clean(client);
+
+		testLogin();
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestAppServer::testAddNewKeyPendingChanges()
 {
 	//theoretical situtation, that cannot occur normally
@@ -1482,7 +1887,7 @@ void TestAppServer::testAddNewKeyPendingChanges()
 		keyMsg.cmac = "cmac";
 		keyMsg.scheme = "scheme";
 		keyMsg.deviceKeys.append(std::make_tuple(partnerDevId, "key", "cmac"));
-		client->sendSigned(keyMsg, crypto);
+		client->sendAuthenticated(keyMsg, crypto);
 
 		//make shure no disconnect
 		QVERIFY(client->waitForError(ErrorMessage::ServerError, true));//is ok here, as this case is typically detected by the KeyChangeMessage.
@@ -1669,6 +2074,9 @@ void TestAppServer::testUnexpectedMessage_data()
 	QTest::newRow("AccessMessage") << createNonced<AccessMessage>()
 								   << true
 								   << true;
+	QTest::newRow("ResumeMessage") << createNonced<ResumeMessage>(devId, QByteArray("ticket"))
+								   << true
+								   << true;
 	QTest::newRow("SyncMessage") << create<SyncMessage>()
 								 << false
 								 << false;
@@ -1702,6 +2110,9 @@ void TestAppServer::testUnexpectedMessage_data()
 	QTest::newRow("NewKeyMessage") << create<NewKeyMessage>()
 								   << false
 								   << true;
+	QTest::newRow("TreeMessage") << create<TreeMessage>(true, QVector<QByteArray>(TreeMessage::BucketCount, "digest").toList())
+								 << false
+								 << false;
 }
 
 void TestAppServer::testUnexpectedMessage()
@@ -1827,6 +2238,36 @@ void TestAppServer::testStop()
 	QTRY_COMPARE(server->status(), QtService::ServiceControl::ServiceStopped);
 }
 
+void TestAppServer::updateDeviceKeys(QUuid deviceId, ClientCrypto *keyCrypto)
+{
+	QSettings config{QStringLiteral(SETUP_FILE), QSettings::IniFormat};
+	config.beginGroup(QStringLiteral("database"));
+
+	{
+		auto db = QSqlDatabase::addDatabase(QStringLiteral("QPSQL"), QStringLiteral("tst_appserver"));
+		db.setDatabaseName(config.value(QStringLiteral("name")).toString());
+		db.setHostName(config.value(QStringLiteral("host")).toString());
+		db.setPort(config.value(QStringLiteral("port")).toInt());
+		db.setUserName(config.value(QStringLiteral("username")).toString());
+		db.setPassword(config.value(QStringLiteral("password")).toString());
+		QVERIFY2(db.open(), qUtf8Printable(db.lastError().text()));
+
+		//updates the keys behind the servers back - the device_keys_trigger notifies the server
+		QSqlQuery updateQuery(db);
+		QVERIFY(updateQuery.prepare(QStringLiteral("UPDATE devices SET signkey = ?, cryptkey = ? WHERE id = ?")));
+		updateQuery.addBindValue(keyCrypto->writeSignKey());
+		updateQuery.addBindValue(keyCrypto->writeCryptKey());
+		updateQuery.addBindValue(deviceId);
+		QVERIFY2(updateQuery.exec(), qUtf8Printable(updateQuery.lastError().text()));
+		QCOMPARE(updateQuery.numRowsAffected(), 1);
+		db.close();
+	}
+	QSqlDatabase::removeDatabase(QStringLiteral("tst_appserver"));
+
+	//give the server time to handle the notification
+	QTest::qWait(1000);
+}
+
 void TestAppServer::clean(bool disconnect)
 {
 	clean(client, disconnect);
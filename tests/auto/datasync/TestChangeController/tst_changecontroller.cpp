@@ -26,6 +26,10 @@ private Q_SLOTS:
 	void testChanges();
 
 	void testDeviceChanges();
+	void testDeviceSnapshots();
+	void testUploadWindow();
+	void testUploadDebounce();
+	void testUploadPriorities();
 
 	//last test, to avoid problems
 	void testChangeTriggers();
@@ -147,7 +151,7 @@ void TestChangeController::testChanges()
 			return;
 		}
 
-		QCOMPARE(changeSpy.size(), 1);
+		QTRY_COMPARE(changeSpy.size(), 1);
 		QVERIFY(activeSpy.last()[0].toBool());
 		QCOMPARE(addedSpy.size(), 1);
 		QCOMPARE(addedSpy.takeFirst()[0].toUInt(), 1u);
@@ -203,8 +207,8 @@ void TestChangeController::testDeviceChanges()
 		if(!errorSpy.isEmpty())
 			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
 
-		QCOMPARE(changeSpy.size(), 2);
-		QCOMPARE(deviceChangeSpy.size(), 3);
+		QTRY_COMPARE(changeSpy.size(), 2);
+		QTRY_COMPARE(deviceChangeSpy.size(), 3);
 		QCOMPARE(addedSpy.size(), 1);
 		QCOMPARE(addedSpy.takeFirst()[0].toUInt(), 5u);
 		QVERIFY(activeSpy.last()[0].toBool());
@@ -261,6 +265,262 @@ void TestChangeController::testDeviceChanges()
 	controller->clearUploads();
 }
 
+void TestChangeController::testDeviceSnapshots()
+{
+	controller->setUploadingEnabled(false);
+	QCoreApplication::processEvents();
+	QSignalSpy changeSpy(controller, &ChangeController::uploadChange);
+	QSignalSpy deviceChangeSpy(controller, &ChangeController::uploadDeviceChange);
+	QSignalSpy incrementSpy(controller, &ChangeController::progressIncrement);
+	QSignalSpy errorSpy(controller, &ChangeController::controllerError);
+
+	try {
+		auto devId = QUuid::createUuid();
+
+		//Create the device changes
+		store->reset(false);
+		for(auto i = 0; i < 5; i++)
+			store->save(TestLib::generateKey(70 + i), TestLib::generateDataJson(70 + i));
+		for(auto i = 0; i < 5; i++)
+			store->markUnchanged(TestLib::generateKey(70 + i), 1, false);
+		store->prepareAccountAdded(devId);
+		QCOMPARE(store->changeCount(), 5u);
+
+		//all device changes are bundled into one upload
+		controller->updateSnapshotSupport(devId, true);
+		controller->setUploadingEnabled(true);
+		QTRY_COMPARE(deviceChangeSpy.size(), 1);
+		QVERIFY(!deviceChangeSpy.wait(500));
+		QVERIFY(changeSpy.isEmpty());
+		if(!errorSpy.isEmpty())
+			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
+
+		auto change = deviceChangeSpy.takeFirst();
+		QCOMPARE(change[1].toUuid(), devId);
+		auto data = change[2].toByteArray();
+		QVERIFY(SyncHelper::isSnapshot(data));
+		auto snapshot = SyncHelper::parseSnapshot(data);
+		QCOMPARE(snapshot.size(), 5);
+		QSet<ObjectKey> keys;
+		for(const auto &entry : snapshot) {
+			keys.insert(entry.key);
+			QCOMPARE(entry.version, 1ull);
+			QCOMPARE(entry.data, store->load(entry.key));
+		}
+		QCOMPARE(keys.size(), 5);
+
+		//acknowledging the snapshot completes all of its datasets
+		controller->deviceUploadDone(change[0].toByteArray(), devId);
+		QCOMPARE(store->changeCount(), 0u);
+		QCOMPARE(incrementSpy.size(), 5);
+		QVERIFY(!deviceChangeSpy.wait());
+
+		//devices without snapshot support get their changes one by one
+		controller->setUploadingEnabled(false);
+		QCoreApplication::processEvents();
+		auto oldDevId = QUuid::createUuid();
+		store->prepareAccountAdded(oldDevId);
+		QCOMPARE(store->changeCount(), 5u);
+		controller->updateSnapshotSupport(oldDevId, false);
+		controller->setUploadingEnabled(true);
+		QTRY_COMPARE(deviceChangeSpy.size(), 5);
+		QVERIFY(changeSpy.isEmpty());
+		if(!errorSpy.isEmpty())
+			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
+		for(const auto &oldChange : qAsConst(deviceChangeSpy)) {
+			QCOMPARE(oldChange[1].toUuid(), oldDevId);
+			QVERIFY(!SyncHelper::isSnapshot(oldChange[2].toByteArray()));
+			controller->deviceUploadDone(oldChange[0].toByteArray(), oldDevId);
+		}
+		deviceChangeSpy.clear();
+		QCOMPARE(store->changeCount(), 0u);
+
+		store->reset(false);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+	controller->clearUploads();
+}
+
+void TestChangeController::testUploadWindow()
+{
+	controller->setUploadingEnabled(false);
+	QCoreApplication::processEvents();
+	QSignalSpy changeSpy(controller, &ChangeController::uploadChange);
+	QSignalSpy errorSpy(controller, &ChangeController::controllerError);
+
+	try {
+		store->reset(false);
+		for(auto i = 0; i < 5; i++)
+			store->save(TestLib::generateKey(50 + i), TestLib::generateDataJson(50 + i));
+
+		//only 2 uploads may be in flight at the same time
+		controller->updateUploadLimit(2);
+		controller->setUploadingEnabled(true);
+		QTRY_COMPARE(changeSpy.size(), 2);
+		QVERIFY(!changeSpy.wait(500));
+		QCOMPARE(changeSpy.size(), 2);
+
+		//completing one frees a slot for the next one
+		QSet<ObjectKey> uploaded;
+		for(auto i = 0; i < 5; i++) {
+			QTRY_VERIFY(!changeSpy.isEmpty());
+			auto change = changeSpy.takeFirst();
+			uploaded.insert(std::get<1>(SyncHelper::extract(change[1].toByteArray())));
+			controller->uploadDone(change[0].toByteArray());
+		}
+		QCOMPARE(uploaded.size(), 5);
+		QVERIFY(!changeSpy.wait(500));
+		QCOMPARE(store->changeCount(), 0u);
+		QVERIFY(errorSpy.isEmpty());
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+
+	controller->updateUploadLimit(10);
+	controller->clearUploads();
+}
+
+void TestChangeController::testUploadDebounce()
+{
+	const auto dName = QStringLiteral("debounce");
+	const auto debounce = 500;
+	LocalStore *dStore = nullptr;
+	ChangeController *dController = nullptr;
+
+	try {
+		Setup setup;
+		TestLib::setup(setup);
+		setup.setUploadDebounce({{QString::fromUtf8(TestLib::TypeName), debounce}});
+		setup.create(dName);
+
+		dStore = new LocalStore(DefaultsPrivate::obtainDefaults(dName), this);
+		dController = new ChangeController(DefaultsPrivate::obtainDefaults(dName), this);
+		dController->initialize({
+									{QStringLiteral("store"), QVariant::fromValue(dStore)},
+									{QStringLiteral("emitter"), QVariant::fromValue<QObject*>(reinterpret_cast<QObject*>(SetupPrivate::engine(dName)->emitter()))},
+								});
+		dController->setUploadingEnabled(true);
+		QCoreApplication::processEvents();
+
+		QSignalSpy changeSpy(dController, &ChangeController::uploadChange);
+		QSignalSpy errorSpy(dController, &ChangeController::controllerError);
+
+		//a burst of changes within the debounce time only uploads the latest version
+		auto key = TestLib::generateKey(60);
+		QJsonObject data;
+		for(auto i = 0; i < 5; i++) {
+			data = TestLib::generateDataJson(60, QString::number(i));
+			dStore->save(key, data);
+			QTest::qWait(debounce / 10);
+		}
+		QVERIFY(changeSpy.isEmpty());
+		QTRY_COMPARE(changeSpy.size(), 1);
+		auto change = changeSpy.takeFirst();
+		QCOMPARE(change[1].toByteArray(), SyncHelper::combine(key, 5, data));
+		dController->uploadDone(change[0].toByteArray());
+		QVERIFY(!changeSpy.wait(debounce * 2));
+		QCOMPARE(dStore->changeCount(), 0u);
+
+		//constant changes are still uploaded once the maximum delay has passed
+		key = TestLib::generateKey(61);
+		QElapsedTimer timer;
+		timer.start();
+		for(auto i = 0; changeSpy.isEmpty() && timer.elapsed() < debounce * 8; i++) {
+			dStore->save(key, TestLib::generateDataJson(61, QString::number(i)));
+			QTest::qWait(debounce / 5);
+		}
+		QCOMPARE(changeSpy.size(), 1);
+		QVERIFY(timer.elapsed() >= debounce * 3);
+		QVERIFY(timer.elapsed() <= debounce * 6);
+		if(!errorSpy.isEmpty())
+			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+
+	if(dController) {
+		dController->finalize();
+		delete dController;
+	}
+	delete dStore;
+	Setup::removeSetup(dName, true);
+}
+
+void TestChangeController::testUploadPriorities()
+{
+	const auto pName = QStringLiteral("priorities");
+	const QByteArray lowType = "LowData";
+	LocalStore *pStore = nullptr;
+	ChangeController *pController = nullptr;
+
+	try {
+		Setup setup;
+		TestLib::setup(setup);
+		setup.setTypePriorities({
+									{QString::fromUtf8(TestLib::TypeName), 10},
+									{QString::fromUtf8(lowType), 0}
+								});
+		setup.create(pName);
+
+		pStore = new LocalStore(DefaultsPrivate::obtainDefaults(pName), this);
+		pController = new ChangeController(DefaultsPrivate::obtainDefaults(pName), this);
+		pController->initialize({
+									{QStringLiteral("store"), QVariant::fromValue(pStore)},
+									{QStringLiteral("emitter"), QVariant::fromValue<QObject*>(reinterpret_cast<QObject*>(SetupPrivate::engine(pName)->emitter()))},
+								});
+		pController->updateUploadLimit(4);
+
+		QSignalSpy changeSpy(pController, &ChangeController::uploadChange);
+		QSignalSpy errorSpy(pController, &ChangeController::controllerError);
+		auto isLow = [&](const QList<QVariant> &change) {
+			return std::get<1>(SyncHelper::extract(change[1].toByteArray())).typeName == lowType;
+		};
+
+		//a backlog of low priority changes, followed by high priority ones
+		for(auto i = 0; i < 6; i++)
+			pStore->save({lowType, QString::number(i)}, TestLib::generateDataJson(i));
+		auto nextHigh = 80;
+		for(; nextHigh < 86; nextHigh++)
+			pStore->save(TestLib::generateKey(nextHigh), TestLib::generateDataJson(nextHigh));
+
+		//the high priority changes fill the window first, but leave a slot for the lower class
+		pController->setUploadingEnabled(true);
+		QTRY_COMPARE(changeSpy.size(), 4);
+		QVERIFY(!changeSpy.wait(500));
+		QCOMPARE(static_cast<int>(std::count_if(changeSpy.constBegin(), changeSpy.constEnd(), isLow)), 1);
+
+		//keep adding high priority changes - the low priority ones must still be uploaded
+		auto lowUploaded = 0;
+		auto highUploaded = 0;
+		for(auto i = 0; i < 50 && lowUploaded < 6; i++) {
+			QTRY_VERIFY(!changeSpy.isEmpty());
+			auto change = changeSpy.takeFirst();
+			if(isLow(change))
+				lowUploaded++;
+			else {
+				highUploaded++;
+				pStore->save(TestLib::generateKey(nextHigh), TestLib::generateDataJson(nextHigh));
+				nextHigh++;
+			}
+			pController->uploadDone(change[0].toByteArray());
+		}
+		QCOMPARE(lowUploaded, 6);
+		QVERIFY(highUploaded > lowUploaded);
+		if(!errorSpy.isEmpty())
+			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+
+	if(pController) {
+		pController->finalize();
+		delete pController;
+	}
+	delete pStore;
+	Setup::removeSetup(pName, true);
+}
+
 void TestChangeController::testChangeTriggers()
 {
 	for(auto i = 0; i < 5; i++) { //wait for the engine to init itself
@@ -2,10 +2,13 @@
 #include <QtTest>
 #include <QCoreApplication>
 #include <testlib.h>
-#include <QtDataSync/private/cryptocontroller_p.h>
+#include <QtDataSync/private/synchelper_p.h>
+#include <QtDataSync/private/message_p.h>
+#include <QtDataSync/private/asymmetriccrypto_p.h>
 
 //fake private
 #define private public
+#include <QtDataSync/private/cryptocontroller_p.h>
 #include <QtDataSync/private/defaults_p.h>
 #undef private
 using namespace QtDataSync;
@@ -28,12 +31,19 @@ private Q_SLOTS:
 	void testKeyAccess();
 	void testSymCrypto_data();
 	void testSymCrypto();
+	void testContextRelease();
 
 	void testKeyExchange();
+	void testKeyPregeneration();
 
 	void testPwCrypto_data();
 	void testPwCrypto();
 
+	void benchmarkCompression_data();
+	void benchmarkCompression();
+	void benchmarkSymCrypto_data();
+	void benchmarkSymCrypto();
+
 private:
 	CryptoController *controller;
 
@@ -235,6 +245,9 @@ void TestCryptoController::testSymCrypto()
 		QByteArray cipher;
 		std::tie(index, salt, cipher) = controller->encryptData(message);
 		QCOMPARE(controller->decryptData(index, salt, cipher), message);
+		//second run with the cached cipher objects
+		std::tie(index, salt, cipher) = controller->encryptData(message + "2");
+		QCOMPARE(controller->decryptData(index, salt, cipher), QByteArray(message + "2"));
 
 		QVERIFY_EXCEPTION_THROWN(controller->decryptData(index + 1, salt, cipher), CryptoException);
 		auto fakeSalt = salt;
@@ -257,6 +270,44 @@ void TestCryptoController::testSymCrypto()
 	}
 }
 
+void TestCryptoController::testContextRelease()
+{
+	QByteArray message("a message encrypted on another thread");
+
+	try {
+		controller->clearKeyMaterial();
+		controller->createPrivateKeys("nonce");
+		auto prepared = controller->prepareEncryption();
+
+		//use the key on a thread that stays alive
+		QThread thread;
+		thread.start();
+		QObject worker;
+		worker.moveToThread(&thread);
+		QByteArray cipher;
+		QByteArray salt;
+		QVERIFY(QMetaObject::invokeMethod(&worker, [&](){
+			std::tie(std::ignore, salt, cipher) = controller->encryptPrepared(prepared, message);
+		}, Qt::BlockingQueuedConnection));
+		QCOMPARE(controller->decryptData(prepared.keyIndex, salt, cipher), message);
+		QCOMPARE(controller->_contexts.size(), 2); //one per thread
+
+		//clearing on this thread must release the keyed objects of the other one too
+		QList<QWeakPointer<CryptoController::CipherContext>> contexts;
+		for(const auto &context : qAsConst(controller->_contexts))
+			contexts.append(context);
+		controller->clearKeyMaterial();
+		QVERIFY(controller->_contexts.isEmpty());
+		for(const auto &context : qAsConst(contexts))
+			QVERIFY(context.isNull());
+
+		thread.quit();
+		QVERIFY(thread.wait());
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestCryptoController::testKeyExchange()
 {
 	try {
@@ -287,6 +338,43 @@ void TestCryptoController::testKeyExchange()
 	}
 }
 
+void TestCryptoController::testKeyPregeneration()
+{
+	QSignalSpy genSpy(controller, &CryptoController::keyGenerationChanged);
+
+	try {
+		controller->clearKeyMaterial();
+		controller->pregenerateKeys();
+		QVERIFY(controller->isGeneratingKeys());
+		QCOMPARE(genSpy.size(), 1);
+		QCOMPARE(genSpy.takeFirst()[0].toBool(), true);
+		controller->pregenerateKeys(); //already running -> ignored
+		QVERIFY(genSpy.isEmpty());
+
+		QVERIFY(genSpy.wait(30000));
+		QCOMPARE(genSpy.size(), 1);
+		QCOMPARE(genSpy.takeFirst()[0].toBool(), false);
+		QVERIFY(!controller->isGeneratingKeys());
+
+		//uses the pregenerated keys
+		controller->createPrivateKeys("nonce");
+		auto fPrint = controller->fingerprint();
+		QVERIFY(!fPrint.isEmpty());
+		QByteArray salt;
+		QByteArray cipher;
+		std::tie(std::ignore, salt, cipher) = controller->encryptData("message");
+		QCOMPARE(controller->decryptData(controller->keyIndex(), salt, cipher), QByteArray("message"));
+
+		//without pregenerated keys, new ones are generated
+		controller->clearKeyMaterial();
+		controller->createPrivateKeys("nonce");
+		QVERIFY(!controller->fingerprint().isEmpty());
+		QVERIFY(controller->fingerprint() != fPrint);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestCryptoController::testPwCrypto_data()
 {
 	symData();
@@ -357,6 +445,134 @@ void TestCryptoController::testPwCrypto()
 	}
 }
 
+void TestCryptoController::benchmarkCompression_data()
+{
+	QTest::addColumn<Setup::CipherScheme>("scheme");
+	QTest::addColumn<int>("level");
+
+	const QList<std::pair<const char*, Setup::CipherScheme>> schemes {
+		{"AES_EAX", Setup::AES_EAX},
+		{"AES_GCM", Setup::AES_GCM},
+		{"TWOFISH_EAX", Setup::TWOFISH_EAX},
+		{"TWOFISH_GCM", Setup::TWOFISH_GCM},
+		{"SERPENT_EAX", Setup::SERPENT_EAX},
+		{"SERPENT_GCM", Setup::SERPENT_GCM},
+		{"IDEA_EAX", Setup::IDEA_EAX}
+	};
+	for(const auto &scheme : schemes) {
+		for(auto level : {0, 1, 6, 9}) {
+			QTest::newRow(QByteArray(scheme.first) + ":" + QByteArray::number(level))
+					<< scheme.second
+					<< level;
+		}
+	}
+}
+
+void TestCryptoController::benchmarkCompression()
+{
+	QFETCH(Setup::CipherScheme, scheme);
+	QFETCH(int, level);
+
+	//a typical dataset: many short, similar entries
+	auto key = TestLib::generateKey(42);
+	QJsonObject data;
+	QJsonArray entries;
+	for(auto i = 0; i < 100; i++) {
+		entries.append(QJsonObject {
+						   {QStringLiteral("id"), i},
+						   {QStringLiteral("name"), QStringLiteral("Entry %1").arg(i)},
+						   {QStringLiteral("done"), i % 3 == 0},
+						   {QStringLiteral("description"), QStringLiteral("The description of entry number %1").arg(i)}
+					   });
+	}
+	data[QStringLiteral("entries")] = entries;
+
+	try {
+		controller->clearKeyMaterial();
+
+		auto dPriv = DefaultsPrivate::obtainDefaults(DefaultSetup);
+		dPriv->properties.insert(Defaults::SymScheme, scheme);
+		controller->createPrivateKeys("nonce");
+
+		quint32 index = 0;
+		QByteArray salt;
+		QByteArray cipher;
+		QBENCHMARK {
+			std::tie(index, salt, cipher) = controller->encryptData(SyncHelper::combine(key, 42, data, level));
+		}
+
+		auto plain = controller->decryptData(index, salt, cipher);
+		QCOMPARE(std::get<3>(SyncHelper::extract(plain)), data);
+		qInfo() << "Bytes on wire:" << cipher.size() + salt.size()
+				<< "uncompressed:" << SyncHelper::combine(key, 42, data).size();
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestCryptoController::benchmarkSymCrypto_data()
+{
+	QTest::addColumn<Setup::CipherScheme>("scheme");
+	QTest::addColumn<int>("size");
+
+	const QList<std::pair<const char*, Setup::CipherScheme>> schemes {
+		{"AES_EAX", Setup::AES_EAX},
+		{"AES_GCM", Setup::AES_GCM},
+		{"TWOFISH_EAX", Setup::TWOFISH_EAX},
+		{"TWOFISH_GCM", Setup::TWOFISH_GCM},
+		{"SERPENT_EAX", Setup::SERPENT_EAX},
+		{"SERPENT_GCM", Setup::SERPENT_GCM},
+		{"IDEA_EAX", Setup::IDEA_EAX},
+#if CRYPTOPP_VERSION >= 810
+		{"CHACHA20_POLY1305", Setup::CHACHA20_POLY1305},
+		{"XCHACHA20_POLY1305", Setup::XCHACHA20_POLY1305},
+#endif
+		{"AUTO_CIPHER", Setup::AUTO_CIPHER}
+	};
+	for(const auto &scheme : schemes) {
+		for(auto size : {64, 1024, 65536}) {
+			QTest::newRow(QByteArray(scheme.first) + ":" + QByteArray::number(size))
+					<< scheme.second
+					<< size;
+		}
+	}
+}
+
+void TestCryptoController::benchmarkSymCrypto()
+{
+	QFETCH(Setup::CipherScheme, scheme);
+	QFETCH(int, size);
+
+	//a single small object, the way changes are uploaded and downloaded
+	QByteArray data(size, 'x');
+
+	try {
+		controller->clearKeyMaterial();
+
+		auto dPriv = DefaultsPrivate::obtainDefaults(DefaultSetup);
+		dPriv->properties.insert(Defaults::SymScheme, scheme);
+		controller->createPrivateKeys("nonce");
+
+		auto encPrepared = controller->prepareEncryption();
+		auto decPrepared = controller->prepareDecryption(encPrepared.keyIndex);
+		quint32 index = 0;
+		QByteArray salt;
+		QByteArray cipher;
+		QByteArray plain;
+		QBENCHMARK {
+			std::tie(index, salt, cipher) = controller->encryptPrepared(encPrepared, data);
+			plain = controller->decryptPrepared(decPrepared, salt, cipher);
+		}
+
+		QCOMPARE(plain, data);
+		QCOMPARE(controller->decryptData(index, salt, cipher), data);
+		if(scheme == Setup::AUTO_CIPHER)
+			qInfo() << "Automatically selected scheme:" << encPrepared.scheme->name();
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestCryptoController::cryptoData()
 {
 	QTest::addColumn<Setup::SignatureScheme>("signScheme");
@@ -404,6 +620,11 @@ void TestCryptoController::symData()
 	QTest::newRow("SERPENT_EAX") << Setup::SERPENT_EAX;
 	QTest::newRow("SERPENT_GCM") << Setup::SERPENT_GCM;
 	QTest::newRow("IDEA_EAX") << Setup::IDEA_EAX;
+#if CRYPTOPP_VERSION >= 810
+	QTest::newRow("CHACHA20_POLY1305") << Setup::CHACHA20_POLY1305;
+	QTest::newRow("XCHACHA20_POLY1305") << Setup::XCHACHA20_POLY1305;
+#endif
+	QTest::newRow("AUTO_CIPHER") << Setup::AUTO_CIPHER;
 }
 
 QTEST_MAIN(TestCryptoController)
@@ -41,6 +41,45 @@ void MockConnection::sendSigned(const QtDataSync::Message &message, QtDataSync::
 	_socket->sendBinaryMessage(message.serializeSigned(crypto->privateSignKey(), crypto->rng(), crypto));
 }
 
+void MockConnection::sendAuthenticated(const QtDataSync::Message &message, QtDataSync::ClientCrypto *crypto)
+{
+	_socket->sendBinaryMessage(serializeAuthenticated(message, crypto));
+}
+
+QByteArray MockConnection::serializeAuthenticated(const QtDataSync::Message &message, QtDataSync::ClientCrypto *crypto)
+{
+	if(!_resumedKey.empty())
+		return message.serializeAuthenticated(_resumedKey, _sessionSequence++);
+	if(_sessionKey.isEmpty())
+		return message.serializeSigned(crypto->privateSignKey(), crypto->rng(), crypto);
+
+	return message.serializeAuthenticated(ticketSecret(crypto), _sessionSequence++);
+}
+
+bool MockConnection::hasSession() const
+{
+	return !_sessionKey.isEmpty() || !_resumedKey.empty();
+}
+
+QByteArray MockConnection::ticket() const
+{
+	return _ticket;
+}
+
+CryptoPP::SecByteBlock MockConnection::ticketSecret(QtDataSync::ClientCrypto *crypto) const
+{
+	auto key = crypto->decrypt(_sessionKey);
+	return CryptoPP::SecByteBlock(reinterpret_cast<const unsigned char*>(key.constData()),
+								  static_cast<size_t>(key.size()));
+}
+
+void MockConnection::sendResume(const QtDataSync::ResumeMessage &message, const CryptoPP::SecByteBlock &secret)
+{
+	_socket->sendBinaryMessage(message.serializeAuthenticated(secret, 0));
+	_resumedKey = QtDataSync::ResumeMessage::deriveSessionKey(secret, message.nonce);
+	_sessionSequence = 0;
+}
+
 void MockConnection::sendPing()
 {
 	_socket->sendBinaryMessage(QtDataSync::Message::PingMessage);
@@ -97,19 +136,42 @@ bool MockConnection::waitForDisconnect()
 	return ok;
 }
 
+bool MockConnection::takeSession(const QByteArray &message)
+{
+	QByteArray name;
+	QDataStream stream(message);
+	QtDataSync::Message::setupStream(stream);
+	stream >> name;
+	if(stream.status() != QDataStream::Ok)
+		return false;
+
+	if(QtDataSync::Message::isType<QtDataSync::SessionMessage>(name)) {
+		_sessionKey = QtDataSync::Message::deserializeMessage<QtDataSync::SessionMessage>(stream).key;
+		_resumedKey.New(0);
+		_sessionSequence = 0;
+		return true;
+	} else if(QtDataSync::Message::isType<QtDataSync::TicketMessage>(name)) {
+		_ticket = QtDataSync::Message::deserializeMessage<QtDataSync::TicketMessage>(stream).ticket;
+		return true;
+	} else
+		return false;
+}
+
 bool MockConnection::waitForReplyImpl(const std::function<void(QByteArray, bool&)> &msgFn)
 {
 	auto ok = false;
 	[&]() {
 		QByteArray msg;
-		do {
+		forever {
 			if(_msgSpy.isEmpty())
 				QVERIFY(_msgSpy.wait(WAIT_TIMEOUT));
 			QVERIFY(!_msgSpy.isEmpty());
 			msg = _msgSpy.takeFirst()[0].toByteArray();
 			if(msg == QtDataSync::Message::PingMessage)
 				_hasPing = true;
-		} while(msg == QtDataSync::Message::PingMessage);
+			else if(!takeSession(msg)) //session keys and tickets are handled transparently
+				break;
+		}
 		try {
 			msgFn(msg, ok);
 		} catch (std::exception &e) {
@@ -8,6 +8,7 @@
 #include <QtDataSync/private/message_p.h>
 #include <QtDataSync/private/cryptocontroller_p.h>
 #include <QtDataSync/private/errormessage_p.h>
+#include <QtDataSync/private/sessionmessage_p.h>
 #include <QtDataSync/private/cryptocontroller_p.h>
 
 class MockConnection : public QObject
@@ -20,6 +21,12 @@ public:
 	void sendBytes(const QByteArray &data);
 	void send(const QtDataSync::Message &message);
 	void sendSigned(const QtDataSync::Message &message, QtDataSync::ClientCrypto *crypto);
+	void sendAuthenticated(const QtDataSync::Message &message, QtDataSync::ClientCrypto *crypto);
+	QByteArray serializeAuthenticated(const QtDataSync::Message &message, QtDataSync::ClientCrypto *crypto);
+	bool hasSession() const;
+	QByteArray ticket() const;
+	CryptoPP::SecByteBlock ticketSecret(QtDataSync::ClientCrypto *crypto) const;
+	void sendResume(const QtDataSync::ResumeMessage &message, const CryptoPP::SecByteBlock &secret);
 	void sendPing();
 	void close();
 	//server does not need signed sending
@@ -40,7 +47,12 @@ private:
 	QSignalSpy _msgSpy;
 	QSignalSpy _closeSpy;
 	bool _hasPing;
+	QByteArray _sessionKey; //as received, encrypted for the client
+	CryptoPP::SecByteBlock _resumedKey; //derived instead of received for resumed sessions
+	quint64 _sessionSequence = 0;
+	QByteArray _ticket;
 
+	bool takeSession(const QByteArray &message);
 	bool waitForReplyImpl(const std::function<void(QByteArray,bool&)> &msgFn);
 };
 
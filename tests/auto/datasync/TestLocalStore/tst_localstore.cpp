@@ -31,6 +31,8 @@ private Q_SLOTS:
 	void testChangeLoading();
 	void testMarkUnchanged();
 	void testDeviceChanges();
+	void testUploadQueue();
+	void testSyncTree();
 
 	//sync access
 	void testInfoLoading();
@@ -384,6 +386,162 @@ void TestLocalStore::testDeviceChanges()
 	}
 }
 
+void TestLocalStore::testUploadQueue()
+{
+	try {
+		store->reset(false);
+		store->save(TestLib::generateKey(1), TestLib::generateDataJson(1));
+		store->save(TestLib::generateKey(2), TestLib::generateDataJson(2));
+		store->save(TestLib::generateKey(3), TestLib::generateDataJson(3));
+
+		//changes are loaded in the order they were made
+		QList<ObjectKey> keys;
+		auto cursor = store->loadChanges(2, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		});
+		QCOMPARE(keys, QList<ObjectKey>({TestLib::generateKey(1), TestLib::generateKey(2)}));
+
+		//continuing at the cursor only finds the rest
+		keys.clear();
+		cursor = store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		}, cursor);
+		QCOMPARE(keys, QList<ObjectKey>({TestLib::generateKey(3)}));
+
+		//changing queued entries again keeps their position, even if already passed by the cursor
+		store->save(TestLib::generateKey(1), TestLib::generateDataJson(1, QStringLiteral("changed")));
+		store->save(TestLib::generateKey(2), TestLib::generateDataJson(2, QStringLiteral("changed")));
+		QList<quint64> versions;
+		keys.clear();
+		store->loadChanges(10, [&](ObjectKey k, quint64 v, QString, QUuid) {
+			keys.append(k);
+			versions.append(v);
+			return true;
+		});
+		QCOMPARE(keys, QList<ObjectKey>({TestLib::generateKey(1), TestLib::generateKey(2), TestLib::generateKey(3)}));
+		QCOMPARE(versions, QList<quint64>({2ull, 2ull, 1ull}));
+		keys.clear();
+		store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		}, cursor);
+		QVERIFY(keys.isEmpty());
+
+		//completing an outdated version requeues it at the end, completing the current one removes it
+		store->markUnchanged(TestLib::generateKey(3), 1, false);
+		store->markUnchanged(TestLib::generateKey(1), 1, false);
+		QCOMPARE(store->changeCount(), 2u);
+		keys.clear();
+		cursor = store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		}, cursor);
+		QCOMPARE(keys, QList<ObjectKey>({TestLib::generateKey(1)}));
+		keys.clear();
+		store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		});
+		QCOMPARE(keys, QList<ObjectKey>({TestLib::generateKey(2), TestLib::generateKey(1)}));
+		store->markUnchanged(TestLib::generateKey(1), 2, false);
+		store->markUnchanged(TestLib::generateKey(2), 2, false);
+		QCOMPARE(store->changeCount(), 0u);
+		keys.clear();
+		store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		});
+		QVERIFY(keys.isEmpty());
+
+		//filter by type
+		ObjectKey otherKey{"OtherType", QStringLiteral("other")};
+		store->save(TestLib::generateKey(4), TestLib::generateDataJson(4));
+		store->save(otherKey, TestLib::generateDataJson(5));
+		store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		}, 0, {"OtherType"});
+		QCOMPARE(keys, QList<ObjectKey>({otherKey}));
+		keys.clear();
+		store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		}, 0, {"OtherType"}, true);
+		QCOMPARE(keys, QList<ObjectKey>({TestLib::generateKey(4)}));
+
+		//the stored key hashes match the calculated ones
+		auto hCount = 0;
+		store->loadUploads(10, [&](ObjectKey k, quint64, QString, QUuid, QByteArray h) {
+			hCount++;
+			[&](){
+				QCOMPARE(h, k.hashed());
+			}();
+			return true;
+		});
+		QCOMPARE(hCount, 2);
+		store->reset(false);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestLocalStore::testSyncTree()
+{
+	try {
+		store->reset(false);
+		const auto key1 = TestLib::generateKey(1);
+		const auto bucket1 = static_cast<quint8>(key1.hashed()[0]);
+
+		//empty stores have equal buckets everywhere
+		auto emptyTree = store->loadSyncTree();
+		QCOMPARE(emptyTree.size(), 256);
+		for(const auto &digest : emptyTree)
+			QCOMPARE(digest, emptyTree.first());
+
+		//saving changes only the bucket of the key
+		store->save(key1, TestLib::generateDataJson(1));
+		auto tree = store->loadSyncTree();
+		for(auto i = 0; i < tree.size(); i++) {
+			if(i == bucket1)
+				QVERIFY(tree[i] != emptyTree[i]);
+			else
+				QCOMPARE(tree[i], emptyTree[i]);
+		}
+		QCOMPARE(store->loadSyncTree(), tree);
+
+		//upload state does not matter, content does
+		store->markUnchanged(key1, 1, false);
+		QCOMPARE(store->loadSyncTree(), tree);
+		store->save(key1, TestLib::generateDataJson(1, QStringLiteral("changed")));
+		auto changedTree = store->loadSyncTree();
+		QVERIFY(changedTree[bucket1] != tree[bucket1]);
+
+		//marking a diverged bucket reuploads its entries only
+		const auto key2 = TestLib::generateKey(2);
+		store->save(key2, TestLib::generateDataJson(2));
+		store->markUnchanged(key1, 2, false);
+		store->markUnchanged(key2, 1, false);
+		QCOMPARE(store->changeCount(), 0u);
+		store->markTreeChanged(QByteArray(1, static_cast<char>(bucket1)));
+		QList<ObjectKey> keys;
+		store->loadChanges(10, [&](ObjectKey k, quint64, QString, QUuid) {
+			keys.append(k);
+			return true;
+		});
+		QVERIFY(keys.contains(key1));
+		if(static_cast<quint8>(key2.hashed()[0]) != bucket1)
+			QCOMPARE(keys.size(), 1);
+
+		//removing the entries results in an empty tree again
+		store->reset(false);
+		QCOMPARE(store->loadSyncTree(), emptyTree);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestLocalStore::testInfoLoading()
 {
 	try {
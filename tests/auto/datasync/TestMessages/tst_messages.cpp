@@ -7,6 +7,7 @@
 #include <QtDataSync/private/accountmessage_p.h>
 #include <QtDataSync/private/changedmessage_p.h>
 #include <QtDataSync/private/changemessage_p.h>
+#include <QtDataSync/private/chunkmessage_p.h>
 #include <QtDataSync/private/devicechangemessage_p.h>
 #include <QtDataSync/private/devicekeysmessage_p.h>
 #include <QtDataSync/private/devicesmessage_p.h>
@@ -20,9 +21,13 @@
 #include <QtDataSync/private/proofmessage_p.h>
 #include <QtDataSync/private/registermessage_p.h>
 #include <QtDataSync/private/removemessage_p.h>
+#include <QtDataSync/private/sessionmessage_p.h>
 #include <QtDataSync/private/syncmessage_p.h>
+#include <QtDataSync/private/treemessage_p.h>
 #include <QtDataSync/private/welcomemessage_p.h>
 #include <QtDataSync/private/cryptocontroller_p.h>
+#include <QtDataSync/private/adaptivewindow_p.h>
+#include <QtDataSync/private/sharedcache_p.h>
 
 using namespace QtDataSync;
 
@@ -42,6 +47,18 @@ private Q_SLOTS:
 	void testSignedSerialization_data();
 	void testSignedSerialization();
 
+	void testSessionAuthentication();
+	void testFrameSlicing();
+	void testIdentifyVersions();
+
+	void testAdaptiveWindow();
+	void testSharedCache();
+
+	void benchmarkSerialization_data();
+	void benchmarkSerialization();
+	void benchmarkAuthentication_data();
+	void benchmarkAuthentication();
+
 private:
 	ClientCrypto *crypto;
 
@@ -101,6 +118,14 @@ void TestMessages::testSerialization()
 		stream >> resName;
 		QCOMPARE(resName, name);
 
+		//the generated serializers must be wire identical to the property based ones
+		QByteArray reflected;
+		QDataStream reflectedStream(&reflected, QIODevice::WriteOnly | QIODevice::Unbuffered);
+		Message::setupStream(reflectedStream);
+		reflectedStream << name;
+		Message::writeProperties(reflectedStream, in);
+		QCOMPARE(data, reflected);
+
 		if(success) {
 			Message::deserializeMessageTo(stream, out);
 			auto mo = message->metaObject();
@@ -169,6 +194,366 @@ void TestMessages::testSignedSerialization()
 	delete resultMessage;
 }
 
+void TestMessages::testSessionAuthentication()
+{
+	CryptoPP::SecByteBlock key(SessionMessage::KeySize);
+	crypto->rng().GenerateBlock(key.data(), key.size());
+	CryptoPP::SecByteBlock otherKey(SessionMessage::KeySize);
+	crypto->rng().GenerateBlock(otherKey.data(), otherKey.size());
+
+	NewKeyMessage message;
+	message.keyIndex = 42;
+	message.cmac = "key_cmac";
+	message.scheme = "random_scheme";
+	message.deviceKeys.append(std::make_tuple(QUuid::createUuid(), "key", "cmac"));
+	const auto data = message.serializeAuthenticated(key, 5);
+
+	auto verify = [&](const QByteArray &frameData, const CryptoPP::SecByteBlock &vKey, quint64 sequence) {
+		QDataStream stream(frameData);
+		Message::setupStream(stream);
+		QByteArray name;
+		stream >> name;
+		QCOMPARE(name, Message::messageName<NewKeyMessage>());
+		auto result = Message::deserializeMessage<NewKeyMessage>(stream);
+		QCOMPARE(result.deviceKeys, message.deviceKeys);
+		Message::verifyAuthentication(stream, vKey, sequence);
+	};
+
+	try {
+		verify(data, key, 5);
+	} catch (std::exception &e) {
+		QFAIL(e.what());
+	}
+
+	//replayed, wrong key or modified
+	QVERIFY_EXCEPTION_THROWN(verify(data, key, 6), CryptoPP::HashVerificationFilter::HashVerificationFailed);
+	QVERIFY_EXCEPTION_THROWN(verify(data, otherKey, 5), CryptoPP::HashVerificationFilter::HashVerificationFailed);
+	auto tampered = data;
+	tampered[tampered.size() - 1] = tampered[tampered.size() - 1] + 'x';
+	QVERIFY_EXCEPTION_THROWN(verify(tampered, key, 5), CryptoPP::HashVerificationFilter::HashVerificationFailed);
+}
+
+void TestMessages::testFrameSlicing()
+{
+	ChangeBatchMessage message;
+	message.changes.append(ChangeBatchMessage::Change{"id1", 1, "salt1", QByteArray(1024, 'a')});
+	message.changes.append(ChangeBatchMessage::Change{"id2", 2, {}, "data2"});
+	const auto data = message.serializeSigned(crypto->privateSignKey(), crypto->rng(), crypto);
+	const auto dBegin = data.constData();
+	const auto dEnd = dBegin + data.size();
+
+	try {
+		MessageFrame frame{data};
+		frame.setSlicing(true);
+		QDataStream stream(&frame);
+		Message::setupStream(stream);
+		QByteArray name;
+		stream >> name;
+		QCOMPARE(name, Message::messageName<ChangeBatchMessage>());
+
+		auto result = Message::deserializeMessage<ChangeBatchMessage>(stream);
+		Message::verifySignature(stream, crypto->signKey(), crypto);
+		QCOMPARE(result.changes, message.changes);
+		QVERIFY(std::get<2>(result.changes[1]).isNull());
+		//byte arrays point into the frame instead of beeing copied
+		for(const auto &change : result.changes) {
+			const auto &cData = std::get<3>(change);
+			QVERIFY(cData.constData() >= dBegin && cData.constData() + cData.size() <= dEnd);
+		}
+	} catch (std::exception &e) {
+		QFAIL(e.what());
+	}
+
+	//truncated frames must fail, not read past the frame
+	MessageFrame frame{data.left(data.size() / 2)};
+	frame.setSlicing(true);
+	QDataStream stream(&frame);
+	Message::setupStream(stream);
+	QByteArray name;
+	stream >> name;
+	QVERIFY_EXCEPTION_THROWN(Message::deserializeMessage<ChangeBatchMessage>(stream), DataStreamException);
+}
+
+void TestMessages::testIdentifyVersions()
+{
+	try {
+		auto message = IdentifyMessage::createRandom(10, crypto->rng());
+		message.uploadMaximum = 50;
+		const auto data = message.serialize();
+
+		//current clients read the maximum
+		{
+			QDataStream stream(data);
+			Message::setupStream(stream);
+			QByteArray name;
+			stream >> name;
+			QCOMPARE(name, Message::messageName<IdentifyMessage>());
+			auto result = Message::deserializeMessage<IdentifyMessage>(stream);
+			QCOMPARE(result.uploadLimit, 10u);
+			QCOMPARE(result.uploadMaximum, 50u);
+		}
+
+		//older clients only read the fixed limit and ignore the rest
+		{
+			QDataStream stream(data);
+			Message::setupStream(stream);
+			QByteArray name;
+			QVersionNumber version;
+			QByteArray nonce;
+			quint32 limit = 0;
+			stream >> name >> version >> nonce >> limit;
+			QCOMPARE(stream.status(), QDataStream::Ok);
+			QCOMPARE(version, InitMessage::CurrentVersion);
+			QCOMPARE(nonce, message.nonce);
+			QCOMPARE(limit, 10u);
+		}
+
+		//older servers do not send a maximum
+		{
+			QByteArray oldData;
+			QDataStream oldStream(&oldData, QIODevice::WriteOnly | QIODevice::Unbuffered);
+			Message::setupStream(oldStream);
+			oldStream << Message::messageName<IdentifyMessage>()
+					  << InitMessage::ResumeVersion
+					  << message.nonce
+					  << 20u;
+
+			QDataStream stream(oldData);
+			Message::setupStream(stream);
+			QByteArray name;
+			stream >> name;
+			auto result = Message::deserializeMessage<IdentifyMessage>(stream);
+			QCOMPARE(result.protocolVersion, InitMessage::ResumeVersion);
+			QCOMPARE(result.uploadLimit, 20u);
+			QCOMPARE(result.uploadMaximum, 20u);
+		}
+	} catch (std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestMessages::testAdaptiveWindow()
+{
+	//explicit timestamps with a constant rtt of 10 ms, so the test does not depend on the actual timing
+	const qint64 rtt = 10;
+	qint64 now = 0;
+	AdaptiveWindow window{4, 6};
+	QCOMPARE(window.size(), 4u);
+
+	//fast acks: grows by about one per window, but never above the maximum
+	for(auto i = 0; i < 5; i++, now++)
+		window.acked(now, now + rtt);
+	QCOMPARE(window.size(), 5u);
+	for(auto i = 0; i < 100; i++, now++)
+		window.acked(now, now + rtt);
+	QCOMPARE(window.size(), 6u);
+	QCOMPARE(window.decreases(), 0u);
+	QCOMPARE(window.smoothedRtt(), rtt);
+
+	//congestion: halves the window, but only once per round trip
+	now += rtt;
+	window.acked(now, now + rtt, true);
+	QCOMPARE(window.size(), 3u);
+	now += rtt / 2;
+	window.acked(now, now + rtt, true);
+	QCOMPARE(window.size(), 3u);
+	QCOMPARE(window.decreases(), 1u);
+
+	//never below one
+	for(auto i = 0; i < 5; i++) {
+		now += 2 * rtt;
+		window.acked(now, now + rtt, true);
+	}
+	QCOMPARE(window.size(), 1u);
+	QCOMPARE(window.decreases(), 6u);
+
+	//reset starts from the initial size, bounded by the maximum
+	window.reset(2);
+	QCOMPARE(window.size(), 2u);
+	QCOMPARE(window.decreases(), 0u);
+	window.reset(20);
+	QCOMPARE(window.size(), 4u);
+	QCOMPARE(window.smoothedRtt(), Q_INT64_C(-1));
+}
+
+void TestMessages::testSharedCache()
+{
+	SharedCache<int, QString> cache{2};
+	QSharedPointer<QString> entry;
+	quint64 generation;
+
+	//miss, then hit once inserted
+	std::tie(entry, generation) = cache.find(1);
+	QVERIFY(!entry);
+	QVERIFY(cache.insert(1, QSharedPointer<QString>::create(QStringLiteral("one")), generation));
+	std::tie(entry, generation) = cache.find(1);
+	QVERIFY(entry);
+	QCOMPARE(*entry, QStringLiteral("one"));
+	QCOMPARE(cache.hits(), 1ull);
+	QCOMPARE(cache.misses(), 1ull);
+
+	//entries loaded before an invalidation are not cached
+	std::tie(entry, generation) = cache.find(2);
+	QVERIFY(!entry);
+	cache.invalidate(1);
+	QVERIFY(!cache.insert(2, QSharedPointer<QString>::create(QStringLiteral("two")), generation));
+	std::tie(entry, generation) = cache.find(1);
+	QVERIFY(!entry);
+	QVERIFY(cache.insert(2, QSharedPointer<QString>::create(QStringLiteral("two")), generation));
+	QCOMPARE(cache.size(), 1);
+	QCOMPARE(cache.hits(), 1ull);
+	QCOMPARE(cache.misses(), 3ull);
+
+	//bounded by the maximum size
+	std::tie(entry, generation) = cache.find(3);
+	QVERIFY(cache.insert(3, QSharedPointer<QString>::create(QStringLiteral("three")), generation));
+	std::tie(entry, generation) = cache.find(4);
+	QVERIFY(cache.insert(4, QSharedPointer<QString>::create(QStringLiteral("four")), generation));
+	QCOMPARE(cache.size(), 2);
+	QCOMPARE(cache.maxSize(), 2);
+
+	//stats output
+	QString stats;
+	QDebug{&stats} << cache;
+	QCOMPARE(stats.trimmed(), QStringLiteral("SharedCache(size: 2/2, hits: 1, misses: 5, hit rate: 16.7%)"));
+
+	cache.clear();
+	QCOMPARE(cache.size(), 0);
+}
+
+void TestMessages::benchmarkSerialization_data()
+{
+	QTest::addColumn<bool>("generated");
+	QTest::addColumn<bool>("decode");
+
+	QTest::newRow("reflection:encode") << false << false;
+	QTest::newRow("reflection:decode") << false << true;
+	QTest::newRow("generated:encode") << true << false;
+	QTest::newRow("generated:decode") << true << true;
+}
+
+void TestMessages::benchmarkSerialization()
+{
+	QFETCH(bool, generated);
+	QFETCH(bool, decode);
+
+	ChangeMessage message{QByteArray(32, 'i')};
+	message.keyIndex = 42;
+	message.salt = QByteArray(16, 's');
+	message.data = QByteArray(1024, 'd');
+
+	try {
+		auto encoded = message.serialize();
+		if(decode) {
+			ChangeMessage result;
+			QBENCHMARK {
+				QDataStream stream(encoded);
+				Message::setupStream(stream);
+				QByteArray name;
+				stream >> name;
+				if(generated)
+					stream >> result;
+				else
+					Message::readProperties(stream, result);
+			}
+			QCOMPARE(result.dataId, message.dataId);
+			QCOMPARE(result.data, message.data);
+		} else {
+			QBENCHMARK {
+				QByteArray out;
+				QDataStream stream(&out, QIODevice::WriteOnly | QIODevice::Unbuffered);
+				Message::setupStream(stream);
+				stream << message.messageName();
+				if(generated)
+					stream << message;
+				else
+					Message::writeProperties(stream, message);
+			}
+		}
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestMessages::benchmarkAuthentication_data()
+{
+	QTest::addColumn<bool>("session");
+	QTest::addColumn<int>("rotations");
+
+	QTest::newRow("signature:1") << false << 1;
+	QTest::newRow("session:1") << true << 1;
+	QTest::newRow("signature:10") << false << 10;
+	QTest::newRow("session:10") << true << 10;
+}
+
+void TestMessages::benchmarkAuthentication()
+{
+	QFETCH(bool, session);
+	QFETCH(int, rotations);
+
+	//one iteration is a login, followed by the given number of key rotations - both sides included
+	const auto signScheme = crypto->signatureScheme();
+	const auto signKey = crypto->writeSignKey();
+	const auto cryptScheme = crypto->encryptionScheme();
+	const auto cryptKey = crypto->writeCryptKey();
+	const LoginMessage login(QUuid::createUuid(),
+							 QStringLiteral("devName"),
+							 QByteArray(InitMessage::NonceSize, 'x'));
+	NewKeyMessage keyMsg;
+	keyMsg.keyIndex = 42;
+	keyMsg.cmac = "key_cmac";
+	keyMsg.scheme = "random_scheme";
+	keyMsg.deviceKeys.append(std::make_tuple(QUuid::createUuid(), QByteArray(256, 'k'), QByteArray(16, 'c')));
+
+	auto readFrame = [](QDataStream &stream) {
+		Message::setupStream(stream);
+		QByteArray name;
+		stream >> name;
+	};
+
+	try {
+		QBENCHMARK {
+			//login: always signed, server loads the stored keys
+			auto data = login.serializeSigned(crypto->privateSignKey(), crypto->rng(), crypto);
+			AsymmetricCryptoInfo info(crypto->rng(), signScheme, signKey, cryptScheme, cryptKey);
+			QDataStream stream(data);
+			readFrame(stream);
+			Message::deserializeMessage<LoginMessage>(stream);
+			Message::verifySignature(stream, info.signatureKey(), &info);
+
+			CryptoPP::SecByteBlock sessionKey;
+			if(session) {
+				sessionKey.New(SessionMessage::KeySize);
+				crypto->rng().GenerateBlock(sessionKey.data(), sessionKey.size());
+				auto encrypted = info.encrypt(crypto->rng(),
+											  QByteArray::fromRawData(reinterpret_cast<const char*>(sessionKey.data()),
+																	  static_cast<int>(sessionKey.size())));
+				crypto->decrypt(encrypted);
+			}
+
+			//key rotations: signed messages reload the keys each time
+			for(auto i = 0; i < rotations; i++) {
+				if(session) {
+					auto keyData = keyMsg.serializeAuthenticated(sessionKey, static_cast<quint64>(i));
+					QDataStream keyStream(keyData);
+					readFrame(keyStream);
+					Message::deserializeMessage<NewKeyMessage>(keyStream);
+					Message::verifyAuthentication(keyStream, sessionKey, static_cast<quint64>(i));
+				} else {
+					auto keyData = keyMsg.serializeSigned(crypto->privateSignKey(), crypto->rng(), crypto);
+					AsymmetricCryptoInfo keyInfo(crypto->rng(), signScheme, signKey, cryptScheme, cryptKey);
+					QDataStream keyStream(keyData);
+					readFrame(keyStream);
+					Message::deserializeMessage<NewKeyMessage>(keyStream);
+					Message::verifySignature(keyStream, keyInfo.signatureKey(), &keyInfo);
+				}
+			}
+		}
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestMessages::addSignedData()
 {
 	QTest::addColumn<QByteArray>("name");
@@ -264,6 +649,24 @@ void TestMessages::addAllData()
 								   crypto->cryptKey(),
 								   crypto);
 	});
+	addData<SessionMessage>([&]() {
+		return SessionMessage("encrypted_key");
+	});
+	addData<SessionMessage>([&]() {
+		return SessionMessage();
+	}, false);
+	addData<TicketMessage>([&]() {
+		return TicketMessage("ticket", 3600);
+	});
+	addData<TicketMessage>([&]() {
+		return TicketMessage("ticket");
+	}, false);
+	addData<ResumeMessage>([&]() {
+		return ResumeMessage(QUuid::createUuid(), "ticket", QByteArray(InitMessage::NonceSize, 'x'));
+	});
+	addData<ResumeMessage>([&]() {
+		return ResumeMessage(QUuid::createUuid(), {}, QByteArray(InitMessage::NonceSize, 'x'));
+	}, false);
 	addData<AccountMessage>([&]() {
 		return AccountMessage(QUuid::createUuid());
 	});
@@ -322,6 +725,49 @@ void TestMessages::addAllData()
 	addData<ChangedAckMessage>([&]() {
 		return ChangedAckMessage(77);
 	});
+	addData<ChangedNackMessage>([&]() {
+		return ChangedNackMessage(77);
+	});
+	addData<ResendMessage>([&]() {
+		return ResendMessage({"id_hash", "id_hash2"});
+	});
+	addData<ChangeChunkMessage>([&]() {
+		ChangeChunkMessage msg("id_hash");
+		msg.keyIndex = 42;
+		msg.salt = "random_salt";
+		msg.chunkIndex = 3;
+		msg.chunkCount = 5;
+		msg.data = "encrypted_chunk";
+		return msg;
+	});
+	addData<ChangeChunkAckMessage>([&]() {
+		ChangeChunkMessage msg("id_hash");
+		msg.salt = "random_salt";
+		return ChangeChunkAckMessage(msg, 4);
+	});
+	addData<ChangedChunkMessage>([&]() {
+		ChangedChunkMessage msg;
+		msg.dataIndex = 77;
+		msg.keyIndex = 42;
+		msg.salt = "random_salt";
+		msg.chunkIndex = 0;
+		msg.chunkCount = 5;
+		msg.changeEstimate = 11;
+		msg.data = "encrypted_chunk";
+		return msg;
+	});
+	addData<ChangedChunkAckMessage>([&]() {
+		return ChangedChunkAckMessage(77, 1);
+	});
+	addData<TreeMessage>([&]() {
+		TreeMessage msg(true);
+		for(auto i = 0; i < TreeMessage::BucketCount; i++)
+			msg.buckets.append("digest_" + QByteArray::number(i));
+		return msg;
+	});
+	addData<TreeDiffMessage>([&]() {
+		return TreeDiffMessage(QByteArray::fromHex("00072aff"));
+	});
 
 	addData<ProofMessage>([&]() {
 		AccessMessage msg(QStringLiteral("devName"),
@@ -336,6 +782,19 @@ void TestMessages::addAllData()
 						  "trustmac");
 		return ProofMessage(msg, QUuid::createUuid());
 	});
+	addData<VersionedProofMessage>([&]() {
+		AccessMessage msg(QStringLiteral("devName"),
+						  QByteArray(InitMessage::NonceSize, 'x'),
+						  crypto->signKey(),
+						  crypto->cryptKey(),
+						  crypto,
+						  QByteArray(InitMessage::NonceSize, 'x'),
+						  QUuid::createUuid(),
+						  "macscheme",
+						  "cmac",
+						  "trustmac");
+		return VersionedProofMessage(msg, QUuid::createUuid());
+	});
 	addData<DenyMessage>([&]() {
 		return DenyMessage(QUuid::createUuid());
 	});
@@ -13,8 +13,10 @@
 
 #include <QtDataSync/private/remoteconnector_p.h>
 #include <QtDataSync/private/setup_p.h>
+#include <QtDataSync/private/synchelper_p.h>
 
 #include <QtDataSync/private/loginmessage_p.h>
+#include <QtDataSync/private/sessionmessage_p.h>
 #include <QtDataSync/private/syncmessage_p.h>
 #include <QtDataSync/private/keychangemessage_p.h>
 
@@ -41,10 +43,13 @@ private Q_SLOTS:
 	void testLogin(bool hasChanges = false, bool withDisconnect = true);
 	void testInvalidKeystoreData();
 	void testLoginWithChanges();
+	void testResume();
 
 	void testUploading();
 	void testDeviceUploading();
 	void testDownloading();
+	void testDownloadingOrdered();
+	void testDownloadingChunked();
 	void testDownloadingInvalid();
 	void testResync();
 	void testErrorMessage();
@@ -102,6 +107,7 @@ void TestRemoteConnector::initTestCase()
 	qRegisterMetaType<RemoteConnector::RemoteEvent>("RemoteEvent");
 	qRegisterMetaType<DeviceInfo>("DeviceInfo");
 	qRegisterMetaType<QList<DeviceInfo>>("QList<DeviceInfo>");
+	qRegisterMetaType<SyncHelper::ChangeData>();
 
 	remote = nullptr;
 	connection = nullptr;
@@ -344,6 +350,77 @@ void TestRemoteConnector::testLoginWithChanges()
 	testLogin(true, false);
 }
 
+void TestRemoteConnector::testResume()
+{
+	QSignalSpy errorSpy(remote, &RemoteConnector::controllerError);
+	QSignalSpy eventSpy(remote, &RemoteConnector::remoteEvent);
+
+	try {
+		auto crypto = remote->cryptoController()->crypto();
+		auto reconnect = [&]() {
+			remote->reconnect();
+			connection = nullptr;
+			QVERIFY(server->waitForConnected(&connection));
+			QCOMPARE(eventSpy.size(), 2);
+			QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteDisconnected);
+			QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteConnecting);
+		};
+		auto welcome = [&]() {
+			connection->send(WelcomeMessage(false));
+			QVERIFY(eventSpy.wait());
+			QCOMPARE(eventSpy.size(), 1);
+			QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteReady);
+		};
+
+		//login and pass a ticket to the client
+		reconnect();
+		auto iMsg = IdentifyMessage::createRandom(20, rng);
+		connection->send(iMsg);
+		QVERIFY(connection->waitForSignedReply<LoginMessage>(crypto, [&](LoginMessage message, bool &ok) {
+			QCOMPARE(message.nonce, iMsg.nonce);
+			ok = true;
+		}));
+		QByteArray secret(SessionMessage::KeySize, 's');
+		connection->send(SessionMessage{crypto->encrypt(crypto->cryptKey(), secret)});
+		connection->send(TicketMessage{"ticket", 3600});
+		welcome();
+
+		//reconnect: must resume with the ticket
+		reconnect();
+		iMsg = IdentifyMessage::createRandom(20, rng);
+		connection->send(iMsg);
+		QVERIFY(connection->waitForReply<ResumeMessage>([&](ResumeMessage message, bool &ok) {
+			QCOMPARE(message.nonce, iMsg.nonce);
+			QCOMPARE(message.protocolVersion, InitMessage::CurrentVersion);
+			QCOMPARE(message.deviceId, devId);
+			QCOMPARE(message.ticket, QByteArray("ticket"));
+			ok = true;
+		}));
+		welcome();
+
+		//reconnect again: reject the ticket, so the client falls back to a login
+		reconnect();
+		iMsg = IdentifyMessage::createRandom(20, rng);
+		connection->send(iMsg);
+		QVERIFY(connection->waitForReply<ResumeMessage>([&](ResumeMessage message, bool &ok) {
+			QCOMPARE(message.nonce, iMsg.nonce);
+			ok = true;
+		}));
+		iMsg = IdentifyMessage::createRandom(20, rng);
+		connection->send(iMsg);
+		QVERIFY(connection->waitForSignedReply<LoginMessage>(crypto, [&](LoginMessage message, bool &ok) {
+			QCOMPARE(message.nonce, iMsg.nonce);
+			QCOMPARE(message.deviceId, devId);
+			ok = true;
+		}));
+		welcome();
+
+		QVERIFY(errorSpy.isEmpty());
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestRemoteConnector::testUploading()
 {
 	QSignalSpy errorSpy(remote, &RemoteConnector::controllerError);
@@ -489,6 +566,114 @@ void TestRemoteConnector::testDownloading()
 	}
 }
 
+void TestRemoteConnector::testDownloadingOrdered()
+{
+	QSignalSpy errorSpy(remote, &RemoteConnector::controllerError);
+	QSignalSpy eventSpy(remote, &RemoteConnector::remoteEvent);
+	QSignalSpy parsedSpy(remote, &RemoteConnector::downloadParsed);
+
+	try {
+		//assume already logged in
+		QVERIFY(connection);
+
+		//send changes of very different sizes, so they are decoded out of order
+		const auto count = 20;
+		for(auto i = 0; i < count; i++) {
+			auto key = TestLib::generateKey(i);
+			auto data = SyncHelper::combine(key, 1ull,
+											TestLib::generateDataJson(i, QString{(count - i) * 1000, QLatin1Char('x')}));
+			if(i == 0) {
+				ChangedInfoMessage infoMsg(count);
+				infoMsg.dataIndex = i;
+				std::tie(infoMsg.keyIndex, infoMsg.salt, infoMsg.data) = remote->cryptoController()->encryptData(data);
+				connection->send(infoMsg);
+			} else {
+				ChangedMessage changeMsg;
+				changeMsg.dataIndex = i;
+				std::tie(changeMsg.keyIndex, changeMsg.salt, changeMsg.data) = remote->cryptoController()->encryptData(data);
+				connection->send(changeMsg);
+			}
+		}
+		connection->send(LastChangedMessage());
+
+		//all downloads must be passed on in order, before completing the download
+		QTRY_COMPARE(parsedSpy.size(), count);
+		for(auto i = 0; i < count; i++) {
+			auto parsed = parsedSpy.takeFirst();
+			QCOMPARE(parsed[0].toULongLong(), static_cast<quint64>(i));
+			auto change = parsed[1].value<SyncHelper::ChangeData>();
+			QCOMPARE(change.key, TestLib::generateKey(i));
+			QVERIFY(!change.isDelta);
+		}
+		QTRY_COMPARE(eventSpy.size(), 2);
+		QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteReadyWithChanges);
+		QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteReady);
+
+		QVERIFY(errorSpy.isEmpty());
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestRemoteConnector::testDownloadingChunked()
+{
+	QSignalSpy errorSpy(remote, &RemoteConnector::controllerError);
+	QSignalSpy eventSpy(remote, &RemoteConnector::remoteEvent);
+	QSignalSpy downloadSpy(remote, &RemoteConnector::downloadData);
+
+	try {
+		//assume already logged in
+		QVERIFY(connection);
+
+		//split one change into multiple chunks, each in its own frame
+		QByteArray data = "random_chunked_dataset_" + QByteArray(4096, 'x');
+		quint32 keyIndex;
+		QByteArray salt;
+		QByteArray cipher;
+		std::tie(keyIndex, salt, cipher) = remote->cryptoController()->encryptData(data);
+		const quint32 chunkCount = 3;
+		const auto chunkSize = cipher.size() / static_cast<int>(chunkCount) + 1;
+		for(quint32 i = 0; i < chunkCount; i++) {
+			ChangedChunkMessage chunkMsg;
+			chunkMsg.dataIndex = 30;
+			chunkMsg.keyIndex = keyIndex;
+			chunkMsg.salt = salt;
+			chunkMsg.chunkIndex = i;
+			chunkMsg.chunkCount = chunkCount;
+			chunkMsg.changeEstimate = i == 0 ? 1 : 0;
+			chunkMsg.data = cipher.mid(static_cast<int>(i) * chunkSize, chunkSize);
+			connection->send(chunkMsg);
+
+			QVERIFY(connection->waitForReply<ChangedChunkAckMessage>([&](ChangedChunkAckMessage message, bool &ok) {
+				QCOMPARE(message.dataIndex, chunkMsg.dataIndex);
+				QCOMPARE(message.nextChunk, i + 1);
+				ok = true;
+			}));
+		}
+
+		//the change is only passed on once all chunks are received
+		QTRY_COMPARE(downloadSpy.size(), 1);
+		auto cChange = downloadSpy.takeFirst();
+		QCOMPARE(cChange[0].toULongLong(), 30ull);
+		QCOMPARE(cChange[1].toByteArray(), data);
+
+		remote->downloadDone(30);
+		QVERIFY(connection->waitForReply<ChangedAckMessage>([&](ChangedAckMessage message, bool &ok) {
+			QCOMPARE(message.dataIndex, 30ull);
+			ok = true;
+		}));
+
+		connection->send(LastChangedMessage());
+		QTRY_COMPARE(eventSpy.size(), 2);
+		QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteReadyWithChanges);
+		QCOMPARE(eventSpy.takeFirst()[0].toInt(), RemoteConnector::RemoteReady);
+
+		QVERIFY(errorSpy.isEmpty());
+	} catch(std::exception &e) {
+		QFAIL(e.what());
+	}
+}
+
 void TestRemoteConnector::testDownloadingInvalid()
 {
 	QSignalSpy errorSpy(remote, &RemoteConnector::controllerError);
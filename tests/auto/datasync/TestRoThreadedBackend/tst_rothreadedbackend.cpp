@@ -20,6 +20,7 @@ public:
 
 public Q_SLOTS:
 	void serverDo(int id) override;
+	void serverEcho(const QByteArray &data) override;
 };
 
 class TestRoThreadedBackend : public QObject
@@ -30,7 +31,11 @@ private Q_SLOTS:
 	void initTestCase();
 
 	void testExchangeDevice();
+	void testRemoteObjects_data();
 	void testRemoteObjects();
+
+	void benchmarkTransport_data();
+	void benchmarkTransport();
 };
 
 void TestRoThreadedBackend::initTestCase()
@@ -84,9 +89,17 @@ void TestRoThreadedBackend::testExchangeDevice()
 	QCOMPARE(d1Spy.size(), 1);
 }
 
+void TestRoThreadedBackend::testRemoteObjects_data()
+{
+	QTest::addColumn<QUrl>("url");
+
+	QTest::newRow("threaded") << QUrl(QStringLiteral("threaded:///some/path"));
+	QTest::newRow("shm") << QUrl(QStringLiteral("shm:///some/path"));
+}
+
 void TestRoThreadedBackend::testRemoteObjects()
 {
-	QUrl url(QStringLiteral("threaded:///some/path"));
+	QFETCH(QUrl, url);
 
 	QRemoteObjectHost host;
 	QtRoTransportRegistry::connectHostNode(url, &host);
@@ -117,7 +130,46 @@ void TestRoThreadedBackend::testRemoteObjects()
 	QCOMPARE(doneSpy.takeFirst()[0].toInt(), 43);
 }
 
+void TestRoThreadedBackend::benchmarkTransport_data()
+{
+	QTest::addColumn<QUrl>("url");
+	QTest::addColumn<int>("payloadSize");
+
+	const QList<QPair<QByteArray, QUrl>> transports {
+		{"threaded", QUrl(QStringLiteral("threaded:///benchmark/path"))},
+		{"shm", QUrl(QStringLiteral("shm:///benchmark/path"))},
+		{"local", QUrl(QStringLiteral("local:qtdatasync_benchmark_path"))}
+	};
+	for(const auto &transport : transports) {
+		QTest::newRow(transport.first + "-latency") << transport.second << 16;
+		QTest::newRow(transport.first + "-throughput") << transport.second << 256 * 1024;
+	}
+}
 
+void TestRoThreadedBackend::benchmarkTransport()
+{
+	QFETCH(QUrl, url);
+	QFETCH(int, payloadSize);
+
+	QRemoteObjectHost host;
+	QtRoTransportRegistry::connectHostNode(url, &host);
+	host.enableRemoting(new TestClass(&host));
+
+	QRemoteObjectNode node;
+	QVERIFY(QtRoTransportRegistry::connectClientNode(url, &node));
+
+	QScopedPointer<TestClassReplica> test{node.acquire<TestClassReplica>()};
+	QVERIFY(test);
+	QVERIFY(test->waitForSource(5000));
+
+	const QByteArray payload(payloadSize, 'x');
+	QSignalSpy echoSpy(test.data(), &TestClassReplica::serverEchoed);
+	QBENCHMARK {
+		test->serverEcho(payload);
+		QVERIFY(echoSpy.wait());
+		QCOMPARE(echoSpy.takeFirst()[0].toByteArray().size(), payloadSize);
+	}
+}
 
 TestClass::TestClass(QObject *parent) :
 	TestClassSimpleSource(parent)
@@ -130,6 +182,11 @@ void TestClass::serverDo(int id)
 	emit serverDone(id);
 }
 
+void TestClass::serverEcho(const QByteArray &data)
+{
+	emit serverEchoed(data);
+}
+
 QTEST_MAIN(TestRoThreadedBackend)
 
 #include "tst_rothreadedbackend.moc"
@@ -108,7 +108,12 @@ void TestSetup::testProperties()
 				.setRemoteConfiguration(RemoteConfig{QStringLiteral("wss://example.com")})
 				.setCipherScheme(Setup::TWOFISH_GCM)
 				.setCipherKeySize(24)
-				.setEventLoggingMode(Setup::EventMode::Disabled);
+				.setEventLoggingMode(Setup::EventMode::Disabled)
+				.setDeltaUploads(true)
+				.setCompressionLevel(6)
+				.setUploadDebounce({{QStringLiteral("TestData"), 500}})
+				.setTypePriorities({{QStringLiteral("TestData"), 2}, {QString(), -1}})
+				.setBinaryPayloads(true);
 
 		QCOMPARE(setup.localDir(), TestLib::tDir.path() + QLatin1Char('/') + sName);
 		QCOMPARE(setup.remoteObjectHost(), QStringLiteral("local:tst_setup"));
@@ -127,6 +132,11 @@ void TestSetup::testProperties()
 		QCOMPARE(setup.cipherScheme(), Setup::TWOFISH_GCM);
 		QCOMPARE(setup.cipherKeySize(), 24);
 		QCOMPARE(setup.eventLoggingMode(), Setup::EventMode::Disabled);
+		QCOMPARE(setup.deltaUploads(), true);
+		QCOMPARE(setup.compressionLevel(), 6);
+		QCOMPARE(setup.uploadDebounce(), QVariantHash({{QStringLiteral("TestData"), 500}}));
+		QCOMPARE(setup.typePriorities(), QVariantHash({{QStringLiteral("TestData"), 2}, {QString(), -1}}));
+		QCOMPARE(setup.binaryPayloads(), true);
 
 		//test transfer to defaults
 		setup.create(sName);
@@ -154,6 +164,11 @@ void TestSetup::testProperties()
 		QCOMPARE(defaults.property(Defaults::SymScheme), QVariant::fromValue(setup.cipherScheme()));
 		QCOMPARE(defaults.property(Defaults::SymKeyParam), QVariant::fromValue(setup.cipherKeySize()));
 		QCOMPARE(defaults.property(Defaults::EventLoggingMode), QVariant::fromValue(setup.eventLoggingMode()));
+		QCOMPARE(defaults.property(Defaults::DeltaUploads), QVariant::fromValue(setup.deltaUploads()));
+		QCOMPARE(defaults.property(Defaults::CompressionLevel), QVariant::fromValue(setup.compressionLevel()));
+		QCOMPARE(defaults.property(Defaults::UploadDebounce), QVariant::fromValue(setup.uploadDebounce()));
+		QCOMPARE(defaults.property(Defaults::TypePriorities), QVariant::fromValue(setup.typePriorities()));
+		QCOMPARE(defaults.property(Defaults::BinaryPayloads), QVariant::fromValue(setup.binaryPayloads()));
 
 		// test other defaults stuff
 		QVERIFY(defaults.remoteNode());
@@ -27,9 +27,23 @@ private Q_SLOTS:
 	void testResolver_data();
 	void testResolver();
 
+	void testDelta_data();
+	void testDelta();
+
+	void testBatch();
+	void testSnapshot();
+
+	void testBinaryPayloads_data();
+	void testBinaryPayloads();
+
+	void benchmarkPayloadFormat_data();
+	void benchmarkPayloadFormat();
+
 private:
 	LocalStore *store;
 	SyncController *controller;
+
+	static QJsonObject generateEntries();
 };
 
 void TestSyncController::initTestCase()
@@ -448,6 +462,7 @@ void TestSyncController::testSyncOperation()
 		//step 3: trigger the change
 		QVERIFY(doneSpy.isEmpty());
 		controller->syncChange(42ull, message);
+		QTRY_VERIFY(!doneSpy.isEmpty() || !errorSpy.isEmpty());
 		if(!errorSpy.isEmpty())
 			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
 		QCOMPARE(doneSpy.size(), 1);
@@ -544,6 +559,7 @@ void TestSyncController::testResolver()
 		//step 3: trigger the change
 		QVERIFY(doneSpy.isEmpty());
 		controller->syncChange(42ull, message);
+		QTRY_VERIFY(!doneSpy.isEmpty() || !errorSpy.isEmpty());
 		if(!errorSpy.isEmpty())
 			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
 		QCOMPARE(doneSpy.size(), 1);
@@ -581,6 +597,313 @@ void TestSyncController::testResolver()
 	}
 }
 
+void TestSyncController::testDelta_data()
+{
+	QTest::addColumn<ObjectKey>("key");
+	QTest::addColumn<quint64>("localVersion");
+	QTest::addColumn<QJsonObject>("localData");
+	QTest::addColumn<QJsonObject>("baseData");
+	QTest::addColumn<QJsonObject>("remoteData");
+	QTest::addColumn<quint64>("resultVersion");
+	QTest::addColumn<QJsonObject>("resultData");
+	QTest::addColumn<bool>("isRemote");
+	QTest::addColumn<bool>("rejected");
+
+	QTest::newRow("apply") << TestLib::generateKey(20)
+						   << 10ull
+						   << TestLib::generateDataJson(20, QStringLiteral("dataA"))
+						   << TestLib::generateDataJson(20, QStringLiteral("dataA"))
+						   << TestLib::generateDataJson(20, QStringLiteral("dataB"))
+						   << 11ull
+						   << TestLib::generateDataJson(20, QStringLiteral("dataB"))
+						   << true
+						   << false;
+	QTest::newRow("mismatch:data") << TestLib::generateKey(21)
+								   << 10ull
+								   << TestLib::generateDataJson(21, QStringLiteral("dataC"))
+								   << TestLib::generateDataJson(21, QStringLiteral("dataA"))
+								   << TestLib::generateDataJson(21, QStringLiteral("dataB"))
+								   << 10ull
+								   << TestLib::generateDataJson(21, QStringLiteral("dataC"))
+								   << false
+								   << true;
+	QTest::newRow("mismatch:version") << TestLib::generateKey(22)
+									  << 9ull
+									  << TestLib::generateDataJson(22, QStringLiteral("dataA"))
+									  << TestLib::generateDataJson(22, QStringLiteral("dataA"))
+									  << TestLib::generateDataJson(22, QStringLiteral("dataB"))
+									  << 9ull
+									  << TestLib::generateDataJson(22, QStringLiteral("dataA"))
+									  << false
+									  << true;
+	QTest::newRow("outdated") << TestLib::generateKey(23)
+							  << 12ull
+							  << TestLib::generateDataJson(23, QStringLiteral("dataC"))
+							  << TestLib::generateDataJson(23, QStringLiteral("dataA"))
+							  << TestLib::generateDataJson(23, QStringLiteral("dataB"))
+							  << 12ull
+							  << TestLib::generateDataJson(23, QStringLiteral("dataC"))
+							  << false
+							  << false;
+}
+
+void TestSyncController::testDelta()
+{
+	QFETCH(ObjectKey, key);
+	QFETCH(quint64, localVersion);
+	QFETCH(QJsonObject, localData);
+	QFETCH(QJsonObject, baseData);
+	QFETCH(QJsonObject, remoteData);
+	QFETCH(quint64, resultVersion);
+	QFETCH(QJsonObject, resultData);
+	QFETCH(bool, isRemote);
+	QFETCH(bool, rejected);
+	QSignalSpy doneSpy(controller, &SyncController::syncDone);
+	QSignalSpy rejectSpy(controller, &SyncController::syncRejected);
+	QSignalSpy errorSpy(controller, &SyncController::controllerError);
+	QSignalSpy baseSpy(controller, &SyncController::deltaBaseChanged);
+	QSignalSpy invalidSpy(controller, &SyncController::deltaBaseInvalidated);
+
+	try {
+		store->reset(false);
+
+		//step 1: setup the local store
+		{
+			auto scope = store->startSync(key);
+			store->storeChanged(scope, localVersion, QString(), localData, false, LocalStore::NoExists);
+			store->commitSync(scope);
+		}
+
+		//step 2: generate the delta message against version 10
+		auto ok = false;
+		QJsonObject patch;
+		std::tie(ok, patch) = SyncHelper::createPatch(baseData, remoteData);
+		QVERIFY(ok);
+		QCOMPARE(SyncHelper::applyPatch(baseData, patch), remoteData);
+		auto message = SyncHelper::combineDelta(key, 11ull,
+												10ull, SyncHelper::jsonHash(baseData),
+												SyncHelper::jsonHash(remoteData),
+												patch);
+		QVERIFY(SyncHelper::isDelta(message));
+
+		//step 3: trigger the change
+		controller->syncChange(42ull, message);
+		QTRY_VERIFY(!doneSpy.isEmpty() || !rejectSpy.isEmpty() || !errorSpy.isEmpty());
+		if(!errorSpy.isEmpty())
+			QFAIL(errorSpy.takeFirst()[0].toString().toUtf8().constData());
+		if(rejected) {
+			//the complete change must be requested instead
+			QVERIFY(doneSpy.isEmpty());
+			QCOMPARE(rejectSpy.size(), 1);
+			QCOMPARE(rejectSpy.takeFirst()[0].toULongLong(), 42ull);
+		} else {
+			QVERIFY(rejectSpy.isEmpty());
+			QCOMPARE(doneSpy.size(), 1);
+			QCOMPARE(doneSpy.takeFirst()[0].toULongLong(), 42ull);
+		}
+		if(isRemote) {
+			QCOMPARE(baseSpy.size(), 1);
+			QCOMPARE(baseSpy.takeFirst()[2].toJsonObject(), remoteData);
+			QVERIFY(invalidSpy.isEmpty());
+		} else {
+			QVERIFY(baseSpy.isEmpty());
+			QCOMPARE(invalidSpy.size(), 1);
+		}
+
+		//step 4: validate the result data
+		{
+			auto scope = store->startSync(key);
+			auto info = store->loadChangeInfo(scope);
+			QCOMPARE(std::get<0>(info), LocalStore::Exists);
+			QCOMPARE(std::get<1>(info), resultVersion);
+			auto tJson = store->readJson(key, std::get<2>(info));
+			QCOMPARE(tJson, resultData);
+			store->commitSync(scope);
+		}
+
+		//step 5: verify unchanged - neither applied nor rejected deltas lead to an upload
+		auto called = false;
+		store->loadChanges(1000, [key, &called](ObjectKey k, quint64, QString, QUuid) -> bool {
+			if(k == key) {
+				called = true;
+				return false;
+			} else
+				return true;
+		});
+		QVERIFY(!called);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestSyncController::testBatch()
+{
+	QSignalSpy doneSpy(controller, &SyncController::syncDone);
+	QSignalSpy errorSpy(controller, &SyncController::controllerError);
+
+	try {
+		store->reset(false);
+
+		//queue multiple changes, with an invalid one in between
+		for(auto i = 0; i < 5; i++) {
+			auto key = TestLib::generateKey(60 + i);
+			if(i == 2)
+				controller->syncChange(i, "invalid");
+			else
+				controller->syncChange(i, SyncHelper::combine(key, 1ull, TestLib::generateDataJson(60 + i)));
+		}
+		//nothing is applied until the batch is flushed
+		QVERIFY(doneSpy.isEmpty());
+		QCOMPARE(store->count(TestLib::TypeName), 0ull);
+
+		QTRY_COMPARE(doneSpy.size(), 4);
+		QCOMPARE(errorSpy.size(), 1);
+		QList<quint64> doneKeys;
+		for(const auto &done : doneSpy)
+			doneKeys.append(done[0].toULongLong());
+		QCOMPARE(doneKeys, QList<quint64>({0, 1, 3, 4}));
+
+		//only the invalid change was rolled back
+		QCOMPARE(store->count(TestLib::TypeName), 4ull);
+		for(auto i = 0; i < 5; i++) {
+			auto key = TestLib::generateKey(60 + i);
+			QCOMPARE(store->contains(key), i != 2);
+			if(i != 2)
+				QCOMPARE(store->load(key), TestLib::generateDataJson(60 + i));
+		}
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestSyncController::testSnapshot()
+{
+	QSignalSpy doneSpy(controller, &SyncController::syncDone);
+	QSignalSpy errorSpy(controller, &SyncController::controllerError);
+
+	try {
+		store->reset(false);
+
+		QByteArrayList changes;
+		for(auto i = 0; i < 5; i++)
+			changes.append(SyncHelper::combine(TestLib::generateKey(80 + i), 1ull, TestLib::generateDataJson(80 + i)));
+		auto data = SyncHelper::combineSnapshot(changes);
+		QVERIFY(SyncHelper::isSnapshot(data));
+		QVERIFY(!SyncHelper::isDelta(data));
+		QVERIFY(!SyncHelper::isSnapshot(changes.first()));
+
+		//the whole snapshot is applied at once and acknowledged as one download
+		controller->syncSnapshot(7, SyncHelper::parseSnapshot(data));
+		QCOMPARE(doneSpy.size(), 1);
+		QCOMPARE(doneSpy.takeFirst()[0].toULongLong(), 7ull);
+		QVERIFY(errorSpy.isEmpty());
+		QCOMPARE(store->count(TestLib::TypeName), 5ull);
+		for(auto i = 0; i < 5; i++)
+			QCOMPARE(store->load(TestLib::generateKey(80 + i)), TestLib::generateDataJson(80 + i));
+
+		//older versions cannot parse snapshots
+		QVERIFY_EXCEPTION_THROWN(SyncHelper::parse(data), QException);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestSyncController::testBinaryPayloads_data()
+{
+	QTest::addColumn<int>("level");
+	QTest::addColumn<bool>("binary");
+
+	QTest::newRow("json") << 0 << false;
+	QTest::newRow("json:compressed") << 9 << false;
+	QTest::newRow("cbor") << 0 << true;
+	QTest::newRow("cbor:compressed") << 9 << true;
+}
+
+void TestSyncController::testBinaryPayloads()
+{
+	QFETCH(int, level);
+	QFETCH(bool, binary);
+
+	auto key = TestLib::generateKey(42);
+	auto data = generateEntries();
+
+	try {
+		auto change = SyncHelper::parse(SyncHelper::combine(key, 42, data, level, binary));
+		QVERIFY(!change.isDelta);
+		QCOMPARE(change.key, key);
+		QCOMPARE(change.version, 42ull);
+		QCOMPARE(change.data, data);
+
+		auto patch = QJsonObject {
+			{QStringLiteral("name"), QStringLiteral("patched")},
+			{QStringLiteral("count"), 42}
+		};
+		change = SyncHelper::parse(SyncHelper::combineDelta(key, 43, 42, "base", "checksum", patch, level, binary));
+		QVERIFY(change.isDelta);
+		QCOMPARE(change.version, 43ull);
+		QCOMPARE(change.baseVersion, 42ull);
+		QCOMPARE(change.data, patch);
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+void TestSyncController::benchmarkPayloadFormat_data()
+{
+	QTest::addColumn<bool>("binary");
+	QTest::addColumn<bool>("decode");
+
+	QTest::newRow("json:encode") << false << false;
+	QTest::newRow("json:decode") << false << true;
+	QTest::newRow("cbor:encode") << true << false;
+	QTest::newRow("cbor:decode") << true << true;
+}
+
+void TestSyncController::benchmarkPayloadFormat()
+{
+	QFETCH(bool, binary);
+	QFETCH(bool, decode);
+
+	auto key = TestLib::generateKey(42);
+	auto data = generateEntries();
+
+	try {
+		auto encoded = SyncHelper::combine(key, 42, data, 0, binary);
+		if(decode) {
+			QJsonObject result;
+			QBENCHMARK {
+				result = std::get<3>(SyncHelper::extract(encoded));
+			}
+			QCOMPARE(result, data);
+		} else {
+			QBENCHMARK {
+				encoded = SyncHelper::combine(key, 42, data, 0, binary);
+			}
+		}
+		qInfo() << "Payload size:" << encoded.size();
+	} catch(QException &e) {
+		QFAIL(e.what());
+	}
+}
+
+QJsonObject TestSyncController::generateEntries()
+{
+	//a typical dataset: many short, similar entries
+	QJsonObject data;
+	QJsonArray entries;
+	for(auto i = 0; i < 100; i++) {
+		entries.append(QJsonObject {
+						   {QStringLiteral("id"), i},
+						   {QStringLiteral("name"), QStringLiteral("Entry %1").arg(i)},
+						   {QStringLiteral("done"), i % 3 == 0},
+						   {QStringLiteral("progress"), i / 100.0},
+						   {QStringLiteral("description"), QStringLiteral("The description of entry number %1").arg(i)}
+					   });
+	}
+	data[QStringLiteral("entries")] = entries;
+	return data;
+}
+
 QTEST_MAIN(TestSyncController)
 
 #include "tst_synccontroller.moc"
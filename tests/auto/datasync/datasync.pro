@@ -24,6 +24,11 @@ include_server_tests {
 	IntegrationTest.depends += TestAppServer #ensure those two don't run in parallel
 }
 
+include_benchmarks {
+	SUBDIRS += \
+		BenchmarkCrypto
+}
+
 include_server_tests: message("Please run 'sudo docker-compose -f $$absolute_path(../../../tools/appserver/docker-compose.yaml) up -d' to start the services needed for server tests")
 
 for(subdir, SUBDIRS):!equals(subdir, "TestLib"): $${subdir}.depends += TestLib
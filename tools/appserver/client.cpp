@@ -6,12 +6,19 @@
 #include "grantmessage_p.h"
 #include "devicekeysmessage_p.h"
 
+#include <limits>
+
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QUuid>
+#include <QtCore/QDateTime>
+#include <QtCore/QtEndian>
 
 #include <QtConcurrent/QtConcurrentRun>
 
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha3.h>
+
 #if QT_HAS_INCLUDE(<chrono>)
 #define scdtime(x) x
 #else
@@ -23,6 +30,9 @@ using namespace std::chrono;
 using std::function;
 using std::get;
 using std::tie;
+#if CRYPTOPP_VERSION >= 600
+using byte = CryptoPP::byte;
+#endif
 
 #undef qDebug
 #define qDebug(...) qCDebug(logFn, __VA_ARGS__)
@@ -33,6 +43,9 @@ using std::tie;
 #undef qCritical
 #define qCritical(...) qCCritical(logFn, __VA_ARGS__)
 
+static const quint32 InitialDownWindow = 20;
+static const int QueueThreshold = 2;
+
 // ------------- Exceptions Definitions -------------
 
 class MessageException : public QException
@@ -74,6 +87,8 @@ public:
 // ------------- Client Implementation -------------
 
 QThreadStorage<Client::Rng> Client::rngPool;
+CryptoPP::SecByteBlock Client::ticketKey;
+quint32 Client::ticketLifetime = 0;
 
 Client::Client(DatabaseController *database, QWebSocket *websocket, QObject *parent) :
 	QObject(parent),
@@ -97,8 +112,11 @@ Client::Client(DatabaseController *database, QWebSocket *websocket, QObject *par
 			this, &Client::sslErrors);
 
 	_uploadLimit = qService->configuration()->value(QStringLiteral("server/uploads/limit"), _uploadLimit).toUInt();
+	_uploadMaximum = qService->configuration()->value(QStringLiteral("server/uploads/maximum"), _uploadMaximum).toUInt();
 	_downLimit = qService->configuration()->value(QStringLiteral("server/downloads/limit"), _downLimit).toUInt();
+	_downMaximum = qService->configuration()->value(QStringLiteral("server/downloads/maximum"), _downMaximum).toUInt();
 	_downThreshold = qService->configuration()->value(QStringLiteral("server/downloads/threshold"), _downThreshold).toUInt();
+	_downWindow = AdaptiveWindow{InitialDownWindow, _downLimit};
 	auto idleTimeout = qService->configuration()->value(QStringLiteral("server/idleTimeout"), 5).toInt();
 	if(idleTimeout > 0) {
 		_idleTimer = new QTimer(this);
@@ -113,11 +131,39 @@ Client::Client(DatabaseController *database, QWebSocket *websocket, QObject *par
 	run([this]() {
 		//initialize connection by sending indent message
 		auto msg = IdentifyMessage::createRandom(_uploadLimit, rngPool.localData());
+		msg.uploadMaximum = qMax(_uploadMaximum, _uploadLimit);
 		_loginNonce = msg.nonce;
 		sendMessage(msg);
 	});
 }
 
+void Client::setupTickets()
+{
+	auto lifetime = qService->configuration()->value(QStringLiteral("server/tickets/lifetime"), 60).toInt();
+	ticketLifetime = static_cast<quint32>(qMax(lifetime, 0)) * 60;
+
+	ticketKey.CleanNew(CryptoPP::SHA3_256::DIGESTSIZE);
+	auto key = qService->configuration()->value(QStringLiteral("server/tickets/key")).toString().toUtf8();
+	if(key.isEmpty()) { //tickets are only valid for this instance
+		CryptoPP::RandomNumberGenerator &rng = rngPool.localData();
+		rng.GenerateBlock(ticketKey.data(), ticketKey.size());
+	} else {
+		CryptoPP::SHA3_256 hash;
+		hash.CalculateDigest(ticketKey.data(),
+							 reinterpret_cast<const byte*>(key.constData()),
+							 static_cast<size_t>(key.size()));
+	}
+}
+
+void Client::logStats()
+{
+	run([this]() {
+		qInfo() << "Download stats:" << _downWindow
+				<< "with" << _activeDownloads.size() << "active downloads and"
+				<< _queue->size() << "queued tasks";
+	});
+}
+
 void Client::dropConnection()
 {
 	_socket->close();
@@ -131,6 +177,22 @@ void Client::notifyChanged()
 	});
 }
 
+void Client::notifyTreeDiverged()
+{
+	run([this]() {
+		if(_state == Idle && _treeEnabled) //silently ignore other states
+			sendTreeDiff();
+	});
+}
+
+void Client::notifyResendRequested()
+{
+	run([this]() {
+		if(_state == Idle && _deltaEnabled) //silently ignore other states
+			sendResend();
+	});
+}
+
 void Client::proofResult(bool success, const AcceptMessage &message)
 {
 	run([this, success, message](){
@@ -146,6 +208,11 @@ void Client::proofResult(bool success, const AcceptMessage &message)
 					return;
 				}
 
+				QScopedPointer<AsymmetricCryptoInfo> crypto;
+				auto issueTicket = _cachedAccessRequest.protocolVersion >= InitMessage::ResumeVersion;
+				if(_cachedAccessRequest.protocolVersion >= InitMessage::SessionVersion)
+					crypto.reset(_cachedAccessRequest.createCryptoInfo(rngPool.localData()));
+
 				auto pDevId = _cachedAccessRequest.partnerId;
 				_database->addNewDeviceToUser(_deviceId,
 											  pDevId,
@@ -159,6 +226,8 @@ void Client::proofResult(bool success, const AcceptMessage &message)
 				_cachedFingerPrint.clear();
 
 				qDebug() << "Created new device and added to account of device" << pDevId;
+				if(crypto)
+					startSession(crypto.data(), issueTicket);
 				sendMessage(GrantMessage{message});
 				_state = Idle;
 				emit connected(_deviceId);
@@ -168,14 +237,16 @@ void Client::proofResult(bool success, const AcceptMessage &message)
 	});
 }
 
-void Client::sendProof(const ProofMessage &message)
+void Client::sendProof(const VersionedProofMessage &message)
 {
 	run([this, message]() {
 		if(_state != Idle) {
 			qWarning() << "Cannot send proof when not in idle state";
 			emit proofDone(message.deviceId, false);
-		} else
+		} else if(_snapshotEnabled) //needs the version of the new device to decide whether it can import snapshots
 			sendMessage(message);
+		else
+			sendMessage(ProofMessage{message});
 	});
 }
 
@@ -203,7 +274,8 @@ void Client::binaryMessageReceived(const QByteArray &message)
 			return;
 
 		try {
-			QDataStream stream(message);
+			MessageFrame frame{message};
+			QDataStream stream(&frame);
 			Message::setupStream(stream);
 			stream.startTransaction();
 			QByteArray name;
@@ -211,20 +283,39 @@ void Client::binaryMessageReceived(const QByteArray &message)
 			if(!stream.commitTransaction())
 				throw DataStreamException(stream);
 
+			//change data is only stored by the synchronous handlers below, so it can be sliced from the frame
+			frame.setSlicing(Message::isType<ChangeMessage>(name) ||
+							 Message::isType<ChangeBatchMessage>(name) ||
+							 Message::isType<DeltaChangeMessage>(name) ||
+							 Message::isType<DeviceChangeMessage>(name) ||
+							 Message::isType<ChangeChunkMessage>(name));
+
 			if(Message::isType<RegisterMessage>(name))
 				onRegister(Message::deserializeMessage<RegisterMessage>(stream), stream);
 			else if(Message::isType<LoginMessage>(name))
 				onLogin(Message::deserializeMessage<LoginMessage>(stream), stream);
+			else if(Message::isType<ResumeMessage>(name))
+				onResume(Message::deserializeMessage<ResumeMessage>(stream), stream);
 			else if(Message::isType<AccessMessage>(name))
 				onAccess(Message::deserializeMessage<AccessMessage>(stream), stream);
 			else if(Message::isType<SyncMessage>(name))
 				onSync(Message::deserializeMessage<SyncMessage>(stream));
 			else if(Message::isType<ChangeMessage>(name))
 				onChange(Message::deserializeMessage<ChangeMessage>(stream));
+			else if(Message::isType<ChangeBatchMessage>(name))
+				onChangeBatch(Message::deserializeMessage<ChangeBatchMessage>(stream));
+			else if(Message::isType<DeltaChangeMessage>(name))
+				onDeltaChange(Message::deserializeMessage<DeltaChangeMessage>(stream));
 			else if(Message::isType<DeviceChangeMessage>(name))
 				onDeviceChange(Message::deserializeMessage<DeviceChangeMessage>(stream));
+			else if(Message::isType<ChangeChunkMessage>(name))
+				onChangeChunk(Message::deserializeMessage<ChangeChunkMessage>(stream));
 			else if(Message::isType<ChangedAckMessage>(name))
 				onChangedAck(Message::deserializeMessage<ChangedAckMessage>(stream));
+			else if(Message::isType<ChangedNackMessage>(name))
+				onChangedNack(Message::deserializeMessage<ChangedNackMessage>(stream));
+			else if(Message::isType<ChangedChunkAckMessage>(name))
+				onChangedChunkAck(Message::deserializeMessage<ChangedChunkAckMessage>(stream));
 			else if(Message::isType<ListDevicesMessage>(name))
 				onListDevices(Message::deserializeMessage<ListDevicesMessage>(stream));
 			else if(Message::isType<RemoveMessage>(name))
@@ -239,6 +330,8 @@ void Client::binaryMessageReceived(const QByteArray &message)
 				onKeyChange(Message::deserializeMessage<KeyChangeMessage>(stream));
 			else if(Message::isType<NewKeyMessage>(name))
 				onNewKey(Message::deserializeMessage<NewKeyMessage>(stream), stream);
+			else if(Message::isType<TreeMessage>(name))
+				onTree(Message::deserializeMessage<TreeMessage>(stream));
 			else {
 				qWarning() << "Unknown message received:" << Message::typeName(name);
 				sendError({
@@ -370,6 +463,97 @@ void Client::doSend(const QByteArray &message)
 	_socket->sendBinaryMessage(message);
 }
 
+void Client::startSession(const AsymmetricCryptoInfo *crypto, bool issueTicket)
+{
+	CryptoPP::RandomNumberGenerator &rng = rngPool.localData();
+	QByteArray ticket;
+	if(issueTicket && ticketLifetime > 0)
+		ticket = createTicket(); //the session key doubles as the secret of the ticket
+	else {
+		_sessionKey.CleanNew(SessionMessage::KeySize);
+		rng.GenerateBlock(_sessionKey.data(), _sessionKey.size());
+	}
+	_sessionSequence = 0;
+	sendMessage(SessionMessage {
+					crypto->encrypt(rng, QByteArray::fromRawData(reinterpret_cast<const char*>(_sessionKey.data()),
+																 static_cast<int>(_sessionKey.size())))
+				});
+	if(!ticket.isEmpty())
+		sendMessage(TicketMessage{ticket, ticketLifetime});
+}
+
+void Client::verifyAuthenticated(QDataStream &stream)
+{
+	try {
+		//the client counts every privileged message it sends, so a message rejected before this point (e.g. by checkIdle)
+		//leaves the sequences out of sync. This is fine, as every rejection goes through sendError, which ignores all
+		//further messages and drops the connection - the client then starts a new session with a fresh sequence
+		if(!_sessionKey.empty())
+			Message::verifyAuthentication(stream, _sessionKey, _sessionSequence++);
+		else {
+			//older clients still sign every message (in case of an unsecure channel)
+			auto crypto = _database->loadCrypto(_deviceId, rngPool.localData());
+			if(!crypto)
+				throw ClientErrorException(ErrorMessage::AuthenticationError);
+			Message::verifySignature(stream, crypto->signatureKey(), crypto.data());
+		}
+	} catch(CryptoPP::SignatureVerificationFilter::SignatureVerificationFailed &e) {
+		qWarning() << "Authentication error:" << e.what();
+		throw ClientErrorException(ErrorMessage::AuthenticationError);
+	} catch(CryptoPP::HashVerificationFilter::HashVerificationFailed &e) {
+		qWarning() << "Authentication error:" << e.what();
+		throw ClientErrorException(ErrorMessage::AuthenticationError);
+	}
+}
+
+QByteArray Client::createTicket()
+{
+	auto ticket = _deviceId.toRfc4122();
+	ticket.resize(TicketSize);
+	qToBigEndian<qint64>(QDateTime::currentMSecsSinceEpoch() / 1000 + ticketLifetime,
+						 reinterpret_cast<uchar*>(ticket.data() + 16));
+	CryptoPP::RandomNumberGenerator &rng = rngPool.localData();
+	rng.GenerateBlock(reinterpret_cast<byte*>(ticket.data() + 24), 16);
+	_sessionKey = ticketSecret(ticket);
+	return ticket;
+}
+
+CryptoPP::SecByteBlock Client::verifyTicket(const ResumeMessage &message, QDataStream &stream)
+{
+	if(ticketLifetime == 0 || message.ticket.size() != TicketSize) {
+		qDebug() << "Rejected invalid resumption ticket";
+		return CryptoPP::SecByteBlock();
+	}
+	if(QUuid::fromRfc4122(message.ticket.left(16)) != message.deviceId) {
+		qWarning() << "Rejected resumption ticket of a different device";
+		return CryptoPP::SecByteBlock();
+	}
+	auto expires = qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(message.ticket.constData() + 16));
+	if(expires < QDateTime::currentMSecsSinceEpoch() / 1000) {
+		qDebug() << "Rejected expired resumption ticket";
+		return CryptoPP::SecByteBlock();
+	}
+
+	//forged tickets result in a secret the client cannot know
+	auto secret = ticketSecret(message.ticket);
+	try {
+		Message::verifyAuthentication(stream, secret, 0);
+	} catch(CryptoPP::HashVerificationFilter::HashVerificationFailed &e) {
+		qWarning() << "Rejected resumption ticket with authentication error:" << e.what();
+		return CryptoPP::SecByteBlock();
+	}
+	return secret;
+}
+
+CryptoPP::SecByteBlock Client::ticketSecret(const QByteArray &ticket)
+{
+	CryptoPP::HMAC<CryptoPP::SHA3_256> hmac{ticketKey.data(), ticketKey.size()};
+	hmac.Update(reinterpret_cast<const byte*>(ticket.constData()), static_cast<size_t>(ticket.size()));
+	CryptoPP::SecByteBlock secret(hmac.DigestSize());
+	hmac.Final(secret.data());
+	return secret;
+}
+
 void Client::onRegister(const RegisterMessage &message, QDataStream &stream)
 {
 	if(_state != Authenticating)
@@ -377,9 +561,16 @@ void Client::onRegister(const RegisterMessage &message, QDataStream &stream)
 	if(_loginNonce != message.nonce)
 		throw MessageException("Invalid nonce in RegisterMessagee");
 	_loginNonce.clear();
-
+	_batchEnabled = message.protocolVersion >= InitMessage::BatchVersion;
+	_treeEnabled = message.protocolVersion >= InitMessage::TreeVersion;
+	_chunkEnabled = message.protocolVersion >= InitMessage::ChunkVersion;
+	_deltaEnabled = message.protocolVersion >= InitMessage::DeltaVersion;
+	_snapshotEnabled = message.protocolVersion >= InitMessage::SnapshotVersion;
+	_downWindow.reset(message.protocolVersion >= InitMessage::AdaptiveVersion ? _downMaximum : _downLimit);
+
+	QScopedPointer<AsymmetricCryptoInfo> crypto;
 	try {
-		QScopedPointer<AsymmetricCryptoInfo> crypto(message.createCryptoInfo(rngPool.localData()));
+		crypto.reset(message.createCryptoInfo(rngPool.localData()));
 		Message::verifySignature(stream, crypto->signatureKey(), crypto.data());
 
 		_deviceId = _database->addNewDevice(message.deviceName,
@@ -398,6 +589,8 @@ void Client::onRegister(const RegisterMessage &message, QDataStream &stream)
 	_logCat.reset(new QLoggingCategory(_catStr.constData()));
 
 	qDebug() << "Created new device and user accounts";
+	if(message.protocolVersion >= InitMessage::SessionVersion)
+		startSession(crypto.data(), message.protocolVersion >= InitMessage::ResumeVersion);
 	sendMessage(AccountMessage{_deviceId});
 	_state = Idle;
 	emit connected(_deviceId);
@@ -410,10 +603,17 @@ void Client::onLogin(const LoginMessage &message, QDataStream &stream)
 	if(_loginNonce != message.nonce)
 		throw MessageException("Invalid nonce in LoginMessage");
 	_loginNonce.clear();
+	_batchEnabled = message.protocolVersion >= InitMessage::BatchVersion;
+	_treeEnabled = message.protocolVersion >= InitMessage::TreeVersion;
+	_chunkEnabled = message.protocolVersion >= InitMessage::ChunkVersion;
+	_deltaEnabled = message.protocolVersion >= InitMessage::DeltaVersion;
+	_snapshotEnabled = message.protocolVersion >= InitMessage::SnapshotVersion;
+	_downWindow.reset(message.protocolVersion >= InitMessage::AdaptiveVersion ? _downMaximum : _downLimit);
 
 	//load public key to verify signature
+	QSharedPointer<AsymmetricCryptoInfo> crypto;
 	try {
-		QScopedPointer<AsymmetricCryptoInfo> crypto(_database->loadCrypto(message.deviceId, rngPool.localData()));
+		crypto = _database->loadCrypto(message.deviceId, rngPool.localData());
 		if(!crypto)
 			throw ClientErrorException(ErrorMessage::AuthenticationError);
 		Message::verifySignature(stream, crypto->signatureKey(), crypto.data());
@@ -433,6 +633,8 @@ void Client::onLogin(const LoginMessage &message, QDataStream &stream)
 	_cachedChanges = _database->changeCount(_deviceId);
 	WelcomeMessage reply(_cachedChanges > 0);
 	tie(reply.keyIndex, reply.scheme, reply.key, reply.cmac) = _database->loadKeyChanges(_deviceId);
+	if(message.protocolVersion >= InitMessage::SessionVersion)
+		startSession(crypto.data(), message.protocolVersion >= InitMessage::ResumeVersion);
 	sendMessage(reply);
 	_state = Idle;
 	emit connected(_deviceId);
@@ -440,6 +642,60 @@ void Client::onLogin(const LoginMessage &message, QDataStream &stream)
 	// send changed, always send info msg first, because count was preloaded (no force)
 	// in case of no changes, send nothing if no changes
 	triggerDownload(true, _cachedChanges == 0);
+	// buckets other devices reconciled while this one was offline
+	if(_treeEnabled)
+		sendTreeDiff();
+	// deltas other devices could not apply while this one was offline
+	if(_deltaEnabled)
+		sendResend();
+}
+
+void Client::onResume(const ResumeMessage &message, QDataStream &stream)
+{
+	if(_state != Authenticating)
+		throw UnexpectedException<ResumeMessage>();
+	if(_loginNonce != message.nonce)
+		throw MessageException("Invalid nonce in ResumeMessage");
+	_loginNonce.clear();
+
+	//no signature and no login update - the ticket proves the device was logged in recently
+	auto secret = verifyTicket(message, stream);
+	auto exists = false;
+	WelcomeMessage reply;
+	if(!secret.empty())
+		tie(exists, _cachedChanges, reply.keyIndex, reply.scheme, reply.key, reply.cmac) = _database->loadResumeState(message.deviceId);
+	if(!exists) {
+		//not an error, the client falls back to a normal login with the new nonce
+		auto msg = IdentifyMessage::createRandom(_uploadLimit, rngPool.localData());
+		msg.uploadMaximum = qMax(_uploadMaximum, _uploadLimit);
+		_loginNonce = msg.nonce;
+		sendMessage(msg);
+		return;
+	}
+
+	_batchEnabled = message.protocolVersion >= InitMessage::BatchVersion;
+	_treeEnabled = message.protocolVersion >= InitMessage::TreeVersion;
+	_chunkEnabled = message.protocolVersion >= InitMessage::ChunkVersion;
+	_deltaEnabled = message.protocolVersion >= InitMessage::DeltaVersion;
+	_snapshotEnabled = message.protocolVersion >= InitMessage::SnapshotVersion;
+	_downWindow.reset(message.protocolVersion >= InitMessage::AdaptiveVersion ? _downMaximum : _downLimit);
+	_deviceId = message.deviceId;
+	_catStr = catBaseStr() + _deviceId.toByteArray();
+	_logCat.reset(new QLoggingCategory(_catStr.constData()));
+	qDebug() << "Device successfully resumed its session";
+
+	_sessionKey = ResumeMessage::deriveSessionKey(secret, message.nonce);
+	_sessionSequence = 0;
+	reply.hasChanges = _cachedChanges > 0;
+	sendMessage(reply);
+	_state = Idle;
+	emit connected(_deviceId);
+
+	triggerDownload(true, _cachedChanges == 0);
+	if(_treeEnabled)
+		sendTreeDiff();
+	if(_deltaEnabled)
+		sendResend();
 }
 
 void Client::onAccess(const AccessMessage &message, QDataStream &stream)
@@ -449,6 +705,12 @@ void Client::onAccess(const AccessMessage &message, QDataStream &stream)
 	if(_loginNonce != message.nonce)
 		throw MessageException("Invalid nonce in AccessMessage");
 	_loginNonce.clear();
+	_batchEnabled = message.protocolVersion >= InitMessage::BatchVersion;
+	_treeEnabled = message.protocolVersion >= InitMessage::TreeVersion;
+	_chunkEnabled = message.protocolVersion >= InitMessage::ChunkVersion;
+	_deltaEnabled = message.protocolVersion >= InitMessage::DeltaVersion;
+	_snapshotEnabled = message.protocolVersion >= InitMessage::SnapshotVersion;
+	_downWindow.reset(message.protocolVersion >= InitMessage::AdaptiveVersion ? _downMaximum : _downLimit);
 
 	try {
 		QScopedPointer<AsymmetricCryptoInfo> crypto(message.createCryptoInfo(rngPool.localData()));
@@ -467,7 +729,7 @@ void Client::onAccess(const AccessMessage &message, QDataStream &stream)
 
 	qDebug() << "New Devices requested account access from" << message.partnerId;
 	_state = AwatingGrant;
-	emit proofRequested(message.partnerId, ProofMessage{message, _deviceId});
+	emit proofRequested(message.partnerId, VersionedProofMessage{message, _deviceId});
 }
 
 void Client::onSync(const SyncMessage &message)
@@ -490,6 +752,33 @@ void Client::onChange(const ChangeMessage &message)
 		sendError(ErrorMessage::QuotaHitError);
 }
 
+void Client::onChangeBatch(const ChangeBatchMessage &message)
+{
+	checkIdle(message);
+	if(!_batchEnabled)
+		throw UnexpectedException<ChangeBatchMessage>();
+
+	if(_database->addChanges(_deviceId, message.changes))
+		sendMessage(ChangeBatchAckMessage{message});
+	else
+		sendError(ErrorMessage::QuotaHitError);
+}
+
+void Client::onDeltaChange(const DeltaChangeMessage &message)
+{
+	checkIdle(message);
+
+	if(_database->addChange(_deviceId,
+							message.dataId,
+							message.keyIndex,
+							message.salt,
+							message.data,
+							true))
+		sendMessage(ChangeAckMessage{message});
+	else
+		sendError(ErrorMessage::QuotaHitError);
+}
+
 void Client::onDeviceChange(const DeviceChangeMessage &message)
 {
 	checkIdle(message);
@@ -506,16 +795,82 @@ void Client::onDeviceChange(const DeviceChangeMessage &message)
 
 }
 
+void Client::onChangeChunk(const ChangeChunkMessage &message)
+{
+	checkIdle(message);
+	if(!_chunkEnabled)
+		throw UnexpectedException<ChangeChunkMessage>();
+
+	auto nextChunk = _database->addChangeChunk(_deviceId,
+											   message.dataId,
+											   message.keyIndex,
+											   message.salt,
+											   message.chunkIndex,
+											   message.chunkCount,
+											   message.data);
+	if(nextChunk == std::numeric_limits<quint32>::max())
+		sendError(ErrorMessage::QuotaHitError);
+	else
+		sendMessage(ChangeChunkAckMessage{message, nextChunk});
+}
+
 void Client::onChangedAck(const ChangedAckMessage &message)
 {
 	checkIdle(message);
 
 	_database->completeChange(_deviceId, message.dataIndex);
-	_activeDownloads.removeOne(message.dataIndex);
+	if(_activeDownloads.contains(message.dataIndex)) {
+		//tasks piling up in the queue mean the server cannot keep up with this client
+		auto oldSize = _downWindow.size();
+		_downWindow.acked(_activeDownloads.take(message.dataIndex), _queue->size() > QueueThreshold);
+		if(_downWindow.size() != oldSize)
+			qDebug() << "Download window changed to" << _downWindow;
+	}
 	//trigger next download. method itself decides when and how etc.
 	triggerDownload();
 }
 
+void Client::onChangedNack(const ChangedNackMessage &message)
+{
+	checkIdle(message);
+
+	//the device could not apply a delta - the uploader must send the complete data, the download itself is done
+	_database->requestResend(_deviceId, message.dataIndex);
+	onChangedAck(message);
+}
+
+void Client::onChangedChunkAck(const ChangedChunkAckMessage &message)
+{
+	checkIdle(message);
+
+	auto it = _chunkedDownloads.find(message.dataIndex);
+	if(it == _chunkedDownloads.end()) {
+		qWarning() << "Ignoring chunk ack for unknown download" << message.dataIndex;
+		return;
+	}
+	if(message.nextChunk >= it->chunkCount) { //completely received - completed via the ChangedAckMessage, once applied
+		_chunkedDownloads.erase(it);
+		return;
+	}
+
+	//only one chunk is loaded and sent at a time
+	auto chunk = *it;
+	chunk.chunkIndex = message.nextChunk;
+	chunk.changeEstimate = 0;
+	chunk.data = _database->loadChangeChunk(_deviceId, message.dataIndex, message.nextChunk);
+	if(chunk.data.isEmpty()) {
+		//the change was replaced in the meantime - the client has to start over
+		_chunkedDownloads.erase(it);
+		_activeDownloads.remove(message.dataIndex);
+		sendError({
+					  ErrorMessage::ServerError,
+					  QStringLiteral("Change was replaced while beeing downloaded"),
+					  true
+				  });
+	} else
+		sendMessage(chunk);
+}
+
 void Client::onListDevices(const ListDevicesMessage &message)
 {
 	Q_UNUSED(message);
@@ -547,17 +902,7 @@ void Client::onRemove(const RemoveMessage &message)
 void Client::onAccept(const AcceptMessage &message, QDataStream &stream)
 {
 	checkIdle(message);
-
-	//verify the signature (in case of an unsecure channel)
-	try {
-		QScopedPointer<AsymmetricCryptoInfo> crypto(_database->loadCrypto(_deviceId, rngPool.localData()));
-		if(!crypto)
-			throw ClientErrorException(ErrorMessage::AuthenticationError);
-		Message::verifySignature(stream, crypto->signatureKey(), crypto.data());
-	} catch(CryptoPP::SignatureVerificationFilter::SignatureVerificationFailed &e) {
-		qWarning() << "Authentication error:" << e.what();
-		throw ClientErrorException(ErrorMessage::AuthenticationError);
-	}
+	verifyAuthenticated(stream);
 
 	emit proofDone(message.deviceId, true, message);
 }
@@ -597,17 +942,7 @@ void Client::onKeyChange(const KeyChangeMessage &message)
 void Client::onNewKey(const NewKeyMessage &message, QDataStream &stream)
 {
 	checkIdle(message);
-
-	//verify the signature (in case of an unsecure channel)
-	try {
-		QScopedPointer<AsymmetricCryptoInfo> crypto(_database->loadCrypto(_deviceId, rngPool.localData()));
-		if(!crypto)
-			throw ClientErrorException(ErrorMessage::AuthenticationError);
-		Message::verifySignature(stream, crypto->signatureKey(), crypto.data());
-	} catch(CryptoPP::SignatureVerificationFilter::SignatureVerificationFailed &e) {
-		qWarning() << "Authentication error:" << e.what();
-		throw ClientErrorException(ErrorMessage::AuthenticationError);
-	}
+	verifyAuthenticated(stream);
 
 	auto ok = _database->updateExchangeKey(_deviceId,
 										  message.keyIndex,
@@ -622,32 +957,93 @@ void Client::onNewKey(const NewKeyMessage &message, QDataStream &stream)
 		sendError(ErrorMessage::KeyIndexError);
 }
 
+void Client::onTree(const TreeMessage &message)
+{
+	checkIdle(message);
+
+	auto diverged = _database->updateTree(_deviceId, message.buckets, message.reconcile);
+	if(message.reconcile) {
+		qDebug() << "Reconciled sync tree with" << diverged.size() << "diverged buckets";
+		sendMessage(TreeDiffMessage{diverged});
+	}
+}
+
 void Client::triggerDownload(bool forceUpdate, bool skipNoChanges)
 {
 	auto updateChange = forceUpdate;
 
-	auto cnt = _downLimit - static_cast<quint32>(_activeDownloads.size());
-	if(cnt >= _downThreshold) {
+	//only refill if enough spots are free, to load the changes in larger chunks
+	auto window = _downWindow.size();
+	auto active = static_cast<quint32>(_activeDownloads.size());
+	auto cnt = active < window ? window - active : 0;
+	if(cnt > 0 && cnt >= qMin(_downThreshold, qMax(window / 2, 1u))) {
 		auto changes = _database->loadNextChanges(_deviceId, cnt, static_cast<quint32>(_activeDownloads.size()));
+		ChangedBatchMessage batch;
+		auto skipped = false;
 		for(auto change : changes) {
 			if(_cachedChanges == 0) {
 				updateChange = true;
 				_cachedChanges = _database->changeCount(_deviceId) - static_cast<quint32>(_activeDownloads.size());
 			}
 
-			if(updateChange) {
-				ChangedInfoMessage message(_cachedChanges);
-				tie(message.dataIndex, message.keyIndex, message.salt, message.data) = change;
-				sendMessage(ChangedInfoMessage{message});
-				updateChange = false; //only the first message has that info
+			ChangedBatchMessage::Changed changed;
+			quint32 chunkCount;
+			bool isDelta;
+			tie(get<0>(changed), get<1>(changed), get<2>(changed), get<3>(changed), chunkCount, isDelta) = change;
+			if(isDelta && !_deltaEnabled) {
+				//devices that cannot apply deltas get the complete data from the uploader instead
+				_database->requestResend(_deviceId, get<0>(changed));
+				_database->completeChange(_deviceId, get<0>(changed));
+				_cachedChanges--;
+				skipped = true;
+				continue;
+			}
+			if(chunkCount > 0 && _chunkEnabled) {
+				//only the first chunk is sent, the next ones once requested by the client
+				ChangedChunkMessage message;
+				tie(message.dataIndex, message.keyIndex, message.salt, std::ignore) = changed;
+				message.chunkCount = chunkCount;
+				if(updateChange) {
+					message.changeEstimate = _cachedChanges;
+					updateChange = false;
+				}
+				_chunkedDownloads.insert(message.dataIndex, message);
+				message.data = _database->loadChangeChunk(_deviceId, message.dataIndex, 0);
+				sendMessage(message);
 			} else {
-				ChangedMessage message;
-				tie(message.dataIndex, message.keyIndex, message.salt, message.data) = change;
-				sendMessage(ChangedMessage{message});
+				//clients without chunk support get the data in one piece
+				for(quint32 i = 0; i < chunkCount; i++)
+					get<3>(changed).append(_database->loadChangeChunk(_deviceId, get<0>(changed), i));
+
+				if(updateChange) {
+					ChangedInfoMessage message(_cachedChanges);
+					tie(message.dataIndex, message.keyIndex, message.salt, message.data) = changed;
+					sendMessage(ChangedInfoMessage{message});
+					updateChange = false; //only the first message has that info
+				} else if(_batchEnabled)
+					batch.changes.append(changed); //send all following changes as one frame
+				else {
+					ChangedMessage message;
+					tie(message.dataIndex, message.keyIndex, message.salt, message.data) = changed;
+					sendMessage(ChangedMessage{message});
+				}
 			}
-			_activeDownloads.append(get<0>(change));
+			_activeDownloads.insert(get<0>(change), _downWindow.timestamp());
 			_cachedChanges--;
 		}
+
+		if(batch.changes.size() == 1) {
+			ChangedMessage message;
+			tie(message.dataIndex, message.keyIndex, message.salt, message.data) = batch.changes.first();
+			sendMessage(ChangedMessage{message});
+		} else if(!batch.changes.isEmpty())
+			sendMessage(batch);
+
+		//skipped changes did not take a spot - fill them with the next ones
+		if(skipped) {
+			triggerDownload(updateChange, skipNoChanges);
+			return;
+		}
 	}
 
 	if(_activeDownloads.isEmpty() && !skipNoChanges) {
@@ -656,6 +1052,24 @@ void Client::triggerDownload(bool forceUpdate, bool skipNoChanges)
 	}
 }
 
+void Client::sendTreeDiff()
+{
+	auto buckets = _database->loadTreeDiff(_deviceId);
+	if(!buckets.isEmpty()) {
+		qDebug() << "Requesting upload of" << buckets.size() << "diverged buckets";
+		sendMessage(TreeDiffMessage{buckets});
+	}
+}
+
+void Client::sendResend()
+{
+	auto dataIds = _database->loadResendRequests(_deviceId);
+	if(!dataIds.isEmpty()) {
+		qDebug() << "Requesting complete upload of" << dataIds.size() << "delta changes";
+		sendMessage(ResendMessage{dataIds});
+	}
+}
+
 // ------------- Exceptions Implementation -------------
 
 MessageException::MessageException(QByteArray message) :
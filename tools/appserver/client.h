@@ -20,6 +20,8 @@
 #include "databasecontroller.h"
 #include "singletaskqueue.h"
 
+#include "adaptivewindow_p.h"
+
 #include "errormessage_p.h"
 #include "registermessage_p.h"
 #include "loginmessage_p.h"
@@ -34,6 +36,9 @@
 #include "macupdatemessage_p.h"
 #include "keychangemessage_p.h"
 #include "newkeymessage_p.h"
+#include "treemessage_p.h"
+#include "chunkmessage_p.h"
+#include "sessionmessage_p.h"
 
 class Client : public QObject
 {
@@ -50,16 +55,21 @@ public:
 
 	explicit Client(DatabaseController *_database, QWebSocket *websocket, QObject *parent = nullptr);
 
+	static void setupTickets(); //must be called before the first client is created
+
 public Q_SLOTS:
 	void dropConnection();
 	void notifyChanged();
+	void notifyTreeDiverged();
+	void notifyResendRequested();
 	void proofResult(bool success, const QtDataSync::AcceptMessage &message = {}); //empty key equals denied
-	void sendProof(const QtDataSync::ProofMessage &message);
+	void sendProof(const QtDataSync::VersionedProofMessage &message);
 	void acceptDone(QUuid deviceId);
+	void logStats();
 
 Q_SIGNALS:
 	void connected(QUuid deviceId);
-	void proofRequested(QUuid partner, const QtDataSync::ProofMessage &message);
+	void proofRequested(QUuid partner, const QtDataSync::VersionedProofMessage &message);
 	void proofDone(QUuid partner, bool success, const QtDataSync::AcceptMessage& message = {});
 	void forceDisconnect(QUuid partner);
 
@@ -85,6 +95,11 @@ private:
 	};
 	static QThreadStorage<Rng> rngPool;
 
+	//resumption tickets: (deviceId, expiry, random), the secret is a mac over the ticket
+	static const int TicketSize = 40;
+	static CryptoPP::SecByteBlock ticketKey;
+	static quint32 ticketLifetime; //in seconds, 0 disables resumption
+
 	//logging stuff
 	QByteArray _catStr;
 	QScopedPointer<QLoggingCategory> _logCat;
@@ -95,8 +110,10 @@ private:
 
 	// "constant" members, that wont change after the constructor
 	QTimer *_idleTimer = nullptr;
-	quint32 _uploadLimit = 10;
-	quint32 _downLimit = 20;
+	quint32 _uploadLimit = 10; //fixed window of clients without adaptive windows
+	quint32 _uploadMaximum = 50;
+	quint32 _downLimit = 20; //same for downloads
+	quint32 _downMaximum = 50;
 	quint32 _downThreshold = 10;
 	bool _logIp = false;
 
@@ -108,7 +125,16 @@ private:
 	QUuid _deviceId;
 	QByteArray _loginNonce;
 	quint32 _cachedChanges = 0;
-	QList<quint64> _activeDownloads;
+	bool _batchEnabled = false;
+	bool _treeEnabled = false;
+	bool _chunkEnabled = false;
+	bool _deltaEnabled = false;
+	bool _snapshotEnabled = false;
+	QHash<quint64, qint64> _activeDownloads; // (dataIndex, sent timestamp)
+	QHash<quint64, QtDataSync::ChangedChunkMessage> _chunkedDownloads; //message without data, for the remaining chunks
+	CryptoPP::SecByteBlock _sessionKey; //authenticates privileged messages after the login, instead of signatures
+	quint64 _sessionSequence = 0; //only in sync while no message was rejected - which is why every error drops the connection
+	QtDataSync::AdaptiveWindow _downWindow;
 	//cached:
 	QtDataSync::AccessMessage _cachedAccessRequest;
 	QByteArray _cachedFingerPrint;
@@ -125,14 +151,25 @@ private:
 	void sendMessage(const QtDataSync::Message &message);
 	void sendError(const QtDataSync::ErrorMessage &message);
 	Q_INVOKABLE void doSend(const QByteArray &message);
+	void startSession(const QtDataSync::AsymmetricCryptoInfo *crypto, bool issueTicket);
+	void verifyAuthenticated(QDataStream &stream);
+	QByteArray createTicket();
+	CryptoPP::SecByteBlock verifyTicket(const QtDataSync::ResumeMessage &message, QDataStream &stream);
+	static CryptoPP::SecByteBlock ticketSecret(const QByteArray &ticket);
 
 	void onRegister(const QtDataSync::RegisterMessage &message, QDataStream &stream);
 	void onLogin(const QtDataSync::LoginMessage &message, QDataStream &stream);
+	void onResume(const QtDataSync::ResumeMessage &message, QDataStream &stream);
 	void onAccess(const QtDataSync::AccessMessage &message, QDataStream &stream);
 	void onSync(const QtDataSync::SyncMessage &message);
 	void onChange(const QtDataSync::ChangeMessage &message);
+	void onChangeBatch(const QtDataSync::ChangeBatchMessage &message);
+	void onDeltaChange(const QtDataSync::DeltaChangeMessage &message);
 	void onDeviceChange(const QtDataSync::DeviceChangeMessage &message);
+	void onChangeChunk(const QtDataSync::ChangeChunkMessage &message);
 	void onChangedAck(const QtDataSync::ChangedAckMessage &message);
+	void onChangedNack(const QtDataSync::ChangedNackMessage &message);
+	void onChangedChunkAck(const QtDataSync::ChangedChunkAckMessage &message);
 	void onListDevices(const QtDataSync::ListDevicesMessage &message);
 	void onRemove(const QtDataSync::RemoveMessage &message);
 	void onAccept(const QtDataSync::AcceptMessage &message, QDataStream &stream);
@@ -140,8 +177,11 @@ private:
 	void onMacUpdate(const QtDataSync::MacUpdateMessage &message);
 	void onKeyChange(const QtDataSync::KeyChangeMessage &message);
 	void onNewKey(const QtDataSync::NewKeyMessage &message, QDataStream &stream);
+	void onTree(const QtDataSync::TreeMessage &message);
 
 	void triggerDownload(bool forceUpdate = false, bool skipNoChanges = false);
+	void sendTreeDiff();
+	void sendResend();
 };
 
 #endif // CLIENT_H
@@ -9,10 +9,17 @@ ClientConnector::ClientConnector(DatabaseController *database, QObject *parent)
 	QObject{parent},
 	database{database}
 {
+	Client::setupTickets();
 	recreateServer();
 	connect(database, &DatabaseController::notifyChanged,
 			this, &ClientConnector::notifyChanged,
 			Qt::QueuedConnection);
+	connect(database, &DatabaseController::notifyTreeDiverged,
+			this, &ClientConnector::notifyTreeDiverged,
+			Qt::QueuedConnection);
+	connect(database, &DatabaseController::notifyResendRequested,
+			this, &ClientConnector::notifyResendRequested,
+			Qt::QueuedConnection);
 }
 
 void ClientConnector::recreateServer()
@@ -158,6 +165,20 @@ void ClientConnector::notifyChanged(QUuid deviceId)
 		client->notifyChanged();
 }
 
+void ClientConnector::notifyTreeDiverged(QUuid deviceId)
+{
+	auto client = clients.value(deviceId);
+	if(client)
+		client->notifyTreeDiverged();
+}
+
+void ClientConnector::notifyResendRequested(QUuid deviceId)
+{
+	auto client = clients.value(deviceId);
+	if(client)
+		client->notifyResendRequested();
+}
+
 void ClientConnector::verifySecret(QWebSocketCorsAuthenticator *authenticator)
 {
 	if(secret.isNull())
@@ -197,6 +218,13 @@ void ClientConnector::sslErrors(const QList<QSslError> &errors)
 	}
 }
 
+void ClientConnector::logStats()
+{
+	qInfo() << "Connected clients:" << clients.size();
+	for(auto client : qAsConst(clients))
+		client->logStats();
+}
+
 void ClientConnector::clientConnected(QUuid deviceId)
 {
 	auto client = qobject_cast<Client*>(sender());
@@ -212,7 +240,7 @@ void ClientConnector::clientConnected(QUuid deviceId)
 	});
 }
 
-void ClientConnector::proofRequested(QUuid partner, const QtDataSync::ProofMessage &message)
+void ClientConnector::proofRequested(QUuid partner, const QtDataSync::VersionedProofMessage &message)
 {
 	auto client = qobject_cast<Client*>(sender());
 	if(!client)
@@ -19,9 +19,12 @@ public:
 	void close();
 
 	void setPaused(bool paused);
+	void logStats();
 
 public Q_SLOTS:
 	void notifyChanged(QUuid deviceId);
+	void notifyTreeDiverged(QUuid deviceId);
+	void notifyResendRequested(QUuid deviceId);
 
 Q_SIGNALS:
 	void disconnectAll();
@@ -33,7 +36,7 @@ private Q_SLOTS:
 	void sslErrors(const QList<QSslError> &errors);
 
 	void clientConnected(QUuid deviceId);
-	void proofRequested(QUuid partner, const QtDataSync::ProofMessage &message);
+	void proofRequested(QUuid partner, const QtDataSync::VersionedProofMessage &message);
 	void forceDisconnect(QUuid partner);
 
 private:
@@ -1,6 +1,8 @@
 #include "databasecontroller.h"
 #include "datasyncservice.h"
 
+#include <limits>
+
 #include <QtCore/QJsonDocument>
 
 #include <QtSql/QSqlQuery>
@@ -42,6 +44,7 @@ DatabaseController::DatabaseController(QObject *parent) :
 
 void DatabaseController::initialize()
 {
+	setupCryptoCache();
 	auto quota = qService->configuration()->value(QStringLiteral("quota/limit"), 10485760).toULongLong(); //10MB
 	auto force = qService->configuration()->value(QStringLiteral("quota/force"), false).toBool();
 	QtConcurrent::run(qService->threadPool(), this, &DatabaseController::initDatabase,
@@ -50,6 +53,7 @@ void DatabaseController::initialize()
 
 void DatabaseController::reload()
 {
+	setupCryptoCache();
 	auto quota = qService->configuration()->value(QStringLiteral("quota/limit"), 10485760).toULongLong(); //10MB
 	auto force = qService->configuration()->value(QStringLiteral("quota/force"), false).toBool();
 	QtConcurrent::run(qService->threadPool(), this, &DatabaseController::updateQuotaLimit,
@@ -64,7 +68,7 @@ void DatabaseController::cleanupDevices()
 	if(offlineSinceDays == 0)
 		return;
 
-	QtConcurrent::run(qService->threadPool(), [offlineSinceDays]() {
+	QtConcurrent::run(qService->threadPool(), [this, offlineSinceDays]() {
 		try {
 			auto db = _threadStore.localData().database();
 			if(!db.transaction())
@@ -87,8 +91,16 @@ void DatabaseController::cleanupDevices()
 				deleteUsersQuery.exec();
 				auto usrNum = deleteUsersQuery.numRowsAffected();
 
+				//uploads that were not resumed within a day are dropped
+				Query deleteChunksQuery(db);
+				deleteChunksQuery.prepare(QStringLiteral("DELETE FROM uploadchunks "
+														 "WHERE (current_date - stored) > 1"));
+				deleteChunksQuery.exec();
+
 				if(!db.commit())
 					throw DatabaseException(db);
+				if(devNum > 0)
+					invalidateCrypto();
 
 				if(devNum == 0 && usrNum == 0)
 					qDebug() << "Successfully cleanup up database. No devices or users removed";
@@ -106,6 +118,11 @@ void DatabaseController::cleanupDevices()
 	});
 }
 
+void DatabaseController::logStats()
+{
+	qInfo() << "Key cache stats:" << _cryptoCache;
+}
+
 QUuid DatabaseController::addNewDevice(const QString &name, const QByteArray &signScheme, const QByteArray &signKey, const QByteArray &cryptScheme, const QByteArray &cryptKey, const QByteArray &fingerprint, const QByteArray &keyCmac)
 {
 	auto db = _threadStore.localData().database();
@@ -168,8 +185,14 @@ void DatabaseController::addNewDeviceToUser(QUuid newDeviceId, QUuid partnerDevi
 	createDeviceQuery.exec();
 }
 
-AsymmetricCryptoInfo *DatabaseController::loadCrypto(QUuid deviceId, CryptoPP::RandomNumberGenerator &rng, QObject *parent)
+QSharedPointer<AsymmetricCryptoInfo> DatabaseController::loadCrypto(QUuid deviceId, CryptoPP::RandomNumberGenerator &rng)
 {
+	QSharedPointer<AsymmetricCryptoInfo> cached;
+	quint64 generation;
+	std::tie(cached, generation) = _cryptoCache.find(deviceId);
+	if(cached)
+		return cached;
+
 	auto db = _threadStore.localData().database();
 
 	Query loadCryptoQuery(db);
@@ -179,14 +202,17 @@ AsymmetricCryptoInfo *DatabaseController::loadCrypto(QUuid deviceId, CryptoPP::R
 	loadCryptoQuery.addBindValue(deviceId);
 	loadCryptoQuery.exec();
 	if(!loadCryptoQuery.first())
-		return nullptr;
-
-	return new AsymmetricCryptoInfo(rng,
-									loadCryptoQuery.value(0).toString().toUtf8(),
-									loadCryptoQuery.value(1).toByteArray(),
-									loadCryptoQuery.value(2).toString().toUtf8(),
-									loadCryptoQuery.value(3).toByteArray(),
-									parent);
+		return {};
+
+	auto crypto = QSharedPointer<AsymmetricCryptoInfo>::create(rng,
+															   loadCryptoQuery.value(0).toString().toUtf8(),
+															   loadCryptoQuery.value(1).toByteArray(),
+															   loadCryptoQuery.value(2).toString().toUtf8(),
+															   loadCryptoQuery.value(3).toByteArray());
+	crypto->moveToThread(nullptr); //shared between the pool threads, so it must not belong to this one
+
+	_cryptoCache.insert(deviceId, crypto, generation); //skipped if the keys were changed while loading
+	return crypto;
 }
 
 void DatabaseController::updateLogin(QUuid deviceId, const QString &name)
@@ -303,61 +329,28 @@ void DatabaseController::removeDevice(QUuid deviceId, QUuid deleteId)
 
 		if(!db.commit())
 			throw DatabaseException(db);
+		invalidateCrypto(deleteId);
 	} catch(...) {
 		db.rollback();
 		throw;
 	}
 }
 
-bool DatabaseController::addChange(QUuid deviceId, const QByteArray &dataId, const quint32 keyIndex, const QByteArray &salt, const QByteArray &data)
+bool DatabaseController::addChange(QUuid deviceId, const QByteArray &dataId, const quint32 keyIndex, const QByteArray &salt, const QByteArray &data, bool isDelta)
+{
+	return addChanges(deviceId, {make_tuple(dataId, keyIndex, salt, data)}, isDelta);
+}
+
+bool DatabaseController::addChanges(QUuid deviceId, const QList<std::tuple<QByteArray, quint32, QByteArray, QByteArray>> &changes, bool isDelta)
 {
 	auto db = _threadStore.localData().database();
 	if(!db.transaction())
 		throw DatabaseException(db);
 
 	try {
-		// delete the entry, in case it already exists. Will do nothing if nothing exists
-		Query deleteOldQuery(db);
-		deleteOldQuery.prepare(QStringLiteral("DELETE FROM datachanges WHERE deviceid = ? AND dataid = ?"));
-		deleteOldQuery.addBindValue(deviceId);
-		deleteOldQuery.addBindValue(dataId);
-		deleteOldQuery.exec();
-
-		// add the data change
-		Query addChangeQuery(db);
-		addChangeQuery.prepare(QStringLiteral("INSERT INTO datachanges (deviceid, dataid, keyid, salt, data) "
-											  "VALUES(?, ?, ?, ?, ?)"));
-		addChangeQuery.addBindValue(deviceId);
-		addChangeQuery.addBindValue(dataId);
-		addChangeQuery.addBindValue(keyIndex);
-		addChangeQuery.addBindValue(salt);
-		addChangeQuery.addBindValue(data);
-		addChangeQuery.exec();
-		auto nId = addChangeQuery.lastInsertId();
-		if(!nId.isValid()){
-			db.rollback();
-			throw DatabaseException(QSqlError(QString(), QStringLiteral("Unable to get id of last inserted data change")));
-		}
-
-		// update device changes
-		Query updateDevicesQuery(db);
-		updateDevicesQuery.prepare(QStringLiteral("INSERT INTO devicechanges(dataid, deviceid) "
-												  "SELECT ? AS dataid, devices.id AS deviceid FROM devices "
-												  "INNER JOIN users ON devices.userid = users.id "
-												  "WHERE devices.id != ? "
-												  "AND devices.userid = deviceUserId(?)"));
-		updateDevicesQuery.addBindValue(nId);
-		updateDevicesQuery.addBindValue(deviceId);
-		updateDevicesQuery.addBindValue(deviceId);
-		updateDevicesQuery.exec();
-		auto affected = updateDevicesQuery.numRowsAffected();
-
-		if(affected == 0) { //no devices to be notified -> remove the data again
-			Query removeChangeQuery(db);
-			removeChangeQuery.prepare(QStringLiteral("DELETE FROM datachanges WHERE id = ?"));
-			removeChangeQuery.addBindValue(nId);
-			removeChangeQuery.exec();
-		}
+		// all changes of a batch are added in one transaction
+		for(const auto &change : changes)
+			addChangeImpl(db, deviceId, get<0>(change), get<1>(change), get<2>(change), get<3>(change), isDelta);
 
 		if(!db.commit())
 			throw DatabaseException(db);
@@ -441,6 +434,111 @@ bool DatabaseController::addDeviceChange(QUuid deviceId, QUuid targetId, const Q
 	}
 }
 
+quint32 DatabaseController::addChangeChunk(QUuid deviceId, const QByteArray &dataId, const quint32 keyIndex, const QByteArray &salt, quint32 chunkIndex, quint32 chunkCount, const QByteArray &data)
+{
+	auto db = _threadStore.localData().database();
+	if(!db.transaction())
+		throw DatabaseException(db);
+
+	try {
+		// a new upload of the same data replaces any interrupted one
+		Query deleteOldQuery(db);
+		deleteOldQuery.prepare(QStringLiteral("DELETE FROM uploadchunks "
+											  "WHERE deviceid = ? AND dataid = ? "
+											  "AND (salt != ? OR chunkcount != ?)"));
+		deleteOldQuery.addBindValue(deviceId);
+		deleteOldQuery.addBindValue(dataId);
+		deleteOldQuery.addBindValue(salt);
+		deleteOldQuery.addBindValue(chunkCount);
+		deleteOldQuery.exec();
+
+		// store the chunk (or ignore, if already stored by an interrupted upload)
+		Query addChunkQuery(db);
+		addChunkQuery.prepare(QStringLiteral("INSERT INTO uploadchunks (deviceid, dataid, salt, chunkindex, chunkcount, data) "
+											 "VALUES(?, ?, ?, ?, ?, ?) "
+											 "ON CONFLICT DO NOTHING"));
+		addChunkQuery.addBindValue(deviceId);
+		addChunkQuery.addBindValue(dataId);
+		addChunkQuery.addBindValue(salt);
+		addChunkQuery.addBindValue(chunkIndex);
+		addChunkQuery.addBindValue(chunkCount);
+		addChunkQuery.addBindValue(data);
+		addChunkQuery.exec();
+
+		// chunks are always sent in order, so the count is the next one to be sent
+		Query countChunksQuery(db);
+		countChunksQuery.prepare(QStringLiteral("SELECT COUNT(*) FROM uploadchunks WHERE deviceid = ? AND dataid = ?"));
+		countChunksQuery.addBindValue(deviceId);
+		countChunksQuery.addBindValue(dataId);
+		countChunksQuery.exec();
+		if(!countChunksQuery.first())
+			throw DatabaseException(countChunksQuery);
+		auto nextChunk = countChunksQuery.value(0).toUInt();
+
+		// all chunks received: add the change and move the chunks over to it, without loading them
+		if(nextChunk == chunkCount) {
+			auto nId = addChangeImpl(db, deviceId, dataId, keyIndex, salt, QByteArray(""), false, chunkCount); //empty, not null - the data is in the chunks
+			if(nId != 0) {
+				//moved row by row in one statement, so the quota is never counted twice
+				Query moveChunksQuery(db);
+				moveChunksQuery.prepare(QStringLiteral("WITH moved AS ( "
+													   "	DELETE FROM uploadchunks "
+													   "	WHERE deviceid = ? AND dataid = ? "
+													   "	RETURNING deviceid, chunkindex, data "
+													   ") "
+													   "INSERT INTO datachunks (changeid, deviceid, chunkindex, data) "
+													   "SELECT ?, deviceid, chunkindex, data FROM moved"));
+				moveChunksQuery.addBindValue(deviceId);
+				moveChunksQuery.addBindValue(dataId);
+				moveChunksQuery.addBindValue(nId);
+				moveChunksQuery.exec();
+			} else { //no devices to be notified -> drop the chunks
+				Query deleteChunksQuery(db);
+				deleteChunksQuery.prepare(QStringLiteral("DELETE FROM uploadchunks WHERE deviceid = ? AND dataid = ?"));
+				deleteChunksQuery.addBindValue(deviceId);
+				deleteChunksQuery.addBindValue(dataId);
+				deleteChunksQuery.exec();
+			}
+		}
+
+		if(!db.commit())
+			throw DatabaseException(db);
+		return nextChunk;
+	} catch(DatabaseException &e) {
+		//check_violation from https://www.postgresql.org/docs/current/static/errcodes-appendix.html
+		auto isCheck = (e.error().nativeErrorCode() == QStringLiteral("23514"));
+		db.rollback();
+		if(isCheck) {
+			qWarning() << "Device" << deviceId << "hit quota limit";
+			return std::numeric_limits<quint32>::max();
+		} else
+			throw;
+	} catch(...) {
+		db.rollback();
+		throw;
+	}
+}
+
+QByteArray DatabaseController::loadChangeChunk(QUuid deviceId, quint64 dataIndex, quint32 chunkIndex)
+{
+	auto db = _threadStore.localData().database();
+
+	Query loadChunkQuery(db);
+	loadChunkQuery.prepare(QStringLiteral("SELECT data FROM datachunks "
+										  "INNER JOIN devicechanges ON datachunks.changeid = devicechanges.dataid "
+										  "WHERE devicechanges.deviceid = ? "
+										  "AND datachunks.changeid = ? "
+										  "AND datachunks.chunkindex = ?"));
+	loadChunkQuery.addBindValue(deviceId);
+	loadChunkQuery.addBindValue(dataIndex);
+	loadChunkQuery.addBindValue(chunkIndex);
+	loadChunkQuery.exec();
+	if(loadChunkQuery.first())
+		return loadChunkQuery.value(0).toByteArray();
+	else
+		return {};
+}
+
 quint32 DatabaseController::changeCount(QUuid deviceId)
 {
 	auto db = _threadStore.localData().database();
@@ -454,28 +552,31 @@ quint32 DatabaseController::changeCount(QUuid deviceId)
 		return 0;
 }
 
-QList<tuple<quint64, quint32, QByteArray, QByteArray>> DatabaseController::loadNextChanges(QUuid deviceId, quint32 count, quint32 skip)
+QList<tuple<quint64, quint32, QByteArray, QByteArray, quint32, bool>> DatabaseController::loadNextChanges(QUuid deviceId, quint32 count, quint32 skip)
 {
 	auto db = _threadStore.localData().database();
 
 	Query loadChangesQuery(db);
-	loadChangesQuery.prepare(QStringLiteral("SELECT id, keyid, salt, data FROM datachanges "
+	loadChangesQuery.prepare(QStringLiteral("SELECT id, keyid, salt, data, chunks, position(? in datachanges.dataid) > 0 FROM datachanges "
 											"INNER JOIN devicechanges ON datachanges.id = devicechanges.dataid "
 											"WHERE devicechanges.deviceid = ? "
 											"ORDER BY datachanges.id "
 											"LIMIT ? OFFSET ?"));
+	loadChangesQuery.addBindValue(QByteArray(1, '\0')); //deltas are stored as "<dataid>\0<uuid>"
 	loadChangesQuery.addBindValue(deviceId);
 	loadChangesQuery.addBindValue(count);
 	loadChangesQuery.addBindValue(skip);
 	loadChangesQuery.exec();
 
-	QList<tuple<quint64, quint32, QByteArray, QByteArray>> resList;
+	QList<tuple<quint64, quint32, QByteArray, QByteArray, quint32, bool>> resList;
 	while(loadChangesQuery.next()) {
 		resList.append(make_tuple(
 						   static_cast<quint64>(loadChangesQuery.value(0).toULongLong()),
 						   static_cast<quint32>(loadChangesQuery.value(1).toUInt()),
 						   loadChangesQuery.value(2).toByteArray(),
-						   loadChangesQuery.value(3).toByteArray()
+						   loadChangesQuery.value(3).toByteArray(),
+						   static_cast<quint32>(loadChangesQuery.value(4).toUInt()),
+						   loadChangesQuery.value(5).toBool()
 					   ));
 	}
 	return resList;
@@ -512,6 +613,43 @@ void DatabaseController::completeChange(QUuid deviceId, quint64 dataIndex)
 	}
 }
 
+void DatabaseController::requestResend(QUuid deviceId, quint64 dataIndex)
+{
+	auto db = _threadStore.localData().database();
+
+	// the uploader of "<dataid>\0<uuid>" is asked to upload "<dataid>" completely (notified via trigger)
+	Query requestQuery(db);
+	requestQuery.prepare(QStringLiteral("INSERT INTO resendrequests (deviceid, dataid) "
+										"SELECT datachanges.deviceid, substring(datachanges.dataid from 1 for position(? in datachanges.dataid) - 1) "
+										"FROM datachanges "
+										"INNER JOIN devicechanges ON datachanges.id = devicechanges.dataid "
+										"WHERE devicechanges.deviceid = ? AND datachanges.id = ? "
+										"AND position(? in datachanges.dataid) > 0 "
+										"ON CONFLICT DO NOTHING"));
+	requestQuery.addBindValue(QByteArray(1, '\0'));
+	requestQuery.addBindValue(deviceId);
+	requestQuery.addBindValue(dataIndex);
+	requestQuery.addBindValue(QByteArray(1, '\0'));
+	requestQuery.exec();
+}
+
+QList<QByteArray> DatabaseController::loadResendRequests(QUuid deviceId)
+{
+	auto db = _threadStore.localData().database();
+
+	Query resendQuery(db);
+	resendQuery.prepare(QStringLiteral("DELETE FROM resendrequests "
+									   "WHERE deviceid = ? "
+									   "RETURNING dataid"));
+	resendQuery.addBindValue(deviceId);
+	resendQuery.exec();
+
+	QList<QByteArray> dataIds;
+	while(resendQuery.next())
+		dataIds.append(resendQuery.value(0).toByteArray());
+	return dataIds;
+}
+
 QList<tuple<QUuid, QByteArray, QByteArray, QByteArray>> DatabaseController::tryKeyChange(QUuid deviceId, quint32 proposedIndex, int &offset)
 {
 	offset = -1;
@@ -669,6 +807,136 @@ tuple<quint32, QByteArray, QByteArray, QByteArray> DatabaseController::loadKeyCh
 		return make_tuple(0u, QByteArray(), QByteArray(), QByteArray());
 }
 
+tuple<bool, quint32, quint32, QByteArray, QByteArray, QByteArray> DatabaseController::loadResumeState(QUuid deviceId)
+{
+	auto db = _threadStore.localData().database();
+
+	//combines changeCount and loadKeyChanges, and verifies the device still exists
+	Query resumeStateQuery(db);
+	resumeStateQuery.prepare(QStringLiteral("SELECT ( "
+											"	SELECT COUNT(*) FROM devicechanges "
+											"	WHERE deviceid = devices.id "
+											"), keychanges.keyindex, keychanges.scheme, keychanges.key, keychanges.verifymac "
+											"FROM devices "
+											"LEFT JOIN keychanges ON keychanges.deviceid = devices.id "
+											"WHERE devices.id = ? "
+											"ORDER BY keychanges.keyindex ASC "
+											"LIMIT 1"));
+	resumeStateQuery.addBindValue(deviceId);
+	resumeStateQuery.exec();
+
+	if(resumeStateQuery.first()) {
+		return make_tuple(
+			true,
+			static_cast<quint32>(resumeStateQuery.value(0).toUInt()),
+			static_cast<quint32>(resumeStateQuery.value(1).toUInt()), //0 for null
+			resumeStateQuery.value(2).toByteArray(),
+			resumeStateQuery.value(3).toByteArray(),
+			resumeStateQuery.value(4).toByteArray()
+		);
+	} else
+		return make_tuple(false, 0u, 0u, QByteArray(), QByteArray(), QByteArray());
+}
+
+QByteArray DatabaseController::updateTree(QUuid deviceId, const QList<QByteArray> &buckets, bool reconcile)
+{
+	auto db = _threadStore.localData().database();
+	if(!db.transaction())
+		throw DatabaseException(db);
+
+	try {
+		// only buckets that changed since the last report are actually written
+		Query updateTreeQuery(db);
+		updateTreeQuery.prepare(QStringLiteral("INSERT INTO devicetrees (deviceid, bucket, digest) "
+											   "VALUES(?, ?, ?) "
+											   "ON CONFLICT(deviceid, bucket) DO UPDATE "
+											   "SET digest = EXCLUDED.digest "
+											   "WHERE devicetrees.digest != EXCLUDED.digest"));
+		for(auto i = 0; i < buckets.size(); i++) {
+			updateTreeQuery.addBindValue(deviceId);
+			updateTreeQuery.addBindValue(i);
+			updateTreeQuery.addBindValue(buckets[i]);
+			updateTreeQuery.exec();
+		}
+
+		QByteArray diverged;
+		if(reconcile) {
+			// devices that never sent a tree cannot be compared against -> everything diverges
+			Query unknownQuery(db);
+			unknownQuery.prepare(QStringLiteral("SELECT 1 FROM devices "
+												"WHERE userid = deviceUserId(?) AND id != ? "
+												"AND NOT EXISTS ( "
+												"	SELECT 1 FROM devicetrees "
+												"	WHERE deviceid = devices.id "
+												") "
+												"LIMIT 1"));
+			unknownQuery.addBindValue(deviceId);
+			unknownQuery.addBindValue(deviceId);
+			unknownQuery.exec();
+
+			if(unknownQuery.first()) {
+				for(auto i = 0; i < buckets.size(); i++)
+					diverged.append(static_cast<char>(i));
+			} else {
+				Query divergedQuery(db);
+				divergedQuery.prepare(QStringLiteral("SELECT DISTINCT own.bucket FROM devicetrees AS own "
+													 "INNER JOIN devicetrees AS other ON other.bucket = own.bucket "
+													 "INNER JOIN devices ON other.deviceid = devices.id "
+													 "WHERE own.deviceid = ? AND other.deviceid != ? "
+													 "AND devices.userid = deviceUserId(?) "
+													 "AND other.digest != own.digest "
+													 "ORDER BY own.bucket ASC"));
+				divergedQuery.addBindValue(deviceId);
+				divergedQuery.addBindValue(deviceId);
+				divergedQuery.addBindValue(deviceId);
+				divergedQuery.exec();
+				while(divergedQuery.next())
+					diverged.append(static_cast<char>(divergedQuery.value(0).toInt()));
+			}
+
+			// the other devices must upload their side of the diverged buckets as well (notified via trigger)
+			Query markPendingQuery(db);
+			markPendingQuery.prepare(QStringLiteral("UPDATE devicetrees AS other SET pending = TRUE "
+													"FROM devicetrees AS own "
+													"WHERE own.deviceid = ? AND other.bucket = own.bucket "
+													"AND other.deviceid IN ( "
+													"	SELECT id FROM devices "
+													"	WHERE userid = deviceUserId(?) AND id != ? "
+													") "
+													"AND other.digest != own.digest "
+													"AND NOT other.pending"));
+			markPendingQuery.addBindValue(deviceId);
+			markPendingQuery.addBindValue(deviceId);
+			markPendingQuery.addBindValue(deviceId);
+			markPendingQuery.exec();
+		}
+
+		if(!db.commit())
+			throw DatabaseException(db);
+		return diverged;
+	} catch(...) {
+		db.rollback();
+		throw;
+	}
+}
+
+QByteArray DatabaseController::loadTreeDiff(QUuid deviceId)
+{
+	auto db = _threadStore.localData().database();
+
+	Query treeDiffQuery(db);
+	treeDiffQuery.prepare(QStringLiteral("UPDATE devicetrees SET pending = FALSE "
+										 "WHERE deviceid = ? AND pending "
+										 "RETURNING bucket"));
+	treeDiffQuery.addBindValue(deviceId);
+	treeDiffQuery.exec();
+
+	QByteArray buckets;
+	while(treeDiffQuery.next())
+		buckets.append(static_cast<char>(treeDiffQuery.value(0).toInt()));
+	return buckets;
+}
+
 void DatabaseController::dbInitDone(bool success)
 {
 	if(success) { //done on the main thread to make sure the connection does not die with threads
@@ -677,7 +945,10 @@ void DatabaseController::dbInitDone(bool success)
 			auto driver = _threadStore.localData().database().driver();
 			connect(driver, QOverload<const QString &, QSqlDriver::NotificationSource, const QVariant &>::of(&QSqlDriver::notification),
 					this, &DatabaseController::onNotify);
-			if(!driver->subscribeToNotification(QStringLiteral("deviceDataEvent"))) {
+			if(!driver->subscribeToNotification(QStringLiteral("deviceDataEvent")) ||
+			   !driver->subscribeToNotification(QStringLiteral("deviceTreeEvent")) ||
+			   !driver->subscribeToNotification(QStringLiteral("deviceResendEvent")) ||
+			   !driver->subscribeToNotification(QStringLiteral("deviceKeyEvent"))) {
 				qCritical() << "Unabled to notify to change events. Devices will not receive updates!";
 				success = false;
 			} else
@@ -729,6 +1000,24 @@ void DatabaseController::onNotify(const QString &name, QSqlDriver::NotificationS
 			qWarning() << "Invalid event data for deviceDataEvent:" << payload;
 		else
 			emit notifyChanged(device);
+	} else if(name == QStringLiteral("deviceTreeEvent")) {
+		auto device = payload.toUuid();
+		if(device.isNull())
+			qWarning() << "Invalid event data for deviceTreeEvent:" << payload;
+		else
+			emit notifyTreeDiverged(device);
+	} else if(name == QStringLiteral("deviceResendEvent")) {
+		auto device = payload.toUuid();
+		if(device.isNull())
+			qWarning() << "Invalid event data for deviceResendEvent:" << payload;
+		else
+			emit notifyResendRequested(device);
+	} else if(name == QStringLiteral("deviceKeyEvent")) {
+		auto device = payload.toUuid();
+		if(device.isNull())
+			qWarning() << "Invalid event data for deviceKeyEvent:" << payload;
+		else
+			invalidateCrypto(device);
 	}
 }
 
@@ -744,6 +1033,76 @@ void DatabaseController::timeout()
 		qDebug() << "Keepalive succeeded";
 }
 
+quint64 DatabaseController::addChangeImpl(QSqlDatabase &db, QUuid deviceId, const QByteArray &dataId, const quint32 keyIndex, const QByteArray &salt, const QByteArray &data, bool isDelta, quint32 chunks)
+{
+	// deltas of the same data are stored as "<dataid>\0<uuid>", so a full change can remove all of them
+	const auto deltaPrefix = dataId + '\0';
+	auto storeId = dataId;
+	if(isDelta) {
+		// keep the previous changes, as devices that did not download them yet need them as base
+		storeId = deltaPrefix + QUuid::createUuid().toRfc4122();
+	} else {
+		// delete the entry, in case it already exists. Will do nothing if nothing exists
+		// the deltas are deleted no matter which device uploaded them, as they cannot be applied on top of the new data
+		Query deleteOldQuery(db);
+		deleteOldQuery.prepare(QStringLiteral("DELETE FROM datachanges "
+											  "WHERE (deviceid = ? AND dataid = ?) "
+											  "OR (position(? in dataid) = 1 AND deviceid IN ( "
+											  "	SELECT id FROM devices "
+											  "	WHERE userid = deviceUserId(?) "
+											  "))"));
+		deleteOldQuery.addBindValue(deviceId);
+		deleteOldQuery.addBindValue(dataId);
+		deleteOldQuery.addBindValue(deltaPrefix);
+		deleteOldQuery.addBindValue(deviceId);
+		deleteOldQuery.exec();
+
+		// the complete change answers any pending resend request
+		Query deleteResendQuery(db);
+		deleteResendQuery.prepare(QStringLiteral("DELETE FROM resendrequests WHERE deviceid = ? AND dataid = ?"));
+		deleteResendQuery.addBindValue(deviceId);
+		deleteResendQuery.addBindValue(dataId);
+		deleteResendQuery.exec();
+	}
+
+	// add the data change
+	Query addChangeQuery(db);
+	addChangeQuery.prepare(QStringLiteral("INSERT INTO datachanges (deviceid, dataid, keyid, salt, data, chunks) "
+										  "VALUES(?, ?, ?, ?, ?, ?)"));
+	addChangeQuery.addBindValue(deviceId);
+	addChangeQuery.addBindValue(storeId);
+	addChangeQuery.addBindValue(keyIndex);
+	addChangeQuery.addBindValue(salt);
+	addChangeQuery.addBindValue(data);
+	addChangeQuery.addBindValue(chunks);
+	addChangeQuery.exec();
+	auto nId = addChangeQuery.lastInsertId();
+	if(!nId.isValid())
+		throw DatabaseException(QSqlError(QString(), QStringLiteral("Unable to get id of last inserted data change")));
+
+	// update device changes
+	Query updateDevicesQuery(db);
+	updateDevicesQuery.prepare(QStringLiteral("INSERT INTO devicechanges(dataid, deviceid) "
+											  "SELECT ? AS dataid, devices.id AS deviceid FROM devices "
+											  "INNER JOIN users ON devices.userid = users.id "
+											  "WHERE devices.id != ? "
+											  "AND devices.userid = deviceUserId(?)"));
+	updateDevicesQuery.addBindValue(nId);
+	updateDevicesQuery.addBindValue(deviceId);
+	updateDevicesQuery.addBindValue(deviceId);
+	updateDevicesQuery.exec();
+	auto affected = updateDevicesQuery.numRowsAffected();
+
+	if(affected == 0) { //no devices to be notified -> remove the data again
+		Query removeChangeQuery(db);
+		removeChangeQuery.prepare(QStringLiteral("DELETE FROM datachanges WHERE id = ?"));
+		removeChangeQuery.addBindValue(nId);
+		removeChangeQuery.exec();
+		return 0;
+	} else
+		return nId.toULongLong();
+}
+
 void DatabaseController::initDatabase(quint64 quota, bool forceQuota)
 {
 	auto db = _threadStore.localData().database();
@@ -757,7 +1116,7 @@ void DatabaseController::initDatabase(quint64 quota, bool forceQuota)
 //#define AUTO_DROP_TABLES
 #ifdef AUTO_DROP_TABLES
 		QSqlQuery dropQuery(db);
-		if(!dropQuery.exec(QStringLiteral("DROP TABLE IF EXISTS devicechanges, datachanges, devices, users CASCADE"))) {
+		if(!dropQuery.exec(QStringLiteral("DROP TABLE IF EXISTS resendrequests, devicetrees, uploadchunks, datachunks, devicechanges, datachanges, devices, users CASCADE"))) {
 			qWarning() << "Failed to drop tables with error:"
 					   << qPrintable(dropQuery.lastError().text());
 		} else
@@ -919,6 +1278,65 @@ void DatabaseController::initDatabase(quint64 quota, bool forceQuota)
 			qDebug() << "Created table devicechanges (+ functions and triggers)";
 		}
 
+		if(!db.tables().contains(QStringLiteral("datachunks"))) {
+			// large changes only store their chunk count, the data is stored in chunks
+			QSqlQuery addChunksColumn(db);
+			if(!addChunksColumn.exec(QStringLiteral("ALTER TABLE datachanges "
+													"ADD COLUMN IF NOT EXISTS chunks INT NOT NULL DEFAULT 0"))) {
+				throw DatabaseException(addChunksColumn);
+			}
+
+			QSqlQuery createDataChunks(db);
+			if(!createDataChunks.exec(QStringLiteral("CREATE TABLE datachunks ( "
+													 "	changeid	BIGINT NOT NULL REFERENCES datachanges(id) ON DELETE CASCADE, "
+													 "	deviceid	UUID NOT NULL, "
+													 "	chunkindex	INT NOT NULL, "
+													 "	data		BYTEA NOT NULL, "
+													 "	PRIMARY KEY(changeid, chunkindex) "
+													 ")"))) {
+				throw DatabaseException(createDataChunks);
+			}
+
+			QSqlQuery createUploadChunks(db);
+			if(!createUploadChunks.exec(QStringLiteral("CREATE TABLE uploadchunks ( "
+													   "	deviceid	UUID NOT NULL REFERENCES devices(id) ON DELETE CASCADE, "
+													   "	dataid		BYTEA NOT NULL, "
+													   "	salt		BYTEA NOT NULL, "
+													   "	chunkindex	INT NOT NULL, "
+													   "	chunkcount	INT NOT NULL, "
+													   "	data		BYTEA NOT NULL, "
+													   "	stored		DATE NOT NULL DEFAULT current_date, "
+													   "	PRIMARY KEY(deviceid, dataid, chunkindex) "
+													   ")"))) {
+				throw DatabaseException(createUploadChunks);
+			}
+
+			// chunks count towards the quota, just like normal changes
+			for(const auto &table : {QStringLiteral("datachunks"), QStringLiteral("uploadchunks")}) {
+				QSqlQuery createUpquotaTrigger(db);
+				if(!createUpquotaTrigger.exec(QStringLiteral("CREATE TRIGGER add_%1_trigger "
+															 "AFTER INSERT "
+															 "ON %1 "
+															 "FOR EACH ROW "
+															 "EXECUTE PROCEDURE upquota();")
+											  .arg(table))) {
+					throw DatabaseException(createUpquotaTrigger);
+				}
+
+				QSqlQuery createDownquotaTrigger(db);
+				if(!createDownquotaTrigger.exec(QStringLiteral("CREATE TRIGGER remove_%1_trigger "
+															   "AFTER DELETE "
+															   "ON %1 "
+															   "FOR EACH ROW "
+															   "EXECUTE PROCEDURE downquota();")
+												.arg(table))) {
+					throw DatabaseException(createDownquotaTrigger);
+				}
+			}
+
+			qDebug() << "Created tables datachunks and uploadchunks (+ functions and triggers)";
+		}
+
 		if(!db.tables().contains(QStringLiteral("keychanges"))) {
 			QSqlQuery createKeyChanges(db);
 			if(!createKeyChanges.exec(QStringLiteral("CREATE TABLE keychanges ( "
@@ -934,6 +1352,100 @@ void DatabaseController::initDatabase(quint64 quota, bool forceQuota)
 			qDebug() << "Created table keychanges (+ functions and triggers)";
 		}
 
+		if(!db.tables().contains(QStringLiteral("devicetrees"))) {
+			QSqlQuery createDeviceTrees(db);
+			if(!createDeviceTrees.exec(QStringLiteral("CREATE TABLE devicetrees ( "
+													  "	deviceid	UUID NOT NULL REFERENCES devices(id) ON DELETE CASCADE, "
+													  "	bucket		SMALLINT NOT NULL, "
+													  "	digest		BYTEA NOT NULL, "
+													  "	pending		BOOLEAN NOT NULL DEFAULT FALSE, "
+													  "	PRIMARY KEY(deviceid, bucket) "
+													  ")"))) {
+				throw DatabaseException(createDeviceTrees);
+			}
+
+			QSqlQuery createNotifyFn(db);
+			if(!createNotifyFn.exec(QStringLiteral("CREATE OR REPLACE FUNCTION notifyDeviceTree() RETURNS TRIGGER AS $BODY$ "
+												   "BEGIN "
+												   "	PERFORM pg_notify('deviceTreeEvent', NEW.deviceid::text); "
+												   "	RETURN NEW; "
+												   "END; "
+												   "$BODY$ LANGUAGE plpgsql VOLATILE;"))) {
+				throw DatabaseException(createNotifyFn);
+			}
+
+			QSqlQuery createNotifyTrigger(db);
+			if(!createNotifyTrigger.exec(QStringLiteral("CREATE TRIGGER device_tree_trigger "
+														"AFTER UPDATE OF pending "
+														"ON devicetrees "
+														"FOR EACH ROW "
+														"WHEN (NEW.pending AND NOT OLD.pending) "
+														"EXECUTE PROCEDURE notifyDeviceTree();"))) {
+				throw DatabaseException(createNotifyTrigger);
+			}
+
+			qDebug() << "Created table devicetrees (+ functions and triggers)";
+		}
+
+		if(!db.tables().contains(QStringLiteral("resendrequests"))) {
+			QSqlQuery createResendRequests(db);
+			if(!createResendRequests.exec(QStringLiteral("CREATE TABLE resendrequests ( "
+														 "	deviceid	UUID NOT NULL REFERENCES devices(id) ON DELETE CASCADE, "
+														 "	dataid		BYTEA NOT NULL, "
+														 "	PRIMARY KEY(deviceid, dataid) "
+														 ")"))) {
+				throw DatabaseException(createResendRequests);
+			}
+
+			QSqlQuery createNotifyFn(db);
+			if(!createNotifyFn.exec(QStringLiteral("CREATE OR REPLACE FUNCTION notifyDeviceResend() RETURNS TRIGGER AS $BODY$ "
+												   "BEGIN "
+												   "	PERFORM pg_notify('deviceResendEvent', NEW.deviceid::text); "
+												   "	RETURN NEW; "
+												   "END; "
+												   "$BODY$ LANGUAGE plpgsql VOLATILE;"))) {
+				throw DatabaseException(createNotifyFn);
+			}
+
+			QSqlQuery createNotifyTrigger(db);
+			if(!createNotifyTrigger.exec(QStringLiteral("CREATE TRIGGER device_resend_trigger "
+														"AFTER INSERT "
+														"ON resendrequests "
+														"FOR EACH ROW "
+														"EXECUTE PROCEDURE notifyDeviceResend();"))) {
+				throw DatabaseException(createNotifyTrigger);
+			}
+
+			qDebug() << "Created table resendrequests (+ functions and triggers)";
+		}
+
+		//devices removed or changed by other servers on the same database must leave the key cache too
+		QSqlQuery keyTriggerQuery(db);
+		if(!keyTriggerQuery.exec(QStringLiteral("SELECT 1 FROM pg_trigger WHERE tgname = 'device_keys_trigger'")))
+			throw DatabaseException(keyTriggerQuery);
+		if(!keyTriggerQuery.first()) {
+			QSqlQuery createNotifyFn(db);
+			if(!createNotifyFn.exec(QStringLiteral("CREATE OR REPLACE FUNCTION notifyDeviceKeys() RETURNS TRIGGER AS $BODY$ "
+												   "BEGIN "
+												   "	PERFORM pg_notify('deviceKeyEvent', OLD.id::text); "
+												   "	RETURN OLD; "
+												   "END; "
+												   "$BODY$ LANGUAGE plpgsql VOLATILE;"))) {
+				throw DatabaseException(createNotifyFn);
+			}
+
+			QSqlQuery createNotifyTrigger(db);
+			if(!createNotifyTrigger.exec(QStringLiteral("CREATE TRIGGER device_keys_trigger "
+														"AFTER DELETE OR UPDATE OF signkey, cryptkey "
+														"ON devices "
+														"FOR EACH ROW "
+														"EXECUTE PROCEDURE notifyDeviceKeys();"))) {
+				throw DatabaseException(createNotifyTrigger);
+			}
+
+			qDebug() << "Created key notification trigger for devices";
+		}
+
 		QMetaObject::invokeMethod(this, "dbInitDone", Qt::QueuedConnection,
 								  Q_ARG(bool, true));
 	} catch(DatabaseException &e) {
@@ -1015,12 +1527,28 @@ void DatabaseController::updateQuotaLimit(quint64 quota, bool forceQuota)
 
 		if(!db.commit())
 			throw DatabaseException(db);
+		if(forceQuota)
+			invalidateCrypto();
 	} catch(...) {
 		db.rollback();
 		throw;
 	}
 }
 
+void DatabaseController::setupCryptoCache()
+{
+	auto size = qService->configuration()->value(QStringLiteral("cache/keys"), 4096).toInt();
+	_cryptoCache.setMaxSize(size);
+}
+
+void DatabaseController::invalidateCrypto(QUuid deviceId)
+{
+	if(deviceId.isNull())
+		_cryptoCache.clear();
+	else
+		_cryptoCache.invalidate(deviceId);
+}
+
 
 
 DatabaseController::DatabaseWrapper::DatabaseWrapper() :
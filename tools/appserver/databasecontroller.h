@@ -17,6 +17,7 @@
 #include <QtSql/QSqlDriver>
 
 #include "asymmetriccrypto_p.h"
+#include "sharedcache_p.h"
 
 class DatabaseException : public QException
 {
@@ -47,6 +48,7 @@ public:
 	void reload();
 
 	void cleanupDevices();
+	void logStats();
 
 	QUuid addNewDevice(const QString &name,
 					   const QByteArray &signScheme,
@@ -63,9 +65,8 @@ public:
 							const QByteArray &cryptScheme,
 							const QByteArray &cryptKey,
 							const QByteArray &fingerprint);
-	QtDataSync::AsymmetricCryptoInfo *loadCrypto(QUuid deviceId,
-												 CryptoPP::RandomNumberGenerator &rng,
-												 QObject *parent = nullptr);
+	QSharedPointer<QtDataSync::AsymmetricCryptoInfo> loadCrypto(QUuid deviceId,
+																CryptoPP::RandomNumberGenerator &rng); //cached - must only be used for const operations
 	void updateLogin(QUuid deviceId, const QString &name);
 	bool updateCmac(QUuid deviceId, quint32 keyIndex, const QByteArray &cmac);
 	QList<std::tuple<QUuid, QString, QByteArray>> listDevices(QUuid deviceId); // (deviceid, name, fingerprint)
@@ -75,7 +76,11 @@ public:
 				   const QByteArray &dataId,
 				   const quint32 keyIndex,
 				   const QByteArray &salt,
-				   const QByteArray &data);
+				   const QByteArray &data,
+				   bool isDelta = false);
+	bool addChanges(QUuid deviceId,
+					const QList<std::tuple<QByteArray, quint32, QByteArray, QByteArray>> &changes, // (dataid, keyindex, salt, data)
+					bool isDelta = false);
 	bool addDeviceChange(QUuid deviceId,
 						 QUuid targetId,
 						 const QByteArray &dataId,
@@ -83,9 +88,20 @@ public:
 						 const QByteArray &salt,
 						 const QByteArray &data);
 
+	quint32 addChangeChunk(QUuid deviceId,
+						   const QByteArray &dataId,
+						   const quint32 keyIndex,
+						   const QByteArray &salt,
+						   quint32 chunkIndex,
+						   quint32 chunkCount,
+						   const QByteArray &data); //returns the next chunk to be sent, or the max value if the quota was hit
+	QByteArray loadChangeChunk(QUuid deviceId, quint64 dataIndex, quint32 chunkIndex);
+
 	quint32 changeCount(QUuid deviceId);
-	QList<std::tuple<quint64, quint32, QByteArray, QByteArray>> loadNextChanges(QUuid deviceId, quint32 count, quint32 skip); // (dataid, keyindex, salt, data)
+	QList<std::tuple<quint64, quint32, QByteArray, QByteArray, quint32, bool>> loadNextChanges(QUuid deviceId, quint32 count, quint32 skip); // (dataid, keyindex, salt, data, chunks, isDelta) - data is empty for chunked changes
 	void completeChange(QUuid deviceId, quint64 dataIndex);
+	void requestResend(QUuid deviceId, quint64 dataIndex); //asks the uploader of a delta for the complete change
+	QList<QByteArray> loadResendRequests(QUuid deviceId);
 
 	QList<std::tuple<QUuid, QByteArray, QByteArray, QByteArray>> tryKeyChange(QUuid deviceId, quint32 proposedIndex, int &offset); //(deviceid, scheme, key, cmac)
 	bool updateExchangeKey(QUuid deviceId,
@@ -93,9 +109,15 @@ public:
 						   const QByteArray &scheme, const QByteArray &cmac,
 						   const QList<std::tuple<QUuid, QByteArray, QByteArray>> &deviceKeys);// (deviceId, key, cmac)
 	std::tuple<quint32, QByteArray, QByteArray, QByteArray> loadKeyChanges(QUuid deviceId);// (keyIndex, scheme, key, cmac)
+	std::tuple<bool, quint32, quint32, QByteArray, QByteArray, QByteArray> loadResumeState(QUuid deviceId);// (exists, changeCount, keyIndex, scheme, key, cmac)
+
+	QByteArray updateTree(QUuid deviceId, const QList<QByteArray> &buckets, bool reconcile); //returns the diverged buckets when reconciling
+	QByteArray loadTreeDiff(QUuid deviceId);
 
 Q_SIGNALS:
 	void notifyChanged(QUuid deviceId);
+	void notifyTreeDiverged(QUuid deviceId);
+	void notifyResendRequested(QUuid deviceId);
 
 	void databaseInitDone(bool success);
 
@@ -120,8 +142,21 @@ private:
 	QTimer *_keepAliveTimer;
 	QTimer *_cleanupTimer;
 
+	//parsed public keys of recently active devices, shared between all client threads
+	QtDataSync::SharedCache<QUuid, QtDataSync::AsymmetricCryptoInfo> _cryptoCache;
+
 	void initDatabase(quint64 quota, bool forceQuota);
+	quint64 addChangeImpl(QSqlDatabase &db,
+						  QUuid deviceId,
+						  const QByteArray &dataId,
+						  const quint32 keyIndex,
+						  const QByteArray &salt,
+						  const QByteArray &data,
+						  bool isDelta,
+						  quint32 chunks = 0); //returns the id of the change, or 0 if no device needs it
 	void updateQuotaLimit(quint64 quota, bool forceQuota);
+	void setupCryptoCache();
+	void invalidateCrypto(QUuid deviceId = {}); //null id clears the whole cache
 };
 
 #endif // DATABASECONTROLLER_H
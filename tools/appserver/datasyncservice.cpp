@@ -198,6 +198,10 @@ void DatasyncService::command(int cmd)
 	case CleanupCode:
 		_database->cleanupDevices();
 		break;
+	case StatsCode:
+		_connector->logStats();
+		_database->logStats();
+		break;
 	default:
 		break;
 	}
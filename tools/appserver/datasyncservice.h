@@ -16,7 +16,8 @@ class DatasyncService : public QtService::Service
 public:
 	enum ServiceCodes {
 		CodeOffset = 128,
-		CleanupCode
+		CleanupCode,
+		StatsCode
 	};
 	Q_ENUM(ServiceCodes)
 
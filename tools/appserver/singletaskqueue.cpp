@@ -58,6 +58,12 @@ bool SingleTaskQueue::isFinished() const
 	return _tasks.isEmpty();
 }
 
+int SingleTaskQueue::size() const
+{
+	LOCK;
+	return _tasks.size();
+}
+
 void SingleTaskQueue::nextTask(QMutexLocker &lock)
 {
 	if(!_tasks.isEmpty()) {
@@ -47,6 +47,7 @@ public:
 
 	bool clear();
 	bool isFinished() const;
+	int size() const;
 
 private:
 	QThreadPool *_pool;